@@ -22,6 +22,17 @@
 #include "Gem/RTE.h"
 #include "Gem/Properties.h"
 #include "Gem/Exception.h"
+#include "Utils/Thread.h"
+
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <list>
 
 using namespace gem::plugins;
 
@@ -39,6 +50,378 @@ namespace {
     char errbuf[MAXPDSTRING];
     verbose(0, "%s%s", prefix, av_make_error_string(errbuf, sizeof(errbuf), errcode));
   }
+  /* by default, use all cores (but not too many, as frame-threading adds latency) */
+  static int default_threads(void) {
+    int cpus = gem::thread::getCPUCount();
+    if (cpus < 1)
+      cpus = 1;
+    if (cpus > 16)
+      cpus = 16;
+    return cpus;
+  }
+  /* "frame", "slice", "auto" (frame+slice) */
+  static int string2threadtype(const std::string&s) {
+    if ("frame" == s)
+      return FF_THREAD_FRAME;
+    if ("slice" == s)
+      return FF_THREAD_SLICE;
+    if ("auto" == s || "both" == s)
+      return FF_THREAD_FRAME | FF_THREAD_SLICE;
+    return 0;
+  }
+  static std::string threadtype2string(int type) {
+    switch(type & (FF_THREAD_FRAME | FF_THREAD_SLICE)) {
+    case FF_THREAD_FRAME:
+      return "frame";
+    case FF_THREAD_SLICE:
+      return "slice";
+    case FF_THREAD_FRAME | FF_THREAD_SLICE:
+      return "auto";
+    default:
+      break;
+    }
+    return "none";
+  }
+
+#if LIBSWSCALE_VERSION_INT >= AV_VERSION_INT(6, 1, 100)
+  /* the output image is owned by us, not by the AVBuffer wrapping it */
+  static void dont_free(void*opaque, uint8_t*data) {
+  }
+#endif
+
+  static const struct {
+    const char*name;
+    int flags;
+  } s_scalers[] = {
+    {"fast_bilinear", SWS_FAST_BILINEAR},
+    {"bilinear", SWS_BILINEAR},
+    {"bicubic", SWS_BICUBIC},
+    {"point", SWS_POINT},
+    {"area", SWS_AREA},
+    {"gauss", SWS_GAUSS},
+    {"lanczos", SWS_LANCZOS},
+    {"spline", SWS_SPLINE},
+  };
+  static int string2scaler(const std::string&s) {
+    for(unsigned int i=0; i<sizeof(s_scalers)/sizeof(*s_scalers); i++) {
+      if(s == s_scalers[i].name)
+        return s_scalers[i].flags;
+    }
+    return -1;
+  }
+  static std::string scaler2string(int flags) {
+    for(unsigned int i=0; i<sizeof(s_scalers)/sizeof(*s_scalers); i++) {
+      if(flags == s_scalers[i].flags)
+        return s_scalers[i].name;
+    }
+    return "";
+  }
+
+  struct indexentry {
+    int64_t pts;
+    bool key;
+    bool operator<(const indexentry&e) const {
+      return pts < e.pts;
+    }
+  };
+};
+
+/*
+ * the index maps frame numbers to presentation timestamps (and their keyframes)
+ *
+ * it is built in a separate thread (with a separate demuxer), by scanning
+ * all the packets of the video stream (without decoding them)
+ * frames are numbered in presentation order, so the index needs to be sorted;
+ * while the index is still growing, we only trust frames that are well
+ * behind the scanning position (as B-frames might still be re-ordered)
+ */
+class filmFFMPEG::Index
+{
+public:
+  Index(const std::string&filename, int stream, int64_t filesize, bool sidecar)
+    : m_filename(filename)
+    , m_sidecar(filename + ".gemidx")
+    , m_stream(stream)
+    , m_filesize(filesize)
+    , m_useSidecar(sidecar)
+    , m_sorted(true)
+    , m_complete(false)
+    , m_keyframes(0)
+    , m_cancel(false)
+  {
+    if(m_useSidecar && load()) {
+      return;
+    }
+    m_thread = std::thread(&Index::run, this);
+  }
+  ~Index(void)
+  {
+    m_cancel = true;
+    if(m_thread.joinable())
+      m_thread.join();
+  }
+
+  /* get the timestamp of 'frame', and of the keyframe preceding it
+   * returns false if the frame is not (yet) known
+   */
+  bool lookup(int frame, int64_t&pts, int64_t&keypts)
+  {
+    std::unique_lock<std::mutex>lock(m_mutex);
+    int size = m_entries.size();
+    if(!m_complete)
+      size -= REORDER_MARGIN;
+    if(frame < 0 || frame >= size)
+      return false;
+    if(!m_sorted) {
+      std::sort(m_entries.begin(), m_entries.end());
+      m_sorted = true;
+    }
+    pts = m_entries[frame].pts;
+    for(int i=frame; i>=0; i--) {
+      if(m_entries[i].key) {
+        keypts = m_entries[i].pts;
+        return true;
+      }
+    }
+    /* no keyframe before the frame: start decoding from the beginning */
+    keypts = m_entries[0].pts;
+    return true;
+  }
+  unsigned int size(void) {
+    std::unique_lock<std::mutex>lock(m_mutex);
+    return m_entries.size();
+  }
+  unsigned int keyframes(void) {
+    std::unique_lock<std::mutex>lock(m_mutex);
+    return m_keyframes;
+  }
+  bool complete(void) {
+    std::unique_lock<std::mutex>lock(m_mutex);
+    return m_complete;
+  }
+
+private:
+  /* max. number of frames B-frames might be re-ordered */
+  static const int REORDER_MARGIN = 16;
+
+  std::string m_filename, m_sidecar;
+  int m_stream;
+  int64_t m_filesize;
+  bool m_useSidecar;
+
+  std::vector<indexentry>m_entries;
+  bool m_sorted, m_complete;
+  unsigned int m_keyframes;
+
+  std::mutex m_mutex;
+  std::atomic<bool> m_cancel;
+  std::thread m_thread;
+
+  void run(void)
+  {
+    AVFormatContext*fmt = 0;
+    AVPacket*pkt = av_packet_alloc();
+    if(!pkt || avformat_open_input(&fmt, m_filename.c_str(), NULL, NULL) < 0) {
+      av_packet_free(&pkt);
+      return;
+    }
+    if(m_stream < (int)fmt->nb_streams) {
+      for(unsigned int i=0; i<fmt->nb_streams; i++) {
+        if((int)i != m_stream)
+          fmt->streams[i]->discard = AVDISCARD_ALL;
+      }
+      while(!m_cancel && av_read_frame(fmt, pkt) >= 0) {
+        if(pkt->stream_index == m_stream) {
+          indexentry e;
+          e.pts = (AV_NOPTS_VALUE != pkt->pts)?pkt->pts:pkt->dts;
+          e.key = (pkt->flags & AV_PKT_FLAG_KEY);
+          if(AV_NOPTS_VALUE != e.pts) {
+            std::unique_lock<std::mutex>lock(m_mutex);
+            if(m_sorted && !m_entries.empty() && e < m_entries.back())
+              m_sorted = false;
+            m_entries.push_back(e);
+            if(e.key)
+              m_keyframes++;
+          }
+        }
+        av_packet_unref(pkt);
+      }
+      if(!m_cancel) {
+        {
+          std::unique_lock<std::mutex>lock(m_mutex);
+          m_complete = true;
+        }
+        if(m_useSidecar)
+          save();
+      }
+    }
+    av_packet_free(&pkt);
+    avformat_close_input(&fmt);
+  }
+
+  /* sidecar format:
+   *   "GEMIDX 1 <stream> <filesize>" followed by one "<pts> <key>" line per frame
+   */
+  bool load(void)
+  {
+    std::ifstream f(m_sidecar.c_str());
+    if(!f.is_open())
+      return false;
+    std::string magic;
+    int version = 0, stream = -1;
+    int64_t filesize = -1;
+    f >> magic >> version >> stream >> filesize;
+    if("GEMIDX" != magic || 1 != version || stream != m_stream || filesize != m_filesize)
+      return false;
+    std::vector<indexentry>entries;
+    unsigned int keyframes = 0;
+    indexentry e;
+    int key;
+    while(f >> e.pts >> key) {
+      e.key = key;
+      if(e.key)
+        keyframes++;
+      entries.push_back(e);
+    }
+    if(entries.empty())
+      return false;
+    std::sort(entries.begin(), entries.end());
+
+    std::unique_lock<std::mutex>lock(m_mutex);
+    m_entries = entries;
+    m_keyframes = keyframes;
+    m_sorted = true;
+    m_complete = true;
+    verbose(1, "[GEM:filmFFMPEG] loaded index for %u frames from %s", (unsigned int)m_entries.size(), m_sidecar.c_str());
+    return true;
+  }
+  bool save(void)
+  {
+    std::vector<indexentry>entries;
+    {
+      std::unique_lock<std::mutex>lock(m_mutex);
+      entries = m_entries;
+    }
+    std::sort(entries.begin(), entries.end());
+    std::ofstream f(m_sidecar.c_str());
+    if(!f.is_open())
+      return false;
+    f << "GEMIDX 1 " << m_stream << " " << m_filesize << "\n";
+    for(unsigned int i=0; i<entries.size(); i++) {
+      f << entries[i].pts << " " << (entries[i].key?1:0) << "\n";
+    }
+    return f.good();
+  }
+};
+
+/*
+ * a cache of converted frames (keyed by their timestamp)
+ *
+ * playing a long-GOP movie backwards means seeking to the preceding keyframe
+ * and decoding forward for each and every frame;
+ * instead we keep all the frames decoded on the way (up to a memory budget),
+ * so the following reverse steps can be served from memory
+ * frames are evicted in least-recently-used order
+ */
+class filmFFMPEG::FrameCache
+{
+public:
+  FrameCache(void)
+    : hits(0), misses(0), evictions(0)
+    , m_budget(256 * 1024 * 1024)
+    , m_used(0)
+  {}
+  ~FrameCache(void)
+  {
+    clear();
+  }
+  void setBudget(size_t bytes)
+  {
+    m_budget = bytes;
+    shrink(m_budget);
+  }
+  size_t getBudget(void) const
+  {
+    return m_budget;
+  }
+  size_t getUsed(void) const
+  {
+    return m_used;
+  }
+  void clear(void)
+  {
+    for(std::map<int64_t, entry>::iterator it=m_frames.begin(); it!=m_frames.end(); ++it) {
+      delete it->second.img;
+    }
+    m_frames.clear();
+    m_lru.clear();
+    m_used = 0;
+  }
+  /* the cached frame for 'pts' (or NULL) */
+  const imageStruct*get(int64_t pts)
+  {
+    std::map<int64_t, entry>::iterator it=m_frames.find(pts);
+    if(it == m_frames.end())
+      return NULL;
+    /* mark as most recently used */
+    m_lru.splice(m_lru.end(), m_lru, it->second.lru);
+    return it->second.img;
+  }
+  void put(int64_t pts, const imageStruct&img)
+  {
+    const size_t size = img.xsize * img.ysize * img.csize;
+    if(!m_budget || size > m_budget)
+      return;
+    std::map<int64_t, entry>::iterator it=m_frames.find(pts);
+    if(it != m_frames.end()) {
+      m_lru.splice(m_lru.end(), m_lru, it->second.lru);
+      return;
+    }
+    imageStruct*copy = 0;
+    /* recycle the least recently used frame if we are running out of budget */
+    if(m_used + size > m_budget) {
+      shrink(m_budget - size, &copy);
+    }
+    if(!copy)
+      copy = new imageStruct;
+    img.copy2Image(copy);
+    entry e;
+    e.img = copy;
+    e.lru = m_lru.insert(m_lru.end(), pts);
+    m_frames[pts] = e;
+    m_used += size;
+  }
+
+  unsigned long hits, misses, evictions;
+
+private:
+  struct entry {
+    imageStruct*img;
+    std::list<int64_t>::iterator lru;
+  };
+  std::map<int64_t, entry>m_frames;
+  std::list<int64_t>m_lru;
+  size_t m_budget, m_used;
+
+  /* evict frames until we use at most 'bytes'
+   * if 'recycle' is given, the last evicted image is returned there (rather than freed) */
+  void shrink(size_t bytes, imageStruct**recycle=0)
+  {
+    while(m_used > bytes && !m_lru.empty()) {
+      std::map<int64_t, entry>::iterator it=m_frames.find(m_lru.front());
+      imageStruct*img = it->second.img;
+      m_used -= img->xsize * img->ysize * img->csize;
+      m_lru.pop_front();
+      m_frames.erase(it);
+      evictions++;
+      if(recycle) {
+        delete *recycle;
+        *recycle = img;
+      } else {
+        delete img;
+      }
+    }
+  }
 };
 
 /////////////////////////////////////////////////////////
@@ -55,6 +438,21 @@ filmFFMPEG :: filmFFMPEG(void)
   , m_fps(0.)
   , m_wantedFormat(0)
   , m_wantedCodec("")
+  , m_threads(default_threads())
+  , m_threadType(FF_THREAD_FRAME | FF_THREAD_SLICE)
+  , m_decodeTime(0.)
+  , m_index(0)
+  , m_useIndex(true)
+  , m_useSidecar(false)
+  , m_targetPts(AV_NOPTS_VALUE)
+  , m_lastPts(AV_NOPTS_VALUE)
+  , m_cache(0)
+  , m_cacheGOP(false)
+  , m_cachedPts(AV_NOPTS_VALUE)
+  , m_wantedWidth(0), m_wantedHeight(0)
+  , m_scaler(SWS_FAST_BILINEAR)
+  , m_convertThreads(0)
+  , m_convertTime(0.)
   , m_resetConverter(false)
   , m_avformat(0)
   , m_avdecoder(0)
@@ -63,11 +461,13 @@ filmFFMPEG :: filmFFMPEG(void)
   , m_avpacket(0)
   , m_avconverter(0)
 {
+  m_cache = new FrameCache();
   m_avframe = av_frame_alloc();
   m_avpacket = av_packet_alloc();
   if(!m_avframe || !m_avpacket) {
     av_packet_free(&m_avpacket);
     av_frame_free(&m_avframe);
+    delete m_cache;
     throw(GemException("unable to allocate FFMPEG frame resp. packet"));
   }
 }
@@ -79,6 +479,7 @@ filmFFMPEG :: filmFFMPEG(void)
 filmFFMPEG :: ~filmFFMPEG(void)
 {
   close();
+  delete m_cache;
   av_packet_free(&m_avpacket);
   av_frame_free(&m_avframe);
   sws_freeContext(m_avconverter);
@@ -87,15 +488,30 @@ filmFFMPEG :: ~filmFFMPEG(void)
 
 bool filmFFMPEG :: isThreadable(void)
 {
-  if(m_numFrames<0) {
+  if(getNumFrames()<0 && !m_index) {
     return false;
   }
   return true;
 }
 
+/* the number of frames as reported by the container,
+ * or as counted by the index if the container doesn't know */
+int filmFFMPEG :: getNumFrames(void)
+{
+  if(m_numFrames<=0 && m_index && m_index->complete()) {
+    return m_index->size();
+  }
+  return m_numFrames;
+}
+
 void filmFFMPEG :: close(void)
 {
   /* LATER: free frame buffers */
+  delete m_index;
+  m_index = 0;
+  m_targetPts = m_lastPts = m_cachedPts = AV_NOPTS_VALUE;
+  m_cacheGOP = false;
+  m_cache->clear();
   avcodec_free_context(&m_avdecoder);
   avformat_close_input(&m_avformat);
 }
@@ -109,6 +525,36 @@ bool filmFFMPEG :: open(const std::string&sfilename,
 {
   close();
 
+  /* the threading properties need to be known before we open the decoder */
+  double d;
+  std::string s;
+  if(wantProps.get("threads", d)) {
+    m_threads = (d < 0)?0:d;
+  }
+  if(wantProps.get("threadtype", s)) {
+    m_threadType = string2threadtype(s);
+  } else if(wantProps.get("threadtype", d)) {
+    m_threadType = ((int)d) & (FF_THREAD_FRAME | FF_THREAD_SLICE);
+  }
+  if(wantProps.get("index", d)) {
+    m_useIndex = (d > 0.5);
+  }
+  if(wantProps.get("sidecar", d)) {
+    m_useSidecar = (d > 0.5);
+  }
+  if(wantProps.get("outwidth", d)) {
+    m_wantedWidth = (d < 0)?0:d;
+  }
+  if(wantProps.get("outheight", d)) {
+    m_wantedHeight = (d < 0)?0:d;
+  }
+  if(wantProps.get("scaler", s)) {
+    int flags = string2scaler(s);
+    if(flags >= 0)
+      m_scaler = flags;
+  }
+  m_resetConverter = true;
+
   const char*filename = sfilename.c_str();
   int ret;
 
@@ -165,6 +611,13 @@ bool filmFFMPEG :: open(const std::string&sfilename,
     close();
     return false;
   }
+  /* multi-threaded decoding
+   * frame-threading decodes several frames in parallel (adding some latency),
+   * slice-threading decodes parts of a frame in parallel (if the codec supports it)
+   */
+  m_avdecoder->thread_count = m_threads;
+  m_avdecoder->thread_type = m_threadType;
+
   /* Init the decoders */
   if ((ret = avcodec_open2(m_avdecoder, dec, NULL)) < 0) {
     verbose(0, "[GEM:filmFFMPEG] Failed to open codec");
@@ -177,11 +630,20 @@ bool filmFFMPEG :: open(const std::string&sfilename,
   m_stream = stream_index;
   m_fps = av_q2d(m_avstream->avg_frame_rate);
   m_numFrames = m_avstream->nb_frames;
-  m_image.image.xsize = m_avdecoder->width;
-  m_image.image.ysize = m_avdecoder->height;
+  getOutputSize(m_avdecoder->width, m_avdecoder->height,
+                m_image.image.xsize, m_image.image.ysize);
   m_image.image.setFormat(GEM_RGBA);
   m_image.image.reallocate();
   m_image.newfilm = true;
+  m_decodeTime = 0.;
+
+  /* only index files we can read twice (not streams) */
+  if(m_useIndex && m_avformat->pb && (m_avformat->pb->seekable & AVIO_SEEKABLE_NORMAL)) {
+    m_index = new Index(sfilename, m_stream, m_avformat->pb?avio_size(m_avformat->pb):-1, m_useSidecar);
+  }
+
+  verbose(1, "[GEM:filmFFMPEG] decoding with %d %s-thread(s)",
+          m_avdecoder->thread_count, threadtype2string(m_avdecoder->active_thread_type).c_str());
 
   return true;
 }
@@ -190,6 +652,29 @@ bool filmFFMPEG :: open(const std::string&sfilename,
 // render
 //
 /////////////////////////////////////////////////////////
+/* the size of the output image (possibly downscaled by the converter) */
+void filmFFMPEG :: getOutputSize(const int width, const int height, int&outwidth, int&outheight) {
+  outwidth = width;
+  outheight = height;
+  if(width <= 0 || height <= 0)
+    return;
+  if(m_wantedWidth > 0 && m_wantedHeight > 0) {
+    outwidth = m_wantedWidth;
+    outheight = m_wantedHeight;
+  } else if (m_wantedWidth > 0) {
+    /* keep the aspect ratio */
+    outwidth = m_wantedWidth;
+    outheight = (int)(((long)height * m_wantedWidth + width/2) / width);
+  } else if (m_wantedHeight > 0) {
+    outheight = m_wantedHeight;
+    outwidth = (int)(((long)width * m_wantedHeight + height/2) / height);
+  }
+  if(outwidth < 1)
+    outwidth = 1;
+  if(outheight < 1)
+    outheight = 1;
+}
+
 void filmFFMPEG :: initConverter(const int width, const int height, const int format) {
   /* check if we need a new decoder object */
   if(width != m_convertinfo.width ||
@@ -233,16 +718,51 @@ void filmFFMPEG :: initConverter(const int width, const int height, const int fo
         dstformats, srcformat,
         has_alpha, &loss);
 
+    /* colorspace conversion and downscaling is done in a single pass */
+    int dstwidth, dstheight;
+    getOutputSize(width, height, dstwidth, dstheight);
+
     m_convertinfo.width = width;
     m_convertinfo.height = height;
     m_convertinfo.srcformat = srcformat;
     m_convertinfo.dstformat = dstformat;
+    m_convertinfo.dstwidth = dstwidth;
+    m_convertinfo.dstheight = dstheight;
 
     sws_freeContext(m_avconverter);
+#if LIBSWSCALE_VERSION_INT >= AV_VERSION_INT(6, 1, 100)
+    /* let libswscale slice the frame across threads
+     * (only worth it for large frames) */
+    int threads = m_convertThreads;
+    if(threads <= 0) {
+      threads = 1;
+      if((long)width * height >= 1920L * 1080L) {
+        threads = gem::thread::getCPUCount();
+        if(threads > 8)
+          threads = 8;
+      }
+    }
+    m_avconverter = sws_alloc_context();
+    if(m_avconverter) {
+      av_opt_set_int(m_avconverter, "srcw", width, 0);
+      av_opt_set_int(m_avconverter, "srch", height, 0);
+      av_opt_set_int(m_avconverter, "src_format", srcformat, 0);
+      av_opt_set_int(m_avconverter, "dstw", dstwidth, 0);
+      av_opt_set_int(m_avconverter, "dsth", dstheight, 0);
+      av_opt_set_int(m_avconverter, "dst_format", dstformat, 0);
+      av_opt_set_int(m_avconverter, "sws_flags", m_scaler, 0);
+      av_opt_set_int(m_avconverter, "threads", threads, 0);
+      if(sws_init_context(m_avconverter, NULL, NULL) < 0) {
+        sws_freeContext(m_avconverter);
+        m_avconverter = 0;
+      }
+    }
+#else
     m_avconverter = sws_getContext(
         width, height, srcformat,
-        width, height, dstformat,
-        SWS_FAST_BILINEAR, NULL, NULL, NULL);
+        dstwidth, dstheight, dstformat,
+        m_scaler, NULL, NULL, NULL);
+#endif
     m_resetConverter = (0 == m_avconverter);
   }
 
@@ -263,12 +783,12 @@ void filmFFMPEG :: initConverter(const int width, const int height, const int fo
     gformat = GEM_RGBA;
     break;
   }
-  if(width != m_image.image.xsize ||
-     height != m_image.image.ysize ||
+  if(m_convertinfo.dstwidth != m_image.image.xsize ||
+     m_convertinfo.dstheight != m_image.image.ysize ||
      gformat != m_image.image.format
      ) {
-    m_image.image.xsize = width;
-    m_image.image.ysize = height;
+    m_image.image.xsize = m_convertinfo.dstwidth;
+    m_image.image.ysize = m_convertinfo.dstheight;
     m_image.image.setFormat(gformat);
     m_image.image.reallocate();
     m_image.newfilm = true;
@@ -294,38 +814,85 @@ int filmFFMPEG :: convertFrame(void)
   int dst_linesize = m_image.image.csize * m_image.image.xsize;
   uint8_t*dst_data = (uint8_t*)m_image.image.data;
 
+  std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+#if LIBSWSCALE_VERSION_INT >= AV_VERSION_INT(6, 1, 100)
+  /* sws_scale() always runs on the calling thread;
+   * only the frame-based API distributes the slices across the converter's threads */
+  AVFrame*dst = av_frame_alloc();
+  if(!dst)
+    return -1;
+  dst->format = m_convertinfo.dstformat;
+  dst->width = m_convertinfo.dstwidth;
+  dst->height = m_convertinfo.dstheight;
+  dst->data[0] = dst_data;
+  dst->linesize[0] = dst_linesize;
+  /* without a buffer, sws_scale_frame() would allocate a new image */
+  dst->buf[0] = av_buffer_create(dst_data, dst_linesize * dst->height, dont_free, NULL, 0);
+  int ret = -1;
+  if(dst->buf[0])
+    ret = sws_scale_frame(m_avconverter, dst, m_avframe);
+  av_frame_free(&dst);
+  if(ret < 0) {
+    verbose(0, "[GEM:filmFFMPEG] Error converting frame (%d)", ret);
+    show_error(ret);
+    return ret;
+  }
+#else
   sws_scale(m_avconverter,
             (const uint8_t **)(m_avframe->data), m_avframe->linesize, 0, m_avframe->height,
             &dst_data, &dst_linesize);
+#endif
+  m_convertTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
   m_image.newimage = true;
   return 0;
 }
 
-/* decodes a single packet */
+/* decodes packets until the decoder returns a frame (or the stream ends)
+ * with frame-threading, the decoder only returns the first frame
+ * after it has been fed with a packet for each thread */
 int filmFFMPEG :: decodePacket(void)
 {
-  // submit the packet to the decoder
-  int ret = avcodec_send_packet(m_avdecoder, m_avpacket);
-  if (ret < 0) {
-    verbose(0, "[GEM:filmFFMPEG] Error submitting packet for decoding (%d)", ret);
-    show_error(ret);
-    return ret;
-  }
-
-  // get all the frame from the decoder
-  /* with video decoding, one packet always has a single frame */
-  ret = avcodec_receive_frame(m_avdecoder, m_avframe);
-  if (ret < 0) {
-    // those two return values are special and mean there is no output
-    // frame available, but there were no errors during decoding
-    if (ret == AVERROR_EOF || ret == AVERROR(EAGAIN))
-      return 0;
+  bool eof = false;
+  while(true) {
+    /* first fetch any frame the decoder has already finished,
+     * so it is always ready to accept the next packet */
+    int ret = avcodec_receive_frame(m_avdecoder, m_avframe);
+    if(ret >= 0) {
+      break;
+    }
+    // AVERROR(EAGAIN) means that the decoder needs more input
+    if(ret != AVERROR(EAGAIN) || eof) {
+      if(ret != AVERROR_EOF && ret != AVERROR(EAGAIN)) {
+        verbose(0, "[GEM:filmFFMPEG] Error during decoding (%d)", ret);
+        show_error(ret);
+      }
+      return ret;
+    }
 
-    verbose(0, "[GEM:filmFFMPEG] Error during decoding (%d)", ret);
-    show_error(ret);
-    return ret;
+    ret = av_read_frame(m_avformat, m_avpacket);
+    if(ret < 0) {
+      /* end of file: flush the decoder to get the remaining frames */
+      eof = true;
+      avcodec_send_packet(m_avdecoder, NULL);
+      continue;
+    }
+    if (m_avpacket->stream_index != m_stream) {
+      av_packet_unref(m_avpacket);
+      continue;
+    }
+    // submit the packet to the decoder
+    ret = avcodec_send_packet(m_avdecoder, m_avpacket);
+    av_packet_unref(m_avpacket);
+    if (ret < 0 && ret != AVERROR_EOF) {
+      verbose(0, "[GEM:filmFFMPEG] Error submitting packet for decoding (%d)", ret);
+      show_error(ret);
+      return ret;
+    }
   }
 
+  m_lastPts = m_avframe->best_effort_timestamp;
+
+  int ret = 0;
   // write the frame data to output file
   if (m_avdecoder->codec->type == AVMEDIA_TYPE_VIDEO) {
 #if 0
@@ -348,26 +915,87 @@ int filmFFMPEG :: decodePacket(void)
 
   return 0;
 }
+/* decodes (without converting) all frames up to m_targetPts, and converts that one */
+int filmFFMPEG :: decodeToTarget(void)
+{
+  bool eof = false;
+  while(true) {
+    int ret;
+    if(!eof) {
+      ret = av_read_frame(m_avformat, m_avpacket);
+      if(ret < 0) {
+        /* flush the decoder to get the remaining frames */
+        eof = true;
+        avcodec_send_packet(m_avdecoder, NULL);
+      } else if (m_avpacket->stream_index != m_stream) {
+        av_packet_unref(m_avpacket);
+        continue;
+      } else {
+        ret = avcodec_send_packet(m_avdecoder, m_avpacket);
+        av_packet_unref(m_avpacket);
+        if(ret < 0 && ret != AVERROR(EAGAIN)) {
+          show_error(ret);
+          m_targetPts = AV_NOPTS_VALUE;
+          return ret;
+        }
+      }
+    }
+
+    while((ret = avcodec_receive_frame(m_avdecoder, m_avframe)) >= 0) {
+      const int64_t pts = m_avframe->best_effort_timestamp;
+      m_lastPts = pts;
+      if(AV_NOPTS_VALUE != pts && pts < m_targetPts) {
+        /* not there yet */
+        if(m_cacheGOP && convertFrame() >= 0) {
+          /* keep the frame for the next reverse steps */
+          m_cache->put(pts, m_image.image);
+        }
+        av_frame_unref(m_avframe);
+        continue;
+      }
+      m_targetPts = AV_NOPTS_VALUE;
+      ret = convertFrame();
+      if(ret >= 0 && m_cacheGOP && AV_NOPTS_VALUE != pts) {
+        m_cache->put(pts, m_image.image);
+      }
+      m_cacheGOP = false;
+      av_frame_unref(m_avframe);
+      return ret;
+    }
+    if(ret != AVERROR(EAGAIN) || eof) {
+      /* EOF or error before we reached the target */
+      m_targetPts = AV_NOPTS_VALUE;
+      m_cacheGOP = false;
+      return ret;
+    }
+  }
+  return -1;
+}
+
 pixBlock* filmFFMPEG :: getFrame(void)
 {
   if(!m_avdecoder || !m_avformat) {
     return NULL;
   }
 
-  if (av_read_frame(m_avformat, m_avpacket) >= 0) {
-    int ret = -1;
-    if (m_avpacket->stream_index == m_stream) {
-      ret = decodePacket();
-      av_packet_unref(m_avpacket);
-    } else {
-      av_packet_unref(m_avpacket);
-    }
-    if (ret >= 0) {
-
-    } else {
-      // ouch
+  std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+  if(AV_NOPTS_VALUE != m_cachedPts) {
+    /* serve the frame from memory (the decoder stays where it is) */
+    const imageStruct*img = m_cache->get(m_cachedPts);
+    m_cachedPts = AV_NOPTS_VALUE;
+    if(img) {
+      img->copy2Image(&m_image.image);
+      m_image.newimage = true;
+      m_decodeTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+      return &m_image;
     }
   }
+  if(AV_NOPTS_VALUE != m_targetPts) {
+    decodeToTarget();
+  } else {
+    decodePacket();
+  }
+  m_decodeTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
   return &m_image;
 }
 
@@ -381,7 +1009,8 @@ film::errCode filmFFMPEG :: changeImage(int imgNum, int trackNum)
   if(!m_avformat) {
     return film::FAILURE;
   }
-  if(!m_numFrames) {
+  const int numFrames = getNumFrames();
+  if(!numFrames && !m_index) {
     return film::DONTKNOW;
   }
   if(trackNum<0) {
@@ -389,6 +1018,44 @@ film::errCode filmFFMPEG :: changeImage(int imgNum, int trackNum)
     return film::SUCCESS;
   }
 
+  /* frame-accurate seeking with the index:
+   * seek to the keyframe preceding the requested frame and decode forward
+   * (if the requested frame is ahead of us within the same GOP, we just decode forward)
+   */
+  int64_t pts, keypts;
+  m_cachedPts = AV_NOPTS_VALUE;
+  if(m_index && m_index->lookup(imgNum, pts, keypts)) {
+    if(m_cache->getBudget()) {
+      if(m_cache->get(pts)) {
+        m_cache->hits++;
+        m_cachedPts = pts;
+        m_targetPts = AV_NOPTS_VALUE;
+        return film::SUCCESS;
+      }
+      m_cache->misses++;
+    }
+    const bool sameGOP = (AV_NOPTS_VALUE != m_lastPts
+                          && keypts <= m_lastPts && m_lastPts < pts);
+    /* going backwards: keep all the frames of the GOP we are about to decode */
+    m_cacheGOP = (m_cache->getBudget()
+                  && AV_NOPTS_VALUE != m_lastPts && pts < m_lastPts);
+    if(!sameGOP) {
+      int ret = av_seek_frame(m_avformat, m_stream, keypts, AVSEEK_FLAG_BACKWARD);
+      if (ret < 0) {
+        return film::FAILURE;
+      }
+      avcodec_flush_buffers(m_avdecoder);
+      m_lastPts = AV_NOPTS_VALUE;
+    }
+    m_targetPts = pts;
+    return film::SUCCESS;
+  }
+  m_targetPts = AV_NOPTS_VALUE;
+  if(!numFrames) {
+    /* neither the container nor the index (yet) knows about the frame */
+    return film::DONTKNOW;
+  }
+
   int frameNum = imgNum;
   if (m_avstream &&
       (m_avstream->r_frame_rate.den && m_avstream->r_frame_rate.num) &&
@@ -416,8 +1083,11 @@ film::errCode filmFFMPEG :: changeImage(int imgNum, int trackNum)
     //show_error(ret);
     return film::FAILURE;
   }
+  /* drop any frames still in flight (e.g. in the frame-threads) */
+  avcodec_flush_buffers(m_avdecoder);
+  m_lastPts = AV_NOPTS_VALUE;
 
-  if(imgNum>=m_numFrames || imgNum<0) {
+  if(imgNum>=numFrames || imgNum<0) {
     return film::DONTKNOW;
   }
 
@@ -440,9 +1110,30 @@ bool filmFFMPEG::enumProperties(gem::Properties&readable,
   readable.set("width", dummy_i);
   readable.set("height", dummy_i);
   readable.set("codec", dummy_s);
+  readable.set("threads", dummy_i);
+  readable.set("threadtype", dummy_s);
+  readable.set("decodetime", dummy_f);
+  readable.set("converttime", dummy_f);
+  readable.set("scaler", dummy_s);
+  readable.set("cachehits", dummy_i);
+  readable.set("cachemisses", dummy_i);
+  readable.set("cacheevictions", dummy_i);
+  readable.set("cachememory", dummy_f);
+  readable.set("indexed", dummy_i);
+  readable.set("keyframes", dummy_i);
 
   writeable.set("colorspace", dummy_i);
   writeable.set("codec", dummy_s);
+  /* the threading properties take effect with the next open */
+  writeable.set("threads", dummy_i);
+  writeable.set("threadtype", dummy_s);
+  writeable.set("outwidth", dummy_i);
+  writeable.set("outheight", dummy_i);
+  writeable.set("scaler", dummy_s);
+  writeable.set("convertthreads", dummy_i);
+  writeable.set("cachesize", dummy_f);
+  writeable.set("index", dummy_i);
+  writeable.set("sidecar", dummy_i);
 
   return false;
 }
@@ -454,15 +1145,69 @@ void filmFFMPEG::setProperties(gem::Properties&props)
     double d;
     std::string s;
     const std::string key =keys[i];
-    if(props.get("colorspace", d)) {
+    if("colorspace" == key && props.get(key, d)) {
       m_wantedFormat = d;
       m_resetConverter = true;
       continue;
     }
-    if(props.get("codec", s)) {
+    if("codec" == key && props.get(key, s)) {
       m_wantedCodec = s;
       continue;
     }
+    if("threads" == key && props.get(key, d)) {
+      m_threads = (d < 0)?0:d;
+      continue;
+    }
+    if("threadtype" == key) {
+      if(props.get(key, s)) {
+        m_threadType = string2threadtype(s);
+      } else if (props.get(key, d)) {
+        m_threadType = ((int)d) & (FF_THREAD_FRAME | FF_THREAD_SLICE);
+      }
+      continue;
+    }
+    if("outwidth" == key && props.get(key, d)) {
+      m_wantedWidth = (d < 0)?0:d;
+      m_resetConverter = true;
+      continue;
+    }
+    if("outheight" == key && props.get(key, d)) {
+      m_wantedHeight = (d < 0)?0:d;
+      m_resetConverter = true;
+      continue;
+    }
+    if("scaler" == key && props.get(key, s)) {
+      int flags = string2scaler(s);
+      if(flags >= 0) {
+        m_scaler = flags;
+        m_resetConverter = true;
+      } else {
+        verbose(0, "[GEM:filmFFMPEG] unknown scaler '%s'", s.c_str());
+      }
+      continue;
+    }
+    if("convertthreads" == key && props.get(key, d)) {
+      m_convertThreads = (d < 0)?0:d;
+      m_resetConverter = true;
+      continue;
+    }
+    if("cachesize" == key && props.get(key, d)) {
+      /* in MB */
+      m_cache->setBudget((d > 0)?(size_t)(d * 1024. * 1024.):0);
+      continue;
+    }
+    if("index" == key && props.get(key, d)) {
+      m_useIndex = (d > 0.5);
+      continue;
+    }
+    if("sidecar" == key && props.get(key, d)) {
+      m_useSidecar = (d > 0.5);
+      continue;
+    }
+  }
+  if(m_resetConverter) {
+    /* the cached frames have the wrong size/format */
+    m_cache->clear();
   }
 }
 
@@ -481,8 +1226,9 @@ void filmFFMPEG::getProperties(gem::Properties&props)
       props.set(key, value);
       continue;
     }
-    if("frames"==key && m_numFrames>=0) {
-      d=m_numFrames;
+    if("frames"==key && getNumFrames()>=0) {
+      /* if the container didn't tell us, the index might have counted */
+      d=getNumFrames();
       value=d;
       props.set(key, value);
       continue;
@@ -505,6 +1251,77 @@ void filmFFMPEG::getProperties(gem::Properties&props)
       props.set(key, value);
       continue;
     }
+    if("threads"==key) {
+      d=m_avdecoder?m_avdecoder->thread_count:m_threads;
+      value=d;
+      props.set(key, value);
+      continue;
+    }
+    if("threadtype"==key) {
+      std::string s = threadtype2string(m_avdecoder?m_avdecoder->active_thread_type:m_threadType);
+      props.set(key, s);
+      continue;
+    }
+    if("converttime"==key) {
+      d=m_convertTime;
+      value=d;
+      props.set(key, value);
+      continue;
+    }
+    if("scaler"==key) {
+      std::string s = scaler2string(m_scaler);
+      props.set(key, s);
+      continue;
+    }
+    if("cachehits"==key) {
+      d=m_cache->hits;
+      value=d;
+      props.set(key, value);
+      continue;
+    }
+    if("cachemisses"==key) {
+      d=m_cache->misses;
+      value=d;
+      props.set(key, value);
+      continue;
+    }
+    if("cacheevictions"==key) {
+      d=m_cache->evictions;
+      value=d;
+      props.set(key, value);
+      continue;
+    }
+    if("cachememory"==key) {
+      /* in MB */
+      d=m_cache->getUsed() / (1024. * 1024.);
+      value=d;
+      props.set(key, value);
+      continue;
+    }
+    if("cachesize"==key) {
+      d=m_cache->getBudget() / (1024. * 1024.);
+      value=d;
+      props.set(key, value);
+      continue;
+    }
+    if("indexed"==key) {
+      d=m_index?m_index->size():0;
+      value=d;
+      props.set(key, value);
+      continue;
+    }
+    if("keyframes"==key) {
+      d=m_index?m_index->keyframes():0;
+      value=d;
+      props.set(key, value);
+      continue;
+    }
+    if("decodetime"==key) {
+      d=m_decodeTime;
+      value=d;
+      props.set(key, value);
+      continue;
+    }
     if("codec"==key) {
       const AVCodecDescriptor*desc=m_avdecoder?avcodec_descriptor_get(m_avdecoder->codec_id):0;
       if(desc) {
@@ -22,6 +22,7 @@ extern "C" {
 #include <libavcodec/avcodec.h>
 #include <libavutil/imgutils.h>
 #include <libswscale/swscale.h>
+#include <libavutil/opt.h>
 }
 
 
@@ -89,6 +90,42 @@ protected:
   // the user can wish for some things
   unsigned int  m_wantedFormat;
   std::string m_wantedCodec;
+  // number of decoding threads (0: let ffmpeg decide)
+  int m_threads;
+  // FF_THREAD_FRAME and/or FF_THREAD_SLICE
+  int m_threadType;
+
+  // time (in ms) it took to decode the last frame
+  double m_decodeTime;
+
+  // index of frame timestamps and keyframes (built in the background)
+  class Index;
+  Index*m_index;
+  // whether to use the index for seeking
+  bool m_useIndex;
+  // whether to read/write the index from/to a sidecar file ("<movie>.gemidx")
+  bool m_useSidecar;
+  // the frame we are decoding towards after a seek (AV_NOPTS_VALUE if none)
+  int64_t m_targetPts;
+  // the timestamp of the last decoded frame
+  int64_t m_lastPts;
+
+  // cache of decoded frames (for reverse/ping-pong playback)
+  class FrameCache;
+  FrameCache*m_cache;
+  // whether to cache all frames decoded on the way to m_targetPts
+  bool m_cacheGOP;
+  // the cached frame to deliver with the next getFrame() (AV_NOPTS_VALUE if none)
+  int64_t m_cachedPts;
+
+  // requested output size (0: same as the movie)
+  int m_wantedWidth, m_wantedHeight;
+  // SWS_FAST_BILINEAR, SWS_BICUBIC,...
+  int m_scaler;
+  // number of threads for colorspace conversion/scaling (0: depending on the frame size)
+  int m_convertThreads;
+  // time (in ms) it took to convert/scale the last frame
+  double m_convertTime;
 
   // whether we need to convert the image before using it in Gem
   bool m_resetConverter;
@@ -105,12 +142,17 @@ protected:
     int height;
     int srcformat;
     int dstformat;
+    int dstwidth;
+    int dstheight;
   } m_convertinfo;
 
   /* helpers to get the frame */
   int decodePacket(void);
+  int decodeToTarget(void);
   int convertFrame(void);
   void initConverter(const int width, const int height, const int format);
+  void getOutputSize(const int width, const int height, int&outwidth, int&outheight);
+  int getNumFrames(void);
 };
 };
 };
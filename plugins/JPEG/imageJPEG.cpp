@@ -23,6 +23,9 @@
 #include "plugins/PluginFactory.h"
 
 #include "Gem/RTE.h"
+#include "Gem/Properties.h"
+
+#include <chrono>
 
 
 extern "C"
@@ -113,6 +116,8 @@ bool imageJPEG :: load(std::string filename, imageStruct&result,
    * (as in https://salsa.debian.org/gnome-team/gdk-pixbuf/-/blob/cf83217de54d6c99ee366a0ab0e87904b2a4dccb/gdk-pixbuf/io-jpeg.c#L486)
    * none is particularly appealing...
    */
+  const std::chrono::steady_clock::time_point start =
+    std::chrono::steady_clock::now();
   // open up the file
   FILE * infile;
   if ((infile = fopen(filename.c_str(), "rb")) == NULL) {
@@ -147,9 +152,40 @@ bool imageJPEG :: load(std::string filename, imageStruct&result,
   // read in the file info
   jpeg_read_header(&cinfo, TRUE);
 
+  // if the caller only needs a smaller image, let the DCT do the downscaling
+  double d;
+  unsigned int wantWidth=0, wantHeight=0;
+  if(props.get("width", d) && d>0) {
+    wantWidth=d;
+  }
+  if(props.get("height", d) && d>0) {
+    wantHeight=d;
+  }
+  if(wantWidth || wantHeight) {
+    unsigned int denom=8;
+    while(denom>1) {
+      const unsigned int w=(cinfo.image_width + denom - 1)/denom;
+      const unsigned int h=(cinfo.image_height + denom - 1)/denom;
+      if(w>=wantWidth && h>=wantHeight) {
+        break;
+      }
+      denom/=2;
+    }
+    cinfo.scale_num=1;
+    cinfo.scale_denom=denom;
+  }
 
-  // do we have an RGB image?
-  if (cinfo.jpeg_color_space == JCS_RGB) {
+  // the caller would rather have YUV, so skip the YCbCr->RGB conversion
+  std::string colorspace;
+  const bool yuv=props.get("colorspace", colorspace) && "yuv"==colorspace
+                 && JCS_YCbCr==cinfo.jpeg_color_space
+                 && 3==cinfo.num_components;
+
+  if (yuv) {
+    result.setFormat(GEM_YUV);
+    cinfo.out_color_space = JCS_YCbCr;
+  } else if (cinfo.jpeg_color_space == JCS_RGB) {
+    // do we have an RGB image?
     result.setFormat(GEM_RGBA);
   } else if (cinfo.jpeg_color_space == JCS_GRAYSCALE) {
     // do we have a gray8 image?
@@ -165,56 +201,89 @@ bool imageJPEG :: load(std::string filename, imageStruct&result,
   int xSize = cinfo.output_width;
   int ySize = cinfo.output_height;
   int cSize = result.csize;
+  if(yuv) {
+    // GEM_YUV packs 2 pixels, so we drop an odd column
+    xSize&=~1;
+  }
   result.upsidedown=true;
   result.xsize = xSize;
   result.ysize = ySize;
   result.reallocate();
 
-  // cycle through the scan lines
-  unsigned char *srcLine = new unsigned char[xSize * cSize];
+  // read a number of scan lines at once
+  const int maxLines = 16;
+  const int srcStride = cinfo.output_width * cinfo.output_components;
+  unsigned char *srcLines = new unsigned char[srcStride * maxLines];
+  JSAMPROW rows[maxLines];
+  for(int i=0; i<maxLines; i++) {
+    rows[i]=srcLines + i*srcStride;
+  }
   unsigned char *dstLine = result.data;
   int yStride = xSize * cSize;
-  int lines = ySize;
-  int pixes = xSize;
 
-  // do RGBA/RGB data
-  if (cSize == 4) {
-    while (lines--) {
-      unsigned char *src = srcLine;
-      unsigned char *dst = dstLine;
-      jpeg_read_scanlines(&cinfo, &src, 1);
-      pixes = xSize;
-      while (pixes--) {
-        dst[chRed]   = src[0];
-        dst[chGreen] = src[1];
-        dst[chBlue]  = src[2];
-        dst[chAlpha] = 255;
-        dst += 4;
-        src += 3;
-      }
-      dstLine += yStride;
+  // JPEG uses full-range YCbCr, Gem's YUV is studio-range (16..235/240)
+  unsigned char lumaLUT[256], chromaLUT[256];
+  if (yuv) {
+    for(int i=0; i<256; i++) {
+      lumaLUT[i]   = 16 + (i*219 + 127)/255;
+      chromaLUT[i] = 128 + ((i-128)*224 + ((i<128)?-127:127))/255;
     }
-  } else {
-    // do grayscale data
-    while (lines--) {
-      unsigned char *src = srcLine;
+  }
+
+  while (cinfo.output_scanline < cinfo.output_height) {
+    const int lines = jpeg_read_scanlines(&cinfo, rows, maxLines);
+    if(lines<1) {
+      break;
+    }
+    for(int line=0; line<lines; line++) {
+      const unsigned char *src = rows[line];
       unsigned char *dst = dstLine;
-      jpeg_read_scanlines(&cinfo, &src, 1);
-      pixes = xSize;
-      while (pixes--) {
-        *dst++ = *src++;
+      int pixes;
+      if (yuv) {
+        // YCbCr 4:4:4 -> UYVY
+        pixes = xSize/2;
+        while (pixes--) {
+          dst[chU]  = chromaLUT[(src[1] + src[4] + 1) >> 1];
+          dst[chY0] = lumaLUT[src[0]];
+          dst[chV]  = chromaLUT[(src[2] + src[5] + 1) >> 1];
+          dst[chY1] = lumaLUT[src[3]];
+          dst += 4;
+          src += 6;
+        }
+      } else if (cSize == 4) {
+        // do RGBA/RGB data
+        pixes = xSize;
+        while (pixes--) {
+          dst[chRed]   = src[0];
+          dst[chGreen] = src[1];
+          dst[chBlue]  = src[2];
+          dst[chAlpha] = 255;
+          dst += 4;
+          src += 3;
+        }
+      } else {
+        // do grayscale data
+        memcpy(dst, src, xSize);
       }
       dstLine += yStride;
     }
   }
 
+  const int scale = cinfo.scale_denom;
+
   // finish the decompression
   jpeg_finish_decompress(&cinfo);
 
   // cleanup
   jpeg_destroy_decompress(&cinfo);
   fclose(infile);
-  delete [] srcLine;
+  delete [] srcLines;
+
+  const double ms = std::chrono::duration<double, std::milli>
+                    (std::chrono::steady_clock::now() - start).count();
+  props.set("decodetime", ms);
+  verbose(1, "[GEM:imageJPEG] decoded '%s' (%dx%d @ 1/%d) in %.2f ms",
+          filename.c_str(), xSize, ySize, scale, ms);
 
   return true;
 }
@@ -327,6 +327,10 @@ bool recordQT4L :: init(const imageStruct*img, double fps)
 //
 /////////////////////////////////////////////////////////
 bool recordQT4L :: write(imageStruct*img)
+{
+  return write(img, clock_gettimesince(m_startTime));
+}
+bool recordQT4L :: write(imageStruct*img, double timestamp_ms)
 {
   if(!m_qtfile || !img) {
     return false;
@@ -350,7 +354,7 @@ bool recordQT4L :: write(imageStruct*img)
   }
 
   double timestamp_d=(m_useTimeStamp
-                      ?(clock_gettimesince(m_startTime)*TIMEBASE/1000.)
+                      ?(timestamp_ms*TIMEBASE/1000.)
                       :m_curFrame*m_timeTick);
 
   int64_t timestamp=timestamp_d;
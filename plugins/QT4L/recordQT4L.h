@@ -103,6 +103,7 @@ public:
    * (what? the framenumber and -1 (0?) on failure?)
    */
   virtual bool write(imageStruct*);
+  virtual bool write(imageStruct*, double timestamp);
 
   virtual bool setCodec(const std::string&name);
 
@@ -0,0 +1,465 @@
+////////////////////////////////////////////////////////
+//
+// GEM - Graphics Environment for Multimedia
+//
+// agent@local
+//
+// Implementation file
+//
+//    Copyright (c) 2026 agent. agent@local
+//    For information on usage and redistribution, and for a DISCLAIMER OF ALL
+//    WARRANTIES, see the file, "GEM.LICENSE.TERMS" in this distribution.
+//
+/////////////////////////////////////////////////////////
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "filmSEQUENCE.h"
+#include "plugins/PluginFactory.h"
+#include "plugins/imageloader.h"
+#include "Gem/RTE.h"
+#include "Gem/Files.h"
+#include "Gem/Properties.h"
+#include "Utils/Thread.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include <stdlib.h>
+#include <sys/stat.h>
+
+using namespace gem::plugins;
+
+REGISTER_FILMFACTORY("sequence", filmSEQUENCE);
+
+namespace
+{
+static const char*s_extensions[] = {
+  "png", "jpg", "jpeg", "tif", "tiff", "exr", "bmp", "tga", "gif",
+  "pnm", "ppm", "pgm", "sgi", "rgb", "hdr", "webp"
+};
+
+static bool isImage(const std::string&filename)
+{
+  const std::string ext = gem::files::getExtension(filename, true);
+  for(unsigned int i=0; i<sizeof(s_extensions)/sizeof(*s_extensions); i++) {
+    if(ext == s_extensions[i]) {
+      return true;
+    }
+  }
+  return false;
+}
+static bool isDirectory(const std::string&path)
+{
+  struct stat st;
+  return (0 == stat(path.c_str(), &st) && S_ISDIR(st.st_mode));
+}
+
+/* expand "img%04d.png" to the existing files, ordered by their number */
+static std::vector<std::string>listPattern(const std::string&pattern)
+{
+  std::vector<std::string>result;
+  const std::string::size_type pos = pattern.find('%');
+  std::string::size_type end = pos + 1;
+  while(end < pattern.size() && pattern[end] >= '0' && pattern[end] <= '9') {
+    end++;
+  }
+  if(end >= pattern.size() || ('d' != pattern[end] && 'i' != pattern[end])) {
+    return result;
+  }
+  const std::string prefix = pattern.substr(0, pos);
+  const std::string suffix = pattern.substr(end + 1);
+  std::vector<std::string>files = gem::files::getFilenameListing(
+                                    prefix + "*" + suffix);
+  std::vector<std::pair<long, std::string> >numbered;
+  for(unsigned int i=0; i<files.size(); i++) {
+    const std::string&name = files[i];
+    if(name.size() <= prefix.size() + suffix.size()
+        || name.compare(0, prefix.size(), prefix)
+        || name.compare(name.size() - suffix.size(), suffix.size(), suffix)) {
+      continue;
+    }
+    const std::string number = name.substr(prefix.size(),
+                                           name.size() - prefix.size() - suffix.size());
+    if(number.find_first_not_of("0123456789") != std::string::npos) {
+      continue;
+    }
+    numbered.push_back(std::pair<long, std::string>(atol(number.c_str()), name));
+  }
+  std::sort(numbered.begin(), numbered.end());
+  for(unsigned int i=0; i<numbered.size(); i++) {
+    result.push_back(numbered[i].second);
+  }
+  return result;
+}
+
+static std::vector<std::string>listFrames(const std::string&name)
+{
+  std::vector<std::string>result;
+  if(name.find('%') != std::string::npos) {
+    return listPattern(name);
+  }
+  if(name.find_first_of("*?") != std::string::npos) {
+    result = gem::files::getFilenameListing(name);
+  } else if(isDirectory(name)) {
+    std::vector<std::string>files = gem::files::getFilenameListing(name + "/*");
+    for(unsigned int i=0; i<files.size(); i++) {
+      if(isImage(files[i])) {
+        result.push_back(files[i]);
+      }
+    }
+  }
+  /* (single files are left to the other backends) */
+  std::sort(result.begin(), result.end());
+  return result;
+}
+};
+
+class filmSEQUENCE::PIMPL
+{
+public:
+  typedef std::shared_ptr<imageStruct> image_t;
+  struct Frame {
+    image_t image;
+    unsigned long used;
+  };
+
+  std::vector<std::string>files;
+  double fps;
+  unsigned int readahead, cachesize, threads;
+
+  std::mutex mutex;
+  std::condition_variable todo, done;
+  bool quit;
+  /* frames waiting to be decoded (most urgent first) */
+  std::deque<int>queue;
+  /* frames that are currently being decoded */
+  std::set<int>decoding;
+  std::set<int>failed;
+  std::map<int, Frame>cache;
+  unsigned long clock;
+
+  int current, direction;
+  bool newimage;
+
+  std::vector<std::thread>workers;
+
+  PIMPL(void)
+    : fps(25.), readahead(8), cachesize(32), threads(0)
+    , quit(false), clock(0)
+    , current(-1), direction(1), newimage(false)
+  {}
+  ~PIMPL(void)
+  {
+    stop();
+  }
+
+  void start(void)
+  {
+    unsigned int count = threads?threads:gem::thread::getCPUCount();
+    quit = false;
+    gem::plugins::imageloader*loader = gem::plugins::imageloader::getInstance();
+    if(!loader) {
+      return;
+    }
+    /* loaders that cannot be used concurrently get a single thread */
+    if(!loader->isThreadable()) {
+      count = 1;
+    }
+    count = std::max(1u, std::min(count, (unsigned int)files.size()));
+    workers.push_back(std::thread(&PIMPL::worker, this, loader));
+    for(unsigned int i=1; i<count; i++) {
+      loader = gem::plugins::imageloader::getInstance();
+      if(!loader) {
+        break;
+      }
+      workers.push_back(std::thread(&PIMPL::worker, this, loader));
+    }
+  }
+  void stop(void)
+  {
+    {
+      std::unique_lock<std::mutex>lock(mutex);
+      quit = true;
+      queue.clear();
+    }
+    todo.notify_all();
+    for(unsigned int i=0; i<workers.size(); i++) {
+      workers[i].join();
+    }
+    workers.clear();
+    decoding.clear();
+    failed.clear();
+    cache.clear();
+    current = -1;
+  }
+
+  void worker(gem::plugins::imageloader*loader)
+  {
+    std::unique_lock<std::mutex>lock(mutex);
+    while(true) {
+      while(!quit && queue.empty()) {
+        todo.wait(lock);
+      }
+      if(quit) {
+        break;
+      }
+      const int frame = queue.front();
+      queue.pop_front();
+      decoding.insert(frame);
+      const std::string filename = files[frame];
+      lock.unlock();
+
+      image_t img(new imageStruct());
+      gem::Properties props;
+      bool ok = loader->load(filename, *img, props);
+
+      lock.lock();
+      decoding.erase(frame);
+      if(ok) {
+        Frame f;
+        f.image = img;
+        f.used = ++clock;
+        cache[frame] = f;
+        evict();
+      } else {
+        verbose(1, "[GEM:filmSEQUENCE] could not load '%s'", filename.c_str());
+        failed.insert(frame);
+      }
+      done.notify_all();
+    }
+    lock.unlock();
+    delete loader;
+  }
+
+  /* drop the least recently used frames (call with the lock held) */
+  void evict(void)
+  {
+    while(cache.size() > cachesize) {
+      std::map<int, Frame>::iterator oldest = cache.end();
+      for(std::map<int, Frame>::iterator it=cache.begin(); it!=cache.end(); ++it) {
+        if(it->first != current
+            && (cache.end() == oldest || it->second.used < oldest->second.used)) {
+          oldest = it;
+        }
+      }
+      if(cache.end() == oldest) {
+        break;
+      }
+      cache.erase(oldest);
+    }
+  }
+
+  /* (re)fill the queue with the frames from 'current' onwards
+   * (in the direction of playback); call with the lock held */
+  void schedule(void)
+  {
+    const int frames = files.size();
+    queue.clear();
+    for(unsigned int i=0; i<=readahead; i++) {
+      /* playback usually loops, so we wrap around */
+      const int frame = ((current + direction * (int)i) % frames + frames) % frames;
+      std::map<int, Frame>::iterator it = cache.find(frame);
+      if(cache.end() != it) {
+        /* keep it from being evicted */
+        it->second.used = ++clock;
+        continue;
+      }
+      if(decoding.count(frame) || failed.count(frame)
+          || std::find(queue.begin(), queue.end(), frame) != queue.end()) {
+        continue;
+      }
+      queue.push_back(frame);
+    }
+    todo.notify_all();
+  }
+};
+
+/////////////////////////////////////////////////////////
+//
+// filmSEQUENCE
+//
+/////////////////////////////////////////////////////////
+// Constructor
+//
+/////////////////////////////////////////////////////////
+
+filmSEQUENCE :: filmSEQUENCE(void)
+  : m_pimpl(new PIMPL())
+{
+}
+filmSEQUENCE :: ~filmSEQUENCE(void)
+{
+  close();
+  delete m_pimpl;
+}
+
+/////////////////////////////////////////////////////////
+// really open the file ! (OS dependent)
+//
+/////////////////////////////////////////////////////////
+bool filmSEQUENCE :: open(const std::string&filename,
+                          const gem::Properties&wantProps)
+{
+  close();
+  std::vector<std::string>files = listFrames(filename);
+  if(files.empty()) {
+    return false;
+  }
+  m_pimpl->files = files;
+  gem::Properties props=wantProps;
+  setProperties(props);
+  m_pimpl->start();
+  if(m_pimpl->workers.empty()) {
+    close();
+    return false;
+  }
+
+  /* make sure that (at least) the first frame can be loaded */
+  changeImage(0);
+  if(!getFrame()) {
+    close();
+    return false;
+  }
+  m_image.newfilm = true;
+  verbose(1, "[GEM:filmSEQUENCE] opened %d frames ('%s' .. '%s') with %d threads",
+          (int)files.size(), files.front().c_str(), files.back().c_str(),
+          (int)m_pimpl->workers.size());
+  return true;
+}
+
+void filmSEQUENCE :: close(void)
+{
+  m_pimpl->stop();
+  m_pimpl->files.clear();
+}
+
+bool filmSEQUENCE :: isThreadable(void)
+{
+  return true;
+}
+
+/////////////////////////////////////////////////////////
+// render
+//
+/////////////////////////////////////////////////////////
+pixBlock* filmSEQUENCE :: getFrame(void)
+{
+  std::unique_lock<std::mutex>lock(m_pimpl->mutex);
+  const int frame = m_pimpl->current;
+  if(frame < 0) {
+    return NULL;
+  }
+  std::map<int, PIMPL::Frame>::iterator it;
+  /* the requested frame comes first in the queue, so this is short */
+  while((it = m_pimpl->cache.find(frame)) == m_pimpl->cache.end()) {
+    if(m_pimpl->failed.count(frame) || m_pimpl->workers.empty()) {
+      return NULL;
+    }
+    m_pimpl->done.wait(lock);
+  }
+  if(m_pimpl->newimage) {
+    /* the pix-chain modifies images in place, so we hand out a copy */
+    it->second.image->copy2Image(&m_image.image);
+    m_image.newimage = true;
+    m_pimpl->newimage = false;
+  }
+  return &m_image;
+}
+
+film::errCode filmSEQUENCE :: changeImage(int imgNum, int trackNum)
+{
+  std::unique_lock<std::mutex>lock(m_pimpl->mutex);
+  if(imgNum < 0 || imgNum >= (int)m_pimpl->files.size()) {
+    return film::FAILURE;
+  }
+  if(imgNum > m_pimpl->current) {
+    m_pimpl->direction = 1;
+  } else if (imgNum < m_pimpl->current) {
+    m_pimpl->direction = -1;
+  }
+  m_pimpl->current = imgNum;
+  m_pimpl->newimage = true;
+  m_pimpl->schedule();
+  return film::SUCCESS;
+}
+
+/////////////////////////////////////////////////////////
+// properties
+//
+/////////////////////////////////////////////////////////
+void filmSEQUENCE :: setProperties(gem::Properties&props)
+{
+  std::unique_lock<std::mutex>lock(m_pimpl->mutex);
+  double d;
+  if(props.get("fps", d) && d>0.) {
+    m_pimpl->fps = d;
+  }
+  if(props.get("readahead", d) && d>=0.) {
+    m_pimpl->readahead = d;
+  }
+  if(props.get("cache", d) && d>=1.) {
+    m_pimpl->cachesize = d;
+  }
+  if(props.get("threads", d) && d>=0.) {
+    m_pimpl->threads = d;
+  }
+  /* the read-ahead frames must fit into the cache */
+  m_pimpl->cachesize = std::max(m_pimpl->cachesize, m_pimpl->readahead + 2);
+  m_pimpl->evict();
+}
+
+void filmSEQUENCE :: getProperties(gem::Properties&props)
+{
+  std::unique_lock<std::mutex>lock(m_pimpl->mutex);
+  std::vector<std::string> keys=props.keys();
+  for(unsigned int i=0; i<keys.size(); i++) {
+    const std::string key=keys[i];
+    props.erase(key);
+#define SETPROP(k, v) } else if(k == key) { double d=(double)v; props.set(key, d)
+    if(""==key) {
+      SETPROP("fps", m_pimpl->fps);
+      SETPROP("frames", m_pimpl->files.size());
+      SETPROP("width", m_image.image.xsize);
+      SETPROP("height", m_image.image.ysize);
+      SETPROP("readahead", m_pimpl->readahead);
+      SETPROP("cache", m_pimpl->cachesize);
+      SETPROP("cached", m_pimpl->cache.size());
+      SETPROP("threads", m_pimpl->workers.size());
+    }
+#undef SETPROP
+  }
+}
+
+bool filmSEQUENCE :: enumProperties(gem::Properties&readprops,
+                                    gem::Properties&writeprops)
+{
+  readprops.clear();
+  writeprops.clear();
+
+  double d=0;
+
+  readprops.set("width", d);
+  readprops.set("height", d);
+  readprops.set("fps", d);
+  readprops.set("frames", d);
+  readprops.set("readahead", d);
+  readprops.set("cache", d);
+  readprops.set("cached", d);
+  readprops.set("threads", d);
+
+  writeprops.set("fps", d);
+  writeprops.set("readahead", d);
+  writeprops.set("cache", d);
+  writeprops.set("threads", d);
+
+  return true;
+}
@@ -0,0 +1,89 @@
+/*-----------------------------------------------------------------
+
+GEM - Graphics Environment for Multimedia
+
+play a sequence of numbered images as a film
+
+Copyright (c) 2026 agent. agent@local
+For information on usage and redistribution, and for a DISCLAIMER OF ALL
+WARRANTIES, see the file, "GEM.LICENSE.TERMS" in this distribution.
+
+
+-----------------------------------------------------------------*/
+
+#ifndef _INCLUDE_GEMPLUGIN__SEQUENCE_FILMSEQUENCE_H_
+#define _INCLUDE_GEMPLUGIN__SEQUENCE_FILMSEQUENCE_H_
+#include "plugins/film.h"
+#include "Gem/Image.h"
+
+/*-----------------------------------------------------------------
+  -------------------------------------------------------------------
+  CLASS
+  filmSEQUENCE
+
+  opens a sequence of images as a film, given as
+  - a printf-style pattern ("frames/img%04d.png"),
+  - a wildcard pattern ("frames/<name>.jpg", with wildcards in <name>), or
+  - a directory (all images in it, sorted by name)
+
+  the images are decoded by the imageloader plugins,
+  by a pool of threads that read ahead in the direction of playback;
+  decoded frames are kept in a bounded cache (least recently used
+  frames are dropped first)
+
+  properties:
+  "fps": the nominal framerate (default: 25)
+  "readahead": number of frames to decode ahead (default: 8)
+  "cache": max. number of decoded frames to keep (default: 32)
+  "threads": number of decoder threads (0: one per CPU; only on open)
+  "cached" (read-only): number of frames currently held
+
+  KEYWORDS
+  pix film movie
+
+  -----------------------------------------------------------------*/
+namespace gem
+{
+namespace plugins
+{
+class GEM_EXPORT filmSEQUENCE : public film
+{
+public:
+
+  //////////
+  // Constructor
+  filmSEQUENCE(void);
+  virtual ~filmSEQUENCE(void);
+
+  //////////
+  // open a movie up
+  virtual bool open(const std::string&filename, const gem::Properties&);
+
+  virtual void close(void);
+
+  //////////
+  // get the next frame
+  virtual pixBlock* getFrame(void);
+
+  //////////
+  // set the next frame to read;
+  virtual errCode changeImage(int imgNum, int trackNum = -1);
+
+  virtual bool enumProperties(gem::Properties&readprops,
+                              gem::Properties&writeprops);
+
+  virtual void getProperties(gem::Properties&props);
+  virtual void setProperties(gem::Properties&props);
+
+  virtual bool isThreadable(void);
+
+private:
+  class PIMPL;
+  PIMPL*m_pimpl;
+
+  pixBlock m_image;
+};
+};
+};
+
+#endif  // for header file
@@ -0,0 +1,511 @@
+////////////////////////////////////////////////////////
+//
+// GEM - Graphics Environment for Multimedia
+//
+// agent@local
+//
+// Implementation file
+//
+//    Copyright (c) 2026 agent. agent@local
+//    For information on usage and redistribution, and for a DISCLAIMER OF ALL
+//    WARRANTIES, see the file, "GEM.LICENSE.TERMS" in this distribution.
+//
+/////////////////////////////////////////////////////////
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "recordSEQUENCE.h"
+#include "plugins/PluginFactory.h"
+#include "plugins/imagesaver.h"
+#include "Gem/RTE.h"
+#include "Gem/Files.h"
+#include "Utils/Thread.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include <stdio.h>
+
+using namespace gem::plugins;
+
+REGISTER_RECORDFACTORY("sequence", recordSEQUENCE);
+
+namespace
+{
+struct codec {
+  const char*name;
+  const char*extension;
+  const char*mimetype;
+  const char*description;
+};
+static const codec s_codecs[] = {
+  {"png",  "png",  "image/png",  "PNG image sequence"},
+  {"jpeg", "jpg",  "image/jpeg", "JPEG image sequence"},
+  {"tiff", "tif",  "image/tiff", "TIFF image sequence"},
+  {"raw",  "pam",  "",           "uncompressed image sequence (PAM)"},
+};
+static const codec*findCodec(const std::string&name)
+{
+  for(unsigned int i=0; i<sizeof(s_codecs)/sizeof(*s_codecs); i++) {
+    if(name == s_codecs[i].name) {
+      return s_codecs+i;
+    }
+  }
+  return NULL;
+}
+static const codec*guessCodec(const std::string&extension)
+{
+  if("jpeg" == extension) {
+    return findCodec("jpeg");
+  }
+  if("tiff" == extension) {
+    return findCodec("tiff");
+  }
+  for(unsigned int i=0; i<sizeof(s_codecs)/sizeof(*s_codecs); i++) {
+    if(extension == s_codecs[i].extension) {
+      return s_codecs+i;
+    }
+  }
+  return NULL;
+}
+
+/* a pattern must contain exactly one "%d" (with an optional width, like "%05d") */
+static bool isPattern(const std::string&pattern)
+{
+  std::string::size_type pos = pattern.find('%');
+  if(std::string::npos == pos
+      || std::string::npos != pattern.find('%', pos + 1)) {
+    return false;
+  }
+  pos++;
+  while(pos < pattern.size() && pattern[pos] >= '0' && pattern[pos] <= '9') {
+    pos++;
+  }
+  return (pos < pattern.size() && 'd' == pattern[pos]);
+}
+
+/* write the image as PAM (with as little processing as possible) */
+static bool writeRaw(const imageStruct&image, const std::string&filename)
+{
+  imageStruct converted;
+  const imageStruct*img=&image;
+  int depth = 1;
+  const char*tupltype = "GRAYSCALE";
+  if(GEM_GRAY != image.format) {
+#ifdef __APPLE__
+    const bool native = false;
+#else
+    const bool native = (GEM_RGBA == image.format);
+#endif
+    if(!native) {
+      converted.convertFrom(&image, GEM_RAW_RGBA);
+      img=&converted;
+    }
+    depth = 4;
+    tupltype = "RGB_ALPHA";
+  }
+
+  FILE*file = fopen(filename.c_str(), "wb");
+  if(!file) {
+    return false;
+  }
+  bool success = (fprintf(file,
+                          "P7\nWIDTH %d\nHEIGHT %d\nDEPTH %d\nMAXVAL 255\nTUPLTYPE %s\nENDHDR\n",
+                          img->xsize, img->ysize, depth, tupltype) > 0);
+  const size_t stride = (size_t)img->xsize * depth;
+  if(success && img->upsidedown) {
+    success = (fwrite(img->data, img->ysize * stride, 1, file) == 1);
+  } else {
+    for(int y = img->ysize - 1; success && y >= 0; --y) {
+      success = (fwrite(img->data + y * stride, stride, 1, file) == 1);
+    }
+  }
+  if(fclose(file)) {
+    success = false;
+  }
+  return success;
+}
+};
+
+class recordSEQUENCE::PIMPL
+{
+public:
+  struct job {
+    job(unsigned long i, imageStruct*img) : index(i), image(img) {}
+    unsigned long index;
+    imageStruct*image;
+  };
+
+  std::string pattern;
+  const codec*format;
+  gem::Properties props;
+  unsigned long first;
+  unsigned int capacity;
+
+  std::mutex mutex;
+  std::condition_variable todo, space;
+  std::deque<job>queue;
+  std::vector<imageStruct*>pool; // recycled frames (to avoid re-allocation)
+  std::vector<std::thread>workers;
+  bool running, failed;
+  unsigned long failedIndex;
+
+  /* frames are numbered in the order they are written */
+  unsigned long next;
+  /* all frames before 'written' are on disk */
+  unsigned long written;
+  /* frames after 'written' that are already on disk */
+  std::set<unsigned long>finished;
+  unsigned int inflight, maxinflight;
+  std::chrono::steady_clock::time_point startTime, stopTime;
+
+  PIMPL(void)
+    : format(NULL)
+    , first(0), capacity(0)
+    , running(false), failed(false), failedIndex(0)
+    , next(0), written(0)
+    , inflight(0), maxinflight(0)
+  {}
+  ~PIMPL(void)
+  {
+    stop();
+    while(!pool.empty()) {
+      delete pool.back();
+      pool.pop_back();
+    }
+  }
+
+  std::string getFilename(unsigned long index) const
+  {
+    char buf[MAXPDSTRING];
+    snprintf(buf, MAXPDSTRING, pattern.c_str(), (int)(first + index));
+    buf[MAXPDSTRING-1]=0;
+    return buf;
+  }
+
+  bool start(unsigned int threads)
+  {
+    if(!threads) {
+      threads = gem::thread::getCPUCount();
+    }
+    std::vector<gem::plugins::imagesaver*>savers;
+    if(format->mimetype[0]) {
+      gem::plugins::imagesaver*saver = gem::plugins::imagesaver::getInstance();
+      if(!saver) {
+        return false;
+      }
+      /* savers that cannot be used concurrently get a single thread */
+      if(!saver->isThreadable()) {
+        threads = 1;
+      }
+      savers.push_back(saver);
+      while(savers.size() < threads) {
+        saver = gem::plugins::imagesaver::getInstance();
+        if(!saver) {
+          break;
+        }
+        savers.push_back(saver);
+      }
+    } else {
+      savers.resize(threads, NULL);
+    }
+    if(!capacity) {
+      capacity = 2 * savers.size();
+    }
+    running = true;
+    failed = false;
+    next = written = 0;
+    inflight = maxinflight = 0;
+    finished.clear();
+    startTime = stopTime = std::chrono::steady_clock::now();
+    for(unsigned int i=0; i<savers.size(); i++) {
+      workers.push_back(std::thread(&PIMPL::worker, this, savers[i]));
+    }
+    return true;
+  }
+
+  /* wait until all frames have been written, and shut down the workers */
+  void stop(void)
+  {
+    {
+      std::unique_lock<std::mutex>lock(mutex);
+      if(!running) {
+        return;
+      }
+      running = false;
+      todo.notify_all();
+    }
+    for(unsigned int i=0; i<workers.size(); i++) {
+      workers[i].join();
+    }
+    workers.clear();
+
+    stopTime = std::chrono::steady_clock::now();
+    const double elapsed = std::chrono::duration<double>
+                           (stopTime - startTime).count();
+    verbose(1, "[GEM:recordSEQUENCE] wrote %lu frames in %.2fs (%.1f fps), max. %u frames in flight",
+            written, elapsed, (elapsed>0.)?(written/elapsed):0., maxinflight);
+    if(failed) {
+      pd_error(0, "[GEM:recordSEQUENCE] could not write '%s'",
+               getFilename(failedIndex).c_str());
+    }
+  }
+
+  void worker(gem::plugins::imagesaver*saver)
+  {
+    /* we already encode several frames at once,
+     * so the imagesaver need not split each frame among threads */
+    gem::Properties saveprops = props;
+    saveprops.set("threads", 1);
+
+    std::unique_lock<std::mutex>lock(mutex);
+    while(true) {
+      while(running && queue.empty()) {
+        todo.wait(lock);
+      }
+      if(queue.empty()) {
+        /* !running && nothing left to do */
+        break;
+      }
+      job j = queue.front();
+      queue.pop_front();
+      bool success = false;
+      if(!failed) {
+        const std::string filename = getFilename(j.index);
+        lock.unlock();
+        if(saver) {
+          success = saver->save(*j.image, filename, format->mimetype, saveprops);
+        } else {
+          success = writeRaw(*j.image, filename);
+        }
+        lock.lock();
+      }
+      if(success) {
+        /* frames may finish out of order, but are only counted once
+         * all their predecessors are on disk */
+        finished.insert(j.index);
+        while(finished.erase(written)) {
+          written++;
+        }
+      } else if(!failed) {
+        failed = true;
+        failedIndex = j.index;
+      }
+      pool.push_back(j.image);
+      inflight--;
+      space.notify_all();
+    }
+    lock.unlock();
+    delete saver;
+  }
+
+  bool push(const imageStruct&img)
+  {
+    std::unique_lock<std::mutex>lock(mutex);
+    while(running && !failed && inflight >= capacity) {
+      space.wait(lock);
+    }
+    if(!running || failed) {
+      return false;
+    }
+    imageStruct*copy = NULL;
+    if(pool.empty()) {
+      copy = new imageStruct;
+    } else {
+      copy = pool.back();
+      pool.pop_back();
+    }
+    inflight++;
+    if(inflight > maxinflight) {
+      maxinflight = inflight;
+    }
+    /* copying might re-allocate, so do it without the lock */
+    lock.unlock();
+    img.copy2Image(copy);
+    lock.lock();
+    queue.push_back(job(next++, copy));
+    todo.notify_one();
+    return true;
+  }
+};
+
+/////////////////////////////////////////////////////////
+//
+// recordSEQUENCE
+//
+/////////////////////////////////////////////////////////
+// Constructor
+//
+/////////////////////////////////////////////////////////
+recordSEQUENCE :: recordSEQUENCE(void)
+  : m_pimpl(new PIMPL())
+{
+}
+
+////////////////////////////////////////////////////////
+// Destructor
+//
+/////////////////////////////////////////////////////////
+recordSEQUENCE :: ~recordSEQUENCE(void)
+{
+  stop();
+  delete m_pimpl;
+}
+
+void recordSEQUENCE :: stop(void)
+{
+  m_pimpl->stop();
+}
+
+/////////////////////////////////////////////////////////
+// open a file !
+//
+/////////////////////////////////////////////////////////
+bool recordSEQUENCE :: start(const std::string&filename,
+                             gem::Properties&props)
+{
+  stop();
+
+  const std::string extension = gem::files::getExtension(filename, true);
+  const codec*format = findCodec(m_codec);
+  if(!format) {
+    format = guessCodec(extension);
+  }
+  if(!format) {
+    format = findCodec("png");
+  }
+
+  std::string pattern = filename;
+  if(std::string::npos != filename.find('%')) {
+    if(!isPattern(filename)) {
+      pd_error(0, "[GEM:recordSEQUENCE] invalid pattern '%s' (must contain a single '%%d')",
+               filename.c_str());
+      return false;
+    }
+  } else if(guessCodec(extension)) {
+    /* insert the frame number before the extension */
+    pattern = filename.substr(0, filename.size() - extension.size() - 1)
+              + "%05d" + filename.substr(filename.size() - extension.size() - 1);
+  } else {
+    pattern = filename + "%05d." + format->extension;
+  }
+
+  double d;
+  unsigned int threads = 0;
+  if(props.get("threads", d) && d>=0.) {
+    threads = d;
+  }
+  m_pimpl->capacity = 0;
+  if(props.get("queue", d) && d>=1.) {
+    m_pimpl->capacity = d;
+  }
+  m_pimpl->first = 0;
+  if(props.get("first", d) && d>=0.) {
+    m_pimpl->first = d;
+  }
+  m_pimpl->props = props;
+  /* these are for us, not for the imagesaver */
+  m_pimpl->props.erase("threads");
+  m_pimpl->props.erase("queue");
+  m_pimpl->props.erase("first");
+  m_pimpl->pattern = pattern;
+  m_pimpl->format = format;
+
+  if(!m_pimpl->start(threads)) {
+    pd_error(0, "[GEM:recordSEQUENCE] no imagesaver available for '%s'",
+             format->name);
+    return false;
+  }
+  verbose(1, "[GEM:recordSEQUENCE] recording %s frames to '%s' with %d threads",
+          format->name, pattern.c_str(), (int)m_pimpl->workers.size());
+  return true;
+}
+
+/////////////////////////////////////////////////////////
+// queue the frame for encoding
+//
+/////////////////////////////////////////////////////////
+bool recordSEQUENCE :: write(imageStruct*img)
+{
+  if(!img) {
+    return false;
+  }
+  return m_pimpl->push(*img);
+}
+
+/////////////////////////////////////////////////////////
+// codecs
+//
+/////////////////////////////////////////////////////////
+bool recordSEQUENCE :: setCodec(const std::string &name)
+{
+  if(findCodec(name)) {
+    m_codec = name;
+    return true;
+  }
+  return false;
+}
+
+std::vector<std::string> recordSEQUENCE :: getCodecs(void)
+{
+  std::vector<std::string> codecs;
+  for(unsigned int i=0; i<sizeof(s_codecs)/sizeof(*s_codecs); i++) {
+    codecs.push_back(s_codecs[i].name);
+  }
+  return codecs;
+}
+
+const std::string recordSEQUENCE :: getCodecDescription(
+  const std::string&codecname)
+{
+  const codec*c = findCodec(codecname);
+  if(c) {
+    return c->description;
+  }
+  return "(unknown codec)";
+}
+
+/////////////////////////////////////////////////////////
+// properties
+//
+/////////////////////////////////////////////////////////
+bool recordSEQUENCE :: enumProperties(gem::Properties&props)
+{
+  props.clear();
+  double d=0;
+  props.set("threads", d);
+  props.set("queue", d);
+  props.set("first", d);
+  props.set("quality", 100.);
+  props.set("compression", std::string());
+  return true;
+}
+
+void recordSEQUENCE :: getProperties(gem::Properties&props)
+{
+  std::unique_lock<std::mutex>lock(m_pimpl->mutex);
+  const std::chrono::steady_clock::time_point now =
+    m_pimpl->running?std::chrono::steady_clock::now():m_pimpl->stopTime;
+  const double elapsed = std::chrono::duration<double>
+                         (now - m_pimpl->startTime).count();
+  std::vector<std::string> keys=props.keys();
+  for(unsigned int i=0; i<keys.size(); i++) {
+    const std::string key=keys[i];
+    props.erase(key);
+#define SETPROP(k, v) } else if(k == key) { double d=(double)v; props.set(key, d)
+    if(""==key) {
+      SETPROP("frames", m_pimpl->written);
+      SETPROP("fps", (elapsed>0.)?(m_pimpl->written/elapsed):0.);
+      SETPROP("depth", m_pimpl->inflight);
+      SETPROP("maxdepth", m_pimpl->maxinflight);
+      SETPROP("threads", m_pimpl->workers.size());
+    }
+#undef SETPROP
+  }
+}
@@ -0,0 +1,109 @@
+/*-----------------------------------------------------------------
+
+GEM - Graphics Environment for Multimedia
+
+record into a sequence of numbered images
+
+Copyright (c) 2026 agent. agent@local
+For information on usage and redistribution, and for a DISCLAIMER OF ALL
+WARRANTIES, see the file, "GEM.LICENSE.TERMS" in this distribution.
+
+
+-----------------------------------------------------------------*/
+
+#ifndef _INCLUDE_GEMPLUGIN__SEQUENCE_RECORDSEQUENCE_H_
+#define _INCLUDE_GEMPLUGIN__SEQUENCE_RECORDSEQUENCE_H_
+
+#include "plugins/record.h"
+
+/*---------------------------------------------------------------
+ -------------------------------------------------------------------
+  CLASS
+  recordSEQUENCE
+
+  records a film as a sequence of numbered images
+
+  the filename is either a printf-style pattern ("frames/img%04d.png")
+  or a plain filename, in which case the frame number is inserted before
+  the extension ("frames/img.png" -> "frames/img00000.png", ...)
+
+  the frames are encoded by the imagesaver plugins on a pool of threads;
+  at most "queue" frames are in flight (write() blocks if there are more).
+
+  codecs:
+  "png", "jpeg", "tiff": encode with the imagesaver plugins
+  "raw": write the pixels as they are (as PAM), without any encoding
+  (if no codec is set, it is guessed from the extension of the filename)
+
+  properties:
+  "threads": number of encoder threads (0: one per CPU)
+  "queue": max. number of frames in flight (0: 2 per thread)
+  "first": number of the first frame (default: 0)
+  "quality", "compression": passed on to the imagesaver
+
+  read-only properties (of the current recording):
+  "frames": number of frames written to disk
+  "fps": frames written per second (since the start)
+  "depth", "maxdepth": number of frames in flight (current and max.)
+
+  KEYWORDS
+  pix record movie
+
+  -----------------------------------------------------------------*/
+namespace gem
+{
+namespace plugins
+{
+class GEM_EXPORT recordSEQUENCE : public record
+{
+public:
+
+  //////////
+  // Constructor
+  recordSEQUENCE(void);
+
+  ////////
+  // Destructor
+  virtual ~recordSEQUENCE(void);
+
+  //////////
+  // stop recording
+  // waits until all pending frames have been written
+  virtual void stop(void);
+
+  //////////
+  // start recording into "filename"
+  // returns TRUE if opening was successful, FALSE otherwise
+  virtual bool start(const std::string&filename, gem::Properties&props);
+
+  //////////
+  // write the next frame
+  virtual bool write(imageStruct*);
+
+  //////////
+  // codecs
+  virtual bool setCodec(const std::string&name);
+  virtual std::vector<std::string>getCodecs(void);
+  virtual const std::string getCodecDescription(const std::string&codecname);
+
+  //////////
+  // properties
+  virtual bool enumProperties(gem::Properties&props);
+  virtual void getProperties(gem::Properties&props);
+
+  virtual bool dialog(void)
+  {
+    return false;
+  }
+
+private:
+  class PIMPL;
+  PIMPL*m_pimpl;
+
+  /* the codec set via setCodec() (empty: guess from the filename) */
+  std::string m_codec;
+};
+};
+};
+
+#endif  // for header file
@@ -20,9 +20,70 @@
 #include <string.h>
 #include "imageSTB.h"
 #include "Gem/RTE.h"
+#include "Gem/Properties.h"
 #include "plugins/PluginFactory.h"
+#include "Utils/Thread.h"
+
+#include <algorithm>
+#include <new>
+#include <thread>
+#include <mutex>
+#include <vector>
+
+#ifdef HAVE_LIBZ
+# include <zlib.h>
+#endif
 
 #ifndef HAVE_LIBSTB
+# include <map>
+namespace
+{
+/* the decoded images are allocated with new[],
+ * so an imageStruct can take them over without copying
+ * (stb_image also uses plain realloc(), so we need to remember the sizes)
+ */
+static std::mutex s_stbMutex;
+static std::map<void*, size_t>s_stbSizes;
+static void*stbMalloc(size_t size)
+{
+  unsigned char*result = new (std::nothrow) unsigned char[size];
+  if(result) {
+    std::unique_lock<std::mutex>lock(s_stbMutex);
+    s_stbSizes[result] = size;
+  }
+  return result;
+}
+/* the buffer is no longer managed by stb */
+static void stbForget(void*p)
+{
+  std::unique_lock<std::mutex>lock(s_stbMutex);
+  s_stbSizes.erase(p);
+}
+static void stbFree(void*p)
+{
+  if(p) {
+    stbForget(p);
+    delete [] static_cast<unsigned char*>(p);
+  }
+}
+static void*stbRealloc(void*p, size_t newsize)
+{
+  size_t oldsize = 0;
+  if(p) {
+    std::unique_lock<std::mutex>lock(s_stbMutex);
+    oldsize = s_stbSizes[p];
+  }
+  void*result = stbMalloc(newsize);
+  if(result && p) {
+    memcpy(result, p, std::min(oldsize, newsize));
+    stbFree(p);
+  }
+  return result;
+}
+};
+# define STBI_MALLOC(sz) stbMalloc(sz)
+# define STBI_FREE(p) stbFree(p)
+# define STBI_REALLOC(p, newsz) stbRealloc(p, newsz)
 # define STB_IMAGE_IMPLEMENTATION
 # define STB_IMAGE_WRITE_IMPLEMENTATION
 #endif
@@ -39,6 +100,290 @@ using namespace gem::plugins;
 REGISTER_IMAGELOADERFACTORY("STB", imageSTB);
 REGISTER_IMAGESAVERFACTORY ("STB", imageSTB);
 
+namespace
+{
+/* the zlib compression level for PNGs ("compression" property) */
+static int getCompression(const gem::Properties&props)
+{
+  const int defaultLevel = 6;
+  double d;
+  std::string s;
+  if(props.get("compression", d)) {
+    return std::max(0, std::min(9, (int)d));
+  }
+  if(!props.get("compression", s)) {
+    return defaultLevel;
+  }
+  if("none" == s) {
+    return 0;
+  } else if("fast" == s) {
+    return 1;
+  } else if("best" == s) {
+    return 9;
+  } else if(!s.empty() && s[0] >= '0' && s[0] <= '9') {
+    return std::min(9, atoi(s.c_str()));
+  }
+  return defaultLevel;
+}
+
+#ifdef HAVE_LIBZ
+/* PNG rows are filtered and deflated in bands of (at least) this many bytes,
+ * which are compressed in parallel */
+static const size_t BANDSIZE = 512*1024;
+
+static inline int paeth(int a, int b, int c)
+{
+  const int p = a + b - c;
+  const int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+  if(pa <= pb && pa <= pc) {
+    return a;
+  }
+  return (pb <= pc)?b:c;
+}
+
+/* apply PNG filter 'type' to 'row' (given the previous row 'prev') */
+static void filterRow(int type, const unsigned char*row,
+                      const unsigned char*prev, size_t rowbytes, int bpp,
+                      unsigned char*out)
+{
+  size_t i;
+  switch(type) {
+  case 0:
+    memcpy(out, row, rowbytes);
+    break;
+  case 1:
+    for(i=0; i<(size_t)bpp; i++) {
+      out[i] = row[i];
+    }
+    for(; i<rowbytes; i++) {
+      out[i] = row[i] - row[i-bpp];
+    }
+    break;
+  case 2:
+    for(i=0; i<rowbytes; i++) {
+      out[i] = row[i] - prev[i];
+    }
+    break;
+  case 3:
+    for(i=0; i<(size_t)bpp; i++) {
+      out[i] = row[i] - (prev[i]>>1);
+    }
+    for(; i<rowbytes; i++) {
+      out[i] = row[i] - ((row[i-bpp] + prev[i])>>1);
+    }
+    break;
+  default:
+    for(i=0; i<(size_t)bpp; i++) {
+      out[i] = row[i] - prev[i];
+    }
+    for(; i<rowbytes; i++) {
+      out[i] = row[i] - paeth(row[i-bpp], prev[i], prev[i-bpp]);
+    }
+    break;
+  }
+}
+
+struct PNGBand {
+  unsigned int first, last; /* rows [first..last) */
+  std::vector<unsigned char>data; /* raw deflate stream */
+  uLong adler, length;  /* of the filtered (uncompressed) data */
+  bool ok;
+};
+
+/* filter and deflate one band of rows;
+ * all but the last band end on a byte boundary (Z_SYNC_FLUSH),
+ * so the bands can simply be concatenated */
+static void encodeBand(PNGBand&band, const imageStruct&img, int level,
+                       bool last)
+{
+  const size_t rowbytes = img.xsize * img.csize;
+  const int bpp = img.csize;
+  std::vector<unsigned char>zeros(rowbytes, 0), candidate(rowbytes);
+  std::vector<unsigned char>filtered((band.last - band.first) * (rowbytes + 1));
+  unsigned char*out = &filtered[0];
+  for(unsigned int y = band.first; y < band.last; y++) {
+    /* PNGs are stored top-down */
+    const unsigned char*row = img.data + (img.upsidedown?y:(img.ysize-1-y)) *
+                              rowbytes;
+    const unsigned char*prev = (y == 0)?&zeros[0]:(img.upsidedown ? row - rowbytes
+                               : row + rowbytes);
+    int best = 0;
+    if(level > 0) {
+      /* pick the filter with the smallest sum of (signed) residuals */
+      unsigned long bestsum = (unsigned long)-1;
+      for(int type = 0; type < 5; type++) {
+        filterRow(type, row, prev, rowbytes, bpp, &candidate[0]);
+        unsigned long sum = 0;
+        for(size_t i = 0; i < rowbytes; i++) {
+          sum += abs((signed char)candidate[i]);
+        }
+        if(sum < bestsum) {
+          bestsum = sum;
+          best = type;
+        }
+      }
+    }
+    *out++ = best;
+    filterRow(best, row, prev, rowbytes, bpp, out);
+    out += rowbytes;
+  }
+  band.length = filtered.size();
+  band.adler = adler32(adler32(0L, Z_NULL, 0), &filtered[0], band.length);
+
+  z_stream zs;
+  memset(&zs, 0, sizeof(zs));
+  band.ok = false;
+  if(Z_OK != deflateInit2(&zs, level, Z_DEFLATED, -15, 8,
+                          Z_DEFAULT_STRATEGY)) {
+    return;
+  }
+  band.data.resize(deflateBound(&zs, band.length) + 16);
+  zs.next_in = &filtered[0];
+  zs.avail_in = band.length;
+  int err = Z_OK;
+  do {
+    if(zs.total_out >= band.data.size()) {
+      band.data.resize(band.data.size() * 2);
+    }
+    zs.next_out = &band.data[zs.total_out];
+    zs.avail_out = band.data.size() - zs.total_out;
+    err = deflate(&zs, last?Z_FINISH:Z_SYNC_FLUSH);
+  } while(Z_OK == err && (0 == zs.avail_out || (last && zs.avail_in)));
+  band.ok = (last?(Z_STREAM_END == err):(Z_OK == err || Z_BUF_ERROR == err));
+  band.data.resize(zs.total_out);
+  deflateEnd(&zs);
+}
+
+class PNGFile
+{
+public:
+  PNGFile(const std::string&filename)
+    : m_fd(fopen(filename.c_str(), "wb")), m_ok(NULL != m_fd), m_crc(0)
+  { }
+  ~PNGFile(void)
+  {
+    if(m_fd) {
+      fclose(m_fd);
+    }
+  }
+  void write(const unsigned char*data, size_t length)
+  {
+    m_ok = m_ok && (fwrite(data, 1, length, m_fd) == length);
+    m_crc = crc32(m_crc, data, length);
+  }
+  void write32(uLong value)
+  {
+    unsigned char buf[4];
+    buf[0] = value>>24;
+    buf[1] = value>>16;
+    buf[2] = value>> 8;
+    buf[3] = value>> 0;
+    write(buf, 4);
+  }
+  /* chunks are written in pieces: begin(), write()..., end() */
+  void begin(const char*type, size_t length)
+  {
+    write32(length);
+    m_crc = crc32(0L, Z_NULL, 0);
+    write(reinterpret_cast<const unsigned char*>(type), 4);
+  }
+  void end(void)
+  {
+    write32(m_crc);
+  }
+  bool close(void)
+  {
+    m_ok = m_ok && (0 == fclose(m_fd));
+    m_fd = NULL;
+    return m_ok;
+  }
+  bool ok(void) const
+  {
+    return m_ok;
+  }
+private:
+  FILE*m_fd;
+  bool m_ok;
+  uLong m_crc;
+};
+
+/* write an 8bit GRAY or RGBA image as PNG,
+ * deflating bands of rows in parallel (like 'pigz' does)
+ */
+static bool writePNG(const std::string&filename, const imageStruct&img,
+                     int level, unsigned int threads)
+{
+  const size_t rowbytes = img.xsize * img.csize;
+  const unsigned int height = img.ysize;
+  unsigned int rowsperband = std::max<size_t>(1, BANDSIZE / (rowbytes + 1));
+  const unsigned int bands = (height + rowsperband - 1) / rowsperband;
+  threads = std::max(1u, std::min(threads, bands));
+
+  std::vector<PNGBand>band(bands);
+  for(unsigned int b = 0; b < bands; b++) {
+    band[b].first = b * rowsperband;
+    band[b].last = std::min(height, (b + 1) * rowsperband);
+  }
+  std::vector<std::thread>workers;
+  for(unsigned int t = 1; t < threads; t++) {
+    workers.push_back(std::thread([&, t]() {
+      for(unsigned int b = t; b < bands; b += threads) {
+        encodeBand(band[b], img, level, b + 1 == bands);
+      }
+    }));
+  }
+  for(unsigned int b = 0; b < bands; b += threads) {
+    encodeBand(band[b], img, level, b + 1 == bands);
+  }
+  for(unsigned int t = 0; t < workers.size(); t++) {
+    workers[t].join();
+  }
+
+  size_t idatsize = 2 + 4;
+  uLong adler = adler32(0L, Z_NULL, 0);
+  for(unsigned int b = 0; b < bands; b++) {
+    if(!band[b].ok) {
+      return false;
+    }
+    idatsize += band[b].data.size();
+    adler = adler32_combine(adler, band[b].adler, band[b].length);
+  }
+
+  PNGFile png(filename);
+  if(!png.ok()) {
+    return false;
+  }
+  static const unsigned char signature[] = {137, 80, 78, 71, 13, 10, 26, 10};
+  png.write(signature, sizeof(signature));
+
+  const unsigned char colortype = (1 == img.csize)?0:6; // GRAY or RGBA
+  const unsigned char ihdr[] = {8, colortype, 0, 0, 0};
+  png.begin("IHDR", 13);
+  png.write32(img.xsize);
+  png.write32(img.ysize);
+  png.write(ihdr, sizeof(ihdr));
+  png.end();
+
+  /* zlib header (with a hint about the compression level) */
+  const unsigned char zheader[] = {0x78,
+                                   (unsigned char)((level < 2)?0x01:(level < 6)?0x5E:(level == 6)?0x9C:0xDA)
+                                  };
+  png.begin("IDAT", idatsize);
+  png.write(zheader, sizeof(zheader));
+  for(unsigned int b = 0; b < bands; b++) {
+    png.write(&band[b].data[0], band[b].data.size());
+  }
+  png.write32(adler);
+  png.end();
+
+  png.begin("IEND", 0);
+  png.end();
+
+  return png.close();
+}
+#endif /* HAVE_LIBZ */
+};
+
 /////////////////////////////////////////////////////////
 //
 // imageSTB
@@ -62,18 +407,57 @@ bool imageSTB :: load(std::string filename, imageStruct&result,
                       gem::Properties&props)
 {
   int xsize, ysize, csize;
-  unsigned char *data = stbi_load(filename.c_str(), &xsize, &ysize, &csize, 4);
+  if(!stbi_info(filename.c_str(), &xsize, &ysize, &csize)) {
+    return false;
+  }
+
+  /* grayscale images stay grayscale; colour images become RGBA,
+   * unless the "native" colorspace is requested
+   * (Gem has no format for gray+alpha, so that becomes RGBA as well)
+   */
+  std::string colorspace;
+  props.get("colorspace", colorspace);
+  int format = GEM_RGBA;
+  if(1 == csize) {
+    format = GEM_GRAY;
+  } else if(3 == csize && "native" == colorspace) {
+    format = GEM_RGB;
+  }
+  result.xsize=xsize;
+  result.ysize=ysize;
+  result.setFormat(format);
+  result.upsidedown=true;
 
+  unsigned char *data = stbi_load(filename.c_str(), &xsize, &ysize, &csize,
+                                  result.csize);
   if(!data) {
     return(false);
   }
 
-  result.xsize=xsize;
-  result.ysize=ysize;
-  result.setFormat(GEM_RGBA);
-  result.reallocate();
+#ifndef HAVE_LIBSTB
+  /* stb's buffer has just the right layout, so we take it over */
+  bool sameLayout = (GEM_GRAY == format);
+# ifndef __APPLE__
+  sameLayout = true;
+# endif
+  if(sameLayout && result.adopt(data,
+                                (size_t)xsize * ysize * result.csize)) {
+    stbForget(data);
+    return true;
+  }
+#endif
 
-  result.fromRGBA(data);
+  switch(format) {
+  case GEM_GRAY:
+    result.fromGray(data);
+    break;
+  case GEM_RGB:
+    result.fromRGB(data);
+    break;
+  default:
+    result.fromRGBA(data);
+    break;
+  }
 
   stbi_image_free(data);
   return true;
@@ -90,14 +474,29 @@ bool imageSTB::save(const imageStruct&image, const std::string&filename,
   if(props.get("quality", fquality)) {
     quality=fquality;
   }
+  /* grayscale images are written as such */
+  image.convertTo(&img, (GEM_GRAY == image.format)?GEM_GRAY:GEM_RAW_RGBA);
 
-  image.convertTo(&img, GEM_RAW_RGBA);
-
-  if(!img.upsidedown) {
-    stbi_flip_vertically_on_write(1);
+  /* stb's flip (and compression) settings are process-wide globals,
+   * and we might be saving from several threads:
+   * so we flip our private copy rather than asking stb to do it */
+#ifdef HAVE_LIBZ
+  if("image/png" == mimetype) {
+    double d_threads=0;
+    props.get("threads", d_threads);
+    unsigned int threads=(d_threads>=1.)?(unsigned int)d_threads:gem::thread::getCPUCount();
+    /* (our own PNG writer can read the rows in either order) */
+    return writePNG(filename, img, getCompression(props), threads);
   }
+#endif
+  img.fixUpDown();
   if("image/png" == mimetype) {
+#ifndef HAVE_LIBZ
+    static std::mutex s_compressionMutex;
+    std::unique_lock<std::mutex>lock(s_compressionMutex);
+    stbi_write_png_compression_level = getCompression(props);
     err = stbi_write_png(filename.c_str(), img.xsize, img.ysize, img.csize, img.data, img.xsize * img.csize);
+#endif
   } else if ("image/bmp" == mimetype) {
     err = stbi_write_bmp(filename.c_str(), img.xsize, img.ysize, img.csize, img.data);
   } else if ("image/targa" == mimetype) {
@@ -126,6 +525,10 @@ float imageSTB::estimateSave(const imageStruct&img,
     }
 
   }
+  if("image/png" == mimetype
+      && gem::Properties::UNSET != props.type("compression")) {
+    result += 1.;
+  }
   return result;
 }
 void imageSTB::getWriteCapabilities(std::vector<std::string>&mimetypes,
@@ -142,4 +545,10 @@ void imageSTB::getWriteCapabilities(std::vector<std::string>&mimetypes,
 
   value=100.f;
   props.set("quality", value);
+  /* zlib level for PNG: 0 (none) ... 9 (best) */
+  value=6.f;
+  props.set("compression", value);
+  /* number of threads used for compressing PNGs (0: one per CPU) */
+  value=0.f;
+  props.set("threads", value);
 }
@@ -0,0 +1,331 @@
+////////////////////////////////////////////////////////
+//
+// GEM - Graphics Environment for Multimedia
+//
+// agent@local
+//
+// Implementation file
+//
+//    Copyright (c) 2026 agent. agent@local
+//    For information on usage and redistribution, and for a DISCLAIMER OF ALL
+//    WARRANTIES, see the file, "GEM.LICENSE.TERMS" in this distribution.
+//
+/////////////////////////////////////////////////////////
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "TestPattern.h"
+#include "Gem/Properties.h"
+
+#include <string.h>
+
+using namespace gem::plugins;
+
+namespace
+{
+/* channel layout of GEM_RGB */
+#ifdef __APPLE__
+const int rgbRed  = 2;
+const int rgbBlue = 0;
+#else
+const int rgbRed  = 0;
+const int rgbBlue = 2;
+#endif
+
+static inline unsigned char rgb2y(int r, int g, int b)
+{
+  return (unsigned char)(((66*r + 129*g + 25*b + 128)>>8) + 16);
+}
+static inline unsigned char rgb2u(int r, int g, int b)
+{
+  return (unsigned char)(((-38*r - 74*g + 112*b + 128)>>8) + 128);
+}
+static inline unsigned char rgb2v(int r, int g, int b)
+{
+  return (unsigned char)(((112*r - 94*g - 18*b + 128)>>8) + 128);
+}
+
+static const unsigned char s_bars[8][3] = {
+  {255, 255, 255}, {255, 255, 0}, {0, 255, 255}, {0, 255, 0},
+  {255, 0, 255}, {255, 0, 0}, {0, 0, 255}, {0, 0, 0}
+};
+
+static const char*s_patterns[] = {
+  "noise", "red", "green", "blue", "bars", "gradient", "checker", "ramp"
+};
+};
+
+TestPattern::TestPattern(unsigned int width, unsigned int height,
+                         enum Pattern pattern)
+  : m_width(width), m_height(height)
+  , m_pattern(pattern)
+  , m_format("rgba")
+  , m_counter(false)
+{
+}
+
+unsigned int TestPattern::width(void) const
+{
+  return m_width;
+}
+unsigned int TestPattern::height(void) const
+{
+  return m_height;
+}
+
+void TestPattern::renderLine(unsigned int y, unsigned long frame)
+{
+  unsigned char*line=&m_line[0];
+  const unsigned int w=m_width;
+  unsigned int x;
+  switch(m_pattern) {
+  case NOISE: {
+    /* a simple LCG, seeded by frame and line, so the noise is reproducible */
+    unsigned int seed=(unsigned int)(frame*2654435761UL + y*40503UL + 1489853723UL);
+    for(x=0; x<3*w; x++) {
+      seed = seed * 435898247 + 938284281;
+      line[x]=seed>>24;
+    }
+  }
+  break;
+  case RED:
+  case GREEN:
+  case BLUE: {
+    const int ch=m_pattern-RED;
+    memset(line, 0, 3*w);
+    for(x=0; x<w; x++) {
+      line[3*x+ch]=255;
+    }
+  }
+  break;
+  case BARS:
+    /* colour bars, scrolling to the left */
+    for(x=0; x<w; x++) {
+      const unsigned char*bar=s_bars[(((x + 4*frame) % w) * 8 / w)];
+      line[3*x+0]=bar[0];
+      line[3*x+1]=bar[1];
+      line[3*x+2]=bar[2];
+    }
+    break;
+  case GRADIENT:
+    for(x=0; x<w; x++) {
+      line[3*x+0]=(unsigned char)(x + frame);
+      line[3*x+1]=(unsigned char)(y + frame);
+      line[3*x+2]=(unsigned char)(x + y + 2*frame);
+    }
+    break;
+  case CHECKER:
+  default:
+    /* 32x32 squares, moving diagonally */
+    for(x=0; x<w; x++) {
+      const unsigned char c=((((x+frame)>>5) + ((y+frame)>>5))&1)?255:0;
+      line[3*x+0]=line[3*x+1]=line[3*x+2]=c;
+    }
+    break;
+  }
+
+  if(m_counter) {
+    /* 32 blocks (MSB first): white for 1, black for 0 */
+    unsigned int blocksize=m_width/128;
+    if(blocksize<8) {
+      blocksize=8;
+    }
+    if(y<blocksize && 32*blocksize<=m_width) {
+      for(x=0; x<32*blocksize; x++) {
+        const unsigned char c=((frame>>(31 - x/blocksize))&1)?255:0;
+        line[3*x+0]=line[3*x+1]=line[3*x+2]=c;
+      }
+    }
+  }
+}
+
+void TestPattern::render(imageStruct&img, unsigned long frame)
+{
+  const bool yuv=("yuv"==m_format || "yuv420"==m_format);
+  unsigned int w=m_width, h=m_height;
+  if(yuv) {
+    /* chroma subsampling needs even dimensions */
+    w&=~1;
+    h&=~1;
+    if(w<2) {
+      w=2;
+    }
+    if(h<2) {
+      h=2;
+    }
+  }
+  m_width=w;
+  m_height=h;
+
+  int format=GEM_RGBA;
+  if("rgb"==m_format) {
+    format=GEM_RGB;
+  } else if("gray"==m_format) {
+    format=GEM_GRAY;
+  } else if(yuv) {
+    format=GEM_YUV;
+  }
+  img.xsize=w;
+  img.ysize=h;
+  img.setFormat(format);
+  img.reallocate();
+  img.upsidedown=true;
+
+  if(RAMP==m_pattern) {
+    unsigned char*data=img.data;
+    size_t size=(size_t)w*h*img.csize;
+    unsigned char value=(unsigned char)frame;
+    while(size-->0) {
+      *data++=value++;
+    }
+    return;
+  }
+
+  m_line.resize(3*w);
+  unsigned char*planeY=NULL, *planeU=NULL, *planeV=NULL;
+  if("yuv420"==m_format) {
+    m_planar.resize(w*h + 2*(w/2)*(h/2));
+    planeY=&m_planar[0];
+    planeU=planeY + w*h;
+    planeV=planeU + (w/2)*(h/2);
+  }
+
+  const unsigned char*line=&m_line[0];
+  for(unsigned int y=0; y<h; y++) {
+    renderLine(y, frame);
+    unsigned char*data=img.data + (size_t)y*w*img.csize;
+    unsigned int x;
+    if(planeY) {
+      unsigned char*Y=planeY + (size_t)y*w;
+      for(x=0; x<w; x++) {
+        Y[x]=rgb2y(line[3*x+0], line[3*x+1], line[3*x+2]);
+      }
+      if(!(y&1)) {
+        unsigned char*U=planeU + (size_t)(y/2)*(w/2);
+        unsigned char*V=planeV + (size_t)(y/2)*(w/2);
+        for(x=0; x<w/2; x++) {
+          const int r=(line[6*x+0]+line[6*x+3])>>1;
+          const int g=(line[6*x+1]+line[6*x+4])>>1;
+          const int b=(line[6*x+2]+line[6*x+5])>>1;
+          U[x]=rgb2u(r, g, b);
+          V[x]=rgb2v(r, g, b);
+        }
+      }
+      continue;
+    }
+    switch(format) {
+    case GEM_GRAY:
+      for(x=0; x<w; x++) {
+        data[x]=rgb2y(line[3*x+0], line[3*x+1], line[3*x+2]);
+      }
+      break;
+    case GEM_YUV:
+      for(x=0; x<w/2; x++) {
+        const unsigned char*p=line+6*x;
+        const int r=(p[0]+p[3])>>1;
+        const int g=(p[1]+p[4])>>1;
+        const int b=(p[2]+p[5])>>1;
+        data[chU ]=rgb2u(r, g, b);
+        data[chY0]=rgb2y(p[0], p[1], p[2]);
+        data[chV ]=rgb2v(r, g, b);
+        data[chY1]=rgb2y(p[3], p[4], p[5]);
+        data+=4;
+      }
+      break;
+    case GEM_RGB:
+      for(x=0; x<w; x++) {
+        data[rgbRed ]=line[3*x+0];
+        data[1      ]=line[3*x+1];
+        data[rgbBlue]=line[3*x+2];
+        data+=3;
+      }
+      break;
+    default:
+      for(x=0; x<w; x++) {
+        data[chRed  ]=line[3*x+0];
+        data[chGreen]=line[3*x+1];
+        data[chBlue ]=line[3*x+2];
+        data[chAlpha]=255;
+        data+=4;
+      }
+      break;
+    }
+  }
+  if(planeY) {
+    /* Gem has no planar format, so this exercises the conversion */
+    img.fromYU12(planeY);
+  }
+}
+
+bool TestPattern::setProperties(gem::Properties&props)
+{
+  bool changed=false;
+  double d;
+  std::string s;
+  if(props.get("width", d) && d>0) {
+    unsigned int w=(d>MAXSIZE)?MAXSIZE:(unsigned int)d;
+    changed|=(w!=m_width);
+    m_width=w;
+  }
+  if(props.get("height", d) && d>0) {
+    unsigned int h=(d>MAXSIZE)?MAXSIZE:(unsigned int)d;
+    changed|=(h!=m_height);
+    m_height=h;
+  }
+  if(props.get("format", s)) {
+    if("rgba"==s || "rgb"==s || "gray"==s || "yuv"==s || "yuv420"==s) {
+      changed|=(s!=m_format);
+      m_format=s;
+    }
+  }
+  /* "type" is the old name of "pattern" */
+  if(props.get("pattern", s) || props.get("type", s)) {
+    for(unsigned int i=0; i<sizeof(s_patterns)/sizeof(*s_patterns); i++) {
+      if(s==s_patterns[i]) {
+        changed|=(m_pattern!=i);
+        m_pattern=(enum Pattern)i;
+      }
+    }
+  }
+  if(props.get("counter", d)) {
+    changed|=(m_counter!=(d>0.5));
+    m_counter=(d>0.5);
+  }
+  return changed;
+}
+
+void TestPattern::getProperties(gem::Properties&props)
+{
+  std::vector<std::string>keys=props.keys();
+  for(unsigned int i=0; i<keys.size(); i++) {
+    const std::string key=keys[i];
+    if("width"==key) {
+      props.set(key, m_width);
+    } else if("height"==key) {
+      props.set(key, m_height);
+    } else if("format"==key) {
+      props.set(key, m_format);
+    } else if("pattern"==key || "type"==key) {
+      props.set(key, std::string(s_patterns[m_pattern]));
+    } else if("counter"==key) {
+      props.set(key, (int)m_counter);
+    }
+  }
+}
+
+void TestPattern::enumProperties(gem::Properties&readable,
+                                 gem::Properties&writeable)
+{
+  const std::string s;
+  readable.set("width", m_width);
+  writeable.set("width", m_width);
+  readable.set("height", m_height);
+  writeable.set("height", m_height);
+  readable.set("format", s);
+  writeable.set("format", s);
+  readable.set("pattern", s);
+  writeable.set("pattern", s);
+  readable.set("counter", 0);
+  writeable.set("counter", 0);
+}
@@ -0,0 +1,84 @@
+/*-----------------------------------------------------------------
+
+GEM - Graphics Environment for Multimedia
+
+generate deterministic test images
+
+Copyright (c) 2026 agent. agent@local
+For information on usage and redistribution, and for a DISCLAIMER OF ALL
+WARRANTIES, see the file, "GEM.LICENSE.TERMS" in this distribution.
+
+
+-----------------------------------------------------------------*/
+
+#ifndef _INCLUDE_GEMPLUGIN__TEST_TESTPATTERN_H_
+#define _INCLUDE_GEMPLUGIN__TEST_TESTPATTERN_H_
+#include "Gem/Image.h"
+
+#include <string>
+#include <vector>
+
+/*-----------------------------------------------------------------
+  -------------------------------------------------------------------
+  CLASS
+  TestPattern
+
+  renders frame #n of a (moving) test pattern into an imageStruct
+
+  the same frame number always gives the same image, so the TEST
+  backends can be used as a reproducible source for benchmarks
+
+  properties:
+  "width", "height": image size (up to 8192x8192)
+  "format": "rgba", "rgb", "gray", "yuv" (packed 4:2:2, as used by Gem)
+  or "yuv420" (planar 4:2:0, converted to Gem's "yuv")
+  "pattern": "noise", "red", "green", "blue", "bars", "gradient",
+  "checker" or "ramp" (a byte ramp, regardless of the format)
+  "counter": embed the frame number as 32 black/white blocks
+  in the top-left corner (MSB first)
+
+  -----------------------------------------------------------------*/
+namespace gem
+{
+class Properties;
+namespace plugins
+{
+class TestPattern
+{
+public:
+  static const unsigned int MAXSIZE=8192;
+
+  enum Pattern {
+    NOISE, RED, GREEN, BLUE, BARS, GRADIENT, CHECKER, RAMP
+  };
+
+  TestPattern(unsigned int width, unsigned int height, enum Pattern pattern);
+
+  /* render frame #'frame' into 'img' */
+  void render(imageStruct&img, unsigned long frame);
+
+  /* apply the properties we know about (returns TRUE if anything changed) */
+  bool setProperties(gem::Properties&props);
+  void getProperties(gem::Properties&props);
+  void enumProperties(gem::Properties&readable, gem::Properties&writeable);
+
+  unsigned int width(void) const;
+  unsigned int height(void) const;
+
+private:
+  unsigned int m_width, m_height;
+  enum Pattern m_pattern;
+  std::string m_format;
+  bool m_counter;
+
+  /* one line of RGB pixels */
+  std::vector<unsigned char>m_line;
+  /* the planes for "yuv420" */
+  std::vector<unsigned char>m_planar;
+
+  void renderLine(unsigned int y, unsigned long frame);
+};
+};
+};
+
+#endif  // for header file
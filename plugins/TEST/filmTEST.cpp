@@ -39,6 +39,9 @@ REGISTER_FILMFACTORY("test", filmTEST);
 filmTEST :: filmTEST(void)
   : m_fps(20)
   , m_numFrames(100)
+  , m_pattern(320, 240, TestPattern::RAMP)
+  , m_frame(0)
+  , m_produced(0), m_delivered(0)
 {
   m_image.image.setFormat(GEM_RGBA);
   m_image.image.xsize=320;
@@ -53,6 +56,9 @@ filmTEST :: filmTEST(void)
 bool filmTEST :: open(const std::string&filename,
                       const gem::Properties&wantProps)
 {
+  gem::Properties props=wantProps;
+  setProperties(props);
+  m_produced=m_delivered=0;
   changeImage(0,0);
 
   return true;
@@ -66,14 +72,30 @@ bool filmTEST::isThreadable(void)
 
 void filmTEST::setProperties(gem::Properties&props)
 {
+  double d;
+  if(props.get("fps", d) && d>0.) {
+    m_fps=d;
+  }
+  if(props.get("frames", d) && d>0.) {
+    m_numFrames=d;
+  }
+  if(m_pattern.setProperties(props)) {
+    changeImage(m_frame);
+  }
 }
 
 void filmTEST::getProperties(gem::Properties&props)
 {
+  /* format, pattern, counter */
+  m_pattern.getProperties(props);
+
   std::vector<std::string> keys=props.keys();
   unsigned int i=0;
   for(i=0; i<keys.size(); i++) {
     std::string key=keys[i];
+    if("format"==key || "pattern"==key || "counter"==key) {
+      continue;
+    }
     props.erase(key);
 #define SETPROP(k, v) } else if(k == key) { double d=(double)v; props.set(key, d)
     if(""==key) {
@@ -81,6 +103,8 @@ void filmTEST::getProperties(gem::Properties&props)
       SETPROP("frames", m_numFrames);
       SETPROP("width", m_image.image.xsize);
       SETPROP("height", m_image.image.ysize);
+      SETPROP("produced", m_produced);
+      SETPROP("delivered", m_delivered);
     }
   }
 }
@@ -92,21 +116,21 @@ void filmTEST::getProperties(gem::Properties&props)
 /////////////////////////////////////////////////////////
 pixBlock* filmTEST :: getFrame()
 {
+  if(m_image.newimage) {
+    m_delivered++;
+  }
   return &m_image;
 }
 
 film::errCode filmTEST :: changeImage(int imgNum, int trackNum)
 {
-  unsigned char*data=m_image.image.data;
-  unsigned int size=
-    m_image.image.xsize*m_image.image.ysize*m_image.image.csize;
-
-  unsigned char value=(unsigned char)imgNum;
-
-  while(size-->0) {
-    *data++=value;
-    value++;
+  if(imgNum<0) {
+    return film::FAILURE;
   }
+  /* the test pattern is the same for all tracks */
+  m_pattern.render(m_image.image, imgNum);
+  m_frame=imgNum;
+  m_produced++;
 
   m_image.newimage=true;
 
@@ -126,6 +150,13 @@ bool filmTEST::enumProperties(gem::Properties&readprops,
   readprops.set("height", d);
   readprops.set("fps", d);
   readprops.set("frames", d);
+  readprops.set("produced", d);
+  readprops.set("delivered", d);
+
+  writeprops.set("fps", d);
+  writeprops.set("frames", d);
+
+  m_pattern.enumProperties(readprops, writeprops);
 
   return true;
 }
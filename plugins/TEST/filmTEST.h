@@ -17,6 +17,7 @@ WARRANTIES, see the file, "GEM.LICENSE.TERMS" in this distribution.
 #define _INCLUDE_GEMPLUGIN__FILMTEST_FILMTEST_H_
 #include "plugins/film.h"
 #include "Gem/Image.h"
+#include "TestPattern.h"
 
 /*-----------------------------------------------------------------
   -------------------------------------------------------------------
@@ -69,6 +70,11 @@ public:
   pixBlock m_image;
   double m_fps;
   unsigned int m_numFrames;
+  TestPattern m_pattern;
+  int m_frame;
+
+  /* frames rendered by changeImage() and frames fetched via getFrame() */
+  unsigned long m_produced, m_delivered;
 };
 };
 };
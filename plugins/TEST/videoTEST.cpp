@@ -4,17 +4,13 @@ using namespace gem::plugins;
 
 REGISTER_VIDEOFACTORY("test", videoTEST);
 
-static double getRandom(void)
-{
-  static unsigned int random_nextseed = 1489853723;
-  random_nextseed = random_nextseed * 435898247 + 938284281;
-  return random_nextseed * (1./4294967296.);;
-}
-
 videoTEST::videoTEST(void) :
   m_name(std::string("test")),
   m_open(false),
-  m_type(0)
+  m_pattern(64, 64, TestPattern::NOISE),
+  m_fps(0.),
+  m_frame(-1),
+  m_produced(0), m_delivered(0)
 {
   m_pixBlock.image.xsize = 64;
   m_pixBlock.image.ysize = 64;
@@ -32,74 +28,35 @@ bool videoTEST::open(gem::Properties&props)
   return (m_open);
 }
 
-static void setNoise(unsigned char*data, unsigned int count)
-{
-  unsigned int i=0;
-  for(i=0; i<count; i++) {
-    data[chRed]=(255*getRandom());
-    data[chGreen]=(255*getRandom());
-    data[chBlue]=(255*getRandom());
-    data[chAlpha]=255;
-    data+=4;
-  }
-}
-static void setRed(unsigned char*data, unsigned int count)
-{
-  unsigned int i=0;
-  for(i=0; i<count; i++) {
-    data[chRed]=255;
-    data[chGreen]=0;
-    data[chBlue]=0;
-    data[chAlpha]=255;
-    data+=4;
-  }
-}
-static void setGreen(unsigned char*data, unsigned int count)
-{
-  unsigned int i=0;
-  for(i=0; i<count; i++) {
-    data[chRed]=0;
-    data[chGreen]=255;
-    data[chBlue]=0;
-    data[chAlpha]=255;
-    data+=4;
-  }
-}
-static void setBlue(unsigned char*data, unsigned int count)
+bool videoTEST::start(void)
 {
-  unsigned int i=0;
-  for(i=0; i<count; i++) {
-    data[chRed]=0;
-    data[chGreen]=0;
-    data[chBlue]=255;
-    data[chAlpha]=255;
-    data+=4;
-  }
+  m_startTime=std::chrono::steady_clock::now();
+  m_frame=-1;
+  m_produced=m_delivered=0;
+  return true;
 }
 
 pixBlock*videoTEST::getFrame(void)
 {
-  m_pixBlock.image.setFormat(GEM_RGBA);
-  m_pixBlock.image.reallocate();
-  const unsigned int count = m_pixBlock.image.xsize * m_pixBlock.image.ysize;
-  unsigned int i=0;
-  unsigned char*data=m_pixBlock.image.data;
-
-  switch(m_type) {
-  case  1:
-    setRed(data, count);
-    break;
-  case  2:
-    setGreen(data, count);
-    break;
-  case  3:
-    setBlue(data, count);
-    break;
-  default:
-    setNoise(data, count);
-    break;
+  long frame=m_frame+1;
+  if(m_fps>0.) {
+    /* which frame is due now? */
+    double elapsed=std::chrono::duration<double>
+                   (std::chrono::steady_clock::now() - m_startTime).count();
+    frame=(long)(elapsed*m_fps);
+  }
+
+  if(frame==m_frame) {
+    /* nothing new (newimage is reset in releaseFrame()) */
+    return &m_pixBlock;
   }
 
+  m_produced+=frame-m_frame;
+  m_delivered++;
+  m_frame=frame;
+
+  m_pattern.render(m_pixBlock.image, frame);
+  m_pixBlock.sequence = frame+1;
   m_pixBlock.newimage = true;
 
   return &m_pixBlock;
@@ -128,13 +85,15 @@ bool videoTEST::enumProperties(gem::Properties&readable,
   readable.clear();
   writeable.clear();
 
+  m_pattern.enumProperties(readable, writeable);
 
-  writeable.set("width", 64);
-  readable.set("width", 64);
-  writeable.set("height", 64);
-  readable.set("height", 64);
+  writeable.set("fps", 0);
+  readable.set("fps", 0);
 
-  writeable.set("type", std::string("noise"));
+  /* statistics */
+  readable.set("produced", 0);
+  readable.set("delivered", 0);
+  readable.set("missed", 0);
   return true;
 }
 void videoTEST::setProperties(gem::Properties&props)
@@ -142,39 +101,35 @@ void videoTEST::setProperties(gem::Properties&props)
   m_props=props;
 
   double d;
-  if(props.get("width", d)) {
-    if(d>0) {
-      m_pixBlock.image.xsize = d;
-    }
-  }
-  if(props.get("height", d)) {
-    if(d>0) {
-      m_pixBlock.image.ysize = d;
-    }
+  if(m_pattern.setProperties(props) && m_frame>=0) {
+    /* re-render the current frame */
+    m_pattern.render(m_pixBlock.image, m_frame);
+    m_pixBlock.newimage = true;
   }
-  std::string s;
-  if(props.get("type", s)) {
-    if("noise"==s) {
-      m_type=0;
-    } else if("red"==s) {
-      m_type=1;
-    } else if("green"==s) {
-      m_type=2;
-    } else if("blue"==s) {
-      m_type=3;
+  if(props.get("fps", d)) {
+    if(d>=0.) {
+      m_fps=d;
+      start();
     }
   }
 }
 void videoTEST::getProperties(gem::Properties&props)
 {
+  m_pattern.getProperties(props);
   std::vector<std::string>keys=props.keys();
   unsigned int i;
   for(i=0; i<keys.size(); i++) {
-    if("width"==keys[i]) {
-      props.set(keys[i], m_pixBlock.image.xsize);
+    if("fps"==keys[i]) {
+      props.set(keys[i], m_fps);
+    }
+    if("produced"==keys[i]) {
+      props.set(keys[i], (double)m_produced);
+    }
+    if("delivered"==keys[i]) {
+      props.set(keys[i], (double)m_delivered);
     }
-    if("height"==keys[i]) {
-      props.set(keys[i], m_pixBlock.image.ysize);
+    if("missed"==keys[i]) {
+      props.set(keys[i], (double)(m_produced-m_delivered));
     }
   }
 }
@@ -3,6 +3,9 @@
 
 #include "plugins/video.h"
 #include "Gem/Image.h"
+#include "TestPattern.h"
+
+#include <chrono>
 
 namespace gem
 {
@@ -15,7 +18,16 @@ private:
   bool m_open;
   pixBlock m_pixBlock;
   Properties m_props;
-  unsigned int m_type;
+  TestPattern m_pattern;
+
+  /* frames per second (0: a new frame for each request) */
+  double m_fps;
+  std::chrono::steady_clock::time_point m_startTime;
+  /* the number of the frame currently in m_pixBlock (-1: none) */
+  long m_frame;
+
+  /* frames the source produced (at its rate) and frames actually delivered */
+  unsigned long m_produced, m_delivered;
 public:
   videoTEST(void);
 
@@ -52,7 +64,10 @@ public:
   {
     return true;
   }
-  virtual void releaseFrame(void) {}
+  virtual void releaseFrame(void)
+  {
+    m_pixBlock.newimage = false;
+  }
   virtual bool grabAsynchronous(bool)
   {
     return true;
@@ -69,10 +84,7 @@ public:
 
 
   virtual void close(void) {};
-  virtual bool start(void)
-  {
-    return true;
-  };
+  virtual bool start(void);
   virtual bool stop(void)
   {
     return true;
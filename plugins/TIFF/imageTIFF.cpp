@@ -32,6 +32,12 @@ extern "C"
 #include "plugins/PluginFactory.h"
 
 #include "Gem/RTE.h"
+#include "Utils/Thread.h"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
 
 
 using namespace gem::plugins;
@@ -90,6 +96,206 @@ static t_imageTIFF_handlers imageTIFF_sethandlers(void)
 #define tiffhandlers_init()   t_imageTIFF_handlers tiffhandler = imageTIFF_sethandlers()
 #define tiffhandlers_cleanup() imageTIFF_sethandlers(tiffhandler)
 
+/* strips are written with (at least) this many bytes, so there is enough
+ * work per strip to compress them in parallel */
+static const size_t STRIPSIZE = 256*1024;
+/* don't bother spawning decoder threads for images smaller than this */
+static const size_t THREADSIZE = 1024*1024;
+
+static double getMBps(size_t bytes, double ms)
+{
+  return (ms>0.)?(bytes / (1024.*1024.) * 1000. / ms):0.;
+}
+
+/* copy 'width' 8bit pixels (with 'samps' samples each) into Gem's GRAY/RGBA */
+static void convertRow(const unsigned char*inp, unsigned char*pixels,
+                       uint32_t width, int samps)
+{
+  if (samps == 1) {
+    memcpy(pixels, inp, width);         // Gray8
+  } else if (samps == 3)  {
+    for (uint32_t i = 0; i < width; i++) {
+      pixels[chRed]   = inp[0];   // Red
+      pixels[chGreen] = inp[1];   // Green
+      pixels[chBlue]  = inp[2];   // Blue
+      pixels[chAlpha] = 255;      // Alpha
+      pixels += 4;
+      inp += 3;
+    }
+  } else {
+    for (uint32_t i = 0; i < width; i++) {
+      pixels[chRed]   = inp[0];   // Red
+      pixels[chGreen] = inp[1];   // Green
+      pixels[chBlue]  = inp[2];   // Blue
+      pixels[chAlpha] = inp[3];   // Alpha
+      pixels += 4;
+      inp += 4;
+    }
+  }
+}
+
+/* decode the strips (or tiles) [first..last) of 'tif' into 'img' */
+static bool readUnits(TIFF*tif, uint32_t first, uint32_t last,
+                      imageStruct&img, int samps)
+{
+  const uint32_t width = img.xsize, height = img.ysize;
+  const size_t yStride = img.xsize * img.csize;
+
+  if (TIFFIsTiled(tif)) {
+    uint32_t tw = 0, th = 0;
+    TIFFGetField(tif, TIFFTAG_TILEWIDTH, &tw);
+    TIFFGetField(tif, TIFFTAG_TILELENGTH, &th);
+    if (!tw || !th) {
+      return false;
+    }
+    const uint32_t across = (width + tw - 1) / tw;
+    const size_t rowsize = TIFFTileRowSize(tif);
+    std::vector<unsigned char>buf(TIFFTileSize(tif));
+    for (uint32_t tile = first; tile < last; tile++) {
+      if (TIFFReadEncodedTile(tif, tile, &buf[0], buf.size()) < 0) {
+        return false;
+      }
+      const uint32_t x0 = (tile % across) * tw, y0 = (tile / across) * th;
+      if (y0 >= height) {
+        continue;
+      }
+      const uint32_t w = std::min(tw, width - x0), h = std::min(th, height - y0);
+      for (uint32_t row = 0; row < h; row++) {
+        convertRow(&buf[row * rowsize],
+                   img.data + (y0 + row) * yStride + x0 * img.csize,
+                   w, samps);
+      }
+    }
+    return true;
+  }
+
+  uint32_t rowsperstrip = height;
+  TIFFGetFieldDefaulted(tif, TIFFTAG_ROWSPERSTRIP, &rowsperstrip);
+  if (!rowsperstrip || rowsperstrip > height) {
+    rowsperstrip = height;
+  }
+  const size_t rowsize = TIFFScanlineSize(tif);
+  std::vector<unsigned char>buf(rowsize * rowsperstrip);
+  for (uint32_t strip = first; strip < last; strip++) {
+    const uint32_t y0 = strip * rowsperstrip;
+    if (y0 >= height) {
+      break;
+    }
+    const uint32_t h = std::min(rowsperstrip, height - y0);
+    if (TIFFReadEncodedStrip(tif, strip, &buf[0], h * rowsize) < 0) {
+      return false;
+    }
+    for (uint32_t row = 0; row < h; row++) {
+      convertRow(&buf[row * rowsize], img.data + (y0 + row) * yStride, width,
+                 samps);
+    }
+  }
+  return true;
+}
+
+/* an in-memory file, so strips can be compressed by libtiff without
+ * touching the (shared) output file */
+struct MemFile {
+  std::vector<unsigned char>data;
+  size_t pos;
+  MemFile(void) : pos(0) {}
+};
+static tsize_t memRead(thandle_t h, tdata_t buf, tsize_t size)
+{
+  MemFile*f = reinterpret_cast<MemFile*>(h);
+  if (f->pos >= f->data.size()) {
+    return 0;
+  }
+  size_t n = std::min((size_t)size, f->data.size() - f->pos);
+  memcpy(buf, &f->data[f->pos], n);
+  f->pos += n;
+  return n;
+}
+static tsize_t memWrite(thandle_t h, tdata_t buf, tsize_t size)
+{
+  MemFile*f = reinterpret_cast<MemFile*>(h);
+  if (f->data.size() < f->pos + size) {
+    f->data.resize(f->pos + size);
+  }
+  memcpy(&f->data[f->pos], buf, size);
+  f->pos += size;
+  return size;
+}
+static toff_t memSeek(thandle_t h, toff_t off, int whence)
+{
+  MemFile*f = reinterpret_cast<MemFile*>(h);
+  switch(whence) {
+  case SEEK_CUR:
+    f->pos += off;
+    break;
+  case SEEK_END:
+    f->pos = f->data.size() + off;
+    break;
+  default:
+    f->pos = off;
+    break;
+  }
+  return f->pos;
+}
+static int memClose(thandle_t h)
+{
+  return 0;
+}
+static toff_t memSize(thandle_t h)
+{
+  return reinterpret_cast<MemFile*>(h)->data.size();
+}
+static int memMap(thandle_t h, tdata_t*base, toff_t*size)
+{
+  return 0;
+}
+static void memUnmap(thandle_t h, tdata_t base, toff_t size)
+{
+}
+
+/* set the tags that determine how a strip is encoded */
+static void setEncoding(TIFF*tif, uint32_t width, uint32_t height,
+                        uint32_t rowsperstrip, short samps, uint16_t compression)
+{
+  TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, width);
+  TIFFSetField(tif, TIFFTAG_IMAGELENGTH, height);
+  TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 8);
+  TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, samps);
+  TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+  TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_RGB);
+  TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, rowsperstrip);
+  TIFFSetField(tif, TIFFTAG_COMPRESSION, compression);
+  if (COMPRESSION_NONE != compression) {
+    TIFFSetField(tif, TIFFTAG_PREDICTOR, PREDICTOR_HORIZONTAL);
+  }
+}
+
+/* compress a single strip (of 'rows' lines) into 'result'
+ * by writing it into a throwaway in-memory TIFF */
+static bool encodeStrip(const unsigned char*data, uint32_t width,
+                        uint32_t rows, short samps, uint16_t compression,
+                        std::vector<unsigned char>&result)
+{
+  MemFile mem;
+  TIFF*tif = TIFFClientOpen("strip", "w", reinterpret_cast<thandle_t>(&mem),
+                            memRead, memWrite, memSeek, memClose, memSize,
+                            memMap, memUnmap);
+  if (!tif) {
+    return false;
+  }
+  setEncoding(tif, width, rows, rows, samps, compression);
+  const size_t size = width * samps * rows;
+  /* libtiff appends the encoded strip to the end of the file */
+  const size_t start = mem.data.size();
+  bool success = (TIFFWriteEncodedStrip(tif, 0,
+                                        const_cast<unsigned char*>(data), size) >= 0);
+  if (success) {
+    result.assign(mem.data.begin() + start, mem.data.end());
+  }
+  TIFFClose(tif);
+  return success;
+}
+
 
 };
 
@@ -123,20 +329,26 @@ bool imageTIFF :: load(std::string filename, imageStruct&result,
                        gem::Properties&props)
 {
   tiffhandlers_init();
-  TIFF *tif = TIFFOpen(filename.c_str(), "r");
+  const std::chrono::steady_clock::time_point start =
+    std::chrono::steady_clock::now();
+  /* 'M': read the file through a memory-mapping */
+  TIFF *tif = TIFFOpen(filename.c_str(), "rM");
   if (tif == NULL) {
     tiffhandlers_cleanup();
     return false;
   }
 
   uint32_t width, height;
-  uint16_t orientation;
+  uint16_t orientation = ORIENTATION_TOPLEFT;
+  uint16_t planar = PLANARCONFIG_CONTIG, compression = COMPRESSION_NONE;
   short bits, samps;
   TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &width);
   TIFFGetField(tif, TIFFTAG_IMAGELENGTH, &height);
   TIFFGetField(tif, TIFFTAG_BITSPERSAMPLE, &bits);
   TIFFGetField(tif, TIFFTAG_SAMPLESPERPIXEL, &samps);
   TIFFGetField(tif, TIFFTAG_ORIENTATION, &orientation);
+  TIFFGetFieldDefaulted(tif, TIFFTAG_PLANARCONFIG, &planar);
+  TIFFGetFieldDefaulted(tif, TIFFTAG_COMPRESSION, &compression);
 
   int npixels = width * height;
 
@@ -145,8 +357,13 @@ bool imageTIFF :: load(std::string filename, imageStruct&result,
   result.upsidedown=(ORIENTATION_BOTLEFT != orientation);
 
   bool knownFormat = false;
+  unsigned int threads = 1;
+  // separate planes are left to the automatic conversion
+  if (PLANARCONFIG_CONTIG != planar) {
+    knownFormat = false;
+  }
   // Is it a gray8 image?
-  if (bits == 8 && samps == 1) {
+  else if (bits == 8 && samps == 1) {
     result.setFormat(GEM_GRAY);
     knownFormat = true;
   }
@@ -163,53 +380,44 @@ bool imageTIFF :: load(std::string filename, imageStruct&result,
 
   // can we handle the raw data?
   if (knownFormat) {
-    unsigned char *buf = new unsigned char [TIFFScanlineSize(tif)];
-    if (buf == NULL) {
-      pd_error(0, "[GEM:imageTIFF] can't allocate memory for scanline buffer: %s",
-               filename.c_str());
-      TIFFClose(tif);
-      tiffhandlers_cleanup();
-      return false;
-    }
-
     result.reallocate();
-    unsigned char *dstLine = result.data;
-    int yStride = result.xsize * result.csize;
-    for (uint32_t row = 0; row < height; row++) {
-      unsigned char *pixels = dstLine;
-      if (TIFFReadScanline(tif, buf, row, 0) < 0) {
-        verbose(1, "[GEM:imageTIFF] bad image data read on line: %d: %s", row,
-                filename.c_str());
-        TIFFClose(tif);
-        return false;
+
+    /* read whole strips (or tiles) rather than single lines;
+     * compressed images are decoded in parallel,
+     * with each thread using its own handle on the (mapped) file */
+    const uint32_t units = TIFFIsTiled(tif)
+                           ? TIFFNumberOfTiles(tif) : TIFFNumberOfStrips(tif);
+    const size_t size = result.xsize * result.ysize * result.csize;
+    if (COMPRESSION_NONE != compression && size >= THREADSIZE) {
+      threads = std::min<unsigned int>(gem::thread::getCPUCount(), units);
+      if (threads < 1) {
+        threads = 1;
       }
-      unsigned char *inp = buf;
-      if (samps == 1) {
-        for (uint32_t i = 0; i < width; i++) {
-          *pixels++ = *inp++;         // Gray8
-        }
-      } else if (samps == 3)  {
-        for (uint32_t i = 0; i < width; i++) {
-          pixels[chRed]   = inp[0];   // Red
-          pixels[chGreen] = inp[1];   // Green
-          pixels[chBlue]  = inp[2];   // Blue
-          pixels[chAlpha] = 255;      // Alpha
-          pixels += 4;
-          inp += 3;
-        }
-      } else {
-        for (uint32_t i = 0; i < width; i++) {
-          pixels[chRed]   = inp[0];   // Red
-          pixels[chGreen] = inp[1];   // Green
-          pixels[chBlue]  = inp[2];   // Blue
-          pixels[chAlpha] = inp[3];   // Alpha
-          pixels += 4;
-          inp += 4;
+    }
+    std::vector<char>success(threads, 0);
+    std::vector<std::thread>workers;
+    for (unsigned int t = 1; t < threads; t++) {
+      const uint32_t first = units * t / threads, last = units * (t + 1) / threads;
+      workers.push_back(std::thread([&, first, last, t]() {
+        TIFF*wtif = TIFFOpen(filename.c_str(), "rM");
+        if (wtif) {
+          success[t] = readUnits(wtif, first, last, result, samps);
+          TIFFClose(wtif);
         }
+      }));
+    }
+    success[0] = readUnits(tif, 0, units / threads, result, samps);
+    for (unsigned int t = 0; t < workers.size(); t++) {
+      workers[t].join();
+    }
+    for (unsigned int t = 0; t < threads; t++) {
+      if (!success[t]) {
+        verbose(1, "[GEM:imageTIFF] bad image data in '%s'", filename.c_str());
+        TIFFClose(tif);
+        tiffhandlers_cleanup();
+        return false;
       }
-      dstLine += yStride;
     }
-    delete [] buf;
   }
   // nope, so use the automatic conversion
   else {
@@ -305,6 +513,15 @@ bool imageTIFF :: load(std::string filename, imageStruct&result,
   }
 
   TIFFClose(tif);
+  tiffhandlers_cleanup();
+
+  const double ms = std::chrono::duration<double, std::milli>
+                    (std::chrono::steady_clock::now() - start).count();
+  const size_t bytes = result.xsize * result.ysize * result.csize;
+  props.set("decodetime", ms);
+  verbose(1, "[GEM:imageTIFF] read '%s' (%dx%d, %d thread%s) in %.2f ms: %.1f MB/s",
+          filename.c_str(), result.xsize, result.ysize, threads,
+          (threads>1)?"s":"", ms, getMBps(bytes, ms));
 
   const char*orient=0;
   switch(orientation) {
@@ -336,6 +553,8 @@ bool imageTIFF::save(const imageStruct&constimage,
                      const gem::Properties&props)
 {
   tiffhandlers_init();
+  const std::chrono::steady_clock::time_point start =
+    std::chrono::steady_clock::now();
   TIFF *tif = NULL;
   imageStruct image;
 
@@ -348,9 +567,7 @@ bool imageTIFF::save(const imageStruct&constimage,
   image.fixUpDown();
 
   uint32_t width=image.xsize, height = image.ysize;
-  short bits=8, samps=image.csize;
-  int npixels = width * height;
-  //int planar_conf = PLANARCONFIG_CONTIG;
+  short samps=image.csize;
   std::string software = "PD/GEM";
   std::string artist;
   std::string hostcomputer;
@@ -375,13 +592,42 @@ bool imageTIFF::save(const imageStruct&constimage,
   props.get("artist", artist);
   props.get("hostcomputer", hostcomputer);
 
+  uint16_t compression = COMPRESSION_NONE;
+  std::string compression_s;
+  if(props.get("compression", compression_s)) {
+    if("lzw"==compression_s) {
+      compression=COMPRESSION_LZW;
+    } else if(("deflate"==compression_s) || ("zip"==compression_s)) {
+      compression=COMPRESSION_ADOBE_DEFLATE;
+    } else if("none"!=compression_s) {
+      verbose(0, "[GEM:imageTIFF] unknown compression '%s'", compression_s.c_str());
+    }
+  }
+  if(!TIFFIsCODECConfigured(compression)) {
+    verbose(0, "[GEM:imageTIFF] compression '%s' not available",
+            compression_s.c_str());
+    compression=COMPRESSION_NONE;
+  }
+  double d_threads=0;
+  props.get("threads", d_threads);
+  unsigned int threads=(d_threads>=1.)?(unsigned int)d_threads:gem::thread::getCPUCount();
+
+  const size_t yStride = image.xsize * image.csize;
+  uint32_t rowsperstrip = yStride?(STRIPSIZE + yStride - 1) / yStride:1;
+  if (rowsperstrip > height) {
+    rowsperstrip = height;
+  }
+  if (rowsperstrip < 1) {
+    rowsperstrip = 1;
+  }
+  const uint32_t strips = (height + rowsperstrip - 1) / rowsperstrip;
+  if(COMPRESSION_NONE==compression) {
+    /* nothing to parallelize */
+    threads=1;
+  }
+  threads=std::max<unsigned int>(1, std::min<unsigned int>(threads, strips));
 
-  TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, width);
-  TIFFSetField(tif, TIFFTAG_IMAGELENGTH, height);
-  TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, bits);
-  TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, samps);
-  TIFFSetField(tif, TIFFTAG_PLANARCONFIG, 1);
-  TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_RGB);
+  setEncoding(tif, width, height, rowsperstrip, samps, compression);
 
   TIFFSetField(tif, TIFFTAG_XRESOLUTION, xresolution); // RATIONAL
   TIFFSetField(tif, TIFFTAG_YRESOLUTION, yresolution); // RATIONAL
@@ -400,22 +646,56 @@ bool imageTIFF::save(const imageStruct&constimage,
     TIFFSetField(tif, TIFFTAG_HOSTCOMPUTER, hostcomputer.c_str());
   }
 
-  int yStride = image.xsize * image.csize;
-  unsigned char *srcLine = image.data;
-
-  for (uint32_t row = 0; row < height; row++) {
-    if (TIFFWriteScanline(tif, srcLine, row, 0) < 0) {
-      verbose(0, "[GEM:imageTIFF] could not write line %d to image '%s'", row,
-              filename.c_str());
-      TIFFClose(tif);
-      tiffhandlers_cleanup();
-      return false;
+  bool success = true;
+  if (threads < 2) {
+    for (uint32_t strip = 0; success && strip < strips; strip++) {
+      const uint32_t rows = std::min(rowsperstrip, height - strip * rowsperstrip);
+      success = (TIFFWriteEncodedStrip(tif, strip,
+                                       image.data + strip * rowsperstrip * yStride,
+                                       rows * yStride) >= 0);
+    }
+  } else {
+    /* libtiff can only encode one strip at a time per file,
+     * so the strips are compressed (in parallel) into memory first,
+     * and then written in order as raw strips */
+    std::vector<std::vector<unsigned char> >encoded(strips);
+    std::vector<char>encodedOK(strips, 0);
+    std::vector<std::thread>workers;
+    for (unsigned int t = 0; t < threads; t++) {
+      workers.push_back(std::thread([&, t]() {
+        for (uint32_t strip = t; strip < strips; strip += threads) {
+          const uint32_t rows = std::min(rowsperstrip, height - strip * rowsperstrip);
+          encodedOK[strip] = encodeStrip(image.data + strip * rowsperstrip * yStride,
+                                         width, rows, samps, compression,
+                                         encoded[strip]);
+        }
+      }));
+    }
+    for (unsigned int t = 0; t < threads; t++) {
+      workers[t].join();
     }
-    srcLine += yStride;
+    for (uint32_t strip = 0; success && strip < strips; strip++) {
+      success = encodedOK[strip]
+                && (TIFFWriteRawStrip(tif, strip, &encoded[strip][0],
+                                      encoded[strip].size()) >= 0);
+    }
+  }
+  if (!success) {
+    verbose(0, "[GEM:imageTIFF] could not write image '%s'", filename.c_str());
+    TIFFClose(tif);
+    tiffhandlers_cleanup();
+    return false;
   }
   TIFFClose(tif);
 
   tiffhandlers_cleanup();
+
+  const double ms = std::chrono::duration<double, std::milli>
+                    (std::chrono::steady_clock::now() - start).count();
+  verbose(1, "[GEM:imageTIFF] wrote '%s' (%dx%d, %s, %d thread%s) in %.2f ms: %.1f MB/s",
+          filename.c_str(), width, height,
+          compression_s.empty()?"none":compression_s.c_str(),
+          threads, (threads>1)?"s":"", ms, getMBps(height * yStride, ms));
   return true;
 }
 
@@ -447,6 +727,9 @@ float imageTIFF::estimateSave(const imageStruct&img,
   if(gem::Properties::UNSET != props.type("hostcomputer")) {
     result+=1.;
   }
+  if(gem::Properties::UNSET != props.type("compression")) {
+    result+=1.;
+  }
 
   return result;
 }
@@ -475,5 +758,11 @@ void imageTIFF::getWriteCapabilities(std::vector<std::string>&mimetypes,
   value=std::string("");
   props.set("artist", value);
   props.set("hostcomputer", value);
+  /* "none", "lzw" or "deflate" */
+  value=std::string("none");
+  props.set("compression", value);
+  /* number of threads used for compressing (0: one per CPU) */
+  value=0.f;
+  props.set("threads", value);
 }
 #endif
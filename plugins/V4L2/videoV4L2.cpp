@@ -24,6 +24,7 @@ using namespace gem::plugins;
 
 #include "Gem/RTE.h"
 #include "Gem/Files.h"
+#include "Utils/Latency.h"
 
 #ifndef HAVE_LIBV4L2
 # define v4l2_open ::open
@@ -85,11 +86,15 @@ videoV4L2 :: videoV4L2() : videoBase("v4l2", 0)
   , m_gotFormat(0), m_colorConvert(0),
   m_tvfd(0),
   m_buffers(NULL), m_nbuffers(0),
-  m_currentBuffer(NULL),
+  m_readyBuffer(-1), m_heldBuffer(-1), m_readyTime(0.), m_readySequence(0),
+  m_zeroCopy(true), m_pollTimeout(100),
+  m_captured(0), m_dropped(0), m_driverDropped(0), m_delivered(0),
+  m_lastSequence(-1),
+  m_latency(0.), m_maxLatency(0.),
   m_frame(0), m_last_frame(0),
   m_maxwidth(844), m_minwidth(32),
   m_maxheight(650), m_minheight(32),
-  m_thread_id(0), m_continue_thread(false), m_frame_ready(false),
+  m_thread_id(0), m_continue_thread(false),
   m_rendering(false),
   m_stopTransfer(false),
   m_frameSize(0)
@@ -141,6 +146,15 @@ static int xioctl(int                    fd,
   return r;
 }
 
+/* the current time in ms
+ * (gem::utils::monotonicTime() is based on CLOCK_MONOTONIC,
+ *  which is also used for V4L2 buffer timestamps)
+ */
+static double monotonic_ms(void)
+{
+  return gem::utils::monotonicTime();
+}
+
 static int reqbufs(int fd, unsigned int numbufs)
 {
   struct v4l2_requestbuffers req;
@@ -229,96 +243,105 @@ void *videoV4L2 :: capturing(void)
 {
   int errorcount=0;
 
-  t_v4l2_buffer*buffers=m_buffers;
-  void *currentBuffer=NULL;
-
   const __u32 expectedSize=m_frameSize;
-  __u32 gotSize=0;
-
+  const int nbuf=m_nbuffers;
 
   struct v4l2_buffer buf;
-  int nbuf=m_nbuffers;
-
-  fd_set fds;
-  struct timeval tv;
+  struct pollfd pfd;
 
   m_capturing=true;
 
-  debugThread("V4L2: memset");
-  memset(&(buf), 0, sizeof (buf));
-
-  buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-  buf.memory = V4L2_MEMORY_MMAP;
-
   while(m_continue_thread) {
     bool captureerror=false;
-    FD_ZERO (&fds);
-    FD_SET (m_tvfd, &fds);
 
     debugThread("V4L2: grab");
 
-    m_frame++;
-    m_frame%=nbuf;
-
-
-    /* Timeout. */
-    tv.tv_sec = 0;
-    tv.tv_usec = 100;
-    int r = select(0,0,0,0,&tv);
+    /* wait until the driver has filled a buffer
+     * (with a timeout, so we notice when we are told to stop) */
+    pfd.fd=m_tvfd;
+    pfd.events=POLLIN;
+    pfd.revents=0;
+    int r = poll(&pfd, 1, m_pollTimeout);
     debugThread("V4L2: waited...");
 
-
     if (-1 == r) {
       if (EINTR == errno) {
         continue;
       }
-      perror("[GEM:videoV4L2] select");//exit
+      perror("[GEM:videoV4L2] poll");
+      captureerror=true;
+    } else if (0 == r) {
+      /* timeout: no frame yet */
+      continue;
+    } else if (pfd.revents & (POLLERR | POLLHUP | POLLNVAL)) {
+      captureerror=true;
     }
 
-    memset(&(buf), 0, sizeof (buf));
-    debugThread("V4L2: memset...");
-
-    buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    buf.memory = V4L2_MEMORY_MMAP;
+    if(!captureerror) {
+      memset(&(buf), 0, sizeof (buf));
+      buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+      buf.memory = V4L2_MEMORY_MMAP;
 
-    if (-1 == xioctl (m_tvfd, VIDIOC_DQBUF, &buf)) {
-      switch (errno) {
-      /* coverity[unterminated_case] */
-      case EAGAIN:
-        perror("[GEM:videoV4L2] VIDIOC_DQBUF: stopping capture thread!");
-        m_stopTransfer=true;
-        m_continue_thread=false;
-      /* coverity[unterminated_case] */
-      case EIO:
-      /* Could ignore EIO, see spec. */
-      /* fall through */
-      default:
-        captureerror=true;
-        perror("[GEM:videoV4L2] VIDIOC_DQBUF");
+      if (-1 == xioctl (m_tvfd, VIDIOC_DQBUF, &buf)) {
+        switch (errno) {
+        case EAGAIN:
+          /* spurious wakeup */
+          continue;
+        case EIO:
+        /* Could ignore EIO, see spec. */
+        /* fall through */
+        default:
+          captureerror=true;
+          perror("[GEM:videoV4L2] VIDIOC_DQBUF");
+        }
       }
     }
 
-    debugThread("V4L2: grabbed %d", buf.index);
-
-    gotSize=buf.bytesused;
-    currentBuffer=buffers[buf.index].start;
-    //process_image (m_buffers[buf.index].start);
-
-    if (-1 == xioctl (m_tvfd, VIDIOC_QBUF, &buf)) {
-      perror("[GEM:videoV4L2] VIDIOC_QBUF");
+    if(!captureerror && (buf.index >= (__u32)nbuf)) {
       captureerror=true;
     }
 
-    debugThread("V4L2: dequeueued");
+    if(!captureerror) {
+      debugThread("V4L2: grabbed %d", buf.index);
+      m_frame=buf.index;
 
-    if(expectedSize<=gotSize) {
-      m_frame_ready = 1;
-      m_last_frame=m_frame;
-      m_currentBuffer=currentBuffer;
-    } else {
-      fprintf(stderr,
-              "[GEM:videoV4L2] oops, skipping incomplete capture %d of %d bytes\n",
-              gotSize, expectedSize);
+      double captime=monotonic_ms();
+#ifdef V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC
+      if(V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC == (buf.flags &
+          V4L2_BUF_FLAG_TIMESTAMP_MASK)) {
+        captime=buf.timestamp.tv_sec*1000. + buf.timestamp.tv_usec/1000.;
+      }
+#endif
+
+      if(expectedSize<=buf.bytesused) {
+        int dropBuffer=-1;
+        std::unique_lock<std::mutex>lock(m_bufferMutex);
+        m_captured++;
+        if(m_lastSequence>=0 && buf.sequence > (__u32)m_lastSequence + 1) {
+          m_driverDropped+=buf.sequence - m_lastSequence - 1;
+        }
+        m_lastSequence=buf.sequence;
+        /* the previous frame was never picked up: give it back */
+        if(m_readyBuffer>=0) {
+          dropBuffer=m_readyBuffer;
+          m_dropped++;
+        }
+        m_readyBuffer=buf.index;
+        m_readyTime=captime;
+        m_readySequence=buf.sequence;
+        m_last_frame=m_frame;
+        lock.unlock();
+        if(dropBuffer>=0 && !requeue(dropBuffer)) {
+          captureerror=true;
+        }
+      } else {
+        fprintf(stderr,
+                "[GEM:videoV4L2] oops, skipping incomplete capture %d of %d bytes\n",
+                buf.bytesused, expectedSize);
+        if(!requeue(buf.index)) {
+          captureerror=true;
+        }
+      }
     }
 
     if(captureerror) {
@@ -329,6 +352,8 @@ void *videoV4L2 :: capturing(void)
         m_continue_thread=false;
         m_stopTransfer=true;
       }
+      /* don't spin on a broken device */
+      usleep(100);
     } else {
       errorcount=0;
     }
@@ -340,6 +365,20 @@ void *videoV4L2 :: capturing(void)
   return NULL;
 }
 
+bool videoV4L2 :: requeue(int index)
+{
+  struct v4l2_buffer buf;
+  memset(&(buf), 0, sizeof (buf));
+  buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  buf.memory = V4L2_MEMORY_MMAP;
+  buf.index = index;
+  if (-1 == xioctl (m_tvfd, VIDIOC_QBUF, &buf)) {
+    perror("[GEM:videoV4L2] VIDIOC_QBUF");
+    return false;
+  }
+  return true;
+}
+
 //////////////////
 // this reads the data that was captured by capturing() and returns it within a pixBlock
 pixBlock *videoV4L2 :: getFrame()
@@ -353,56 +392,93 @@ pixBlock *videoV4L2 :: getFrame()
     m_rendering=rendering;
     return NULL;
   }
-  //debugPost("v4l2: getting frame %d", m_frame_ready);
   m_image.newfilm=0;
-  if (!m_frame_ready) {
+
+  std::unique_lock<std::mutex>lock(m_bufferMutex);
+  const int index=m_readyBuffer;
+  const double captime=m_readyTime;
+  const unsigned long sequence=m_readySequence;
+  m_readyBuffer=-1;
+  lock.unlock();
+
+  if (index<0) {
     m_image.newimage = 0;
-  } else {
-    unsigned char*data=(unsigned char*)m_currentBuffer;
-    if (m_colorConvert) {
-      m_image.image.not_owned = false;
-      switch(m_gotFormat) {
+    return &m_image;
+  }
+
+  if(m_heldBuffer>=0) {
+    /* the new frame replaces the previous one */
+    requeue(m_heldBuffer);
+  }
+  unsigned char*data=(unsigned char*)m_buffers[index].start;
+  /* the buffer stays with us until the next frame replaces it:
+   * m_image keeps pointing to it, even if there is no new frame */
+  m_heldBuffer=index;
+  if (m_colorConvert) {
+    m_image.image.not_owned = false;
+    switch(m_gotFormat) {
 #if 1
 # define CONVERT(type) m_image.image.from##type (data)
 #else
 # define CONVERT(type) post("from " #type "!");m_image.image.from##type (data)
 #endif
-      case V4L2_PIX_FMT_RGB24:
-        CONVERT(RGB   );
-        break;
-      case V4L2_PIX_FMT_BGR32:
-        CONVERT(BGRA  );
-        break;
-      case V4L2_PIX_FMT_RGB32:
-        CONVERT(ARGB  );
-        break;
-      case V4L2_PIX_FMT_GREY :
-        CONVERT(Gray  );
-        break;
-      case V4L2_PIX_FMT_UYVY :
-        CONVERT(YUV422);
-        break;
-      case V4L2_PIX_FMT_YUYV :
-        CONVERT(YUY2  );
-        break;
-      case V4L2_PIX_FMT_YUV420:
-        CONVERT(YU12  );
-        break;
+    case V4L2_PIX_FMT_RGB24:
+      CONVERT(RGB   );
+      break;
+    case V4L2_PIX_FMT_BGR32:
+      CONVERT(BGRA  );
+      break;
+    case V4L2_PIX_FMT_RGB32:
+      CONVERT(ARGB  );
+      break;
+    case V4L2_PIX_FMT_GREY :
+      CONVERT(Gray  );
+      break;
+    case V4L2_PIX_FMT_UYVY :
+      CONVERT(YUV422);
+      break;
+    case V4L2_PIX_FMT_YUYV :
+      CONVERT(YUY2  );
+      break;
+    case V4L2_PIX_FMT_YUV420:
+      CONVERT(YU12  );
+      break;
 
 
-      default: // ? what should we do ?
-        m_image.image.data=data;
-        m_image.image.not_owned = true;
-      }
-    } else {
+    default: // ? what should we do ?
       m_image.image.data=data;
       m_image.image.not_owned = true;
     }
-    m_image.image.upsidedown=true;
-
-    m_image.newimage = 1;
-    m_frame_ready = false;
+  } else if (m_zeroCopy && m_nbuffers>2) {
+    /* the driver delivers the format we want: use its buffer directly */
+    m_image.image.data=data;
+    m_image.image.not_owned = true;
+  } else {
+    /* copy, so the buffer can go back to the driver right away */
+    m_image.image.reallocate();
+    size_t size=m_image.image.xsize*m_image.image.ysize*m_image.image.csize;
+    if(size>m_buffers[index].length) {
+      size=m_buffers[index].length;
+    }
+    memcpy(m_image.image.data, data, size);
+  }
+  if(!m_image.image.not_owned) {
+    /* we have a copy */
+    m_heldBuffer=-1;
+    requeue(index);
+  }
+  m_image.image.upsidedown=true;
+  m_image.timestamp=captime;
+  m_image.sequence=sequence;
+
+  const double latency=monotonic_ms() - captime;
+  m_latency=latency;
+  if(latency>m_maxLatency) {
+    m_maxLatency=latency;
   }
+  m_delivered++;
+
+  m_image.newimage = 1;
   return &m_image;
 }
 
@@ -760,8 +836,12 @@ bool videoV4L2 :: startTransfer()
   debugPost("v4l2: colorconvert=%d", m_colorConvert);
 
   /* create thread */
+  m_readyBuffer=-1;
+  m_heldBuffer=-1;
+  m_lastSequence=-1;
+  m_captured=m_dropped=m_driverDropped=m_delivered=0;
+  m_latency=m_maxLatency=0.;
   m_continue_thread = 1;
-  m_frame_ready = 0;
   pthread_create(&m_thread_id, 0, capturing_, this);
   while(!m_capturing) {
     usleep(10);
@@ -801,6 +881,11 @@ bool videoV4L2 :: stopTransfer()
     debugPost("v4l2: waiting for thread to finish");
   }
 
+  /* don't let the image point into the buffers that are about to go away */
+  if(m_image.image.not_owned) {
+    m_image.image.reallocate();
+  }
+
   // unmap the mmap
   debugPost("v4l2: unmapping %d buffers: %x", m_nbuffers, m_buffers);
   if(m_buffers) {
@@ -825,7 +910,8 @@ bool videoV4L2 :: stopTransfer()
   debugPost("v4l2: de-requesting buffers");
   reqbufs(m_tvfd, 0);
 
-  m_frame_ready = 0;
+  m_readyBuffer=-1;
+  m_heldBuffer=-1;
   m_rendering=false;
   debugPost("v4l2: stoppedTransfer");
   return true;
@@ -978,6 +1064,19 @@ bool videoV4L2 :: enumProperties(gem::Properties&readable,
   readable.set("width",0);
   readable.set("height",0);
 
+  /* capture statistics */
+  readable.set("buffers", 0);
+  readable.set("captured", 0);
+  readable.set("delivered", 0);
+  readable.set("dropped", 0);
+  readable.set("driverdropped", 0);
+  readable.set("latency", 0);
+  readable.set("maxlatency", 0);
+  readable.set("zerocopy", 1);
+  readable.set("polltimeout", 0);
+
+  writeable.set("zerocopy", 1);
+  writeable.set("polltimeout", 0);
   writeable.set("channel",0);
   writeable.set("frequency",0);
   writeable.set("norm", dummy_s);
@@ -1175,6 +1274,27 @@ void videoV4L2 :: getProperties(gem::Properties&props)
         props.set("card", (char*) m_caps.card);
       } else if("bus_info" == key) {
         props.set("bus_info", (char*) m_caps.bus_info);
+      } else if("zerocopy" == key) {
+        props.set("zerocopy", (int)m_zeroCopy);
+      } else if("polltimeout" == key) {
+        props.set("polltimeout", m_pollTimeout);
+      } else if("buffers" == key) {
+        props.set("buffers", m_nbuffers);
+      } else if("captured" == key) {
+        std::unique_lock<std::mutex>lock(m_bufferMutex);
+        props.set("captured", (double)m_captured);
+      } else if("delivered" == key) {
+        props.set("delivered", (double)m_delivered);
+      } else if("dropped" == key) {
+        std::unique_lock<std::mutex>lock(m_bufferMutex);
+        props.set("dropped", (double)m_dropped);
+      } else if("driverdropped" == key) {
+        std::unique_lock<std::mutex>lock(m_bufferMutex);
+        props.set("driverdropped", (double)m_driverDropped);
+      } else if("latency" == key) {
+        props.set("latency", m_latency);
+      } else if("maxlatency" == key) {
+        props.set("maxlatency", m_maxLatency);
       } else {
       }
     }
@@ -1333,6 +1453,16 @@ void videoV4L2 :: setProperties(gem::Properties&props)
           }
         }
       } else if("frequency" == key) {
+      } else if("zerocopy" == key) {
+        double d=0.;
+        if(props.get("zerocopy", d)) {
+          m_zeroCopy=(d>0.5);
+        }
+      } else if("polltimeout" == key) {
+        double d=0.;
+        if(props.get("polltimeout", d) && d>0.) {
+          m_pollTimeout=d;
+        }
       } else if("width" == key) {
         double d=0.;
         if(props.get("width", d)) {
@@ -28,6 +28,7 @@ WARRANTIES, see the file, "GEM.LICENSE.TERMS" in this distribution.
 # endif /* HAVE_LIBV4L2 */
 
 # include <map>
+# include <mutex>
 
 # include <stdio.h>
 # include <stdlib.h>
@@ -43,6 +44,7 @@ WARRANTIES, see the file, "GEM.LICENSE.TERMS" in this distribution.
 # include <asm/types.h>
 # include <linux/videodev2.h>
 # include <sys/mman.h>
+# include <poll.h>
 #if (defined HAVE_PTHREADS) || (defined HAVE_PTHREAD)
 /* the bad thing is, that we currently don't have any alternative to using PTHREADS
  * LATER: make threading optional
@@ -147,7 +149,34 @@ protected:
 
   struct t_v4l2_buffer*m_buffers;
   int  m_nbuffers;
-  void*m_currentBuffer;
+
+  //////////
+  // buffer ownership
+  // a buffer is either queued in the driver, 'ready' (dequeued by the
+  // capture thread but not yet picked up by getFrame()), or 'held' (passed
+  // on to the pix-chain without copying, until the next frame replaces it)
+  // all access is protected by m_bufferMutex
+  std::mutex m_bufferMutex;
+  int  m_readyBuffer; // index of the newest captured buffer (or -1)
+  int  m_heldBuffer;  // index of the buffer handed out by getFrame() (or -1)
+  double m_readyTime; // capture time of the 'ready' buffer (CLOCK_MONOTONIC, in ms)
+  unsigned long m_readySequence; // the driver's sequence number of the 'ready' buffer
+  /* hand buffers to the pix-chain without copying (if the format matches) */
+  bool m_zeroCopy;
+  /* ms to wait for a frame before checking whether we should stop */
+  int  m_pollTimeout;
+
+  //////////
+  // statistics
+  unsigned long m_captured;      // frames dequeued from the driver
+  unsigned long m_dropped;       // frames captured but never picked up by getFrame()
+  unsigned long m_driverDropped; // frames the driver dropped (gaps in the sequence)
+  unsigned long m_delivered;     // frames passed on to the pix-chain
+  long   m_lastSequence;
+  double m_latency, m_maxLatency; // capture->getFrame() latency (in ms)
+
+  /* give buffer 'index' back to the driver */
+  bool      requeue(int index);
 
   int m_frame, m_last_frame;
 
@@ -162,7 +191,6 @@ protected:
   // the capturing thread
   pthread_t m_thread_id;
   bool      m_continue_thread;
-  bool      m_frame_ready;
 
   /* capture frames (in a separate thread! */
   void*capturing(void);
@@ -85,7 +85,16 @@ void GemPixObj :: render(GemState *state)
     cachedPixBlock.newimage = image->newimage;
     cachedPixBlock.newfilm =
       image->newfilm; //added for newfilm copy from cache cgc 6-21-03
-    image->image.copy2ImageStruct(&cachedPixBlock.image);
+    cachedPixBlock.timestamp = image->timestamp;
+    cachedPixBlock.sequence  = image->sequence;
+    if (m_processOnOff && image->readonly) {
+      /* we must not touch the original data, so we process a copy */
+      image->image.copy2Image(&cachedPixBlock.image);
+      cachedPixBlock.readonly = false;
+    } else {
+      image->image.copy2ImageStruct(&cachedPixBlock.image);
+      cachedPixBlock.readonly = image->readonly;
+    }
     image = &cachedPixBlock;
     if (m_processOnOff) {
       switch (image->image.type) {
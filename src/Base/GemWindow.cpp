@@ -19,6 +19,7 @@
 #include "GemContext.h"
 #include "Gem/Exception.h"
 #include "GemBase.h"
+#include "Utils/Latency.h"
 
 #include <set>
 #include <sstream>
@@ -214,6 +215,7 @@ public:
 
     if(swap) {
       parent->swapBuffers();
+      gem::utils::FrameLatency::swapped();
     }
 
     mycontext->pop();
@@ -594,6 +596,47 @@ void GemWindow::       printMess(void)
   }
 }
 
+void GemWindow::       latencyMess(t_symbol*s, int argc, t_atom*argv)
+{
+  if(argc && A_SYMBOL==argv->a_type && gensym("reset")==atom_getsymbol(argv)) {
+    gem::utils::FrameLatency::reset();
+    return;
+  }
+  const gem::utils::LatencyHistogram upload=
+    gem::utils::FrameLatency::getUpload();
+  const gem::utils::LatencyHistogram swap=gem::utils::FrameLatency::getSwap();
+  const std::vector<unsigned long>&bins=swap.bins();
+
+  std::vector<t_atom>alist;
+  t_atom at;
+  SETSYMBOL(&at, gensym("latency"));
+  alist.push_back(at);
+  SETSYMBOL(&at, gensym("upload"));
+  alist.push_back(at);
+  SETFLOAT(&at, upload.count());
+  alist.push_back(at);
+  SETFLOAT(&at, upload.mean());
+  alist.push_back(at);
+  SETFLOAT(&at, upload.max());
+  alist.push_back(at);
+  info(alist);
+
+  alist[1].a_w.w_symbol=gensym("swap");
+  SETFLOAT(&alist[2], swap.count());
+  SETFLOAT(&alist[3], swap.mean());
+  SETFLOAT(&alist[4], swap.max());
+  info(alist);
+
+  /* the histogram of the ages at buffer swap */
+  alist.resize(2);
+  alist[1].a_w.w_symbol=gensym("histogram");
+  for(unsigned int i=0; i<bins.size(); i++) {
+    SETFLOAT(&at, bins[i]);
+    alist.push_back(at);
+  }
+  info(alist);
+}
+
 void GemWindow:: anyMess(t_symbol*s, int argc, t_atom*argv)
 {
   outlet_anything(m_pimpl->rejectOut, s, argc, argv);
@@ -618,6 +661,7 @@ void GemWindow :: obj_setupCallback(t_class *classPtr)
   CPPEXTERN_MSG1(classPtr, "transparent", transparentMess, bool);
 
   CPPEXTERN_MSG0(classPtr, "print", printMess);
+  CPPEXTERN_MSG (classPtr, "latency", latencyMess);
 
   CPPEXTERN_MSG1(classPtr, "activate", activate, bool);
 
@@ -204,6 +204,9 @@ public:
   /* print some info */
   virtual void        printMess(void);
 
+  /* report (or "reset") the age of frames at texture upload and buffer swap */
+  virtual void        latencyMess(t_symbol*s, int argc, t_atom*argv);
+
   /* fallback callback */
   virtual void        anyMess(t_symbol*s, int argc, t_atom*argv);
 
@@ -76,6 +76,7 @@
 #include <ctype.h>
 
 #include<new>
+#include <utility>
 
 /* this is some magic for debugging:
  * to time execution of a code-block use
@@ -336,6 +337,8 @@ namespace {
 
 pixBlock :: pixBlock(void)
   : image(imageStruct()), newimage(0), newfilm(0)
+  , timestamp(0.), sequence(0)
+  , readonly(false)
 {}
 
 
@@ -445,6 +448,41 @@ GEM_EXTERN void imageStruct::clear(void)
   datasize=0;
 }
 
+GEM_EXTERN bool imageStruct::adopt(unsigned char*buffer, size_t size)
+{
+  /* reallocate() expects the data at the first aligned address of pdata */
+  if (!buffer || ((reinterpret_cast<size_t>(buffer))&
+                  (GEM_VECTORALIGNMENT/8-1))) {
+    return false;
+  }
+  clear();
+  data = pdata = buffer;
+  datasize = size;
+  not_owned = false;
+  return true;
+}
+
+
+GEM_EXTERN bool imageStruct::swapData(imageStruct&other)
+{
+  const size_t maxoffset = GEM_VECTORALIGNMENT/8;
+  /* 'data' must be the (aligned) start of 'pdata' on both sides */
+  if ((data && !(pdata && data>=pdata && data<pdata+maxoffset)) ||
+      (other.data && !(other.pdata && other.data>=other.pdata
+                       && other.data<other.pdata+maxoffset))) {
+    return false;
+  }
+  std::swap(data, other.data);
+  std::swap(pdata, other.pdata);
+  std::swap(datasize, other.datasize);
+  not_owned = other.not_owned = false;
+  return true;
+}
+
+GEM_EXTERN size_t imageStruct::getReservedSize(void) const
+{
+  return pdata?datasize:0;
+}
 
 GEM_EXTERN void imageStruct::copy2ImageStruct(imageStruct *to) const
 {
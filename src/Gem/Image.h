@@ -95,6 +95,19 @@ struct GEM_EXTERN imageStruct {
   // delete the buffer (if it is ours)
   virtual void clear(void);
 
+  // take over a buffer that was allocated with 'new unsigned char[size]'
+  // (it is freed by us from now on), so it need not be copied;
+  // returns false (and leaves the buffer to the caller) if it is not aligned
+  bool adopt(unsigned char*buffer, size_t size);
+
+  // exchange the buffers of two images (without copying any data);
+  // only works if both images use their own buffer (or have none):
+  // returns false (and leaves both images untouched) otherwise
+  bool swapData(imageStruct&);
+
+  // number of bytes reserved for the data (by this image)
+  size_t getReservedSize(void) const;
+
 
   //////////
   // dimensions of the image
@@ -292,6 +305,21 @@ struct GEM_EXTERN pixBlock {
   // keeps track of when new films are loaded
   // (useful for rectangle_textures on macOS)
   bool newfilm;
+
+  //////////
+  // when the image was captured (or decoded), in ms
+  // (see gem::utils::monotonicTime(); 0 if unknown)
+  double timestamp;
+
+  //////////
+  // running number of the image as delivered by its source
+  // (films use the frame number)
+  unsigned long sequence;
+
+  //////////
+  // the image data is not ours to modify (e.g. it lives in shared memory)
+  // objects that want to process the image in place must work on a copy
+  bool readonly;
 };
 
 ///////////////////////////////////////////////////////////////////////////////
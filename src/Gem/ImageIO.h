@@ -22,6 +22,8 @@ LOG
 struct imageStruct;
 
 #include <string>
+#include <vector>
+#include <memory>
 
 
 // image2mem() reads an image file into memory
@@ -38,6 +40,10 @@ struct imageStruct;
 namespace gem
 {
 class Properties;
+namespace RTE
+{
+class Outlet;
+};
 namespace image
 {
 class GEM_EXTERN load
@@ -50,6 +56,8 @@ public:
    *
    * the loaded image is stored in 'img'
    * 'props' holds a list of additional image properties discovered during loading
+   * when called, 'props' may hold hints for the loader
+   * (e.g. "width" and "height" if a smaller image will do; see the backends)
    */
   static bool sync(const std::string&filename,
                    imageStruct&img,
@@ -103,6 +111,13 @@ public:
                     const std::string&filename,
                     id_t&ID
                    );
+  /* same as above, but with hints for the loader (see sync()) */
+  static bool async(callback cb,
+                    void*userdata,
+                    const std::string&filename,
+                    const Properties&hints,
+                    id_t&ID
+                   );
 
   /* cancels asynchronous loading of an image
    * removes the given ID (as returned by loadAsync()) from the loader queue
@@ -118,6 +133,11 @@ public:
                    void*userdata,
                    const std::string&filename,
                    id_t&ID);
+  static bool sync(callback cb,
+                   void*userdata,
+                   const std::string&filename,
+                   const Properties&hints,
+                   id_t&ID);
 
   /*
    * deliver all loaded images not delivered yet
@@ -132,6 +152,188 @@ public:
   static bool setPolling(bool);
 
 
+  /* loads a number of images (given as 'filenames') asynchronously
+   * the images are decoded in parallel by a pool of loader threads
+   * (setting "image.loading.threads"; 0 (the default) uses one thread per CPU)
+   * but the callback 'cb' is called for them in the order of 'filenames',
+   * from within the main thread
+   * the images are neither taken from nor added to the image cache
+   *
+   * 'IDs' receives one ID per file (as passed to the callback),
+   * which can be used to cancel() single images
+   * if an image cannot be loaded, the callback is called with img=NULL
+   *
+   * if the imageloader cannot be used from multiple threads,
+   * the images are loaded synchronously (and all IDs are IMMEDIATE)
+   */
+  static bool asyncBatch(callback cb,
+                         void*userdata,
+                         const std::vector<std::string>&filenames,
+                         std::vector<id_t>&IDs);
+
+  struct BatchStats {
+    unsigned int files;   /* number of images loaded */
+    unsigned int failed;  /* number of images that could not be loaded */
+    unsigned int threads; /* number of loader threads */
+    double bytes;         /* size of the decoded images */
+    double time;          /* time from queueing to delivering the last image (in ms) */
+  };
+  /* statistics of the last completed batch
+   * (valid from within the callback of the batch's last image)
+   */
+  static struct BatchStats getBatchStats(void);
+};
+
+class GEM_EXTERN save
+{
+public:
+  /**
+   * saves an image (given as 'img') as 'filename' synchronously,
+   * using the first imagesaver that accepts it
+   * (see gem::plugins::imagesaver::save() for 'mimetype' and 'props')
+   * returns TRUE on success
+   */
+  static bool sync(const imageStruct&img,
+                   const std::string&filename,
+                   const std::string&mimetype,
+                   const Properties&props);
+};
+
+/*
+ * a bounded queue that saves images in the background
+ *
+ * images push()ed onto the queue are written to disk by a number of
+ * encoder threads (each with its own imagesaver instance), so the
+ * caller (typically the render thread) does not have to wait for
+ * the image to be encoded
+ */
+class GEM_EXTERN SaveQueue
+{
+private:
+  class PIMPL;
+  PIMPL*m_pimpl;
+
+  SaveQueue(const SaveQueue&);
+  SaveQueue&operator=(const SaveQueue&);
+
+public:
+  /* what to do, if an image is pushed onto a full queue */
+  enum Policy {
+    BLOCK,       /* wait until an encoder has finished with an image */
+    DROP_OLDEST, /* discard the oldest image that is still waiting */
+    DROP_NEWEST  /* discard the image that is about to be pushed */
+  };
+
+  struct Stats {
+    unsigned int depth;    /* images currently waiting to be encoded */
+    unsigned int maxdepth; /* high-water mark of 'depth' */
+    unsigned int capacity; /* max. number of waiting images */
+    unsigned int threads;  /* number of encoder threads */
+    unsigned long saved;   /* images successfully written */
+    unsigned long failed;  /* images that could not be written */
+    unsigned long dropped; /* images discarded due to the policy */
+    double encodeTime;     /* average encoding time per image (in ms) */
+    double lastEncodeTime; /* encoding time of the last image (in ms) */
+  };
+
+  /*
+   * 'capacity' is the max. number of images waiting to be encoded
+   * 'threads' is the number of encoder threads (0: pick one based on the number of CPUs)
+   */
+  SaveQueue(unsigned int capacity=8, unsigned int threads=0);
+  /* the dtor waits until all pending images have been written */
+  virtual ~SaveQueue(void);
+
+  /*
+   * queue the image 'img' for saving as 'filename'
+   * (see gem::plugins::imagesaver::save() for 'mimetype' and 'props')
+   *
+   * the queue takes ownership of 'img' (which must be allocated with 'new'),
+   * regardless of whether the image is eventually saved or not
+   *
+   * returns FALSE if the image was rejected (DROP_NEWEST on a full queue)
+   *
+   * if the available imagesavers cannot be used from multiple threads,
+   * the image is saved synchronously (within push())
+   */
+  virtual bool push(imageStruct*img,
+                    const std::string&filename,
+                    const std::string&mimetype,
+                    const gem::Properties&props);
+
+  /* block until all queued images have been written */
+  virtual void flush(void);
+
+  virtual void setPolicy(enum Policy);
+  virtual enum Policy getPolicy(void) const;
+  virtual void setCapacity(unsigned int);
+  /* change the number of encoder threads (flushes the queue) */
+  virtual void setThreads(unsigned int);
+
+  virtual struct Stats getStats(void) const;
+  virtual void resetStats(void);
+
+  /*
+   * get the names of all files that failed to save since the last call
+   * (this is meant to be called from the main thread, so errors can be reported)
+   */
+  virtual std::vector<std::string>getFailures(void);
+
+  /* parse a policy name ("block", "drop_oldest", "drop_newest")
+   * returns FALSE if the name is unknown
+   */
+  static bool string2policy(const std::string&, enum Policy&);
+
+  /* send the statistics of 'queue' (which may be NULL) through 'outlet' as
+   * "stats depth <cur> <max> <capacity>", "stats frames <saved> <dropped> <failed>",
+   * "stats encodetime <avg_ms> <last_ms>" and "stats threads <n>"
+   */
+  static void sendStats(const SaveQueue*queue, gem::RTE::Outlet*outlet);
+};
+
+/*
+ * a process-wide cache of decoded images
+ *
+ * images are keyed by their (full) path (and the loader hints)
+ * together with the size and
+ * modification time of the file, so a changed file is decoded again.
+ * the cache holds up to a memory budget (setting "image.cache", in MB;
+ * 0 disables the cache) and evicts the least recently used images first.
+ * images are refcounted: an image that is still used by an object
+ * is never evicted (but it does count towards the budget)
+ *
+ * all functions can be called from any thread
+ */
+class GEM_EXTERN cache
+{
+public:
+  typedef std::shared_ptr<const imageStruct> image_t;
+
+  struct Stats {
+    unsigned long hits;      /* lookups served from the cache */
+    unsigned long misses;    /* lookups that had to decode the file */
+    unsigned long evictions; /* images dropped to stay within the budget */
+    unsigned int entries;    /* number of images held */
+    size_t bytes;            /* memory held by the images */
+    size_t budget;           /* max. memory (0: caching is disabled) */
+  };
+
+  /*
+   * get the decoded image for 'filename',
+   * either from the cache or by loading the file (and adding it to the cache)
+   * returns an empty pointer if the image could not be loaded
+   * 'props' holds the loader hints, and receives the image properties
+   * discovered during loading
+   */
+  static image_t load(const std::string&filename, Properties&props);
+
+  /* decode the given files in the background, so they are cached when needed */
+  static void prewarm(const std::vector<std::string>&filenames);
+
+  static void setBudget(size_t bytes);
+  static struct Stats getStats(void);
+  /* drop all images (images that are still in use are kept alive by their users) */
+  static void clear(void);
 };
 };
 };
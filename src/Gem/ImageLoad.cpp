@@ -17,10 +17,22 @@
 /////////////////////////////////////////////////////////
 #include "ImageIO.h"
 #include "Gem/RTE.h"
+#include "Gem/Settings.h"
+#include "Gem/Properties.h"
 #include "Utils/SynchedWorkerThread.h"
+#include "Utils/Thread.h"
+#include "Utils/Latency.h"
 
 #include "plugins/imageloader.h"
 
+#include <list>
+#include <map>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <stdio.h>
+#include <sys/stat.h>
+
 namespace gem
 {
 namespace image
@@ -30,10 +42,13 @@ struct PixImageThreadLoader : public gem::thread::SynchedWorkerThread {
     load::callback cb;
     void*userdata;
     std::string filename;
-    InData(load::callback cb_, void*data_, const std::string&fname) :
+    gem::Properties props;
+    InData(load::callback cb_, void*data_, const std::string&fname,
+           const gem::Properties&props_) :
       cb(cb_),
       userdata(data_),
-      filename(fname)
+      filename(fname),
+      props(props_)
     {
     };
   };
@@ -84,10 +99,11 @@ struct PixImageThreadLoader : public gem::thread::SynchedWorkerThread {
       return NULL;
     }
     // DOIT
-    out->img=new imageStruct;
-    if(!s_imageloader->load(in->filename, *out->img, out->props)) {
-      delete out->img;
-      out->img=0;
+    out->props=in->props;
+    cache::image_t img=cache::load(in->filename, out->props);
+    if(img) {
+      out->img=new imageStruct;
+      img->copy2Image(out->img);
     }
     void*result=reinterpret_cast<void*>(out);
     //post("processing[%d] %p -> %p", ID, data, result);
@@ -106,9 +122,9 @@ struct PixImageThreadLoader : public gem::thread::SynchedWorkerThread {
   };
 
   virtual bool queue(id_t&ID, load::callback cb, void*userdata,
-                     std::string filename)
+                     std::string filename, const gem::Properties&props)
   {
-    InData *in = new InData(cb, userdata, filename);
+    InData *in = new InData(cb, userdata, filename, props);
     return SynchedWorkerThread::queue(ID, reinterpret_cast<void*>(in));
   };
 
@@ -147,6 +163,472 @@ PixImageThreadLoader*PixImageThreadLoader::s_instance=NULL;
 gem::plugins::imageloader*PixImageThreadLoader::s_imageloader=NULL;
 
 
+namespace
+{
+/* the imageloader used for all (cached) loading */
+static gem::plugins::imageloader*getLoader(void)
+{
+  static std::mutex s_mutex;
+  std::unique_lock<std::mutex>lock(s_mutex);
+  if(!PixImageThreadLoader::s_imageloader) {
+    PixImageThreadLoader::s_imageloader=
+      gem::plugins::imageloader::getInstance();
+  }
+  return PixImageThreadLoader::s_imageloader;
+}
+static bool decode(const std::string&filename,
+                   imageStruct&img, gem::Properties&props)
+{
+  gem::plugins::imageloader*loader=getLoader();
+  if(!loader) {
+    return false;
+  }
+  if(loader->isThreadable()) {
+    return loader->load(filename, img, props);
+  }
+  /* the loader must not be used from several threads at once */
+  static std::mutex s_mutex;
+  std::unique_lock<std::mutex>lock(s_mutex);
+  return loader->load(filename, img, props);
+}
+
+/* "<size>:<mtime>" of a file; empty if it cannot be stat()ed */
+static std::string getStamp(const std::string&filename)
+{
+  struct stat st;
+  if(stat(filename.c_str(), &st)) {
+    return std::string();
+  }
+  char buf[MAXPDSTRING];
+  snprintf(buf, MAXPDSTRING, "%lu:%lu",
+           (unsigned long)st.st_size, (unsigned long)st.st_mtime);
+  buf[MAXPDSTRING-1]=0;
+  return buf;
+}
+/* the loader hints in 'props' (e.g. a target size), as part of the cache key */
+static std::string getHints(const gem::Properties&props)
+{
+  std::string result;
+  const std::vector<std::string>keys=props.keys();
+  for(size_t i=0; i<keys.size(); i++) {
+    double d;
+    std::string s;
+    char buf[MAXPDSTRING];
+    if(props.get(keys[i], d)) {
+      snprintf(buf, MAXPDSTRING, "%g", d);
+      buf[MAXPDSTRING-1]=0;
+      s=buf;
+    } else if(!props.get(keys[i], s)) {
+      continue;
+    }
+    result+="\n" + keys[i] + "=" + s;
+  }
+  return result;
+}
+static size_t getBytes(const imageStruct&img)
+{
+  return (size_t)img.xsize * img.ysize * img.csize;
+}
+
+class ImageCache
+{
+public:
+  static ImageCache*get(void)
+  {
+    static ImageCache*s_cache=new ImageCache();
+    return s_cache;
+  }
+
+  struct Entry {
+    std::string key; /* filename and loader hints */
+    std::string stamp;
+    gem::image::cache::image_t img;
+    gem::Properties props;
+    size_t bytes;
+  };
+
+  std::mutex mutex;
+  /* most recently used first */
+  std::list<Entry>entries;
+  std::map<std::string, std::list<Entry>::iterator>index;
+  gem::image::cache::Stats stats;
+
+  /* must be called with the mutex locked */
+  void remove(std::list<Entry>::iterator it)
+  {
+    stats.bytes-=it->bytes;
+    index.erase(it->key);
+    entries.erase(it);
+  }
+  /* drop the least recently used images that are not in use, until we are within our budget */
+  void evict(void)
+  {
+    std::list<Entry>::iterator it=entries.end();
+    while(stats.bytes>stats.budget && it!=entries.begin()) {
+      --it;
+      if(it->img.use_count()>1) {
+        continue;
+      }
+      std::list<Entry>::iterator victim=it++;
+      remove(victim);
+      stats.evictions++;
+    }
+  }
+
+private:
+  ImageCache(void)
+  {
+    int budget=256;
+    gem::Settings::get("image.cache", budget);
+    stats.hits=stats.misses=stats.evictions=0;
+    stats.entries=0;
+    stats.bytes=0;
+    stats.budget=(budget>0)?((size_t)budget)<<20:0;
+  }
+};
+};
+
+cache::image_t cache::load(const std::string&filename,
+                           gem::Properties&props)
+{
+  ImageCache*c=ImageCache::get();
+  const std::string stamp=getStamp(filename);
+  const std::string key=filename + getHints(props);
+  do {
+    std::unique_lock<std::mutex>lock(c->mutex);
+    std::map<std::string, std::list<ImageCache::Entry>::iterator>::iterator it=
+      c->index.find(key);
+    if(c->index.end()==it) {
+      break;
+    }
+    if(stamp.empty() || it->second->stamp != stamp) {
+      /* the file has changed (or is gone) */
+      c->remove(it->second);
+      break;
+    }
+    c->entries.splice(c->entries.begin(), c->entries, it->second);
+    c->stats.hits++;
+    props=it->second->props;
+    return it->second->img;
+  } while(0);
+
+  /* decode without holding the lock */
+  imageStruct*img=new imageStruct;
+  gem::Properties loadprops=props;
+  if(!decode(filename, *img, loadprops)) {
+    delete img;
+    std::unique_lock<std::mutex>lock(c->mutex);
+    c->stats.misses++;
+    return image_t();
+  }
+  image_t result(img);
+  props=loadprops;
+
+  std::unique_lock<std::mutex>lock(c->mutex);
+  c->stats.misses++;
+  if(!c->stats.budget || stamp.empty()) {
+    return result;
+  }
+  std::map<std::string, std::list<ImageCache::Entry>::iterator>::iterator it=
+    c->index.find(key);
+  if(c->index.end()!=it) {
+    /* somebody else was faster */
+    if(it->second->stamp == stamp) {
+      c->entries.splice(c->entries.begin(), c->entries, it->second);
+      return it->second->img;
+    }
+    c->remove(it->second);
+  }
+  ImageCache::Entry entry;
+  entry.key=key;
+  entry.stamp=stamp;
+  entry.img=result;
+  entry.props=loadprops;
+  entry.bytes=getBytes(*img);
+  c->entries.push_front(entry);
+  c->index[key]=c->entries.begin();
+  c->stats.bytes+=entry.bytes;
+  c->evict();
+  return result;
+}
+
+void cache::prewarm(const std::vector<std::string>&filenames)
+{
+  if(filenames.empty()) {
+    return;
+  }
+  gem::plugins::imageloader*loader=getLoader();
+  if(!loader) {
+    return;
+  }
+  if(!loader->isThreadable()) {
+    for(size_t i=0; i<filenames.size(); i++) {
+      gem::Properties props;
+      cache::load(filenames[i], props);
+    }
+    return;
+  }
+  std::thread t([filenames]() {
+    for(size_t i=0; i<filenames.size(); i++) {
+      gem::Properties props;
+      cache::load(filenames[i], props);
+    }
+  });
+  t.detach();
+}
+
+void cache::setBudget(size_t bytes)
+{
+  ImageCache*c=ImageCache::get();
+  std::unique_lock<std::mutex>lock(c->mutex);
+  c->stats.budget=bytes;
+  c->evict();
+}
+
+struct cache::Stats cache::getStats(void)
+{
+  ImageCache*c=ImageCache::get();
+  std::unique_lock<std::mutex>lock(c->mutex);
+  c->stats.entries=c->entries.size();
+  return c->stats;
+}
+
+void cache::clear(void)
+{
+  ImageCache*c=ImageCache::get();
+  std::unique_lock<std::mutex>lock(c->mutex);
+  c->entries.clear();
+  c->index.clear();
+  c->stats.bytes=0;
+}
+
+
+
+namespace
+{
+static std::mutex s_batchMutex;
+static struct load::BatchStats s_batchStats= {0, 0, 0, 0., 0.};
+
+static void setBatchStats(const struct load::BatchStats&stats)
+{
+  std::unique_lock<std::mutex>lock(s_batchMutex);
+  s_batchStats=stats;
+  const double secs=stats.time/1000.;
+  const double mb=stats.bytes/(1024.*1024.);
+  verbose(1,
+          "[GEM:image] loaded %u images (%.1f MB) with %u threads in %.1f ms: %.1f files/s, %.1f MB/s",
+          stats.files, mb, stats.threads, stats.time,
+          (secs>0.)?(stats.files/secs):0.,
+          (secs>0.)?(mb/secs):0.);
+}
+
+/* a pool of loader threads for asyncBatch()
+ * the images are decoded in parallel, but delivered in order
+ * (from a clock in the main thread)
+ */
+class BatchLoader
+{
+public:
+  static BatchLoader*get(void)
+  {
+    static BatchLoader*s_loader=new BatchLoader();
+    return s_loader;
+  }
+
+  struct Batch {
+    load::callback cb;
+    void*userdata;
+    std::vector<std::string>filenames;
+    std::vector<load::id_t>IDs;
+    std::vector<imageStruct*>images;
+    std::vector<gem::Properties>props;
+    std::vector<bool>done;
+    std::vector<bool>cancelled;
+    size_t next;      /* the next image to be handed to a loader thread */
+    size_t delivered; /* the next image to be delivered */
+    double start;
+    double bytes;
+    unsigned int loaded;
+    unsigned int failed;
+  };
+
+  void queue(load::callback cb, void*userdata,
+             const std::vector<std::string>&filenames,
+             std::vector<load::id_t>&IDs)
+  {
+    Batch*b=new Batch;
+    const size_t count=filenames.size();
+    b->cb=cb;
+    b->userdata=userdata;
+    b->filenames=filenames;
+    b->images.resize(count, NULL);
+    b->props.resize(count);
+    b->done.resize(count, false);
+    b->cancelled.resize(count, false);
+    b->next=b->delivered=0;
+    b->start=gem::utils::monotonicTime();
+    b->bytes=0.;
+    b->loaded=b->failed=0;
+
+    IDs.clear();
+    std::unique_lock<std::mutex>lock(m_mutex);
+    for(size_t i=0; i<count; i++) {
+      /* batch IDs live in their own range, so they don't clash with async() */
+      m_id=(m_id+1) & 0x7FFFFFFF;
+      b->IDs.push_back(m_id | 0x80000000);
+    }
+    IDs=b->IDs;
+    m_batches.push_back(b);
+    lock.unlock();
+    m_cond.notify_all();
+    clock_delay(m_clock, 0);
+  }
+
+  bool cancel(load::id_t ID)
+  {
+    std::unique_lock<std::mutex>lock(m_mutex);
+    std::list<Batch*>::iterator it;
+    for(it=m_batches.begin(); it!=m_batches.end(); ++it) {
+      Batch*b=*it;
+      for(size_t i=b->delivered; i<b->IDs.size(); i++) {
+        if(ID==b->IDs[i]) {
+          b->cancelled[i]=true;
+          return true;
+        }
+      }
+    }
+    return false;
+  }
+
+  /* deliver all images that are ready (in order); main thread only */
+  void deliver(void)
+  {
+    for(;;) {
+      std::unique_lock<std::mutex>lock(m_mutex);
+      Batch*b=NULL;
+      size_t index=0;
+      std::list<Batch*>::iterator it;
+      for(it=m_batches.begin(); it!=m_batches.end(); ++it) {
+        if((*it)->delivered < (*it)->IDs.size() && (*it)->done[(*it)->delivered]) {
+          b=*it;
+          break;
+        }
+      }
+      if(!b) {
+        break;
+      }
+      index=b->delivered++;
+      const bool last=(b->delivered == b->IDs.size());
+      if(last) {
+        m_batches.erase(it);
+        struct load::BatchStats stats;
+        stats.files=b->loaded;
+        stats.failed=b->failed;
+        stats.threads=m_threads.size();
+        stats.bytes=b->bytes;
+        stats.time=gem::utils::monotonicTime() - b->start;
+        setBatchStats(stats);
+      }
+      const bool cancelled=b->cancelled[index];
+      lock.unlock();
+
+      imageStruct*img=b->images[index];
+      b->images[index]=NULL;
+      if(cancelled) {
+        delete img;
+      } else {
+        (*b->cb)(b->userdata, b->IDs[index], img, b->props[index]);
+      }
+      if(last) {
+        delete b;
+      }
+    }
+
+    std::unique_lock<std::mutex>lock(m_mutex);
+    if(!m_batches.empty()) {
+      clock_delay(m_clock, 5);
+    }
+  }
+
+private:
+  std::mutex m_mutex;
+  std::condition_variable m_cond;
+  std::list<Batch*>m_batches;
+  std::vector<std::thread>m_threads;
+  load::id_t m_id;
+  t_clock*m_clock;
+
+  BatchLoader(void)
+    : m_id(0)
+    , m_clock(clock_new(this, reinterpret_cast<t_method>(tickCb)))
+  {
+    int numthreads=0;
+    gem::Settings::get("image.loading.threads", numthreads);
+    if(numthreads<1) {
+      numthreads=gem::thread::getCPUCount();
+    }
+    if(numthreads<1) {
+      numthreads=1;
+    }
+    for(int i=0; i<numthreads; i++) {
+      m_threads.push_back(std::thread(&BatchLoader::process, this));
+    }
+  }
+  static void tickCb(void*you)
+  {
+    reinterpret_cast<BatchLoader*>(you)->deliver();
+  }
+
+  void process(void)
+  {
+    for(;;) {
+      std::unique_lock<std::mutex>lock(m_mutex);
+      Batch*b=NULL;
+      while(!b) {
+        std::list<Batch*>::iterator it;
+        for(it=m_batches.begin(); it!=m_batches.end(); ++it) {
+          if((*it)->next < (*it)->IDs.size()) {
+            b=*it;
+            break;
+          }
+        }
+        if(!b) {
+          m_cond.wait(lock);
+        }
+      }
+      const size_t index=b->next++;
+      const bool cancelled=b->cancelled[index];
+      const std::string filename=b->filenames[index];
+      lock.unlock();
+
+      imageStruct*img=NULL;
+      gem::Properties props;
+      if(!cancelled) {
+        /* bypass the image cache: a batch (e.g. a long sequence) would
+         * only flush it, and we would have to copy each image out of it */
+        img=new imageStruct;
+        if(!decode(filename, *img, props)) {
+          delete img;
+          img=NULL;
+        }
+      }
+
+      /* the batch stays alive until this image has been delivered */
+      lock.lock();
+      b->images[index]=img;
+      b->props[index]=props;
+      b->done[index]=true;
+      if(img) {
+        b->loaded++;
+        b->bytes+=getBytes(*img);
+      } else if(!cancelled) {
+        b->failed++;
+      }
+    }
+  }
+};
+};
+
 const load::id_t load::IMMEDIATE= 0;
 const load::id_t load::INVALID  =~0;
 
@@ -154,12 +636,9 @@ bool load::sync(const std::string&filename,
                 imageStruct&result,
                 gem::Properties&props)
 {
-  if(!PixImageThreadLoader::s_imageloader) {
-    PixImageThreadLoader::s_imageloader=
-      gem::plugins::imageloader::getInstance();
-  }
-  if((PixImageThreadLoader::s_imageloader) &&
-      (PixImageThreadLoader::s_imageloader->load(filename, result, props))) {
+  cache::image_t img=cache::load(filename, props);
+  if(img) {
+    img->copy2Image(&result);
     return true;
   }
   return false;
@@ -169,6 +648,15 @@ bool load::async(load::callback cb,
                  void*userdata,
                  const std::string&filename,
                  id_t&ID)
+{
+  const gem::Properties props;
+  return async(cb, userdata, filename, props, ID);
+}
+bool load::async(load::callback cb,
+                 void*userdata,
+                 const std::string&filename,
+                 const gem::Properties&props,
+                 id_t&ID)
 {
   if(NULL==cb) {
     ID=INVALID;
@@ -180,33 +668,46 @@ bool load::async(load::callback cb,
   //post("threadloader %p", threadloader);
 
   if(threadloader) {
-    return threadloader->queue(ID, cb, userdata, filename);
+    return threadloader->queue(ID, cb, userdata, filename, props);
   }
-  return sync(cb, userdata, filename, ID);
+  return sync(cb, userdata, filename, props, ID);
 }
 
 bool load::sync(load::callback cb,
                 void*userdata,
                 const std::string&filename,
                 id_t&ID)
+{
+  const gem::Properties props;
+  return sync(cb, userdata, filename, props, ID);
+}
+bool load::sync(load::callback cb,
+                void*userdata,
+                const std::string&filename,
+                const gem::Properties&hints,
+                id_t&ID)
 {
   if(NULL==cb) {
     ID=INVALID;
     return false;
   }
   imageStruct*result=new imageStruct;
-  gem::Properties props;
+  gem::Properties props=hints;
   if(sync(filename, *result, props)) {
     ID=IMMEDIATE;
     (*cb)(userdata, ID, result, props);
     return true;
   }
+  delete result;
   ID=INVALID;
   return false;
 }
 
 bool load::cancel(id_t ID)
 {
+  if(INVALID!=ID && IMMEDIATE!=ID && (ID & 0x80000000)) {
+    return BatchLoader::get()->cancel(ID);
+  }
   PixImageThreadLoader*threadloader=PixImageThreadLoader::getInstance(false);
   if(threadloader) {
     bool success=threadloader->cancel(ID);
@@ -234,6 +735,55 @@ void load::poll(void)
   }
 }
 
+bool load::asyncBatch(load::callback cb,
+                      void*userdata,
+                      const std::vector<std::string>&filenames,
+                      std::vector<id_t>&IDs)
+{
+  IDs.clear();
+  if(NULL==cb) {
+    return false;
+  }
+  if(filenames.empty()) {
+    return true;
+  }
+  gem::plugins::imageloader*loader=getLoader();
+  if(!loader) {
+    return false;
+  }
+  if(!loader->isThreadable()) {
+    struct BatchStats stats= {0, 0, 0, 0., 0.};
+    const double start=gem::utils::monotonicTime();
+    for(size_t i=0; i<filenames.size(); i++) {
+      gem::Properties props;
+      imageStruct*img=new imageStruct;
+      if(decode(filenames[i], *img, props)) {
+        stats.files++;
+        stats.bytes+=getBytes(*img);
+      } else {
+        stats.failed++;
+        delete img;
+        img=NULL;
+      }
+      IDs.push_back(IMMEDIATE);
+      if(i+1 == filenames.size()) {
+        stats.time=gem::utils::monotonicTime() - start;
+        setBatchStats(stats);
+      }
+      (*cb)(userdata, IMMEDIATE, img, props);
+    }
+    return true;
+  }
+  BatchLoader::get()->queue(cb, userdata, filenames, IDs);
+  return true;
+}
+
+struct load::BatchStats load::getBatchStats(void)
+{
+  std::unique_lock<std::mutex>lock(s_batchMutex);
+  return s_batchStats;
+}
+
 
 }; // image
 }; // gem
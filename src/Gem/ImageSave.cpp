@@ -22,6 +22,18 @@
 #include "plugins/imagesaver.h"
 #include "plugins/PluginFactory.h"
 
+#include "Gem/Image.h"
+#include "Gem/Properties.h"
+#include "RTE/Outlet.h"
+#include "Utils/Thread.h"
+
+#include <string.h>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
 namespace gem
 {
 namespace PixImageSaver
@@ -45,18 +57,421 @@ static gem::plugins::imagesaver*getInstance(void)
  ***************************************************************************/
 GEM_EXTERN int mem2image(imageStruct* image, const char *filename,
                          const int type)
+{
+  gem::Properties props;
+  if(type>0) {
+    props.set("quality", (float)type);
+  }
+  if(gem::image::save::sync(*image, filename, std::string(), props)) {
+    return (1);
+  }
+  pd_error(0, "GEM: Unable to save image to '%s'", filename);
+  return (0);
+}
+
+bool gem::image::save::sync(const imageStruct&img,
+                            const std::string&filename,
+                            const std::string&mimetype,
+                            const gem::Properties&props)
 {
   gem::plugins::imagesaver*piximagesaver=gem::PixImageSaver::getInstance();
   if(piximagesaver) {
+    return piximagesaver->save(img, filename, mimetype, props);
+  }
+  return false;
+}
+
+
+/***************************************************************************
+ *
+ * SaveQueue - save images in the background
+ *
+ ***************************************************************************/
+namespace gem
+{
+namespace image
+{
+class SaveQueue::PIMPL
+{
+public:
+  struct Job {
+    imageStruct*img;
+    std::string filename;
     std::string mimetype;
     gem::Properties props;
-    if(type>0) {
-      props.set("quality", (float)type);
+    Job(imageStruct*img_, const std::string&filename_,
+        const std::string&mimetype_, const gem::Properties&props_)
+      : img(img_), filename(filename_), mimetype(mimetype_), props(props_)
+    {}
+  };
+
+  mutable std::mutex mutex;
+  std::condition_variable cond_todo;   /* signals encoders that there is work (or that they should quit) */
+  std::condition_variable cond_space;  /* signals producers that a slot became free */
+  std::condition_variable cond_idle;   /* signals flush() that all work is done */
+
+  std::deque<Job*>todo;
+  unsigned int busy; /* number of jobs currently being encoded */
+  bool keeprunning;
+
+  std::vector<std::thread>threads;
+  std::vector<gem::plugins::imagesaver*>savers;
+  /* used for synchronous saving, if the backends are not threadable */
+  gem::plugins::imagesaver*syncsaver;
+
+  enum Policy policy;
+  unsigned int capacity;
+  unsigned int numthreads;
+
+  Stats stats;
+  double totalEncodeTime;
+  std::vector<std::string>failures;
+
+  PIMPL(unsigned int capacity_, unsigned int threads_)
+    : busy(0), keeprunning(true)
+    , syncsaver(NULL)
+    , policy(BLOCK)
+    , capacity(capacity_?capacity_:1)
+    , numthreads(threads_)
+    , totalEncodeTime(0.)
+  {
+    clearStats();
+    if(!numthreads) {
+      /* leave one core for rendering, but don't go crazy */
+      numthreads=gem::thread::getCPUCount();
+      if(numthreads>1) {
+        numthreads--;
+      }
+      if(numthreads>4) {
+        numthreads=4;
+      }
     }
-    if(piximagesaver->save(*image, filename, mimetype, props)) {
-      return (1);
+    start();
+  }
+  ~PIMPL(void)
+  {
+    stop();
+    delete syncsaver;
+    syncsaver=NULL;
+  }
+
+  void clearStats(void)
+  {
+    stats.depth=0;
+    stats.maxdepth=0;
+    stats.capacity=0;
+    stats.threads=0;
+    stats.saved=0;
+    stats.failed=0;
+    stats.dropped=0;
+    stats.encodeTime=0.;
+    stats.lastEncodeTime=0.;
+    totalEncodeTime=0.;
+  }
+
+  bool start(void)
+  {
+    /* the imagesavers are created in the calling (main) thread,
+     * since plugin loading is not thread-safe
+     */
+    for(unsigned int i=0; i<numthreads; i++) {
+      gem::plugins::imagesaver*saver=gem::plugins::imagesaver::getInstance();
+      if(!saver) {
+        break;
+      }
+      if(!saver->isThreadable()) {
+        delete saver;
+        break;
+      }
+      savers.push_back(saver);
     }
+    if(savers.empty()) {
+      /* no threading: save synchronously */
+      if(!syncsaver) {
+        syncsaver=gem::plugins::imagesaver::getInstance();
+      }
+      return false;
+    }
+    keeprunning=true;
+    for(unsigned int i=0; i<savers.size(); i++) {
+      threads.push_back(std::thread(&PIMPL::encoder, this, savers[i]));
+    }
+    return true;
   }
-  pd_error(0, "GEM: Unable to save image to '%s'", filename);
-  return (0);
+  void stop(void)
+  {
+    flush();
+    {
+      std::unique_lock<std::mutex>lock(mutex);
+      keeprunning=false;
+    }
+    cond_todo.notify_all();
+    for(unsigned int i=0; i<threads.size(); i++) {
+      threads[i].join();
+    }
+    threads.clear();
+    for(unsigned int i=0; i<savers.size(); i++) {
+      delete savers[i];
+    }
+    savers.clear();
+  }
+  void flush(void)
+  {
+    std::unique_lock<std::mutex>lock(mutex);
+    while(!threads.empty() && (!todo.empty() || busy)) {
+      cond_idle.wait(lock);
+    }
+  }
+
+  static void dispose(Job*job)
+  {
+    if(job) {
+      delete job->img;
+    }
+    delete job;
+  }
+
+  /* must be called with the mutex held */
+  void done(const Job*job, bool success, double ms)
+  {
+    if(success) {
+      stats.saved++;
+    } else {
+      stats.failed++;
+      /* don't pile up errors if nobody asks for them */
+      if(failures.size()<256) {
+        failures.push_back(job->filename);
+      }
+    }
+    stats.lastEncodeTime=ms;
+    totalEncodeTime+=ms;
+    stats.encodeTime=totalEncodeTime/(stats.saved+stats.failed);
+  }
+
+  bool save(gem::plugins::imagesaver*saver, const Job*job, double&ms)
+  {
+    std::chrono::steady_clock::time_point t0=std::chrono::steady_clock::now();
+    bool success=saver->save(*job->img, job->filename, job->mimetype, job->props);
+    std::chrono::duration<double, std::milli>dt=std::chrono::steady_clock::now()
+        - t0;
+    ms=dt.count();
+    return success;
+  }
+
+  void encoder(gem::plugins::imagesaver*saver)
+  {
+    std::unique_lock<std::mutex>lock(mutex);
+    while(true) {
+      while(keeprunning && todo.empty()) {
+        cond_todo.wait(lock);
+      }
+      if(todo.empty()) {
+        /* told to quit, and nothing left to do */
+        break;
+      }
+      Job*job=todo.front();
+      todo.pop_front();
+      busy++;
+      lock.unlock();
+      cond_space.notify_one();
+
+      double ms=0.;
+      bool success=save(saver, job, ms);
+
+      lock.lock();
+      done(job, success, ms);
+      busy--;
+      bool idle=(todo.empty() && !busy);
+      lock.unlock();
+      dispose(job);
+      if(idle) {
+        cond_idle.notify_all();
+      }
+      lock.lock();
+    }
+  }
+
+  bool push(Job*job)
+  {
+    if(threads.empty()) {
+      /* synchronous fallback */
+      double ms=0.;
+      bool success=syncsaver?save(syncsaver, job, ms):false;
+      std::unique_lock<std::mutex>lock(mutex);
+      done(job, success, ms);
+      lock.unlock();
+      dispose(job);
+      return true;
+    }
+
+    Job*dropped=NULL;
+    std::unique_lock<std::mutex>lock(mutex);
+    if(todo.size()>=capacity) {
+      switch(policy) {
+      case DROP_NEWEST:
+        stats.dropped++;
+        lock.unlock();
+        dispose(job);
+        return false;
+      case DROP_OLDEST:
+        stats.dropped++;
+        dropped=todo.front();
+        todo.pop_front();
+        break;
+      default:
+        while(todo.size()>=capacity) {
+          cond_space.wait(lock);
+        }
+        break;
+      }
+    }
+    todo.push_back(job);
+    if(todo.size()>stats.maxdepth) {
+      stats.maxdepth=todo.size();
+    }
+    lock.unlock();
+    cond_todo.notify_one();
+
+    dispose(dropped);
+    return true;
+  }
+};
+
+SaveQueue::SaveQueue(unsigned int capacity, unsigned int threads)
+  : m_pimpl(new PIMPL(capacity, threads))
+{
+}
+SaveQueue::~SaveQueue(void)
+{
+  delete m_pimpl;
+  m_pimpl=NULL;
+}
+
+/* _private_ dummy implementations */
+SaveQueue::SaveQueue(const SaveQueue&org)
+  : m_pimpl(new PIMPL(org.m_pimpl->capacity, org.m_pimpl->numthreads))
+{
+}
+SaveQueue&SaveQueue::operator=(const SaveQueue&org)
+{
+  return (*this);
+}
+
+bool SaveQueue::push(imageStruct*img, const std::string&filename,
+                     const std::string&mimetype, const gem::Properties&props)
+{
+  if(!img) {
+    return false;
+  }
+  return m_pimpl->push(new PIMPL::Job(img, filename, mimetype, props));
 }
+
+void SaveQueue::flush(void)
+{
+  m_pimpl->flush();
+}
+
+void SaveQueue::setPolicy(enum Policy policy)
+{
+  std::unique_lock<std::mutex>lock(m_pimpl->mutex);
+  m_pimpl->policy=policy;
+}
+enum SaveQueue::Policy SaveQueue::getPolicy(void) const
+{
+  std::unique_lock<std::mutex>lock(m_pimpl->mutex);
+  return m_pimpl->policy;
+}
+void SaveQueue::setCapacity(unsigned int capacity)
+{
+  std::unique_lock<std::mutex>lock(m_pimpl->mutex);
+  m_pimpl->capacity=capacity?capacity:1;
+  lock.unlock();
+  /* blocked producers might fit in now */
+  m_pimpl->cond_space.notify_all();
+}
+void SaveQueue::setThreads(unsigned int threads)
+{
+  if(!threads || threads==m_pimpl->numthreads) {
+    return;
+  }
+  m_pimpl->stop();
+  m_pimpl->numthreads=threads;
+  m_pimpl->start();
+}
+
+struct SaveQueue::Stats SaveQueue::getStats(void) const
+{
+  std::unique_lock<std::mutex>lock(m_pimpl->mutex);
+  Stats stats=m_pimpl->stats;
+  stats.depth=m_pimpl->todo.size();
+  stats.capacity=m_pimpl->capacity;
+  stats.threads=m_pimpl->threads.size();
+  return stats;
+}
+void SaveQueue::resetStats(void)
+{
+  std::unique_lock<std::mutex>lock(m_pimpl->mutex);
+  m_pimpl->clearStats();
+}
+
+std::vector<std::string>SaveQueue::getFailures(void)
+{
+  std::vector<std::string>result;
+  std::unique_lock<std::mutex>lock(m_pimpl->mutex);
+  result.swap(m_pimpl->failures);
+  return result;
+}
+
+bool SaveQueue::string2policy(const std::string&name, enum Policy&policy)
+{
+  if("block"==name) {
+    policy=BLOCK;
+  } else if ("drop_oldest"==name || "oldest"==name) {
+    policy=DROP_OLDEST;
+  } else if ("drop_newest"==name || "newest"==name || "drop"==name) {
+    policy=DROP_NEWEST;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+void SaveQueue::sendStats(const SaveQueue*queue, gem::RTE::Outlet*outlet)
+{
+  if(!outlet) {
+    return;
+  }
+  struct Stats stats;
+  if(queue) {
+    stats=queue->getStats();
+  } else {
+    memset(&stats, 0, sizeof(stats));
+  }
+  std::vector<gem::any>data;
+  data.push_back(std::string("depth"));
+  data.push_back(stats.depth);
+  data.push_back(stats.maxdepth);
+  data.push_back(stats.capacity);
+  outlet->send("stats", data);
+
+  data.clear();
+  data.push_back(std::string("frames"));
+  data.push_back(static_cast<double>(stats.saved));
+  data.push_back(static_cast<double>(stats.dropped));
+  data.push_back(static_cast<double>(stats.failed));
+  outlet->send("stats", data);
+
+  data.clear();
+  data.push_back(std::string("encodetime"));
+  data.push_back(stats.encodeTime);
+  data.push_back(stats.lastEncodeTime);
+  outlet->send("stats", data);
+
+  data.clear();
+  data.push_back(std::string("threads"));
+  data.push_back(stats.threads);
+  outlet->send("stats", data);
+}
+
+}; // image
+}; // gem
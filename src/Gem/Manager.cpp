@@ -36,6 +36,7 @@
 #endif
 
 #include "Utils/SIMD.h"
+#include "Utils/Latency.h"
 
 #include "Controls/gemhead.h"
 
@@ -1173,6 +1174,7 @@ void GemMan :: swapBuffers()
   } else {
     glFlush();
   }
+  gem::utils::FrameLatency::swapped();
 
   //  TODO:
   //  why is this called here?
@@ -50,11 +50,14 @@ protected:
   virtual void  processRGBAImage(imageStruct &image);
   virtual void  processGrayImage(imageStruct &image);
   virtual void  processYUVImage(imageStruct &image);
-#ifdef __VEC__
-  virtual void  processYUVAltivec(imageStruct &image);
-#endif /* __VEC__ */
 
-  unsigned int  *saved;
+  //////////
+  // blend the image into the history;
+  // the bytes (of each 4-byte group) that are set in 'keep' are left alone
+  void          blend(imageStruct &image, unsigned int keep);
+
+  // the history, 8.8 fixed point (one per byte of the image)
+  unsigned short*saved;
   void blurMess(float value);
   float         m_blurf;
   int           m_blurH,m_blurW,m_blurSize,m_blurBpp;
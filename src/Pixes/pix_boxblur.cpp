@@ -0,0 +1,507 @@
+////////////////////////////////////////////////////////
+//
+// GEM - Graphics Environment for Multimedia
+//
+// agent@local
+//
+// Implementation file
+//
+//    Copyright (c) 2026 agent. agent@local
+//    For information on usage and redistribution, and for a DISCLAIMER OF ALL
+//    WARRANTIES, see the file, "GEM.LICENSE.TERMS" in this distribution.
+//
+/////////////////////////////////////////////////////////
+
+#include "pix_boxblur.h"
+#include "Utils/SIMD.h"
+#include "Utils/BandPool.h"
+#include "RTE/Outlet.h"
+
+#include <string.h>
+#include <math.h>
+
+CPPEXTERN_NEW_WITH_ONE_ARG(pix_boxblur, t_float, A_DEFFLOAT);
+
+namespace
+{
+/* bands should not get thinner than this (in lines resp. bytes) */
+const int MIN_BAND_HEIGHT = 32;
+const int MIN_STRIP_WIDTH = 64;
+
+/* the samples of one channel within a line:
+ * bytes offset, offset+step, offset+2*step,... */
+struct Channel {
+  int offset;
+  int step;
+  int radius;
+};
+
+inline unsigned char average(float sum, float scale)
+{
+  return static_cast<unsigned char>(sum*scale + 0.5f);
+}
+
+#ifdef __SSE2__
+/* the 4 bytes at 'in' as 4 ints */
+inline __m128i loadPixel(const unsigned char*in, __m128i zero)
+{
+  int pixel;
+  memcpy(&pixel, in, 4);
+  return _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(pixel), zero),
+                            zero);
+}
+#endif
+
+/* running-sum box filter along the lines [y0..y1) */
+void boxHorizontal(const unsigned char*src, unsigned char*dst,
+                   int pitch, int y0, int y1,
+                   const std::vector<Channel>&channels)
+{
+#ifdef __SSE2__
+  /* 4 channels of the same radius: do them all at once */
+  const bool rgba = (channels.size()==4 && pitch%4==0
+                     && channels[0].step==4 && channels[0].offset==0
+                     && channels[1].offset==1 && channels[2].offset==2
+                     && channels[3].offset==3
+                     && channels[0].radius==channels[3].radius
+                     && channels[1].radius==channels[0].radius
+                     && channels[2].radius==channels[0].radius);
+  if(rgba) {
+    const int r=channels[0].radius;
+    const int last=pitch/4-1;
+    const __m128 scale=_mm_set1_ps(1.f/(2*r+1));
+    const __m128 half=_mm_set1_ps(0.5f);
+    const __m128i zero=_mm_setzero_si128();
+    for(int y=y0; y<y1; y++) {
+      const unsigned char*in=src+y*pitch;
+      unsigned char*out=dst+y*pitch;
+#define PIXEL(x) loadPixel(in+4*(x), zero)
+      __m128i sum=_mm_set_epi32((r+1)*in[3], (r+1)*in[2],
+                                (r+1)*in[1], (r+1)*in[0]);
+      for(int j=1; j<=r; j++) {
+        sum=_mm_add_epi32(sum, PIXEL((j<last)?j:last));
+      }
+      for(int x=0; x<=last; x++) {
+        const __m128i avg=_mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(
+                                             _mm_cvtepi32_ps(sum), scale), half));
+        const __m128i bytes=_mm_packus_epi16(_mm_packs_epi32(avg, zero), zero);
+        const int pixel=_mm_cvtsi128_si32(bytes);
+        memcpy(out+4*x, &pixel, 4);
+        const int add=(x+r+1<last)?(x+r+1):last;
+        const int sub=(x-r>0)?(x-r):0;
+        sum=_mm_sub_epi32(_mm_add_epi32(sum, PIXEL(add)), PIXEL(sub));
+      }
+#undef PIXEL
+    }
+    return;
+  }
+#endif
+  for(int y=y0; y<y1; y++) {
+    for(size_t c=0; c<channels.size(); c++) {
+      const int step=channels[c].step, r=channels[c].radius;
+      const unsigned char*in=src+y*pitch+channels[c].offset;
+      unsigned char*out=dst+y*pitch+channels[c].offset;
+      const int last=(pitch-channels[c].offset-1)/step;
+      const float scale=1.f/(2*r+1);
+      int sum=(r+1)*in[0];
+      for(int j=1; j<=r; j++) {
+        sum+=in[((j<last)?j:last)*step];
+      }
+      for(int x=0; x<=last; x++) {
+        out[x*step]=average(sum, scale);
+        const int add=(x+r+1<last)?(x+r+1):last;
+        const int sub=(x-r>0)?(x-r):0;
+        sum+=in[add*step]-in[sub*step];
+      }
+    }
+  }
+}
+
+/* running-sum box filter along the columns (bytes) [x0..x1) */
+void boxVertical(const unsigned char*src, unsigned char*dst,
+                 int pitch, int height, int x0, int x1, int r,
+                 std::vector<int>&scratch)
+{
+  const int width=x1-x0;
+  const int last=height-1;
+  if(width<1) {
+    return;
+  }
+  const float scale=1.f/(2*r+1);
+  scratch.resize(width);
+  int*acc=&scratch[0];
+  src+=x0;
+  dst+=x0;
+
+  for(int i=0; i<width; i++) {
+    acc[i]=(r+1)*src[i];
+  }
+  for(int j=1; j<=r; j++) {
+    const unsigned char*in=src+((j<last)?j:last)*pitch;
+    for(int i=0; i<width; i++) {
+      acc[i]+=in[i];
+    }
+  }
+
+  for(int y=0; y<height; y++) {
+    const unsigned char*add=src+((y+r+1<last)?(y+r+1):last)*pitch;
+    const unsigned char*sub=src+((y-r>0)?(y-r):0)*pitch;
+    unsigned char*out=dst+y*pitch;
+    int i=0;
+#ifdef __SSE2__
+    const __m128 vscale=_mm_set1_ps(scale);
+    const __m128 half=_mm_set1_ps(0.5f);
+    const __m128i zero=_mm_setzero_si128();
+    for(; i+16<=width; i+=16) {
+      __m128i*a=reinterpret_cast<__m128i*>(acc+i);
+      __m128i a0=_mm_loadu_si128(a+0), a1=_mm_loadu_si128(a+1);
+      __m128i a2=_mm_loadu_si128(a+2), a3=_mm_loadu_si128(a+3);
+#define AVERAGE(x) _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(x), \
+                                    vscale), half))
+      const __m128i lo=_mm_packs_epi32(AVERAGE(a0), AVERAGE(a1));
+      const __m128i hi=_mm_packs_epi32(AVERAGE(a2), AVERAGE(a3));
+#undef AVERAGE
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out+i),
+                       _mm_packus_epi16(lo, hi));
+
+      const __m128i in=_mm_loadu_si128(reinterpret_cast<const __m128i*>(add+i));
+      const __m128i out_=_mm_loadu_si128(reinterpret_cast<const __m128i*>(sub+i));
+      /* (in-out) as 16 shorts, then widened to ints */
+      const __m128i dlo=_mm_sub_epi16(_mm_unpacklo_epi8(in, zero),
+                                      _mm_unpacklo_epi8(out_, zero));
+      const __m128i dhi=_mm_sub_epi16(_mm_unpackhi_epi8(in, zero),
+                                      _mm_unpackhi_epi8(out_, zero));
+      a0=_mm_add_epi32(a0, _mm_srai_epi32(_mm_unpacklo_epi16(dlo, dlo), 16));
+      a1=_mm_add_epi32(a1, _mm_srai_epi32(_mm_unpackhi_epi16(dlo, dlo), 16));
+      a2=_mm_add_epi32(a2, _mm_srai_epi32(_mm_unpacklo_epi16(dhi, dhi), 16));
+      a3=_mm_add_epi32(a3, _mm_srai_epi32(_mm_unpackhi_epi16(dhi, dhi), 16));
+      _mm_storeu_si128(a+0, a0);
+      _mm_storeu_si128(a+1, a1);
+      _mm_storeu_si128(a+2, a2);
+      _mm_storeu_si128(a+3, a3);
+    }
+#endif
+    for(; i<width; i++) {
+      out[i]=average(acc[i], scale);
+      acc[i]+=add[i]-sub[i];
+    }
+  }
+}
+
+/* summed-area table, step 1: running sums along the lines [y0..y1) */
+void integralLines(const unsigned char*src, unsigned int*sat,
+                   int pitch, int y0, int y1,
+                   const std::vector<Channel>&channels)
+{
+  for(int y=y0; y<y1; y++) {
+    for(size_t c=0; c<channels.size(); c++) {
+      const int step=channels[c].step;
+      const unsigned char*in=src+y*pitch+channels[c].offset;
+      unsigned int*out=sat+y*pitch+channels[c].offset;
+      const int last=(pitch-channels[c].offset-1)/step;
+      unsigned int sum=0;
+      for(int x=0; x<=last; x++) {
+        sum+=in[x*step];
+        out[x*step]=sum;
+      }
+    }
+  }
+}
+
+/* summed-area table, step 2: running sums along the columns [x0..x1)
+ * (the sums may wrap around; the differences are still right) */
+void integralColumns(unsigned int*sat, int pitch, int height, int x0, int x1)
+{
+  for(int y=1; y<height; y++) {
+    const unsigned int*above=sat+(y-1)*pitch;
+    unsigned int*line=sat+y*pitch;
+    for(int x=x0; x<x1; x++) {
+      line[x]+=above[x];
+    }
+  }
+}
+
+/* box filter the lines [y0..y1) from the summed-area table */
+void integralBox(const unsigned int*sat, unsigned char*dst,
+                 int pitch, int height, int y0, int y1, int r,
+                 const std::vector<Channel>&channels)
+{
+  for(int y=y0; y<y1; y++) {
+    const int top=y-r-1;  // the line above the box (-1: none)
+    const int bottom=(y+r<height)?(y+r):(height-1);
+    const unsigned int*b=sat+bottom*pitch;
+    const unsigned int*t=(top>=0)?(sat+top*pitch):NULL;
+    const int lines=bottom-((top>=0)?top:-1);
+    for(size_t c=0; c<channels.size(); c++) {
+      const int step=channels[c].step, cr=channels[c].radius;
+      const int offset=channels[c].offset;
+      const int last=(pitch-offset-1)/step;
+      const unsigned int*bc=b+offset;
+      const unsigned int*tc=t?(t+offset):NULL;
+      unsigned char*out=dst+y*pitch+offset;
+      /* the box is completely inside the line for x in [x0..x1) */
+      int x0=cr+1, x1=last-cr+1;
+      if(x1<x0) {
+        x0=x1=last+1;
+      }
+      for(int x=0; x<=last; x++) {
+        if(x==x0) {
+          /* fast path */
+          const float scale=1.f/(lines*(2*cr+1));
+          const int width=(2*cr+1)*step;
+          if(tc) {
+            for(; x<x1; x++) {
+              const int right=(x+cr)*step;
+              const unsigned int sum=bc[right]-bc[right-width]
+                                     -tc[right]+tc[right-width];
+              out[x*step]=average(static_cast<float>(sum), scale);
+            }
+          } else {
+            for(; x<x1; x++) {
+              const int right=(x+cr)*step;
+              const unsigned int sum=bc[right]-bc[right-width];
+              out[x*step]=average(static_cast<float>(sum), scale);
+            }
+          }
+          if(x>last) {
+            break;
+          }
+        }
+        const int left=x-cr-1;
+        const int right=(x+cr<last)?(x+cr):last;
+        unsigned int sum=bc[right*step];
+        if(tc) {
+          sum-=tc[right*step];
+        }
+        if(left>=0) {
+          sum-=bc[left*step];
+          if(tc) {
+            sum+=tc[left*step];
+          }
+        }
+        const int area=lines*(right-((left>=0)?left:-1));
+        out[x*step]=average(static_cast<float>(sum), 1.f/area);
+      }
+    }
+  }
+}
+
+/* the radii of 3 box blurs that approximate a gaussian with 'sigma' */
+void gaussRadii(float sigma, int radii[3])
+{
+  const int n=3;
+  int wl=static_cast<int>(floorf(sqrtf(12.f*sigma*sigma/n + 1.f)));
+  if(wl%2==0) {
+    wl--;
+  }
+  const int wu=wl+2;
+  const float m=(12.f*sigma*sigma - n*wl*wl - 4.f*n*wl - 3.f*n)/(-4.f*wl - 4.f);
+  const int mi=static_cast<int>(floorf(m+0.5f));
+  for(int i=0; i<n; i++) {
+    radii[i]=((i<mi)?wl:wu)/2;
+  }
+}
+};
+
+/////////////////////////////////////////////////////////
+//
+// pix_boxblur
+//
+/////////////////////////////////////////////////////////
+// Constructor
+//
+/////////////////////////////////////////////////////////
+pix_boxblur :: pix_boxblur(t_float radius) :
+  m_radius(radius>0?radius:0),
+  m_mode(BOX),
+  m_pool(new gem::thread::BandPool()),
+  m_outlet(NULL)
+{
+  inlet_new(this->x_obj, &this->x_obj->ob_pd, &s_float, gensym("radius"));
+  m_outlet = new gem::RTE::Outlet(this);
+}
+
+/////////////////////////////////////////////////////////
+// Destructor
+//
+/////////////////////////////////////////////////////////
+pix_boxblur :: ~pix_boxblur(void)
+{
+  delete m_outlet;
+  delete m_pool;
+}
+
+/////////////////////////////////////////////////////////
+// processImage
+//
+/////////////////////////////////////////////////////////
+void pix_boxblur :: blur(imageStruct &image, int stride, unsigned int chroma)
+{
+  const int r=static_cast<int>(m_radius+0.5f);
+  if(!image.data || image.xsize<1 || image.ysize<1
+      || (m_mode!=GAUSS && r<1) || (m_mode==GAUSS && m_radius<0.5f)) {
+    return;
+  }
+  m_pool->begin();
+
+  const int pitch=image.xsize*image.csize;
+  const int height=image.ysize;
+  for(int i=0; i<2; i++) {
+    imageStruct&buf=m_buffer[i];
+    buf.xsize=image.xsize;
+    buf.ysize=image.ysize;
+    buf.csize=image.csize;
+    buf.format=image.format;
+    buf.type=image.type;
+    buf.upsidedown=image.upsidedown;
+    if(!buf.reallocate()) {
+      return;
+    }
+  }
+  unsigned char*tmp=m_buffer[0].data;
+  unsigned char*dst=m_buffer[1].data;
+
+  const unsigned int bands = m_pool->getBands(height, MIN_BAND_HEIGHT,
+                             pitch, MIN_STRIP_WIDTH);
+  if(m_scratch.size()<bands) {
+    m_scratch.resize(bands);
+  }
+  /* lines [y0..y1) resp. (16-byte aligned) columns [x0..x1) of a band */
+  std::vector<int>lines(bands+1), columns(bands+1);
+  for(unsigned int b=0; b<=bands; b++) {
+    lines[b]=height*b/bands;
+    columns[b]=(b==bands)?pitch:(((pitch*b/bands)/16)*16);
+  }
+
+  std::vector<Channel>channels;
+  for(int c=0; c<stride; c++) {
+    Channel ch;
+    ch.offset=c;
+    ch.step=stride;
+    ch.radius=r;
+    if(chroma & (1<<c)) {
+      // subsampled chroma
+      ch.radius=r/2;
+    } else if (chroma) {
+      // luma: both Y-channels are one
+      if(c!=chY0) {
+        continue;
+      }
+      ch.step=stride/2;
+    }
+    channels.push_back(ch);
+  }
+
+  if(m_mode==INTEGRAL) {
+    m_sat.resize(static_cast<size_t>(pitch)*height);
+    unsigned int*sat=&m_sat[0];
+    const unsigned char*src=image.data;
+    m_pool->run(bands, [&](unsigned int b) {
+      integralLines(src, sat, pitch, lines[b], lines[b+1], channels);
+    });
+    m_pool->run(bands, [&](unsigned int b) {
+      integralColumns(sat, pitch, height, columns[b], columns[b+1]);
+    });
+    m_pool->run(bands, [&](unsigned int b) {
+      integralBox(sat, dst, pitch, height, lines[b], lines[b+1], r, channels);
+    });
+  } else {
+    int radii[3]= {r, 0, 0};
+    int passes=1;
+    if(m_mode==GAUSS) {
+      gaussRadii(m_radius, radii);
+      passes=3;
+    }
+    const unsigned char*src=image.data;
+    for(int pass=0; pass<passes; pass++) {
+      const int pr=radii[pass];
+      for(size_t c=0; c<channels.size(); c++) {
+        channels[c].radius=(chroma & (1<<channels[c].offset))?(pr/2):pr;
+      }
+      m_pool->run(bands, [&](unsigned int b) {
+        boxHorizontal(src, tmp, pitch, lines[b], lines[b+1], channels);
+      });
+      m_pool->run(bands, [&](unsigned int b) {
+        boxVertical(tmp, dst, pitch, height, columns[b], columns[b+1], pr,
+                    m_scratch[b]);
+      });
+      src=dst;
+    }
+  }
+
+  image.data = dst;
+  image.not_owned = true;
+
+  m_pool->end(static_cast<double>(image.xsize)*image.ysize);
+}
+
+void pix_boxblur :: processRGBAImage(imageStruct &image)
+{
+  blur(image, 4, 0);
+}
+
+void pix_boxblur :: processRGBImage(imageStruct &image)
+{
+  blur(image, 3, 0);
+}
+
+void pix_boxblur :: processGrayImage(imageStruct &image)
+{
+  blur(image, 1, 0);
+}
+
+void pix_boxblur :: processYUVImage(imageStruct &image)
+{
+  blur(image, 4, (1<<chU) | (1<<chV));
+}
+
+/////////////////////////////////////////////////////////
+// messages
+//
+/////////////////////////////////////////////////////////
+void pix_boxblur :: radiusMess(float radius)
+{
+  m_radius = (radius>0)?radius:0;
+  setPixModified();
+}
+
+void pix_boxblur :: modeMess(std::string mode)
+{
+  if("box" == mode) {
+    m_mode = BOX;
+  } else if ("gauss" == mode) {
+    m_mode = GAUSS;
+  } else if ("integral" == mode) {
+    m_mode = INTEGRAL;
+  } else {
+    error("unknown mode '%s' (use 'box', 'gauss' or 'integral')", mode.c_str());
+    return;
+  }
+  if(m_mode != INTEGRAL) {
+    /* free the summed-area table */
+    std::vector<unsigned int>().swap(m_sat);
+  }
+  setPixModified();
+}
+
+void pix_boxblur :: threadsMess(int threads)
+{
+  m_pool->setThreads((threads>0)?threads:0);
+}
+
+void pix_boxblur :: statsMess(void)
+{
+  m_pool->sendStats(m_outlet);
+}
+
+/////////////////////////////////////////////////////////
+// static member function
+//
+/////////////////////////////////////////////////////////
+void pix_boxblur :: obj_setupCallback(t_class *classPtr)
+{
+  CPPEXTERN_MSG1(classPtr, "radius", radiusMess, float);
+  CPPEXTERN_MSG1(classPtr, "mode", modeMess, std::string);
+  CPPEXTERN_MSG1(classPtr, "threads", threadsMess, int);
+  CPPEXTERN_MSG0(classPtr, "stats", statsMess);
+}
@@ -0,0 +1,112 @@
+/*-----------------------------------------------------------------
+LOG
+    GEM - Graphics Environment for Multimedia
+
+    spatial box/gaussian blur
+
+    Copyright (c) 2026 agent. agent@local
+    For information on usage and redistribution, and for a DISCLAIMER OF ALL
+    WARRANTIES, see the file, "GEM.LICENSE.TERMS" in this distribution.
+
+-----------------------------------------------------------------*/
+
+#ifndef _INCLUDE__GEM_PIXES_PIX_BOXBLUR_H_
+#define _INCLUDE__GEM_PIXES_PIX_BOXBLUR_H_
+
+#include "Base/GemPixObj.h"
+#include <vector>
+
+namespace gem
+{
+namespace RTE
+{
+class Outlet;
+};
+namespace thread
+{
+class BandPool;
+};
+};
+
+/*-----------------------------------------------------------------
+-------------------------------------------------------------------
+CLASS
+    pix_boxblur
+
+    blur an image; the cost per pixel does not depend on the radius
+
+KEYWORDS
+    pix
+
+DESCRIPTION
+
+    "radius" - the radius of the blur (in pixels)
+    "mode box" - a box blur (running sums; horizontal, then vertical)
+    "mode gauss" - approximate a gaussian blur (with "radius" as sigma)
+                   by 3 box blurs
+    "mode integral" - a box blur from a summed-area table
+                   (at the border, only the pixels within the image count)
+    "threads" - number of threads (0: one per CPU)
+    "stats" - output timing information
+
+    the horizontal passes are distributed over the threads by lines,
+    the vertical passes by columns.
+    for YUV images, the chroma is blurred with half the horizontal radius.
+
+-----------------------------------------------------------------*/
+class GEM_EXTERN pix_boxblur : public GemPixObj
+{
+  CPPEXTERN_HEADER(pix_boxblur, GemPixObj);
+
+public:
+
+  //////////
+  // Constructor
+  pix_boxblur(t_float radius);
+
+protected:
+
+  //////////
+  // Destructor
+  virtual ~pix_boxblur(void);
+
+  //////////
+  // Do the processing
+  virtual void  processRGBAImage(imageStruct &image);
+  virtual void  processRGBImage(imageStruct &image);
+  virtual void  processGrayImage(imageStruct &image);
+  virtual void  processYUVImage(imageStruct &image);
+
+  //////////
+  // blur the image; each pixel consists of 'stride' bytes,
+  // 'chroma' is the byte-mask of the subsampled (YUV) chroma channels
+  void          blur(imageStruct &image, int stride, unsigned int chroma);
+
+  void          radiusMess(float radius);
+  void          modeMess(std::string mode);
+  void          threadsMess(int threads);
+  void          statsMess(void);
+
+  enum Mode {
+    BOX,
+    GAUSS,
+    INTEGRAL
+  };
+
+  float         m_radius;
+  Mode          m_mode;
+
+  // the intermediate and the final image
+  imageStruct   m_buffer[2];
+  // the summed-area table for INTEGRAL
+  std::vector<unsigned int>m_sat;
+  // per-thread scratch memory for the vertical passes
+  std::vector<std::vector<int> >m_scratch;
+
+  // the threads (and the timing of the last frame)
+  gem::thread::BandPool*m_pool;
+
+  gem::RTE::Outlet*m_outlet;
+};
+
+#endif  // for header file
@@ -18,10 +18,20 @@
 
 #include "pix_buffer.h"
 #include "Gem/ImageIO.h"
+#include "Gem/GemGL.h"
 
 #include <string.h>
 #include <stdio.h>
+#include <stdint.h>
 #include "Gem/Files.h"
+#include "Gem/Properties.h"
+
+#ifndef _WIN32
+# include <fcntl.h>
+# include <unistd.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+#endif
 
 #include "plugins/imagesaver.h"
 #include "RTE/Outlet.h"
@@ -76,6 +86,68 @@ static void addProperties(CPPExtern*obj, gem::Properties&props, int argc, t_atom
   }
 }
 
+/* the frame-bank format:
+ *  a header, a table of which frames are present, and the raw frames,
+ *  each starting at a multiple of 'align' bytes
+ *  (so they can be memory-mapped and paged in individually)
+ */
+namespace
+{
+static const char BANK_MAGIC[8]= {'G', 'E', 'M', 'B', 'A', 'N', 'K', 0};
+static const uint32_t BANK_BYTEORDER=0x01020304;
+static const uint32_t BANK_VERSION=1;
+/* covers the page sizes of all systems we know of */
+static const uint32_t BANK_ALIGN=16384;
+
+struct BankHeader {
+  char magic[8];
+  uint32_t byteorder;
+  uint32_t version;
+  uint32_t xsize, ysize, csize;
+  uint32_t format, type, upsidedown;
+  uint32_t frames;
+  uint32_t align;
+  uint64_t framesize; /* bytes per frame */
+  uint64_t stride;    /* distance between two frames */
+  uint64_t offset;    /* position of frame #0 */
+  /* followed by 'frames' bytes: 1 if the frame is present, 0 otherwise */
+};
+/* 64bit file positions (frame-banks can easily exceed 2GB) */
+static int seekFile(FILE*f, uint64_t pos, int whence)
+{
+#ifdef _WIN32
+  return _fseeki64(f, (__int64)pos, whence);
+#else
+  return fseeko(f, (off_t)pos, whence);
+#endif
+}
+static int64_t tellFile(FILE*f)
+{
+#ifdef _WIN32
+  return _ftelli64(f);
+#else
+  return ftello(f);
+#endif
+}
+static uint64_t frameSize(uint32_t xsize, uint32_t ysize, uint32_t csize,
+                          uint32_t type)
+{
+  uint64_t size=(uint64_t)xsize*ysize*csize;
+  switch(type) {
+  case GL_FLOAT:
+    return size*sizeof(GLfloat);
+  case GL_DOUBLE:
+    return size*sizeof(GLdouble);
+  default:
+    return size;
+  }
+}
+static uint64_t alignTo(uint64_t value, uint64_t align)
+{
+  return ((value + align - 1) / align) * align;
+}
+};
+
 /////////////////////////////////////////////////////////
 //
 // pix_buffer
@@ -94,7 +166,11 @@ pix_buffer :: pix_buffer(t_symbol* s,t_float f=100.0)
     m_numframes(0),
     m_bindname(NULL),
     m_handle(NULL),
-    m_outlet(new gem::RTE::Outlet(this))
+    m_outlet(new gem::RTE::Outlet(this)),
+    m_async(false),
+    m_queue(NULL),
+    m_immediatePos(0), m_immediateCount(0),
+    m_bank(NULL), m_banksize(0), m_readahead(8)
 {
   if (s==&s_) {
     static int buffercounter=0;
@@ -125,11 +201,17 @@ pix_buffer :: pix_buffer(t_symbol* s,t_float f=100.0)
 pix_buffer :: ~pix_buffer( void )
 {
   pd_unbind(&this->x_obj->ob_pd, m_bindname);
+  cancelLoading();
+
+  /* this blocks until all pending images are saved */
+  delete m_queue;
+  m_queue=NULL;
 
   if(m_buffer) {
     delete [] m_buffer;
   }
   m_buffer=NULL;
+  unmapBank();
   if(m_handle) {
     delete m_handle;
   }
@@ -193,7 +275,10 @@ void pix_buffer :: resizeMess(int newsize)
   }
 
   for(i=0; i<size; i++) {
-    if(0!=m_buffer[i].data) {
+    if(isMapped(m_buffer+i)) {
+      // only copy the descriptor: the pixels stay in the frame-bank
+      m_buffer[i].copy2ImageStruct(buffer+i);
+    } else if(0!=m_buffer[i].data) {
       // copy the image
       m_buffer[i].copy2Image(buffer+i);
       m_buffer[i].xsize=1;
@@ -268,9 +353,6 @@ void pix_buffer :: loadMess(std::string filename, int pos)
 {
   // GRH: muss i wie in pix_image die ganzen andern Sachen a machen ????
 
-  // load an image into mem
-  imageStruct *image = NULL;
-
   // some checks
   if (pos<0 || pos>=m_numframes) {
     pd_error(0, "index %d out of range (0..%d)!", pos, m_numframes);
@@ -278,16 +360,379 @@ void pix_buffer :: loadMess(std::string filename, int pos)
   }
   std::string file=findFile(filename);
 
-  image = image2mem(file.c_str());
+  // the decoded image is shared via the image cache,
+  // so we copy it straight into the buffer
+  gem::Properties props;
+  gem::image::cache::image_t image=gem::image::cache::load(file, props);
   if(!image) {
     pd_error(0, "'%s' is no valid image!", file.c_str());
     return;
   }
 
-  putMess(image,pos);
+  image->copy2Image(m_buffer+pos);
+}
+
+/////////////////////////////////////////////////////////
+// loadseqMess
+//
+/////////////////////////////////////////////////////////
+void pix_buffer :: loadseqMess(t_symbol*, int argc, t_atom*argv)
+{
+  if(argc<3 || argc>4 || A_SYMBOL!=argv[0].a_type) {
+    pd_error(0, "loadseq <pattern> <first> <last> [<pos>]");
+    return;
+  }
+  const std::string pattern=atom_getsymbol(argv)->s_name;
+  const int first=atom_getint(argv+1);
+  const int last=atom_getint(argv+2);
+  const int pos=(argc>3)?atom_getint(argv+3):0;
+  const std::string::size_type star=pattern.find('*');
+  if(std::string::npos==star) {
+    pd_error(0, "unable to find * in '%s'", pattern.c_str());
+    return;
+  }
+  if(last<first || pos<0) {
+    pd_error(0, "invalid range %d..%d @ %d", first, last, pos);
+    return;
+  }
+  cancelLoading();
+
+  std::vector<std::string>files;
+  for(int i=first; i<=last && (pos+files.size())<m_numframes; i++) {
+    char num[32];
+    snprintf(num, sizeof(num), "%d", i);
+    files.push_back(findFile(pattern.substr(0, star) + num +
+                             pattern.substr(star+1)));
+  }
+  if((unsigned int)(last-first+1)>files.size()) {
+    pd_error(0, "only room for %d of %d images", (int)files.size(),
+             last-first+1);
+  }
 
-  // destroy the image-data
-  delete image;
+  std::vector<gem::image::load::id_t>IDs;
+  /* if the images cannot be loaded in the background,
+   * they are delivered (in order) from within asyncBatch()
+   */
+  m_immediatePos=pos;
+  m_immediateCount=files.size();
+  if(!gem::image::load::asyncBatch(loadCallback, this, files, IDs)) {
+    m_immediateCount=0;
+    pd_error(0, "unable to load images");
+    return;
+  }
+  m_immediateCount=0;
+  for(unsigned int i=0; i<IDs.size(); i++) {
+    if(gem::image::load::IMMEDIATE!=IDs[i]) {
+      m_loading[IDs[i]]=pos+i;
+    }
+  }
+}
+void pix_buffer :: cancelLoading(void)
+{
+  std::map<gem::image::load::id_t, unsigned int>::iterator it;
+  for(it=m_loading.begin(); it!=m_loading.end(); ++it) {
+    gem::image::load::cancel(it->first);
+  }
+  m_loading.clear();
+}
+void pix_buffer :: loaded(gem::image::load::id_t ID, imageStruct*img)
+{
+  unsigned int pos=0;
+  if(gem::image::load::IMMEDIATE==ID && m_immediateCount) {
+    pos=m_immediatePos++;
+    m_immediateCount--;
+  } else {
+    std::map<gem::image::load::id_t, unsigned int>::iterator it=m_loading.find(
+          ID);
+    if(m_loading.end()==it) {
+      delete img;
+      return;
+    }
+    pos=it->second;
+    m_loading.erase(it);
+  }
+  if(img) {
+    if(pos<m_numframes) {
+      imageStruct*slot=m_buffer+pos;
+      /* hand the decoded pixels over to the slot rather than copying them
+       * (the slot's old buffer is freed along with 'img') */
+      if(img->data && slot->swapData(*img)) {
+        slot->xsize=img->xsize;
+        slot->ysize=img->ysize;
+        slot->csize=img->csize;
+        slot->format=img->format;
+        slot->type=img->type;
+        slot->upsidedown=img->upsidedown;
+      } else {
+        img->copy2Image(slot);
+      }
+    }
+    delete img;
+  }
+  if(!m_loading.empty() || m_immediateCount) {
+    return;
+  }
+
+  const struct gem::image::load::BatchStats stats=
+    gem::image::load::getBatchStats();
+  const double secs=stats.time/1000.;
+  std::vector<gem::any>data;
+  data.push_back(static_cast<double>(stats.files));
+  data.push_back(static_cast<double>(stats.failed));
+  data.push_back(stats.time);
+  data.push_back((secs>0.)?(stats.files/secs):0.);
+  data.push_back((secs>0.)?(stats.bytes/(1024.*1024.)/secs):0.);
+  m_outlet->send("loadseq", data);
+}
+void pix_buffer :: loadCallback(void*data, gem::image::load::id_t ID,
+                                imageStruct*img, const gem::Properties&)
+{
+  pix_buffer*me=reinterpret_cast<pix_buffer*>(data);
+  me->loaded(ID, img);
+}
+
+/////////////////////////////////////////////////////////
+// frame-banks
+//   store all frames as raw data in a single file,
+//   that can be memory-mapped when loading
+//
+/////////////////////////////////////////////////////////
+void pix_buffer :: savebankMess(std::string filename)
+{
+  if(filename.empty()) {
+    pd_error(0, "no filename given!");
+    return;
+  }
+  /* all frames must look the same */
+  const imageStruct*ref=NULL;
+  for(unsigned int i=0; i<m_numframes; i++) {
+    const imageStruct*img=m_buffer+i;
+    if(!img->data || !img->format) {
+      continue;
+    }
+    if(!ref) {
+      ref=img;
+    } else if(img->xsize!=ref->xsize || img->ysize!=ref->ysize
+              || img->format!=ref->format || img->type!=ref->type
+              || img->upsidedown!=ref->upsidedown) {
+      pd_error(0, "frame %d differs from frame %d: refusing to save frame-bank",
+               i, (int)(ref-m_buffer));
+      return;
+    }
+  }
+  if(!ref) {
+    pd_error(0, "nothing to save");
+    return;
+  }
+
+  BankHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, BANK_MAGIC, sizeof(header.magic));
+  header.byteorder=BANK_BYTEORDER;
+  header.version=BANK_VERSION;
+  header.xsize=ref->xsize;
+  header.ysize=ref->ysize;
+  header.csize=ref->csize;
+  header.format=ref->format;
+  header.type=ref->type;
+  header.upsidedown=ref->upsidedown;
+  header.frames=m_numframes;
+  header.align=BANK_ALIGN;
+  header.framesize=frameSize(ref->xsize, ref->ysize, ref->csize, ref->type);
+  header.stride=alignTo(header.framesize, BANK_ALIGN);
+  header.offset=alignTo(sizeof(header)+m_numframes, BANK_ALIGN);
+
+  const std::string fullname=gem::files::getFullpath(filename);
+  FILE*f=fopen(fullname.c_str(), "wb");
+  if(!f) {
+    pd_error(0, "unable to open '%s' for writing", fullname.c_str());
+    return;
+  }
+  bool ok=(1==fwrite(&header, sizeof(header), 1, f));
+  for(unsigned int i=0; ok && i<m_numframes; i++) {
+    const unsigned char present=(m_buffer[i].data && m_buffer[i].format)?1:0;
+    ok=(EOF!=fputc(present, f));
+  }
+  for(unsigned int i=0; ok && i<m_numframes; i++) {
+    if(!m_buffer[i].data || !m_buffer[i].format) {
+      continue;
+    }
+    ok=(0==seekFile(f, header.offset + i*header.stride, SEEK_SET))
+       && (1==fwrite(m_buffer[i].data, header.framesize, 1, f));
+  }
+  /* make the file as long as the last frame's stride */
+  const uint64_t end=header.offset + m_numframes*header.stride;
+  if(ok && (uint64_t)tellFile(f)<end) {
+    ok=(0==seekFile(f, end-1, SEEK_SET)) && (EOF!=fputc(0, f));
+  }
+  if(fclose(f)) {
+    ok=false;
+  }
+  if(!ok) {
+    pd_error(0, "failed to write frame-bank '%s'", fullname.c_str());
+  }
+}
+
+void pix_buffer :: loadbankMess(std::string filename)
+{
+  const std::string fullname=findFile(filename);
+  cancelLoading();
+
+  unsigned char*bank=NULL;
+  size_t banksize=0;
+  BankHeader header;
+  const char*err=NULL;
+#ifdef _WIN32
+  /* no mmap(), so we read the whole file */
+  FILE*f=fopen(fullname.c_str(), "rb");
+  if(f) {
+    if(!seekFile(f, 0, SEEK_END)) {
+      const int64_t len=tellFile(f);
+      if(len>0) {
+        banksize=len;
+        bank=new unsigned char[banksize];
+        rewind(f);
+        if(1!=fread(bank, banksize, 1, f)) {
+          delete[]bank;
+          bank=NULL;
+        }
+      }
+    }
+    fclose(f);
+  }
+#else
+  int fd=open(fullname.c_str(), O_RDONLY);
+  if(fd>=0) {
+    struct stat st;
+    if(!fstat(fd, &st) && st.st_size>0) {
+      banksize=st.st_size;
+      /* copy-on-write, so objects writing into the frames don't touch the file */
+      void*addr=mmap(NULL, banksize, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+      if(MAP_FAILED!=addr) {
+        bank=reinterpret_cast<unsigned char*>(addr);
+      }
+    }
+    close(fd);
+  }
+#endif
+  if(!bank) {
+    pd_error(0, "unable to open frame-bank '%s'", fullname.c_str());
+    return;
+  }
+
+  if(banksize<sizeof(header)) {
+    err="file too short";
+  } else {
+    memcpy(&header, bank, sizeof(header));
+    if(memcmp(header.magic, BANK_MAGIC, sizeof(header.magic))) {
+      err="not a frame-bank";
+    } else if(BANK_BYTEORDER!=header.byteorder) {
+      err="wrong byte order";
+    } else if(BANK_VERSION!=header.version) {
+      err="unsupported version";
+    } else if(header.framesize != frameSize(header.xsize, header.ysize,
+                                            header.csize, header.type)
+              || header.stride<header.framesize
+              || header.offset<sizeof(header)+header.frames
+              || header.offset + (uint64_t)header.frames*header.stride > banksize) {
+      err="corrupt header";
+    }
+  }
+  if(err) {
+    pd_error(0, "'%s': %s", fullname.c_str(), err);
+#ifdef _WIN32
+    delete[]bank;
+#else
+    munmap(bank, banksize);
+#endif
+    return;
+  }
+
+  const unsigned char*present=bank+sizeof(header);
+  imageStruct*buffer=new imageStruct[header.frames];
+  for(unsigned int i=0; i<header.frames; i++) {
+    if(!present[i]) {
+      continue;
+    }
+    imageStruct&img=buffer[i];
+    img.xsize=header.xsize;
+    img.ysize=header.ysize;
+    img.csize=header.csize;
+    img.format=header.format;
+    img.type=header.type;
+    img.upsidedown=header.upsidedown;
+    img.data=bank + header.offset + i*header.stride;
+    img.not_owned=true;
+  }
+  delete[]m_buffer;
+  m_buffer=buffer;
+  m_numframes=header.frames;
+
+  unmapBank();
+  m_bank=bank;
+  m_banksize=banksize;
+  prefetch(0, 1);
+
+  bangMess();
+}
+
+void pix_buffer :: readaheadMess(int frames)
+{
+  m_readahead=(frames<0)?0:frames;
+}
+
+void pix_buffer :: prefetch(unsigned int pos, int direction)
+{
+#ifndef _WIN32
+  if(!m_bank || !m_readahead) {
+    return;
+  }
+  static const size_t pagesize=sysconf(_SC_PAGESIZE);
+  for(unsigned int i=1; i<=m_readahead; i++) {
+    const long frame=(long)pos + ((direction<0)?-(long)i:(long)i);
+    if(frame<0 || frame>=(long)m_numframes) {
+      break;
+    }
+    const imageStruct&img=m_buffer[frame];
+    if(!isMapped(&img)) {
+      continue;
+    }
+    const size_t size=frameSize(img.xsize, img.ysize, img.csize, img.type);
+    const size_t start=(img.data-m_bank)/pagesize*pagesize;
+    madvise(m_bank+start, (img.data-m_bank)+size-start, MADV_WILLNEED);
+  }
+#endif
+}
+
+bool pix_buffer :: isMapped(const imageStruct*img) const
+{
+  return m_bank && img->data && img->not_owned
+         && img->data>=m_bank && img->data<m_bank+m_banksize;
+}
+
+void pix_buffer :: unmapBank(void)
+{
+  if(!m_bank) {
+    return;
+  }
+  /* frames that still live in the frame-bank are copied out */
+  for(unsigned int i=0; m_buffer && i<m_numframes; i++) {
+    if(isMapped(m_buffer+i)) {
+      imageStruct&img=m_buffer[i];
+      const unsigned char*src=img.data;
+      /* gets us our own buffer (the bank is left alone) */
+      if(img.reallocate()) {
+        memcpy(img.data, src, frameSize(img.xsize, img.ysize, img.csize, img.type));
+      }
+    }
+  }
+#ifdef _WIN32
+  delete[]m_bank;
+#else
+  munmap(m_bank, m_banksize);
+#endif
+  m_bank=NULL;
+  m_banksize=0;
 }
 
 /////////////////////////////////////////////////////////
@@ -307,7 +752,16 @@ void pix_buffer :: saveMess(std::string filename, int pos)
 
   if(img && img->data) {
     std::string fullname=gem::files::getFullpath(filename);
-    if(m_handle) {
+    if(m_async) {
+      /* the queue takes ownership of the image, so give it a copy */
+      if(!m_queue) {
+        m_queue=new gem::image::SaveQueue();
+      }
+      imageStruct*copy=new imageStruct();
+      img->copy2Image(copy);
+      m_queue->push(copy, fullname, std::string(), m_writeprops);
+      reportFailures();
+    } else if(m_handle) {
       m_handle->save(*img, fullname, std::string(), m_writeprops);
     } else {
       mem2image(img, fullname.c_str(), 0);
@@ -337,6 +791,46 @@ void pix_buffer :: copyMess(int src, int dst)
   }
 }
 
+/////////////////////////////////////////////////////////
+// background saving
+//
+/////////////////////////////////////////////////////////
+void pix_buffer :: asyncMess(bool on)
+{
+  if(!on && m_queue) {
+    m_queue->flush();
+    reportFailures();
+  }
+  m_async=on;
+}
+void pix_buffer :: policyMess(t_symbol*s)
+{
+  gem::image::SaveQueue::Policy policy;
+  if(!gem::image::SaveQueue::string2policy(s->s_name, policy)) {
+    pd_error(0, "unknown policy '%s' (use 'block', 'drop_oldest' or 'drop_newest')",
+             s->s_name);
+    return;
+  }
+  if(!m_queue) {
+    m_queue=new gem::image::SaveQueue();
+  }
+  m_queue->setPolicy(policy);
+}
+void pix_buffer :: statsMess(void)
+{
+  gem::image::SaveQueue::sendStats(m_queue, m_outlet);
+}
+void pix_buffer :: reportFailures(void)
+{
+  if(!m_queue) {
+    return;
+  }
+  std::vector<std::string>failed=m_queue->getFailures();
+  for(unsigned int i=0; i<failed.size(); i++) {
+    pd_error(0, "unable to save image to '%s'", failed[i].c_str());
+  }
+}
+
 void pix_buffer :: enumProperties(void)
 {
   std::vector<std::string> mimetypes;
@@ -428,8 +922,15 @@ void pix_buffer :: obj_setupCallback(t_class *classPtr)
   CPPEXTERN_MSG0(classPtr, "bang", bangMess);
   CPPEXTERN_MSG2(classPtr, "open", loadMess, std::string, int);
   CPPEXTERN_MSG2(classPtr, "load", loadMess, std::string, int);
+  CPPEXTERN_MSG (classPtr, "loadseq", loadseqMess);
   CPPEXTERN_MSG2(classPtr, "save", saveMess, std::string, int);
+  CPPEXTERN_MSG1(classPtr, "savebank", savebankMess, std::string);
+  CPPEXTERN_MSG1(classPtr, "loadbank", loadbankMess, std::string);
+  CPPEXTERN_MSG1(classPtr, "readahead", readaheadMess, int);
   CPPEXTERN_MSG2(classPtr, "copy", copyMess, int, int);
+  CPPEXTERN_MSG1(classPtr, "async", asyncMess, bool);
+  CPPEXTERN_MSG1(classPtr, "policy", policyMess, t_symbol*);
+  CPPEXTERN_MSG0(classPtr, "stats", statsMess);
   CPPEXTERN_MSG (classPtr, "allocate", allocateMess);
 
   CPPEXTERN_MSG0(classPtr, "enumProps",  enumProperties);
@@ -17,6 +17,9 @@ LOG
 
 #include "Base/CPPExtern.h"
 #include "Gem/Image.h"
+#include "Gem/ImageIO.h"
+
+#include <map>
 
 #include "Gem/Properties.h"
 
@@ -42,6 +45,10 @@ namespace plugins
 {
 class imagesaver;
 };
+namespace image
+{
+class SaveQueue;
+};
 namespace RTE
 {
 class Outlet;
@@ -71,12 +78,34 @@ public:
   void          allocateMess(t_symbol*,int,t_atom*);
   virtual void  bangMess( void );
   virtual void  loadMess(std::string,int);
+  //////////
+  // load a numbered sequence of images in parallel:
+  // "loadseq <pattern> <first> <last> [<pos>]" ('*' in the pattern is
+  // replaced by the number)
+  virtual void  loadseqMess(t_symbol*,int,t_atom*);
   virtual void  saveMess(std::string,int);
 
+  //////////
+  // frame-banks: all frames as raw data in a single file
+  // "loadbank" memory-maps the file, so the frames are paged in lazily
+  virtual void  savebankMess(std::string);
+  virtual void  loadbankMess(std::string);
+  // number of frames to read ahead (in the playback direction)
+  virtual void  readaheadMess(int);
+  // hint that the frames following <pos> (in <direction>) will be needed soon
+  virtual void  prefetch(unsigned int pos, int direction);
+
   virtual void  copyMess(int,int);
 
   virtual void  resizeMess(int);
 
+  //////////
+  // background saving
+  virtual void  asyncMess(bool);
+  virtual void  policyMess(t_symbol*);
+  virtual void  statsMess(void);
+  virtual void  reportFailures(void);
+
   virtual void enumProperties( void );
   virtual void clearProperties( void );
   virtual void setProperties( t_symbol*, int, t_atom*);
@@ -90,6 +119,25 @@ protected:
 
   gem::plugins::imagesaver*m_handle;
   gem::RTE::Outlet*m_outlet;
+
+  bool m_async;
+  gem::image::SaveQueue*m_queue;
+
+  // images of a "loadseq" that are still being loaded (ID -> position)
+  std::map<gem::image::load::id_t, unsigned int>m_loading;
+  // images delivered synchronously (if the loader is not threadable)
+  unsigned int m_immediatePos, m_immediateCount;
+  void cancelLoading(void);
+  void loaded(gem::image::load::id_t, imageStruct*);
+  static void loadCallback(void*, gem::image::load::id_t, imageStruct*,
+                           const gem::Properties&);
+
+  // the memory-mapped frame-bank
+  unsigned char*m_bank;
+  size_t m_banksize;
+  unsigned int m_readahead;
+  bool isMapped(const imageStruct*) const;
+  void unmapBank(void);
 };
 
 #endif  // for header file
@@ -141,6 +141,8 @@ void pix_buffer_read :: update_image()
   }
 
   img=buffer->getMess((int)m_frame);
+  /* frames from a frame-bank are paged in lazily, so ask for the next ones */
+  buffer->prefetch((unsigned int)m_frame, (m_auto<0.f)?-1:1);
 
   if (img && img->data) {
     img->copy2ImageStruct(&m_pixBlock.image);
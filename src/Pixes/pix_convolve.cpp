@@ -18,10 +18,220 @@
 #include "pix_convolve.h"
 #include "Gem/Exception.h"
 #include "Utils/Functions.h"
+#include "Utils/SIMD.h"
+#include "Utils/BandPool.h"
+#include "RTE/Outlet.h"
+
+#include <string.h>
+#include <math.h>
 
 CPPEXTERN_NEW_WITH_TWO_ARGS(pix_convolve, t_floatarg, A_DEFFLOAT,
                             t_floatarg, A_DEFFLOAT);
 
+namespace
+{
+/* bands should not get thinner than this (in lines),
+ * else the threads spend more time on the margins than on the band */
+const int MIN_BAND_HEIGHT = 32;
+
+struct ConvolveJob {
+  const unsigned char*src;
+  unsigned char*dst;
+  int width, height;
+  size_t pitch;        // bytes per line (of both src and dst)
+  int stride, offset;  // bytes per pixel; byte of the first channel
+  int channels;        // number of channels to convolve
+  int skip;            // byte (within a pixel) to leave alone (-1: none)
+  int fill;            // value for the bytes not convolved (-1: copy)
+  int kw, kh;          // size of the kernel
+  const float*kernel;  // kh lines of kw taps
+  bool separable;
+  const float*hkernel; // kw taps
+  const float*vkernel; // kh taps
+};
+
+/* out[i] (+)= sum_j k[j]*in[i+j*step] */
+void correlate(float*out, const float*in, const float*k, int taps,
+               int step, size_t n, bool accumulate)
+{
+  size_t i=0;
+#ifdef __SSE__
+  /* two independent sums, to keep the pipeline busy */
+  for(; i+8<=n; i+=8) {
+    __m128 sum0 = accumulate?_mm_loadu_ps(out+i  ):_mm_setzero_ps();
+    __m128 sum1 = accumulate?_mm_loadu_ps(out+i+4):_mm_setzero_ps();
+    const float*in_i=in+i;
+    for(int j=0; j<taps; j++) {
+      const __m128 kj=_mm_set1_ps(k[j]);
+      sum0 = _mm_add_ps(sum0, _mm_mul_ps(kj, _mm_loadu_ps(in_i+j*step  )));
+      sum1 = _mm_add_ps(sum1, _mm_mul_ps(kj, _mm_loadu_ps(in_i+j*step+4)));
+    }
+    _mm_storeu_ps(out+i  , sum0);
+    _mm_storeu_ps(out+i+4, sum1);
+  }
+#endif
+  for(; i<n; i++) {
+    float sum = accumulate?out[i]:0.f;
+    for(int j=0; j<taps; j++) {
+      sum += k[j]*in[i+j*step];
+    }
+    out[i] = sum;
+  }
+}
+
+/* out[i] = sum_r k[r]*rows[r][i] */
+void combine(float*out, const float*const*rows, const float*k, int taps,
+             size_t n)
+{
+  size_t i=0;
+#ifdef __SSE__
+  for(; i+8<=n; i+=8) {
+    __m128 sum0 = _mm_setzero_ps();
+    __m128 sum1 = _mm_setzero_ps();
+    for(int r=0; r<taps; r++) {
+      const __m128 kr=_mm_set1_ps(k[r]);
+      sum0 = _mm_add_ps(sum0, _mm_mul_ps(kr, _mm_loadu_ps(rows[r]+i  )));
+      sum1 = _mm_add_ps(sum1, _mm_mul_ps(kr, _mm_loadu_ps(rows[r]+i+4)));
+    }
+    _mm_storeu_ps(out+i  , sum0);
+    _mm_storeu_ps(out+i+4, sum1);
+  }
+#endif
+  for(; i<n; i++) {
+    float sum = 0.f;
+    for(int r=0; r<taps; r++) {
+      sum += k[r]*rows[r][i];
+    }
+    out[i] = sum;
+  }
+}
+
+/* convert line 'y' to floats, with 'pad' pixels replicated at either end */
+void loadLine(const ConvolveJob&job, int y, int pad, float*out)
+{
+  if(y<0) {
+    y=0;
+  } else if (y>=job.height) {
+    y=job.height-1;
+  }
+  const unsigned char*line=job.src+y*job.pitch+job.offset;
+  const int channels=job.channels;
+  const int width=job.width;
+  float*data=out+pad*channels;
+  if(channels==job.stride) {
+    const int n=width*channels;
+    for(int i=0; i<n; i++) {
+      data[i] = line[i];
+    }
+  } else {
+    for(int x=0; x<width; x++) {
+      const unsigned char*pixel=line+x*job.stride;
+      for(int c=0; c<channels; c++) {
+        data[x*channels+c] = pixel[c];
+      }
+    }
+  }
+  const size_t pixelsize=channels*sizeof(float);
+  for(int x=0; x<pad; x++) {
+    memcpy(out+x*channels, data, pixelsize);
+    memcpy(data+(width+x)*channels, data+(width-1)*channels, pixelsize);
+  }
+}
+
+void storeLine(const ConvolveJob&job, int y, const float*in)
+{
+  const unsigned char*source=job.src+y*job.pitch;
+  unsigned char*line=job.dst+y*job.pitch;
+  const int channels=job.channels;
+  if(channels==job.stride) {
+    const int n=job.width*channels;
+    int i=0;
+#ifdef __SSE2__
+    /* the saturating packs do the clamping */
+    const __m128 half=_mm_set1_ps(0.5f);
+    for(; i+8<=n; i+=8) {
+      __m128i lo=_mm_cvttps_epi32(_mm_add_ps(_mm_loadu_ps(in+i), half));
+      __m128i hi=_mm_cvttps_epi32(_mm_add_ps(_mm_loadu_ps(in+i+4), half));
+      __m128i bytes=_mm_packus_epi16(_mm_packs_epi32(lo, hi), _mm_setzero_si128());
+      _mm_storel_epi64(reinterpret_cast<__m128i*>(line+i), bytes);
+    }
+#endif
+    for(; i<n; i++) {
+      const float v=in[i] + 0.5f;
+      line[i] = (v<=0.f)?0:((v>=255.f)?255:static_cast<unsigned char>(v));
+    }
+    if(job.skip>=0) {
+      for(int x=0; x<job.width; x++) {
+        line[x*job.stride+job.skip] = source[x*job.stride+job.skip];
+      }
+    }
+    return;
+  }
+
+  if(job.fill>=0) {
+    memset(line, job.fill, job.pitch);
+  } else {
+    memcpy(line, source, job.pitch);
+  }
+  line+=job.offset;
+  const int skip=job.skip-job.offset;
+  for(int x=0; x<job.width; x++) {
+    unsigned char*pixel=line+x*job.stride;
+    for(int c=0; c<channels; c++) {
+      const float v=*in++ + 0.5f;
+      if(c==skip) {
+        continue;
+      }
+      pixel[c] = (v<=0.f)?0:((v>=255.f)?255:static_cast<unsigned char>(v));
+    }
+  }
+}
+
+/* convolve the lines [y0..y1) */
+void convolveBand(const ConvolveJob&job, int y0, int y1,
+                  std::vector<float>&scratch)
+{
+  const int rw=job.kw/2, rh=job.kh/2;
+  const size_t n=job.width*job.channels;
+  const size_t padn=(job.width+2*rw)*job.channels;
+  /* a ring of the last 'kh' lines: either horizontally filtered
+   * (separable kernels) or just padded (all others) */
+  const size_t linesize=job.separable?n:padn;
+  scratch.resize(padn + job.kh*linesize + n);
+  float*padded=&scratch[0];
+  float*ring=padded+padn;
+  float*acc=ring+job.kh*linesize;
+  std::vector<const float*>rows(job.kh);
+
+  const int first=y0-rh;
+  for(int y=first; y<y1+rh; y++) {
+    float*line=ring+((y-first)%job.kh)*linesize;
+    if(job.separable) {
+      loadLine(job, y, rw, padded);
+      correlate(line, padded, job.hkernel, job.kw, job.channels, n, false);
+    } else {
+      loadLine(job, y, rw, line);
+    }
+    if(y-first < job.kh-1) {
+      continue;
+    }
+    /* we have all the lines for output line 'y-rh' */
+    for(int r=0; r<job.kh; r++) {
+      rows[r]=ring+((y-job.kh+1+r-first)%job.kh)*linesize;
+    }
+    if(job.separable) {
+      combine(acc, &rows[0], job.vkernel, job.kh, n);
+    } else {
+      for(int r=0; r<job.kh; r++) {
+        correlate(acc, rows[r], job.kernel+r*job.kw, job.kw, job.channels, n,
+                  r>0);
+      }
+    }
+    storeLine(job, y-rh, acc);
+  }
+}
+};
+
 /////////////////////////////////////////////////////////
 //
 // pix_convolve
@@ -31,15 +241,17 @@ CPPEXTERN_NEW_WITH_TWO_ARGS(pix_convolve, t_floatarg, A_DEFFLOAT,
 //
 /////////////////////////////////////////////////////////
 pix_convolve :: pix_convolve(t_floatarg fRow, t_floatarg fCol) :
-  m_imatrix(NULL),
-  m_irange(255),
+  m_range(1.f),
   m_rows(0), m_cols(0),
-  m_chroma(0)
+  m_chroma(0),
+  m_separable(false),
+  m_pool(new gem::thread::BandPool()),
+  m_outlet(NULL)
 {
   int row = static_cast<int>(fRow);
   int col = static_cast<int>(fCol);
 
-  if (!row || !col ) {
+  if (row<1 || col<1) {
     throw(GemException("matrix must have some dimension"));
   }
 
@@ -49,20 +261,17 @@ pix_convolve :: pix_convolve(t_floatarg fRow, t_floatarg fCol) :
 
   m_rows = row;
   m_cols = col;
-  m_imatrix = new signed short[m_rows * m_cols];
-
   // zero out the matrix
-  int i;
-  for (i = 0; i < m_cols * m_rows; i++) {
-    m_imatrix[i] = 0;
-  }
+  m_matrix.assign(m_rows * m_cols, 0.f);
   // insert a one for the default center value (identity matrix)
-  m_imatrix[ ((m_cols / 2 + 1) * m_rows) + (m_rows / 2 + 1) ] = 255;
+  m_matrix[ (m_cols / 2) * m_rows + (m_rows / 2) ] = 1.f;
+  updateKernel();
 
   inlet_new(this->x_obj, &this->x_obj->ob_pd, gensym("float"),
             gensym("ft1"));
   inlet_new(this->x_obj, &this->x_obj->ob_pd, gensym("list"),
             gensym("matrix"));
+  m_outlet = new gem::RTE::Outlet(this);
 }
 
 /////////////////////////////////////////////////////////
@@ -71,611 +280,132 @@ pix_convolve :: pix_convolve(t_floatarg fRow, t_floatarg fCol) :
 /////////////////////////////////////////////////////////
 pix_convolve :: ~pix_convolve()
 {
-  if (m_imatrix) {
-    delete [] m_imatrix;
-  }
+  delete m_outlet;
+  delete m_pool;
 }
 
 /////////////////////////////////////////////////////////
-// processImage
+// updateKernel
 //
 /////////////////////////////////////////////////////////
-void pix_convolve :: calculateRGBA3x3(imageStruct &image,
-                                      imageStruct &tempImg)
+void pix_convolve :: updateKernel(void)
 {
-  int i;
-  int j;
-//  int k;
-  int xsize =  tempImg.xsize;
-  int ysize =  tempImg.ysize;
-  int size = xsize*ysize - xsize-1;
-  int csize = tempImg.csize;
-
-  int* src = (int*) tempImg.data;
-  int* dest = (int*)image.data;
-
-
-//unroll this to do R G B in one pass?? (too many registers?)
-  i = xsize;
-  int* val1 = 0;
-  int* val2 = src+i-xsize;
-  int* val3 = src+i-xsize+1;
-  int* val4 = src+i-1;
-  int* val5 = src+i;
-  int* val6 = src+i+1;
-  int* val7 = src+i+xsize-1;
-  int* val8 = src+i+xsize;
-  int* val9 = src+i+xsize+1;
-  int res;
-  for (i=xsize+1; i<size; i++) {
-    val1 = val2;
-    val2 = val3;
-    val3 = src+i-xsize+1;
-    val4 = val5;
-    val5 = val6;
-    val6 = src+i+1;
-    val7 = val8;
-    val8 = val9;
-    val9 = src+i+xsize+1;
-    if (i%xsize == 0 || i%xsize == xsize-1) {
-      continue;
+  const int kw=m_rows, kh=m_cols;
+
+  m_kernel.resize(kw*kh);
+  int pivot=0;
+  for(int i=0; i<kw*kh; i++) {
+    m_kernel[i]=m_matrix[i]*m_range;
+    if(fabsf(m_matrix[i])>fabsf(m_matrix[pivot])) {
+      pivot=i;
     }
-#ifndef __APPLE__
-    for (j=0; j<3; j++)
-#else
-    for (j=1; j<4; j++)
-#endif
-    {
-      //      res =  m_imatrix[0]*(int)((unsigned char*)val1)[j];
-      res =  m_imatrix[0]*static_cast<int>(reinterpret_cast<unsigned char*>(val1)[j]);
-      res += m_imatrix[1]*static_cast<int>(reinterpret_cast<unsigned char*>(val2)[j]);
-      res += m_imatrix[2]*static_cast<int>(reinterpret_cast<unsigned char*>(val3)[j]);
-      res += m_imatrix[3]*static_cast<int>(reinterpret_cast<unsigned char*>(val4)[j]);
-      res += m_imatrix[4]*static_cast<int>(reinterpret_cast<unsigned char*>(val5)[j]);
-      res += m_imatrix[5]*static_cast<int>(reinterpret_cast<unsigned char*>(val6)[j]);
-      res += m_imatrix[6]*static_cast<int>(reinterpret_cast<unsigned char*>(val7)[j]);
-      res += m_imatrix[7]*static_cast<int>(reinterpret_cast<unsigned char*>(val8)[j]);
-      res += m_imatrix[8]*static_cast<int>(reinterpret_cast<unsigned char*>(val9)[j]);
-      res*=m_irange;
-      res>>=16;
-      ((unsigned char*)dest)[i*csize+j] = CLAMP(res);
-    }
-  }
-}
-
-void pix_convolve :: processRGBAImage(imageStruct &image)
-{
-  image.copy2Image(&tempImg);
-  int initX = m_rows / 2;
-  int initY = m_cols / 2;
-  int maxX = tempImg.xsize - initX;
-  int maxY = tempImg.ysize - initY;
-  int xTimesc = tempImg.xsize * tempImg.csize;
-  int initOffset = initY * xTimesc + initX * tempImg.csize;
-  const int csize = tempImg.csize;
-
-  if (m_rows == 3 && m_cols == 3) {
-    calculateRGBA3x3(image,tempImg);
-    return;
   }
 
-  for (int y = initY; y < maxY; y++) {
-    int realY = y * xTimesc;
-    int offsetY = realY - initOffset;
-
-    for (int x = initX; x < maxX; x++) {
-      int realPos = x * csize + realY;
-      int offsetXY = x * csize + offsetY;
-
-      // skip the alpha value
-      for (int c = 1; c < csize; c++) {
-        int new_val = 0;
-        int offsetXYC = offsetXY + c;
-        for (int matY = 0; matY < m_cols; matY++) {
-          int offsetXYCMat = matY * xTimesc + offsetXYC;
-          int realMatY = matY * m_rows;
-          for (int matX = 0; matX < m_rows; matX++) {
-            new_val += (tempImg.data[offsetXYCMat + matX * csize] *
-                        m_imatrix[realMatY + matX])>>8;
-          }
-        }
-        image.data[realPos + c] = CLAMP(new_val);
-        //removes insult from injury ??
-        // we do not use the m_irange anymore ...  remove it ??
-
+  /* the kernel is separable, if it has rank 1,
+   * that is: each line is a multiple of the line of the pivot */
+  const int pr=pivot/kw, pc=pivot%kw;
+  const float p=m_matrix[pivot];
+  const float epsilon=p*p*1e-6;
+  bool separable=(kw>1 && kh>1);
+  for(int y=0; separable && y<kh; y++) {
+    for(int x=0; x<kw; x++) {
+      if(fabsf(m_matrix[y*kw+x]*p - m_matrix[y*kw+pc]*m_matrix[pr*kw+x])
+          > epsilon) {
+        separable=false;
+        break;
       }
     }
   }
-
-}
-
-void pix_convolve :: processGrayImage(imageStruct &image)
-{
-  const int csize=image.csize;
-  image.copy2Image(&tempImg);
-  int initX = m_rows / 2;
-  int initY = m_cols / 2;
-  int maxX = tempImg.xsize - initX;
-  int maxY = tempImg.ysize - initY;
-  int xTimesc = tempImg.xsize * csize;
-  int initOffset = initY * xTimesc + initX * csize;
-
-  for (int y = initY; y < maxY; y++)    {
-    int realY = y * xTimesc;
-    int offsetY = realY - initOffset;
-
-    for (int x = initX; x < maxX; x++)        {
-      int offsetXY = x + offsetY;
-
-      int new_val = 0;
-      int offsetXYC = offsetXY;
-      for (int matY = 0; matY < m_cols; matY++)   {
-        int offsetXYCMat = matY * xTimesc + offsetXYC;
-        int realMatY = matY * m_rows;
-        for (int matX = 0; matX < m_rows; matX++)     {
-          new_val += (tempImg.data[offsetXYCMat + matX] *
-                      m_imatrix[realMatY + matX])>>8;
-        }
-      }
-      image.data[x+realY] = CLAMP(new_val);
-      //removes insult from injury ??
-      // we do not use the m_irange anymore ...  remove it ??
-    }
+  m_separable=separable;
+  if(!m_separable) {
+    return;
+  }
+  m_hkernel.resize(kw);
+  m_vkernel.resize(kh);
+  for(int x=0; x<kw; x++) {
+    m_hkernel[x]=m_matrix[pr*kw+x]*m_range;
+  }
+  for(int y=0; y<kh; y++) {
+    m_vkernel[y]=(p!=0.f)?(m_matrix[y*kw+pc]/p):0.f;
   }
 }
 
-void pix_convolve :: processYUVImage(imageStruct &image)
+/////////////////////////////////////////////////////////
+// processImage
+//
+/////////////////////////////////////////////////////////
+void pix_convolve :: convolve(imageStruct &image, int stride, int offset,
+                              int channels, int skip, int fill)
 {
-  image.copy2Image(&tempImg);
-  //float range = 1;
-  int initX = m_rows / 2;
-  int initY = m_cols / 2;
-  int maxX = tempImg.xsize - initX;
-  int maxY = tempImg.ysize - initY;
-  int xTimesc = tempImg.xsize * tempImg.csize;
-  int initOffset = initY * xTimesc + initX * tempImg.csize;
-
-//   calculate3x3YUV(image,tempImg);
-
-//quick fix for Intel 3x3YUV problems
-#ifdef __BIG_ENDIAN__
-  if (m_rows == 3 && m_cols == 3) {
-    calculate3x3YUV(image,tempImg);
+  if(!image.data || image.xsize<1 || image.ysize<1) {
     return;
   }
-#endif
-  if (m_chroma) {
-    for (int y = initY; y < maxY; y++)   {
-      int realY = y * xTimesc;
-      int offsetY = realY - initOffset;
-
-      for (int x = initX; x < maxX; x++) {
-        int realPos = x * tempImg.csize + realY;
-        int offsetXY = x * tempImg.csize + offsetY;
-
-        // skip the UV
-        for (int c = 1; c < 3; c+=2) {
-          int new_val = 0;
-          int offsetXYC = offsetXY + c;
-          for (int matY = 0; matY < m_cols; matY++) {
-            int offsetXYCMat = matY * xTimesc + offsetXYC;
-            int realMatY = matY * m_rows;
-            for (int matX = 0; matX < m_rows; matX++) {
-              new_val += (tempImg.data[offsetXYCMat + matX * tempImg.csize] *
-                          m_imatrix[realMatY + matX])>>8;
-            }
-          }
-          image.data[realPos + c] = CLAMP(new_val);
-          // image.data[realPos + c-1] = 128;  //remove the U+V
-        }
-      }
-    }
-  } else {
-    for (int y = initY; y < maxY; y++) {
-      int realY = y * xTimesc;
-      int offsetY = realY - initOffset;
-
-      for (int x = initX; x < maxX; x++) {
-        int realPos = x * tempImg.csize + realY;
-        int offsetXY = x * tempImg.csize + offsetY;
-
-        // skip the UV
-        for (int c = 1; c < 3; c+=2) {
-          int new_val = 0;
-          int offsetXYC = offsetXY + c;
-          for (int matY = 0; matY < m_cols; matY++) {
-            int offsetXYCMat = matY * xTimesc + offsetXYC;
-            int realMatY = matY * m_rows;
-            for (int matX = 0; matX < m_rows; matX++) {
-              new_val += (tempImg.data[offsetXYCMat + matX * tempImg.csize] *
-                          m_imatrix[realMatY + matX])>>8;
-            }
-          }
-          image.data[realPos + c] = CLAMP(new_val);
-          image.data[realPos + c-1] = 128;  //remove the U+V
-        }
-      }
-    }
+  m_pool->begin();
+
+  tempImg.xsize = image.xsize;
+  tempImg.ysize = image.ysize;
+  tempImg.csize = image.csize;
+  tempImg.format = image.format;
+  tempImg.type = image.type;
+  tempImg.upsidedown = image.upsidedown;
+  if(!tempImg.reallocate()) {
+    return;
   }
 
-}
-
-//make two functions - one for chroma one without
-void pix_convolve :: calculate3x3YUV(imageStruct &image,
-                                     imageStruct &tempImg)
-{
+  ConvolveJob job;
+  job.src = image.data;
+  job.dst = tempImg.data;
+  job.width = image.xsize;
+  job.height = image.ysize;
+  job.pitch = image.xsize*image.csize;
+  job.stride = stride;
+  job.offset = offset;
+  job.channels = channels;
+  job.skip = skip;
+  job.fill = fill;
+  job.kw = m_rows;
+  job.kh = m_cols;
+  job.kernel = &m_kernel[0];
+  job.separable = m_separable;
+  job.hkernel = m_separable?&m_hkernel[0]:NULL;
+  job.vkernel = m_separable?&m_vkernel[0]:NULL;
+
+  const unsigned int bands = m_pool->getBands(image.ysize, MIN_BAND_HEIGHT);
+  if(m_scratch.size()<bands) {
+    m_scratch.resize(bands);
+  }
 
-#ifdef __VEC__
-  calculate3x3YUVAltivec(image,tempImg);
-  return;
-#else
-  int xsize =  tempImg.xsize -1;
-  int ysize =  tempImg.ysize -1;
-
-  short* src = (short*) tempImg.data;
-  short* dest = (short*)image.data;
-  int mat1,mat2,mat3,mat4,mat5,mat6,mat7,mat8,mat9;
-  int res1,res2,res3,res4,res5,res6,res7,res8,res9;
-  int range;
-
-  mat1 = m_imatrix[0];
-  mat2 = m_imatrix[1];
-  mat3 = m_imatrix[2];
-  mat4 = m_imatrix[3];
-  mat5 = m_imatrix[4];
-  mat6 = m_imatrix[5];
-  mat7 = m_imatrix[6];
-  mat8 = m_imatrix[7];
-  mat9 = m_imatrix[8];
-  range =m_irange;
-
-  if (m_chroma) {
-    int i = xsize;
-
-#ifdef i386
-    unsigned char val1 = 0;
-    unsigned char val2 = src[i-xsize+1];
-    unsigned char val3 = src[i-xsize+3];
-    unsigned char val4 = src[i-1];
-    unsigned char val5 = src[i+1];
-    unsigned char val6 = src[i+3];
-    unsigned char val7 = src[i+xsize-1];
-    unsigned char val8 = src[i+xsize+1];
-    unsigned char val9 = src[i+xsize+3];
-#else
-    unsigned char val1 = 0;
-    unsigned char val2 = src[i-xsize+1];
-    unsigned char val3 = src[i-xsize+3];
-    unsigned char val4 = src[i-1];
-    unsigned char val5 = src[i+1];
-    unsigned char val6 = src[i+3];
-    unsigned char val7 = src[i+xsize-1];
-    unsigned char val8 = src[i+xsize+1];
-    unsigned char val9 = src[i+xsize+3];
-#endif
+  const int height=image.ysize;
+  m_pool->run(bands, [&](unsigned int b) {
+    convolveBand(job, height*b/bands, height*(b+1)/bands, m_scratch[b]);
+  });
 
-    //unroll this 2x to fill the registers? (matrix*y1*y2= 9*9*9 =27)
-    //messed up looking on x86
-    i=xsize+2;
-
-    for (int k=1; k<ysize; k++) {
-      for (int j=1; j<xsize; j++) {
-        //load furthest value first...the rest should be in cache
-
-        val7 = val8;
-        val8 = val9;
-        val9 = src[i+xsize+3]; //this will come from main mem
-        val1 = val2;
-        val2 = val3;
-        val3 = src[i-xsize+3]; //should be in cache from previous pass
-        val4 = val5;
-        val5 = val6;
-        val6 = src[i+3];
-
-        //unroll??
-        res1 = mat1*static_cast<int>(val1);
-        res2 = mat2*static_cast<int>(val2);
-        res3 = mat3*static_cast<int>(val3);
-        res4 = mat4*static_cast<int>(val4);
-        res5 = mat5*static_cast<int>(val5);
-        res6 = mat6*static_cast<int>(val6);
-        res7 = mat7*static_cast<int>(val7);
-        res8 = mat8*static_cast<int>(val8);
-        res9 = mat9*static_cast<int>(val9);
-
-
-        res1 += res2 + res3;
-        res4 += res5 + res6;
-        res7 += res8 + res9;
-        res1 += res4 + res7;
-
-        res1*=range;
-        res1>>=16;
-        ((unsigned char*)dest)[i*2+1] = CLAMP(res1);
-        i++;
+  image.data = tempImg.data;
+  image.not_owned = true;
 
-      }
-      i=k*tempImg.xsize;
-    }
-  } else {
-    int i = xsize;
-    //make these temp register vars rather than pointers?
-
-    short* val1 = 0;
-    short* val2 = src+i-xsize; //val2 = src[i-xsize];
-    short* val3 = src+i-xsize+1; //val3 = src[i-xsize+1];
-    short* val4 = src+i-1; //val4 = src[i-1];
-    short* val5 = src+i; //val5 = src[i];
-    short* val6 = src+i+1; //val6 = src[i+1];
-    short* val7 = src+i+xsize-1; //val7 = src[i+xsize-1];
-    short* val8 = src+i+xsize; //val8 = src[i+xsize];
-    short* val9 = src+i+xsize+1; //val9 = src[i+xsize+1];
-    /*
-    short* val1 = 0;
-    short* val2 = src+i-xsize; //val2 = src[i-xsize];
-    short* val3 = src+i-xsize+1; //val3 = src[i-xsize+1];
-    short* val4 = src+i-1; //val4 = src[i-1];
-    short* val5 = src+i; //val5 = src[i];
-    short* val6 = src+i+1; //val6 = src[i+1];
-    short* val7 = src+i+xsize-1; //val7 = src[i+xsize-1];
-    short* val8 = src+i+xsize; //val8 = src[i+xsize];
-    short* val9 = src+i+xsize+1; //val9 = src[i+xsize+1];*/
-    //int res;
-// for (i=xsize+1;i<size;i++) {
-    for (int k=1; k<ysize; k++) {
-      for (int j=1; j<xsize; j++) {
-        val1 = val2;
-        val2 = val3;
-        val3 = src+i-xsize+1;
-        val4 = val5;
-        val5 = val6;
-        val6 = src+i+1;
-        val7 = val8;
-        val8 = val9;
-        val9 = src+i+xsize+1;
-
-        /* if (i%xsize == 0 || i%xsize == xsize-1) continue;
-#ifndef __APPLE__
-         for (j=0;j<3;j++)
-#else
-         for (j=1;j<3;j+=2)
-#endif
-         { */
-
-        res1 = mat1*static_cast<int>(reinterpret_cast<unsigned char*>(val1)[j]);
-        res2 = mat2*static_cast<int>(reinterpret_cast<unsigned char*>(val2)[j]);
-        res3 = mat3*static_cast<int>(reinterpret_cast<unsigned char*>(val3)[j]);
-        res4 = mat4*static_cast<int>(reinterpret_cast<unsigned char*>(val4)[j]);
-        res5 = mat5*static_cast<int>(reinterpret_cast<unsigned char*>(val5)[j]);
-        res6 = mat6*static_cast<int>(reinterpret_cast<unsigned char*>(val6)[j]);
-        res7 = mat7*static_cast<int>(reinterpret_cast<unsigned char*>(val7)[j]);
-        res8 = mat8*static_cast<int>(reinterpret_cast<unsigned char*>(val8)[j]);
-        res9 = mat9*static_cast<int>(reinterpret_cast<unsigned char*>(val9)[j]);
-        res1 += res2 + res3;
-        res4 += res5 + res6;
-        res7 += res8 + res9;
-        res1 += res4 + res7;
-        res1*=range;
-        res1>>=16;
-        // ((unsigned char*)dest)[i*2] = 128;
-        // ((unsigned char*)dest)[i*2+2] = 128;
-        ((unsigned char*)dest)[i*2+1] = CLAMP(res1);
-        // }
-        ((unsigned char*)dest)[i*2] = 128;
-        // ((unsigned char*)dest)[i*2+2] = 128;
-        i++;
-      }
-      i=k*tempImg.xsize;
-    }
-  }
-#endif
+  m_pool->end(static_cast<double>(image.xsize)*image.ysize);
 }
 
-//too many temps for all the registers - reuse some
-void pix_convolve :: calculate3x3YUVAltivec(imageStruct &image,
-    imageStruct &tempImg)
+void pix_convolve :: processRGBAImage(imageStruct &image)
 {
-#ifdef __VEC__
-  int h,w,width,i;
-  int xsize =  (tempImg.xsize)*2;
-
-  width = (tempImg.xsize)/8;
-  //format is U Y V Y
-
-  union {
-    short   elements[8];
-    vector  signed short v;
-  } shortBuffer;
-
-  union {
-    unsigned int    elements[4];
-    vector  unsigned int v;
-  } intBuffer;
-
-  vector unsigned char one;
-  vector signed short mat1,mat2,mat3,mat4,mat5,mat6,mat7,mat8,mat9;
-  vector unsigned char val1,val2,val3,val4,val5,val6,val7,val8,val9;
-  vector signed int res1,res2,res3,res4,res5,res6,res7,res8,res9;
-  vector signed int yhi,ylo;
-  vector signed int res1a,res2a,res3a,res4a,res5a,res6a,res7a,res8a,res9a;
-  vector unsigned int bitshift;
-  vector signed short y1,y2,y3,y4,y5,y6,y7,y8,y9,yres,uvres,hiImage,loImage;
-  vector signed short range,uvnone,uv128;
-  unsigned char *dst =  (unsigned char*) image.data;
-  unsigned char *src =  (unsigned char*) tempImg.data;
-
-
-  one =  vec_splat_u8( 1 );
-
-  intBuffer.elements[0] = 8;
-  //Load it into the vector unit
-  bitshift = intBuffer.v;
-  bitshift = (vector unsigned int)vec_splat((vector unsigned int)bitshift,0);
-
-  shortBuffer.elements[0] = m_irange;
-  range = shortBuffer.v;
-  range = (vector signed short)vec_splat((vector signed short)range, 0);
-
-  shortBuffer.elements[0] = 128;
-  uvnone = shortBuffer.v;
-  uvnone = (vector signed short)vec_splat((vector signed short)uvnone, 0);
-
-  //load the matrix values into vectors
-  shortBuffer.elements[0] = m_imatrix[0];
-  mat1 = shortBuffer.v;
-  mat1 = (vector signed short)vec_splat((vector signed short)mat1,0);
-
-  shortBuffer.elements[0] = m_imatrix[1];
-  mat2 = shortBuffer.v;
-  mat2 = (vector signed short)vec_splat((vector signed short)mat2,0);
-
-  shortBuffer.elements[0] = m_imatrix[2];
-  mat3 = shortBuffer.v;
-  mat3 = (vector signed short)vec_splat((vector signed short)mat3,0);
-
-  shortBuffer.elements[0] = m_imatrix[3];
-  mat4 = shortBuffer.v;
-  mat4 = (vector signed short)vec_splat((vector signed short)mat4,0);
-
-  shortBuffer.elements[0] = m_imatrix[4];
-  mat5 = shortBuffer.v;
-  mat5 = (vector signed short)vec_splat((vector signed short)mat5,0);
-
-  shortBuffer.elements[0] = m_imatrix[5];
-  mat6 = shortBuffer.v;
-  mat6 = (vector signed short)vec_splat((vector signed short)mat6,0);
-
-  shortBuffer.elements[0] = m_imatrix[6];
-  mat7 = shortBuffer.v;
-  mat7 = (vector signed short)vec_splat((vector signed short)mat7,0);
-
-  shortBuffer.elements[0] = m_imatrix[7];
-  mat8 = shortBuffer.v;
-  mat8 = (vector signed short)vec_splat((vector signed short)mat8,0);
-
-  shortBuffer.elements[0] = m_imatrix[8];
-  mat9 = shortBuffer.v;
-  mat9 = (vector signed short)vec_splat((vector signed short)mat9,0);
-
-  shortBuffer.elements[0] = 128;
-  uv128 = shortBuffer.v;
-  uv128 = (vector signed short)vec_splat((vector signed short)uv128,0);
-#ifndef PPC970
-  UInt32                      prefetchSize = GetPrefetchConstant( 16, 1,
-      256 );
-  vec_dst( src, prefetchSize, 0 );
-  vec_dst( dst, prefetchSize, 0 );
-#endif
-
-  i = xsize*2;
-
-//need to treat the first rows as a special case for accuracy and keep it from crashing
-//or just skip the first 2 rows ;)
-
-  for ( h=2; h<image.ysize-1; h++) {
-    // i+=2; //this gets rid of the echoes but kills the vertical edge-detects???
-    i+=8;
-    for (w=0; w<width-1; w++) {
-#ifndef PPC970
-      vec_dst( src, prefetchSize, 0 );
-      vec_dst( dst, prefetchSize, 1 );
-#endif
-
-      val1 = vec_ld(0,src+(i-xsize-2));//this might crash?
-      val2 = vec_ld(0,src+(i-xsize));
-      val3 = vec_ld(0,src+(i-xsize+2));
-      val4 = vec_ld(0,src+(i-2));
-      val5 = vec_ld(0,src+i);
-      val6 = vec_ld(0,src+(i+2));
-      val7 = vec_ld(0,src+(i+xsize-2));
-      val8 = vec_ld(0,src+(i+xsize));
-      val9 = vec_ld(0,src+(i+xsize+2));
-
-      //extract the Y for processing
-      y1 = (vector signed short)vec_mulo((vector unsigned char)one, (vector unsigned char)val1);
-      y2 = (vector signed short)vec_mulo((vector unsigned char)one, (vector unsigned char)val2);
-      y3 = (vector signed short)vec_mulo((vector unsigned char)one, (vector unsigned char)val3);
-      y4 = (vector signed short)vec_mulo((vector unsigned char)one, (vector unsigned char)val4);
-      y5 = (vector signed short)vec_mulo((vector unsigned char)one, (vector unsigned char)val5);
-      y6 = (vector signed short)vec_mulo((vector unsigned char)one, (vector unsigned char)val6);
-      y7 = (vector signed short)vec_mulo((vector unsigned char)one, (vector unsigned char)val7);
-      y8 = (vector signed short)vec_mulo((vector unsigned char)one, (vector unsigned char)val8);
-      y9 = (vector signed short)vec_mulo((vector unsigned char)one, (vector unsigned char)val9);
-
-      uvres = (vector signed short)vec_mule((vector unsigned char)one, (vector unsigned char)val5);
-
-      //mult the Y by the matrix coefficient
-      res1 = vec_mulo(mat1,y1);
-      res2 = vec_mulo(mat2,y2);
-      res3 = vec_mulo(mat3,y3);
-      res4 = vec_mulo(mat4,y4);
-      res5 = vec_mulo(mat5,y5);
-      res6 = vec_mulo(mat6,y6);
-      res7 = vec_mulo(mat7,y7);
-      res8 = vec_mulo(mat8,y8);
-      res9 = vec_mulo(mat9,y9);
-
-      res1a = vec_mule(mat1,y1);
-      res2a = vec_mule(mat2,y2);
-      res3a = vec_mule(mat3,y3);
-      res4a = vec_mule(mat4,y4);
-      res5a = vec_mule(mat5,y5);
-      res6a = vec_mule(mat6,y6);
-      res7a = vec_mule(mat7,y7);
-      res8a = vec_mule(mat8,y8);
-      res9a = vec_mule(mat9,y9);
-
-      //sum the results - these are only 1 cycle ops so no dependency issues
-      res1 = vec_adds(res1,res2); //1+2
-      res3 = vec_adds(res3,res4);//3+4
-      res5 = vec_adds(res5,res6);//5+6
-      res7 = vec_adds(res7,res8);//7+8
-      res1 = vec_adds(res1,res3);//(1+2)+(3+4)
-      res7 = vec_adds(res7,res9);//7+8+9
-      res1 = vec_adds(res1,res5);//(1+2)+(3+4)+(5+6)
-      res1 = vec_adds(res1,res7);//(1+2)+(3+4)+(5+6)+(7+8+9)
-
-      res1a = vec_adds(res1a,res2a); //1+2
-      res3a = vec_adds(res3a,res4a);//3+4
-      res5a = vec_adds(res5a,res6a);//5+6
-      res7a = vec_adds(res7a,res8a);//7+8
-      res1a = vec_adds(res1a,res3a);//(1+2)+(3+4)
-      res7a = vec_adds(res7a,res9a);//7+8+9
-      res1a = vec_adds(res1a,res5a);//(1+2)+(3+4)+(5+6)
-      res1a = vec_adds(res1a,res7a);//(1+2)+(3+4)+(5+6)+(7+8+9)
-
-
-      //do the bitshift on the results here??
-      res1 = vec_sra(res1,bitshift);
-      res1a = vec_sra(res1a,bitshift);
-
-      //pack back to one short vector??
-      yhi = vec_mergeh(res1a,res1);
-      ylo = vec_mergel(res1a,res1);
-
-
-      yres = vec_packs(yhi,ylo);
-
-
-      //combine with the UV
-      //vec_mergel + vec_mergeh Y and UV
-      hiImage =  vec_mergeh(uvres,yres);
-      loImage =  vec_mergel(uvres,yres);
-
-      val1 = vec_packsu(hiImage,loImage);
-      vec_st(val1,0,dst+i);
-      i+=16;
+  // leave the alpha-channel alone
+  convolve(image, 4, 0, 4, chAlpha, -1);
+}
 
-    }
-    i = h * xsize;
-#ifndef PPC970
-    vec_dss( 0 );
-    vec_dss( 1 );
-#endif
-  }  /*end of working altivec function */
+void pix_convolve :: processRGBImage(imageStruct &image)
+{
+  convolve(image, 3, 0, 3, -1, -1);
+}
 
+void pix_convolve :: processGrayImage(imageStruct &image)
+{
+  convolve(image, 1, 0, 1, -1, -1);
+}
 
-#endif
+void pix_convolve :: processYUVImage(imageStruct &image)
+{
+  // convolve the luma; either keep the chroma or remove it
+  convolve(image, 2, chY0, 1, -1, m_chroma?-1:128);
 }
 
 /////////////////////////////////////////////////////////
@@ -684,7 +414,8 @@ void pix_convolve :: calculate3x3YUVAltivec(imageStruct &image,
 /////////////////////////////////////////////////////////
 void pix_convolve :: rangeMess(float range)
 {
-  m_irange = (int)(range*255.f);
+  m_range = range;
+  updateKernel();
   setPixModified();
 }
 
@@ -701,13 +432,36 @@ void pix_convolve :: matrixMess(int argc, t_atom *argv)
 
   int i;
   for (i = 0; i < argc; i++) {
-    m_imatrix[i] = (int)(atom_getfloat(&argv[i])*255.);
+    m_matrix[i] = atom_getfloat(&argv[i]);
   }
-
+  updateKernel();
 
   setPixModified();
 }
 
+/////////////////////////////////////////////////////////
+// threadsMess
+//
+/////////////////////////////////////////////////////////
+void pix_convolve :: threadsMess(int threads)
+{
+  m_pool->setThreads((threads>0)?threads:0);
+}
+
+/////////////////////////////////////////////////////////
+// statsMess
+//
+/////////////////////////////////////////////////////////
+void pix_convolve :: statsMess(void)
+{
+  std::vector<gem::any>data;
+  data.push_back(std::string("separable"));
+  data.push_back(m_separable?1:0);
+  m_outlet->send("stats", data);
+
+  m_pool->sendStats(m_outlet);
+}
+
 /////////////////////////////////////////////////////////
 // static member function
 //
@@ -723,6 +477,8 @@ void pix_convolve :: obj_setupCallback(t_class *classPtr)
   class_addmethod(classPtr,
                   reinterpret_cast<t_method>(&pix_convolve::chromaMessCallback),
                   gensym("chroma"), A_FLOAT, A_NULL);
+  CPPEXTERN_MSG1(classPtr, "threads", threadsMess, int);
+  CPPEXTERN_MSG0(classPtr, "stats", statsMess);
 }
 void pix_convolve :: matrixMessCallback(void *data, t_symbol*, int argc,
                                         t_atom *argv)
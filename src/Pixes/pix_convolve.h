@@ -17,6 +17,19 @@ LOG
 #define _INCLUDE__GEM_PIXES_PIX_CONVOLVE_H_
 
 #include "Base/GemPixObj.h"
+#include <vector>
+
+namespace gem
+{
+namespace RTE
+{
+class Outlet;
+};
+namespace thread
+{
+class BandPool;
+};
+};
 
 /*-----------------------------------------------------------------
 -------------------------------------------------------------------
@@ -35,6 +48,14 @@ DESCRIPTION
 
     "matrix" - The matrix for the convolution kernal
     "ft1" - The range of the matrix
+    "chroma" - keep the chroma of YUV images (rather than making them grey)
+    "threads" - number of threads (0: one per CPU)
+    "stats" - output timing information
+
+    kernels that are the product of a column and a row (e.g. box or
+    gaussian blurs) are applied as two 1D-passes.
+    pixels beyond the border are taken to be the same as the border pixels.
+    the image is processed in horizontal bands (one per thread).
 
 -----------------------------------------------------------------*/
 class GEM_EXTERN pix_convolve : public GemPixObj
@@ -53,17 +74,20 @@ protected:
   // Destructor
   virtual ~pix_convolve();
 
-  void calculate3x3YUV(imageStruct &image,imageStruct &tempImg);
-  void calculate3x3YUVAltivec(imageStruct &image,imageStruct &tempImg);
-  void calculateRGBA3x3(imageStruct &image,imageStruct &tempImg);
-
-
   //////////
   // Do the processing
   virtual void    processRGBAImage(imageStruct &image);
+  virtual void    processRGBImage(imageStruct &image);
   virtual void    processGrayImage(imageStruct &image);
   virtual void    processYUVImage(imageStruct &image);
 
+  //////////
+  // convolve 'channels' interleaved channels, starting at byte 'offset'
+  // of each pixel (that is 'stride' bytes wide); the result ends up in
+  // tempImg (bytes that are not convolved are copied resp. set to 'fill')
+  void            convolve(imageStruct &image, int stride, int offset,
+                           int channels, int skip, int fill);
+
   //////////
   // Set the matrix range
   void            rangeMess(float range);
@@ -72,13 +96,20 @@ protected:
   // Set the matrix
   void            matrixMess(int argc, t_atom *argv);
 
+  void            threadsMess(int threads);
+  void            statsMess(void);
+
+  //////////
+  // (re)calculate the kernels from m_matrix & m_range
+  void            updateKernel(void);
+
   //////////
   // The matrix
-  short int       *m_imatrix;
+  std::vector<float>m_matrix;
 
   //////////
   // The range
-  int             m_irange;
+  float           m_range;
 
 
   //////////
@@ -91,9 +122,24 @@ protected:
 
   int             m_chroma;
 
+  //////////
+  // the scaled kernel (m_cols lines of m_rows taps)
+  std::vector<float>m_kernel;
+  // if the kernel is separable: its horizontal and vertical parts
+  bool              m_separable;
+  std::vector<float>m_hkernel, m_vkernel;
+
+  // per-band scratch memory
+  std::vector<std::vector<float> >m_scratch;
+
+  // the threads (and the timing of the last frame)
+  gem::thread::BandPool*m_pool;
+
 private:
   imageStruct tempImg;
 
+  gem::RTE::Outlet*m_outlet;
+
   //////////
   // Static member functions
   static void     rangeMessCallback(void *data, t_float range);
@@ -12,6 +12,7 @@
 //
 /////////////////////////////////////////////////////////
 #include "pix_delay.h"
+#include "RTE/Outlet.h"
 #include <string.h>
 
 CPPEXTERN_NEW_WITH_ONE_ARG(pix_delay, t_float,A_DEFFLOAT);
@@ -25,13 +26,18 @@ CPPEXTERN_NEW_WITH_ONE_ARG(pix_delay, t_float,A_DEFFLOAT);
 //
 /////////////////////////////////////////////////////////
 pix_delay :: pix_delay(t_float &f)
+  : m_curframe(0), m_filled(0)
+  , m_maxframes((f>0)?(int)f:DEFAULT_MAX_FRAMES)
+  , m_frame(0)
+  , m_swapped(0), m_copied(0)
+  , m_outlet(0)
 {
-  m_maxframes=(f>0)?(int)f:DEFAULT_MAX_FRAMES;
-  myImage.xsize=myImage.ysize=myImage.csize=1;
-  myImage.allocate(1*m_maxframes);
-  m_curframe = m_frame = 0;
+  /* one more slot than frames, so we can delay by <maxframes>;
+   * the slots are empty until they are written to */
+  m_ring.resize(m_maxframes+1);
 
   inlet_new(this->x_obj, &this->x_obj->ob_pd, &s_float, gensym("delay"));
+  m_outlet=new gem::RTE::Outlet(this);
 }
 
 /////////////////////////////////////////////////////////
@@ -40,11 +46,11 @@ pix_delay :: pix_delay(t_float &f)
 /////////////////////////////////////////////////////////
 pix_delay :: ~pix_delay()
 {
-  myImage.clear();
+  delete m_outlet;
 }
 
 /////////////////////////////////////////////////////////
-// sizeMess
+// delayMess
 //
 /////////////////////////////////////////////////////////
 void pix_delay :: delayMess(int frame)
@@ -54,6 +60,33 @@ void pix_delay :: delayMess(int frame)
   }
 }
 
+/////////////////////////////////////////////////////////
+// statsMess
+//
+/////////////////////////////////////////////////////////
+void pix_delay :: statsMess(void)
+{
+  size_t bytes=0;
+  for(size_t i=0; i<m_ring.size(); i++) {
+    bytes+=m_ring[i].getReservedSize();
+  }
+  std::vector<gem::any>data;
+  data.push_back(std::string("frames"));
+  data.push_back(static_cast<int>(m_filled));
+  data.push_back(static_cast<int>(m_ring.size()));
+  m_outlet->send("stats", data);
+
+  data.clear();
+  data.push_back(std::string("memory"));
+  data.push_back(static_cast<double>(bytes));
+  m_outlet->send("stats", data);
+
+  data.clear();
+  data.push_back(std::string("swapped"));
+  data.push_back(static_cast<double>(m_swapped));
+  data.push_back(static_cast<double>(m_copied));
+  m_outlet->send("stats", data);
+}
 
 /////////////////////////////////////////////////////////
 // processImage
@@ -61,35 +94,58 @@ void pix_delay :: delayMess(int frame)
 /////////////////////////////////////////////////////////
 void pix_delay :: processImage(imageStruct &image)
 {
-  unsigned char *src = image.data;
-  unsigned char *dest;
-
-  unsigned int dataSize = image.xsize * image.ysize * image.csize;
-  int readframe;
-
-  if (myImage.xsize*myImage.ysize*myImage.csize !=
-      image.xsize*image.ysize*image.csize) {
-    myImage.reallocate(dataSize*m_maxframes);
-    m_curframe=0;
+  const unsigned int slots = m_ring.size();
+  size_t dataSize = image.xsize * image.ysize * image.csize;
+  if (!image.data) {
+    return;
   }
 
-  myImage.xsize = image.xsize;
-  myImage.ysize = image.ysize;
-  myImage.setFormat(image.format);
-  myImage.reallocate();
-
-  dest = myImage.data+m_curframe*dataSize;
-  readframe=m_curframe-m_frame;
-  readframe+=m_maxframes;
-  readframe%=m_maxframes;
+  if (m_filled) {
+    /* start afresh if the images change their size or format
+     * (the buffers are kept and re-used) */
+    const imageStruct&last = m_ring[(m_curframe+slots-1)%slots];
+    if (last.xsize != image.xsize || last.ysize != image.ysize
+        || last.format != image.format || last.type != image.type) {
+      m_filled=0;
+      m_curframe=0;
+    }
+  }
 
-  // copy the data to the buffer
-  //while(dataSize--)*src++=*dest++;
-  memcpy(dest, src, dataSize);
-  m_curframe++;
-  m_curframe%=m_maxframes;
+  imageStruct&slot = m_ring[m_curframe];
+  if (image.swapData(slot)) {
+    /* the image is a copy of its own (e.g. of read-only data),
+     * so we just take its buffer (and give it the one of the slot) */
+    m_swapped++;
+  } else {
+    if (!slot.reallocate(dataSize)) {
+      return;
+    }
+    memcpy(slot.data, image.data, dataSize);
+    m_copied++;
+  }
+  slot.xsize = image.xsize;
+  slot.ysize = image.ysize;
+  slot.csize = image.csize;
+  slot.type = image.type;
+  slot.format = image.format;
+  slot.upsidedown = image.upsidedown;
+
+  m_curframe = (m_curframe+1)%slots;
+  if (m_filled < slots) {
+    m_filled++;
+  }
 
-  image.data=myImage.data+readframe*dataSize;
+  /* until the ring is filled, we output the oldest frame we have */
+  unsigned int delay = m_frame;
+  if (delay >= m_filled) {
+    delay = m_filled-1;
+  }
+  const imageStruct&delayed = m_ring[(m_curframe+slots-1-delay)%slots];
+  image.data = delayed.data;
+  image.upsidedown = delayed.upsidedown;
+  image.not_owned = true;
+  /* the data is still ours: downstream objects must copy it before writing */
+  cachedPixBlock.readonly = true;
 }
 
 
@@ -102,6 +158,7 @@ void pix_delay :: obj_setupCallback(t_class *classPtr)
   class_addmethod(classPtr,
                   reinterpret_cast<t_method>(&pix_delay::delayMessCallback),
                   gensym("delay"), A_FLOAT, A_NULL);
+  CPPEXTERN_MSG0(classPtr, "stats", statsMess);
 }
 
 
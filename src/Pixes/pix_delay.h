@@ -16,20 +16,37 @@ LOG
 #define _INCLUDE__GEM_PIXES_PIX_DELAY_H_
 
 #include "Base/GemPixObj.h"
+#include <vector>
 
 #define DEFAULT_MAX_FRAMES 256
+
+namespace gem
+{
+namespace RTE
+{
+class Outlet;
+};
+};
 /*-----------------------------------------------------------------
   -------------------------------------------------------------------
   CLASS
   pix_delay
 
-  change the pixBuf into dots
+  delay a stream of images by a number of frames
 
   KEYWORDS
   pix
 
   DESCRIPTION
 
+  the frames are kept in a ring of <maxframes>+1 buffers,
+  that are allocated on demand and re-used afterwards
+  (so changing the delay is for free).
+  the output points directly to the delayed buffer
+  (it is marked read-only, so pix-processors downstream copy it first);
+  incoming images that are already a private copy are swapped into the ring
+  instead of being copied.
+
   -----------------------------------------------------------------*/
 class GEM_EXTERN pix_delay : public GemPixObj
 {
@@ -51,13 +68,23 @@ protected:
   // Do the processing
   virtual void  processImage(imageStruct &image);
 
-  imageStruct    myImage;
-
   virtual void  delayMess(int frames);
+  virtual void  statsMess(void);
 
-  int m_maxframes, m_curframe;
+  // the ring of frames
+  std::vector<imageStruct>m_ring;
+  // the slot the next frame is written to
+  unsigned int m_curframe;
+  // number of valid frames in the ring
+  unsigned int m_filled;
+
+  int m_maxframes;
   int m_frame;
 
+  // frames that could be swapped into the ring (rather than copied)
+  unsigned long m_swapped, m_copied;
+
+  gem::RTE::Outlet*m_outlet;
 
 private:
 
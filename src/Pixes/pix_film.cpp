@@ -24,16 +24,20 @@
 #include "Gem/Properties.h"
 
 #include "plugins/PluginFactory.h"
+#include "plugins/BackendCache.h"
 #include "Gem/Exception.h"
-
-// for usleep()
-#include "Utils/Thread.h"
+#include "Utils/Latency.h"
 
 #include <ctype.h>
 #include <stdio.h>
 
 #include <sstream>
 
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
 /***************************************
  * on the order of codec-libraries
  *
@@ -138,47 +142,269 @@ static std::vector<std::string> split(const std::string &s, char delim)
 
 CPPEXTERN_NEW_WITH_ONE_ARG(pix_film, t_symbol*, A_DEFSYMBOL);
 
-#ifdef HAVE_PTHREADS
-/* the "capturing"-thread */
-void *pix_film :: grabThread(void*you)
+/*
+ * the decoder-thread
+ *
+ * decodes the requested frame and the next few frames (in the current
+ * playing direction) into a ring of frames, so the render-thread
+ * can (most of the time) simply pick up an already decoded frame
+ */
+class pix_film :: PIMPL
 {
-  pix_film *me=reinterpret_cast<pix_film*>(you);
-  pthread_mutex_lock  ( me->m_mutex);
-  me->m_thread_running=true;
-  pthread_cond_signal (&me->m_runcondition);
-  pthread_mutex_unlock( me->m_mutex);
-
-  //me->post("using pthreads");
-  while(me->m_thread_continue) {
-    int reqFrame=static_cast<int>(me->m_reqFrame);
-    int reqTrack=static_cast<int>(me->m_reqTrack);
-
-    if(reqFrame!=me->m_curFrame || reqTrack!=me->m_curTrack) {
-
-      pthread_mutex_lock(me->m_mutex);
-      if (gem::plugins::film::FAILURE!=me->m_handle->changeImage(reqFrame,
-          reqTrack)) {
-        me->m_frame=me->m_handle->getFrame();
+public:
+  struct slot {
+    enum state_t {
+      EMPTY,
+      DECODING,
+      READY,
+      FAILED
+    };
+    slot(void) : frame(-1), track(-1), state(EMPTY) {}
+    pixBlock pix;
+    int frame;
+    int track;
+    enum state_t state;
+  };
+
+  gem::plugins::film*handle;
+  std::thread decoder;
+  std::mutex mutex;       // protects the ring (and all the members below)
+  std::mutex decodeMutex; // protects the film-handle
+  std::condition_variable cond_request, cond_ready;
+  std::vector<slot*>ring;
+  unsigned int size;
+  bool running;
+  unsigned int generation; // bumped whenever decoded frames become invalid
+
+  int reqFrame, reqTrack;
+  int direction;
+  int numFrames;
+  int displayed; // slot currently in use by the render-thread
+
+  unsigned long hits, misses, decoded;
+  double decodeTime, lastDecodeTime; // in ms
+
+  PIMPL(void)
+    : handle(NULL)
+    , size(4)
+    , running(false)
+    , generation(0)
+    , reqFrame(0), reqTrack(0)
+    , direction(1)
+    , numFrames(0)
+    , displayed(-1)
+    , hits(0), misses(0), decoded(0)
+    , decodeTime(0.), lastDecodeTime(0.)
+  {}
+  ~PIMPL(void)
+  {
+    stop();
+  }
+
+  /* find the slot holding (or decoding) the given frame */
+  int find(int frame, int track)
+  {
+    for(unsigned int i=0; i<ring.size(); i++) {
+      const slot*s=ring[i];
+      if(slot::EMPTY!=s->state && frame==s->frame && track==s->track) {
+        return i;
+      }
+    }
+    return -1;
+  }
+  /* whether the frame is within the decode-ahead window */
+  bool inWindow(const slot*s)
+  {
+    if(s->track != reqTrack) {
+      return false;
+    }
+    int dist=(s->frame - reqFrame)*direction;
+    return (dist>=0 && dist < static_cast<int>(size)-1);
+  }
+  bool isValidFrame(int frame)
+  {
+    return (frame>=0 && (numFrames<=0 || frame<numFrames));
+  }
+  /* the next frame within the window that needs decoding (or -1) */
+  int nextMissing(void)
+  {
+    for(unsigned int i=0; i+1<size; i++) {
+      int frame=reqFrame + direction*static_cast<int>(i);
+      if(!isValidFrame(frame)) {
+        break;
+      }
+      if(find(frame, reqTrack)<0) {
+        return frame;
+      }
+    }
+    return -1;
+  }
+  /* a slot that can be (re)used for decoding (or -1) */
+  int findVictim(void)
+  {
+    int victim=-1;
+    for(unsigned int i=0; i<ring.size(); i++) {
+      const slot*s=ring[i];
+      if(static_cast<int>(i)==displayed || slot::DECODING==s->state) {
+        continue;
+      }
+      if(slot::EMPTY==s->state) {
+        return i;
+      }
+      if(victim<0 && !inWindow(s)) {
+        victim=i;
+      }
+    }
+    return victim;
+  }
+
+  void decodeThread(void)
+  {
+    std::unique_lock<std::mutex>lock(mutex);
+    while(running) {
+      int frame=nextMissing();
+      int victim=(frame<0)?-1:findVictim();
+      if(victim<0) {
+        cond_request.wait(lock);
+        continue;
+      }
+      slot*s=ring[victim];
+      const int track=reqTrack;
+      const unsigned int gen=generation;
+      s->frame=frame;
+      s->track=track;
+      s->state=slot::DECODING;
+      lock.unlock();
+
+      bool success=false;
+      std::chrono::steady_clock::time_point t0=std::chrono::steady_clock::now();
+      {
+        std::unique_lock<std::mutex>dlock(decodeMutex);
+        if(gem::plugins::film::FAILURE!=handle->changeImage(frame, track)) {
+          pixBlock*pix=handle->getFrame();
+          if(pix && pix->image.data) {
+            pix->image.copy2Image(&s->pix.image);
+            s->pix.newfilm=pix->newfilm;
+            s->pix.newimage=true;
+            s->pix.timestamp=gem::utils::monotonicTime();
+            s->pix.sequence=frame;
+            success=true;
+          }
+        }
+      }
+      double ms=std::chrono::duration<double, std::milli>
+                (std::chrono::steady_clock::now() - t0).count();
+
+      lock.lock();
+      decoded++;
+      decodeTime+=ms;
+      lastDecodeTime=ms;
+      if(gen!=generation) {
+        s->state=slot::EMPTY;
       } else {
-        me->m_frame=0;
+        s->state=success?slot::READY:slot::FAILED;
       }
+      cond_ready.notify_all();
+    }
+  }
+
+  void start(gem::plugins::film*h, int frames)
+  {
+    stop();
+    std::unique_lock<std::mutex>lock(mutex);
+    handle=h;
+    numFrames=frames;
+    reqFrame=0;
+    reqTrack=0;
+    direction=1;
+    displayed=-1;
+    for(unsigned int i=0; i<size; i++) {
+      ring.push_back(new slot());
+    }
+    running=true;
+    decoder=std::thread(&PIMPL::decodeThread, this);
+  }
+  void stop(void)
+  {
+    {
+      std::unique_lock<std::mutex>lock(mutex);
+      if(!running) {
+        return;
+      }
+      running=false;
+      cond_request.notify_all();
+      cond_ready.notify_all();
+    }
+    decoder.join();
+    while(!ring.empty()) {
+      delete ring.back();
+      ring.pop_back();
+    }
+    displayed=-1;
+  }
+  /* drop all decoded frames (e.g. because the colorspace has changed) */
+  void invalidate(void)
+  {
+    std::unique_lock<std::mutex>lock(mutex);
+    generation++;
+    for(unsigned int i=0; i<ring.size(); i++) {
+      if(slot::DECODING!=ring[i]->state) {
+        ring[i]->state=slot::EMPTY;
+      }
+    }
+    cond_request.notify_all();
+  }
 
-      me->m_curFrame=reqFrame;
-      me->m_curTrack=reqTrack;
+  /*
+   * get the given frame from the ring
+   * if the frame is not (yet) decoded, this blocks until it is
+   * returns NULL if the frame could not be decoded
+   */
+  pixBlock*fetch(int frame, int track, int speed)
+  {
+    std::unique_lock<std::mutex>lock(mutex);
+    if(!running || !isValidFrame(frame)) {
+      return NULL;
+    }
+    if(speed) {
+      direction=(speed<0)?-1:1;
+    } else if (frame!=reqFrame) {
+      /* guess the direction from the requests */
+      direction=(frame<reqFrame)?-1:1;
+    }
+    if(frame!=reqFrame || track!=reqTrack) {
+      reqFrame=frame;
+      reqTrack=track;
+      cond_request.notify_one();
+    }
 
-      pthread_mutex_unlock(me->m_mutex);
-      gem::thread::usleep(100);
+    int idx=find(frame, track);
+    if(idx>=0 && slot::DECODING!=ring[idx]->state) {
+      hits++;
     } else {
-      gem::thread::usleep(5000);
+      misses++;
+      while(running) {
+        idx=find(frame, track);
+        if(idx>=0 && slot::DECODING!=ring[idx]->state) {
+          break;
+        }
+        cond_request.notify_one();
+        cond_ready.wait(lock);
+      }
+    }
+    if(idx<0 || slot::READY!=ring[idx]->state) {
+      return NULL;
     }
+    if(idx!=displayed) {
+      /* switching to another slot: this is a new image */
+      ring[idx]->pix.newimage=true;
+      displayed=idx;
+      /* the previously displayed slot might be re-usable now */
+      cond_request.notify_one();
+    }
+    return &ring[idx]->pix;
   }
-
-  pthread_mutex_lock  (me->m_mutex);
-  me->m_thread_running=false;
-  pthread_mutex_unlock(me->m_mutex);
-  return NULL;
-}
-#endif
+};
 
 /////////////////////////////////////////////////////////
 //
@@ -195,18 +421,9 @@ pix_film :: pix_film(t_symbol* filename) :
   m_numTracks(0), m_reqTrack(0), m_curTrack(0),
   m_handle(NULL),
   m_outNumFrames(NULL), m_outEnd(NULL),
-#ifdef HAVE_PTHREADS
-# ifndef _WIN32
-  m_thread_id(0),
-# endif /* _WIN32 */
-  m_mutex(NULL), m_frame(NULL), m_thread_continue(false),
-#endif
-  m_thread_running(false), m_wantThread(false)
+  m_thread_running(false), m_wantThread(true),
+  m_pimpl(new PIMPL())
 {
-#ifdef HAVE_PTHREADS
-  m_wantThread=true;
-  pthread_cond_init(&m_runcondition, 0);
-#endif
 
   m_handle = gem::plugins::film::getInstance();
 
@@ -251,9 +468,8 @@ pix_film :: ~pix_film()
   // Clean up the movie
   closeMess();
 
-#ifdef HAVE_PTHREADS
-  pthread_cond_destroy(&m_runcondition);
-#endif
+  delete m_pimpl;
+  m_pimpl=NULL;
 
   delete m_handle;
   m_handle=NULL;
@@ -265,27 +481,8 @@ pix_film :: ~pix_film()
 /////////////////////////////////////////////////////////
 void pix_film :: closeMess(void)
 {
-
-#ifdef HAVE_PTHREADS
-  if(m_thread_running) {
-    void *dummy=0;
-    int counter=0;
-    m_thread_continue = false;
-    pthread_join (m_thread_id, &dummy);
-    while(m_thread_running) {
-      counter++;
-    }
-  }
-#ifndef _WIN32
-  m_thread_id=0;
-#endif
-
-  if ( m_mutex ) {
-    pthread_mutex_destroy(m_mutex);
-    free(m_mutex);
-    m_mutex=NULL;
-  }
-#endif
+  m_pimpl->stop();
+  m_thread_running=false;
 
   if(m_handle) {
     m_handle->close();
@@ -325,6 +522,9 @@ void pix_film :: openMess(std::string filename, int format,
   if (FILE*fd=fopen(buff, "r")) {
     fname=buff;
     fclose(fd);
+  } else if (filename.find_first_of("%*?") != std::string::npos) {
+    // an image sequence (e.g. "img%04d.png") is not a file itself
+    fname=buff;
   }
 
 
@@ -390,26 +590,15 @@ void pix_film :: openMess(std::string filename, int format,
        fps);
   outlet_list(m_outNumFrames, 0, 4, ap);
 
-#ifdef HAVE_PTHREADS
   bool canThread=m_handle->isThreadable();
   if(canThread && m_wantThread) {
     debug("creating thread");
-    m_mutex = (pthread_mutex_t*) malloc(sizeof(pthread_mutex_t));
-    if ( pthread_mutex_init(m_mutex, NULL) < 0 ) {
-      perror("pix_film : couldn't create mutex");
-    } else {
-      m_thread_continue = true;
-      m_reqFrame=0;
-      m_curFrame=-1;
-      pthread_mutex_lock(m_mutex);
-      pthread_create(&m_thread_id, 0, grabThread, this);
-      pthread_cond_wait(&m_runcondition, m_mutex);
-      pthread_mutex_unlock(m_mutex);
-
-      debug("thread created");
-    }
+    m_reqFrame=0;
+    m_curFrame=-1;
+    m_pimpl->start(m_handle, m_numFrames);
+    m_thread_running=true;
+    debug("thread created");
   }
-#endif
 }
 
 void pix_film :: bangMess()
@@ -431,7 +620,10 @@ void pix_film :: bangMess()
   gotProps.set("frames", 0);
   gotProps.set("fps", 0);
 
-  m_handle->getProperties(gotProps);
+  {
+    std::unique_lock<std::mutex>lock(m_pimpl->decodeMutex);
+    m_handle->getProperties(gotProps);
+  }
 
   /* coverity[check_return]: props.get() defaults to nop if properties are missing */
   gotProps.get("width", width);
@@ -450,6 +642,19 @@ void pix_film :: bangMess()
   outlet_list(m_outNumFrames, 0, 4, ap);
 }
 
+/////////////////////////////////////////////////////////
+// grabFrame
+//
+/////////////////////////////////////////////////////////
+pixBlock*pix_film :: grabFrame(void)
+{
+  if(m_thread_running) {
+    return m_pimpl->fetch(static_cast<int>(m_reqFrame), m_reqTrack,
+                          (m_auto<0.)?-1:((m_auto>0.)?1:0));
+  }
+  return m_handle->getFrame();
+}
+
 /////////////////////////////////////////////////////////
 // render
 //
@@ -462,17 +667,17 @@ void pix_film :: render(GemState *state)
     return;
   }
 
-#ifdef HAVE_PTHREADS
-  if(m_thread_running) {
-    pthread_mutex_lock(m_mutex);
-    state->set(GemState::_PIX, m_frame);
-  } else
-#endif /* PTHREADS */
-    state->set(GemState::_PIX, m_handle->getFrame());
+  state->set(GemState::_PIX, grabFrame());
 
   pixBlock*img=NULL;
   state->get(GemState::_PIX, img);
 
+  if(img && img->newimage && !m_thread_running) {
+    /* the frame has just been decoded */
+    img->timestamp=gem::utils::monotonicTime();
+    img->sequence=static_cast<int>(m_reqFrame);
+  }
+
   // someone wants to process the image downstream, so make sure they get it
   if (m_cache&&m_cache->resendImage&&img) {
     img->newimage=true;
@@ -487,14 +692,8 @@ void pix_film :: render(GemState *state)
     if(frame!=static_cast<int>(m_reqFrame)) {
       // someone responded immediately to the outlet_float and changed the requested frame
       // so get the newly requested frame:
-
-      if(m_thread_running) {
-        /* if we are threaded (currently locked!), we change the frame# and grab the frame immediately
-         * (if we are not threaded, the frame# is already changed and the grabbing is always immediately)
-         */
-        m_handle->changeImage(static_cast<int>(m_reqFrame), m_reqTrack);
-      }
-      state->set(GemState::_PIX, m_handle->getFrame());
+      // (if we are not threaded, the frame# is already changed and the grabbing is always immediately)
+      state->set(GemState::_PIX, grabFrame());
 
     }
   }
@@ -517,12 +716,6 @@ void pix_film :: postrender(GemState *state)
     }
   }
 
-#ifdef HAVE_PTHREADS
-  if(m_thread_running) {
-    pthread_mutex_unlock(m_mutex);
-  }
-#endif /* PTHREADS */
-
   // automatic proceeding
   m_reqFrame+=m_auto;
 
@@ -596,7 +789,12 @@ void pix_film :: csMess(t_symbol* s, bool immediately)
   gem::any value=d;
   props.set("colorspace", value);
   if(immediately && m_handle) {
-    m_handle->setProperties(props);
+    {
+      std::unique_lock<std::mutex>lock(m_pimpl->decodeMutex);
+      m_handle->setProperties(props);
+    }
+    /* frames decoded so far have the wrong colorspace */
+    m_pimpl->invalidate();
   }
 }
 /////////////////////////////////////////////////////////
@@ -606,11 +804,79 @@ void pix_film :: csMess(t_symbol* s, bool immediately)
 void pix_film :: threadMess(int state)
 {
   m_wantThread=!(!state);
-#ifdef HAVE_PTHREADS
   post("thread settings will have an effect on next open!");
-#else
-  post("no thread support");
-#endif
+}
+
+void pix_film :: ringMess(int size)
+{
+  if(size<2) {
+    pd_error(0, "ring size must be >= 2");
+    return;
+  }
+  bool restart=m_thread_running;
+  if(restart) {
+    m_pimpl->stop();
+  }
+  m_pimpl->size=size;
+  if(restart) {
+    m_pimpl->start(m_handle, m_numFrames);
+  }
+}
+void pix_film :: statsMess(void)
+{
+  t_atom ap[3];
+  unsigned int size, ready=0;
+  unsigned long hits, misses, decoded;
+  double decodeTime, lastDecodeTime;
+  {
+    std::unique_lock<std::mutex>lock(m_pimpl->mutex);
+    size=m_pimpl->size;
+    for(unsigned int i=0; i<m_pimpl->ring.size(); i++) {
+      if(PIMPL::slot::READY==m_pimpl->ring[i]->state) {
+        ready++;
+      }
+    }
+    hits=m_pimpl->hits;
+    misses=m_pimpl->misses;
+    decoded=m_pimpl->decoded;
+    decodeTime=decoded?(m_pimpl->decodeTime/decoded):0.;
+    lastDecodeTime=m_pimpl->lastDecodeTime;
+  }
+
+  SETSYMBOL(ap+0, gensym("ring"));
+  SETFLOAT (ap+1, size);
+  SETFLOAT (ap+2, ready);
+  outlet_anything(m_outEnd, gensym("stats"), 3, ap);
+
+  SETSYMBOL(ap+0, gensym("hits"));
+  SETFLOAT (ap+1, hits);
+  SETFLOAT (ap+2, misses);
+  outlet_anything(m_outEnd, gensym("stats"), 3, ap);
+
+  SETSYMBOL(ap+0, gensym("decoded"));
+  SETFLOAT (ap+1, decoded);
+  outlet_anything(m_outEnd, gensym("stats"), 2, ap);
+
+  SETSYMBOL(ap+0, gensym("decodetime"));
+  SETFLOAT (ap+1, decodeTime);
+  SETFLOAT (ap+2, lastDecodeTime);
+  outlet_anything(m_outEnd, gensym("stats"), 3, ap);
+
+  /* how long the backends took to open files (for all objects) */
+  std::vector<gem::plugins::BackendCache::Latency>latencies=
+    gem::plugins::BackendCache::getLatencies("film");
+  for(unsigned int i=0; i<latencies.size(); i++) {
+    const gem::plugins::BackendCache::Latency&l=latencies[i];
+    const unsigned long count=l.opens + l.failures;
+    t_atom bp[6];
+    SETSYMBOL(bp+0, gensym("backend"));
+    SETSYMBOL(bp+1, gensym(l.id.c_str()));
+    SETFLOAT (bp+2, l.opens);
+    SETFLOAT (bp+3, l.failures);
+    SETFLOAT (bp+4, count?(l.time/count):0.);
+    SETFLOAT (bp+5, l.maxtime);
+    outlet_anything(m_outEnd, gensym("stats"), 6, bp);
+  }
 }
 
 void pix_film :: autoMess(double speed)
@@ -620,6 +886,7 @@ void pix_film :: autoMess(double speed)
   gem::any value=speed;
   props.set("auto", value);
   if(m_handle) {
+    std::unique_lock<std::mutex>lock(m_pimpl->decodeMutex);
     m_handle->setProperties(props);
   }
 }
@@ -720,6 +987,8 @@ void pix_film :: obj_setupCallback(t_class *classPtr)
   CPPEXTERN_MSG1(classPtr, "auto", autoMess, t_float);
   CPPEXTERN_MSG1(classPtr, "colorspace", csMess, t_symbol*);
   CPPEXTERN_MSG1(classPtr, "thread", threadMess, bool);
+  CPPEXTERN_MSG1(classPtr, "ring", ringMess, int);
+  CPPEXTERN_MSG0(classPtr, "stats", statsMess);
   CPPEXTERN_MSG (classPtr, "loader", backendMess);
   CPPEXTERN_MSG (classPtr, "driver", backendMess);
   CPPEXTERN_MSG0(classPtr, "bang", bangMess);
@@ -17,10 +17,6 @@ WARRANTIES, see the file, "GEM.LICENSE.TERMS" in this distribution.
 #define _INCLUDE__GEM_PIXES_PIX_FILM_H_
 #include "Base/GemBase.h"
 
-#ifdef HAVE_PTHREADS
-# include <pthread.h>
-#endif
-
 #include "plugins/film.h"
 
 
@@ -36,6 +32,10 @@ WARRANTIES, see the file, "GEM.LICENSE.TERMS" in this distribution.
 
   DESCRIPTION
 
+  "thread 0/1" - decode frames in a separate thread (on next open)
+  "ring <n>" - number of frames the decoder-thread keeps ready
+  "stats" - output decoder statistics (ring hits/misses, decoding time)
+
   -----------------------------------------------------------------*/
 class GEM_EXTERN pix_film : public GemBase
 {
@@ -88,6 +88,11 @@ protected:
   // turn on/off threaded reading
   virtual void threadMess(int);
 
+  //////////
+  // size of the decode-ahead ring (threaded reading only)
+  virtual void ringMess(int);
+  virtual void statsMess(void);
+
   //////////
   // automatic frame increment
   virtual void autoMess(double state);
@@ -137,23 +142,25 @@ protected:
 
 
 protected:
-  /* grab-thread */
-#ifdef HAVE_PTHREADS
-  pthread_t m_thread_id;
-  pthread_mutex_t *m_mutex;
-  pthread_cond_t   m_runcondition;
-  static void*grabThread(void*);
-
-  pixBlock*m_frame;
+  //////////
+  // get the requested frame (m_reqFrame/m_reqTrack)
+  // if we have a decoder-thread, this is taken from the decode-ahead ring,
+  // else it is whatever the backend currently holds
+  pixBlock*grabFrame(void);
 
-  bool m_thread_continue;
-#endif
   /* do we have a thread ? */
   bool m_thread_running;
 
   /* does the user request reading to be threaded */
   bool m_wantThread;
 
+private:
+  /* decoder-thread and ring of decoded frames */
+  class PIMPL;
+  PIMPL*m_pimpl;
+
+protected:
+
   //////////
   // static member functions
   static void openMessCallback   (void *data, t_symbol*,int,t_atom*);
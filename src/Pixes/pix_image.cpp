@@ -98,9 +98,9 @@ void pix_image :: openMess(std::string filename)
 
   bool success=false;
   if(m_wantThread) {
-    success=gem::image::load::async(cb, userdata, m_filename, m_id);
+    success=gem::image::load::async(cb, userdata, m_filename, m_hints, m_id);
   } else {
-    success=gem::image::load:: sync(cb, userdata, m_filename, m_id);
+    success=gem::image::load:: sync(cb, userdata, m_filename, m_hints, m_id);
   }
   if(gem::image::load::INVALID == m_id) {
     success=false;
@@ -126,6 +126,65 @@ void pix_image :: openMess(std::string filename)
 }
 
 
+void pix_image :: hintMess(t_symbol*, int argc, t_atom*argv)
+{
+  if(!argc) {
+    m_hints.clear();
+    return;
+  }
+  if(argc!=2 || A_SYMBOL!=argv[0].a_type) {
+    pd_error(0, "hint <key> <value>");
+    return;
+  }
+  const std::string key=atom_getsymbol(argv)->s_name;
+  if(A_FLOAT==argv[1].a_type) {
+    m_hints.set(key, atom_getfloat(argv+1));
+  } else {
+    m_hints.set(key, std::string(atom_getsymbol(argv+1)->s_name));
+  }
+}
+
+void pix_image :: prewarmMess(t_symbol*, int argc, t_atom*argv)
+{
+  std::vector<std::string>files;
+  for(int i=0; i<argc; i++) {
+    if(A_SYMBOL!=argv[i].a_type) {
+      pd_error(0, "prewarm <filename...>");
+      return;
+    }
+    files.push_back(findFile(atom_getsymbol(argv+i)->s_name));
+  }
+  gem::image::cache::prewarm(files);
+}
+
+void pix_image :: cacheMess(t_symbol*, int argc, t_atom*argv)
+{
+  const std::string cmd=(argc>0)?atom_getsymbol(argv)->s_name:"";
+  if("clear"==cmd) {
+    gem::image::cache::clear();
+  } else if("budget"==cmd && argc==2 && A_FLOAT==argv[1].a_type) {
+    double mb=atom_getfloat(argv+1);
+    gem::image::cache::setBudget((mb>0)?(size_t)(mb*1024.*1024.):0);
+  } else if(!cmd.empty()) {
+    pd_error(0, "cache [clear|budget <MB>]");
+    return;
+  }
+
+  const struct gem::image::cache::Stats stats=gem::image::cache::getStats();
+  const unsigned long lookups=stats.hits+stats.misses;
+  std::vector<gem::any>atoms;
+  gem::any value;
+  atoms.push_back(value=(double)stats.hits);
+  atoms.push_back(value=(double)stats.misses);
+  atoms.push_back(value=(lookups>0)?((double)stats.hits/lookups):0.);
+  atoms.push_back(value=(int)stats.entries);
+  atoms.push_back(value=(double)stats.bytes);
+  atoms.push_back(value=(double)stats.budget);
+  atoms.push_back(value=(double)stats.evictions);
+  m_infoOut.send("cache", atoms);
+}
+
+
 void    pix_image:: loaded(const gem::image::load::id_t ID,
                            imageStruct*img,
                            const gem::Properties&props)
@@ -149,6 +208,12 @@ void    pix_image:: loaded(const gem::image::load::id_t ID,
     m_loadedImage->copy2Image(&m_pixBlock.image);
     m_pixBlock.newimage = 1;
     verbose(0, "loaded image '%s'", m_filename.c_str());
+    double decodetime;
+    if(props.get("decodetime", decodetime)) {
+      std::vector<gem::any>data;
+      data.push_back(value=decodetime);
+      m_infoOut.send("decodetime", data);
+    }
     atoms.push_back(value=std::string("success"));
   } else {
     pd_error(0, "failed to load image '%s'", m_filename.c_str());
@@ -240,4 +305,7 @@ void pix_image :: obj_setupCallback(t_class *classPtr)
 {
   CPPEXTERN_MSG1(classPtr, "open", openMess, std::string);
   CPPEXTERN_MSG1(classPtr, "thread", threadMess, bool);
+  CPPEXTERN_MSG (classPtr, "hint", hintMess);
+  CPPEXTERN_MSG (classPtr, "prewarm", prewarmMess);
+  CPPEXTERN_MSG (classPtr, "cache", cacheMess);
 }
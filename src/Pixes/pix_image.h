@@ -20,6 +20,7 @@
 #include "Base/GemBase.h"
 #include "Gem/Image.h"
 #include "Gem/ImageIO.h"
+#include "Gem/Properties.h"
 
 #include "RTE/Outlet.h"
 
@@ -82,6 +83,20 @@ protected:
   virtual void  threadMess(bool onoff);
   bool m_wantThread;
 
+  //////////
+  // the (process-wide) cache of decoded images
+  // "prewarm <files...>" decodes files in the background
+  // "cache" outputs the cache statistics,
+  // "cache clear" empties it, "cache budget <MB>" limits its size
+  virtual void  prewarmMess(t_symbol*, int argc, t_atom*argv);
+  virtual void  cacheMess(t_symbol*, int argc, t_atom*argv);
+
+  //////////
+  // hints for the image loader, e.g. "hint width 320" or "hint colorspace yuv"
+  // ("hint" without arguments clears all hints)
+  virtual void  hintMess(t_symbol*, int argc, t_atom*argv);
+  gem::Properties m_hints;
+
   //////////
   // the full filename of the image
   std::string            m_filename;
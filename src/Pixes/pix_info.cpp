@@ -18,6 +18,7 @@
 #include "pix_info.h"
 #include "Gem/State.h"
 #include "Utils/GLUtil.h"
+#include "Utils/Latency.h"
 
 CPPEXTERN_NEW_WITH_GIMME(pix_info);
 
@@ -109,7 +110,7 @@ void pix_info :: showInfoRaw(pixBlock*img) {
 }
 
 void pix_info :: showInfoCooked(pixBlock*img) {
-  t_atom abuf[10];
+  t_atom abuf[12];
   const char*name=0;
 
   if(img) {
@@ -139,12 +140,20 @@ void pix_info :: showInfoCooked(pixBlock*img) {
     SETFLOAT(abuf+7, (t_float)img->newimage);
     SETFLOAT(abuf+8, (t_float)img->newfilm);
 
+    /* how old is the frame (in ms)? */
+    SETFLOAT(abuf+10, (t_float)img->sequence);
+    SETFLOAT(abuf+11, (t_float)((img->timestamp>0.)
+                                ?(gem::utils::monotonicTime() - img->timestamp)
+                                :-1));
+
     if(img->image.data) {
       t_gpointer*gp=(t_gpointer*)img->image.data;
       SETPOINTER(abuf+9, gp);
       outlet_anything(m_data, gensym("data"), 1, abuf+9);
     }
 
+    outlet_anything(m_data, gensym("age"), 1, abuf+11);
+    outlet_anything(m_data, gensym("sequence"), 1, abuf+10);
     outlet_anything(m_data, gensym("newfilm"), 1, abuf+8);
     outlet_anything(m_data, gensym("newimage"), 1, abuf+7);
 
@@ -66,13 +66,7 @@ void pix_movie :: render(GemState *state)
     return;
   }
   // get the frame from the decoding-object: film[].cpp
-#ifdef HAVE_PTHREADS
-  if(m_thread_running) {
-    pthread_mutex_lock(m_mutex);
-    state->set(GemState::_PIX, m_frame);
-  } else
-#endif /* PTHREADS */
-    state->set(GemState::_PIX, m_handle->getFrame());
+  state->set(GemState::_PIX, grabFrame());
 
   pixBlock*img=NULL;
   state->get(GemState::_PIX, img);
@@ -85,13 +79,7 @@ void pix_movie :: render(GemState *state)
     if(frame!=static_cast<int>(m_reqFrame)) {
       // someone responded immediately to the outlet_float and changed the requested frame
       // so try to get the newly requested frame:
-      if(m_thread_running) {
-        /* the grabbing-thread is currently locked
-         * we do the grabbing ourselves
-         */
-        m_handle->changeImage(static_cast<int>(m_reqFrame), m_reqTrack);
-      }
-      state->set(GemState::_PIX, m_handle->getFrame());
+      state->set(GemState::_PIX, grabFrame());
     }
   }
 
@@ -115,12 +103,6 @@ void pix_movie :: postrender(GemState *state)
     }
   }
 
-#ifdef HAVE_PTHREADS
-  if(m_thread_running) {
-    pthread_mutex_unlock(m_mutex);
-  }
-#endif /* PTHREADS */
-
   // automatic proceeding
   if (m_auto!=0) {
     if(m_thread_running) {
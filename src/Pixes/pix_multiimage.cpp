@@ -21,12 +21,11 @@
 #include "Gem/Cache.h"
 #include "Gem/State.h"
 #include "Gem/ImageIO.h"
+#include "Gem/Properties.h"
 
 CPPEXTERN_NEW_WITH_FOUR_ARGS(pix_multiimage, t_symbol*, A_DEFSYMBOL,
                              t_floatarg, A_DEFFLOAT, t_floatarg, A_DEFFLOAT, t_floatarg, A_DEFFLOAT);
 
-pix_multiimage::multiImageCache *pix_multiimage::s_imageCache = NULL;
-
 /////////////////////////////////////////////////////////
 //
 // pix_multiimage
@@ -37,7 +36,7 @@ pix_multiimage::multiImageCache *pix_multiimage::s_imageCache = NULL;
 /////////////////////////////////////////////////////////
 pix_multiimage :: pix_multiimage(t_symbol* filename, t_floatarg baseImage,
                                  t_floatarg topImage, t_floatarg skipRate)
-  : m_numImages(0), m_curImage(-1), m_loadedCache(NULL)
+  : m_numImages(0), m_curImage(-1)
 {
   inlet_new(this->x_obj, &this->x_obj->ob_pd, gensym("float"),
             gensym("img_num"));
@@ -93,35 +92,6 @@ void pix_multiimage :: openMess(t_symbol* filename, int baseImage,
     skipRate = 1;
   }
 
-  // have we already loaded the image?
-  multiImageCache *cache = s_imageCache;
-  int found = 0;
-  while (!found && cache) {
-    if (baseImage == cache->baseImage &&
-        topImage == cache->topImage &&
-        skipRate == cache->skipRate &&
-        !strcmp(filename->s_name, cache->imageName)) {
-      found = 1;
-    } else {
-      cache = cache->next;
-    }
-  }
-
-  // yep, we have it
-  if (found) {
-    m_loadedCache = cache;
-    m_loadedCache->refCount++;
-    m_curImage = 0;
-    m_numImages = m_loadedCache->numImages;
-    m_loadedCache->images[m_curImage]->copy2Image(&m_pixBlock.image);
-    m_pixBlock.newimage = 1;
-    if (m_cache) {
-      m_cache->resendImage = 1;
-    }
-    return;
-  }
-
-  // nope, so create the new cache
   // find the * in the filename
   char preName[256];
   char postName[256];
@@ -144,58 +114,40 @@ void pix_multiimage :: openMess(t_symbol* filename, int baseImage,
 
   // need to figure out how many filenames there are to load
   m_numImages = (topImage + 1 - baseImage) / skipRate;
-
-  // create the new cache
-  multiImageCache *newCache = new multiImageCache(filename->s_name);
-  newCache->images = new imageStruct*[m_numImages];
-  newCache->numImages = m_numImages;
-  newCache->baseImage = baseImage;
-  newCache->topImage = topImage;
-  newCache->skipRate = skipRate;
+  if (m_numImages < 1) {
+    m_numImages = 0;
+    return;
+  }
 
   int realNum = baseImage;
   char bufName[MAXPDSTRING];
   canvas_makefilename(const_cast<t_canvas*>(getCanvas()), preName, bufName,
                       MAXPDSTRING);
 
-  // allocate texture bindings for OpenGL
-  newCache->textBind = new unsigned int[m_numImages];
-
+  // the images are shared (and kept) by the image cache
+  std::vector<std::shared_ptr<const imageStruct> > images;
   for (i = 0; i < m_numImages; i++, realNum += skipRate) {
     char newName[MAXPDSTRING];
     snprintf(newName, MAXPDSTRING, "%s%d%s", bufName, realNum, postName);
-    newCache->textBind[i] = 0;
-    if ( !(newCache->images[i] = image2mem(newName)) ) {
-      // a load failed, blow away the cache
-      newCache->numImages = i;
-      delete newCache;
+    gem::Properties props;
+    std::shared_ptr<const imageStruct> img = gem::image::cache::load(newName,
+        props);
+    if (!img) {
+      pd_error(0, "unable to load image '%s'", newName);
       m_numImages = 0;
       return;
     }
+    images.push_back(img);
   }
+  m_images.swap(images);
 
   m_curImage = 0;
-  newCache->images[m_curImage]->copy2Image(&m_pixBlock.image);
+  m_images[m_curImage]->copy2Image(&m_pixBlock.image);
   m_pixBlock.newimage = 1;
   if (m_cache) {
     m_cache->resendImage = 1;
   }
 
-  m_loadedCache = newCache;
-  newCache->refCount++;
-
-  // insert the cache at the end of the linked list
-  multiImageCache *ptr = s_imageCache;
-
-  if (!ptr) {
-    s_imageCache = newCache;
-  } else {
-    while(ptr->next) {
-      ptr = ptr->next;
-    }
-    ptr->next = newCache;
-  }
-
   post("loaded images: %s %s from %d to %d skipping %d",
        bufName, postName, baseImage, topImage, skipRate);
 }
@@ -213,7 +165,7 @@ void pix_multiimage :: render(GemState *state)
 
   // do we need to reload the image?
   if (m_cache->resendImage) {
-    m_loadedCache->images[m_curImage]->refreshImage(&m_pixBlock.image);
+    m_images[m_curImage]->refreshImage(&m_pixBlock.image);
     m_pixBlock.newimage = 1;
     m_cache->resendImage = 0;
   }
@@ -241,7 +193,7 @@ void pix_multiimage :: startRendering()
     return;
   }
 
-  m_loadedCache->images[m_curImage]->refreshImage(&m_pixBlock.image);
+  m_images[m_curImage]->refreshImage(&m_pixBlock.image);
   m_pixBlock.newimage = 1;
 }
 
@@ -276,32 +228,8 @@ void pix_multiimage :: changeImage(int imgNum)
 void pix_multiimage :: cleanImages()
 {
   if (m_numImages) {
-    // decrement the reference count
-    m_loadedCache->refCount--;
-
-    // If the refCount == 0, then destroy the cache
-    if (m_loadedCache->refCount == 0) {
-      // find the cache
-      multiImageCache *ptr = s_imageCache;
-
-      // if the loaded cache is the first cache in the list
-      if (m_loadedCache == s_imageCache) {
-        s_imageCache = m_loadedCache->next;
-        delete m_loadedCache;
-      } else {
-        while (ptr && ptr->next != m_loadedCache) {
-          ptr = ptr->next;
-        }
-        if (!ptr) {
-          error("Unable to find image cache!");
-        } else {
-          ptr->next = m_loadedCache->next;
-          delete m_loadedCache;
-        }
-      }
-    }
-
-    m_loadedCache = NULL;
+    // the image cache takes care of the images no longer in use
+    m_images.clear();
     m_numImages = 0;
     m_pixBlock.image.clear();
     m_pixBlock.image.data = NULL;
@@ -18,7 +18,8 @@ LOG
 #include "Base/GemBase.h"
 #include "Gem/Image.h"
 
-#include <string.h>
+#include <memory>
+#include <vector>
 
 /*-----------------------------------------------------------------
 -------------------------------------------------------------------
@@ -34,6 +35,8 @@ DESCRIPTION
 
     You can select which file by giving a number.
 
+    The images are shared with all other objects (via the image cache)
+
 -----------------------------------------------------------------*/
 class GEM_EXTERN pix_multiimage : public GemBase
 {
@@ -46,39 +49,6 @@ public:
   pix_multiimage(t_symbol* filename, t_floatarg baseImage,
                  t_floatarg topImage, t_floatarg skipRate);
 
-  class multiImageCache
-  {
-  public:
-
-    multiImageCache(const char *_imageName)
-      : refCount(0), next(NULL), images(NULL), textBind(NULL),
-        numImages(0), baseImage(0), topImage(0), skipRate(0)
-    {
-      imageName = strdup(_imageName);
-    }
-    ~multiImageCache()
-    {
-      delete imageName;
-      for(int i=0; i < numImages; i++) {
-        delete images[i];
-      }
-      delete [] textBind;
-      delete [] images;
-    }
-    int                 refCount;
-    multiImageCache     *next;
-    imageStruct         **images;
-    unsigned int            *textBind;
-    int                 numImages;
-    char                *imageName;
-    int                 baseImage;
-    int                 topImage;
-    int                 skipRate;
-  };
-
-  //////////
-  static multiImageCache  *s_imageCache;
-
 protected:
 
   //////////
@@ -127,8 +97,8 @@ protected:
   imageStruct     m_imageStruct;
 
   //////////
-  // The original images
-  multiImageCache *m_loadedCache;
+  // The original images (owned by the image cache)
+  std::vector<std::shared_ptr<const imageStruct> > m_images;
 
 private:
 
@@ -7,19 +7,42 @@
 
 #include "Gem/State.h"
 #include "Gem/Exception.h"
+#include "Gem/ImageIO.h"
 
 #include "plugins/PluginFactory.h"
 
 #include <map>
+#include <deque>
 #include <algorithm>
 
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
 CPPEXTERN_NEW_WITH_GIMME(pix_record);
 
 class pix_record :: PIMPL
 {
 public:
-  PIMPL(void) {};
-  ~PIMPL(void) {};
+  PIMPL(void)
+    : handle(NULL)
+    , running(false), busy(false), failed(false)
+    , capacity(4), maxdepth(0)
+    , policy(gem::image::SaveQueue::BLOCK)
+    , encoded(0), dropped(0)
+    , encodeTime(0.), lastEncodeTime(0.)
+    , statsEncoded(0)
+    , statsTime(std::chrono::steady_clock::now())
+  {};
+  ~PIMPL(void)
+  {
+    stop();
+    while(!pool.empty()) {
+      delete pool.back();
+      pool.pop_back();
+    }
+  };
 
   struct codechandle {
     codechandle(gem::plugins::record*h, const std::string&c):handle(h),
@@ -46,6 +69,177 @@ public:
     m_codechandle.clear();
   }
 
+  /*
+   * asynchronous encoding:
+   * frames are copied into a (bounded) queue on the render thread,
+   * and handed to the backend by a dedicated encoder thread
+   */
+  struct frame {
+    frame(imageStruct*i, double t) : img(i), timestamp(t) {}
+    imageStruct*img;
+    double timestamp;
+  };
+
+  gem::plugins::record*handle;
+  std::thread encoder;
+  std::mutex mutex;
+  std::condition_variable cond_todo, cond_space, cond_idle;
+  std::deque<frame>todo;
+  std::vector<imageStruct*>pool; // recycled frames (to avoid re-allocation)
+  bool running, busy, failed;
+
+  unsigned int capacity, maxdepth;
+  gem::image::SaveQueue::Policy policy;
+  unsigned long encoded, dropped;
+  double encodeTime, lastEncodeTime; // in ms
+  unsigned long statsEncoded;
+  std::chrono::steady_clock::time_point statsTime;
+
+
+  imageStruct*getFrame(void)
+  {
+    /* must be called with the mutex held */
+    if(pool.empty()) {
+      return new imageStruct;
+    }
+    imageStruct*img=pool.back();
+    pool.pop_back();
+    return img;
+  }
+
+  void encodeThread(void)
+  {
+    std::unique_lock<std::mutex>lock(mutex);
+    while(true) {
+      while(running && todo.empty()) {
+        cond_todo.wait(lock);
+      }
+      if(todo.empty()) {
+        /* !running && nothing left to do */
+        break;
+      }
+      frame f=todo.front();
+      todo.pop_front();
+      busy=true;
+      cond_space.notify_one();
+
+      bool success=false;
+      if(!failed) {
+        lock.unlock();
+        std::chrono::steady_clock::time_point t0=
+          std::chrono::steady_clock::now();
+        success=handle->write(f.img, f.timestamp);
+        double ms=std::chrono::duration<double, std::milli>
+                  (std::chrono::steady_clock::now() - t0).count();
+        lock.lock();
+        lastEncodeTime=ms;
+        encodeTime+=ms;
+      }
+      if(success) {
+        encoded++;
+      } else {
+        /* once the backend has failed, discard all pending frames;
+         * the backend is stop()ped from the main thread (see render()) */
+        failed=true;
+      }
+      pool.push_back(f.img);
+      busy=false;
+      if(todo.empty()) {
+        cond_idle.notify_all();
+      }
+    }
+    cond_idle.notify_all();
+  }
+
+  void start(gem::plugins::record*h)
+  {
+    stop();
+    std::unique_lock<std::mutex>lock(mutex);
+    handle=h;
+    running=true;
+    failed=false;
+    encoded=dropped=0;
+    maxdepth=0;
+    encodeTime=lastEncodeTime=0.;
+    statsEncoded=0;
+    statsTime=std::chrono::steady_clock::now();
+    encoder=std::thread(&PIMPL::encodeThread, this);
+  }
+  /* wait until all queued frames have been encoded, and shut down the encoder */
+  void stop(void)
+  {
+    {
+      std::unique_lock<std::mutex>lock(mutex);
+      if(!running) {
+        return;
+      }
+      running=false;
+      cond_todo.notify_all();
+    }
+    encoder.join();
+  }
+  /* wait until all queued frames have been encoded */
+  void flush(void)
+  {
+    std::unique_lock<std::mutex>lock(mutex);
+    while(running && (busy || !todo.empty())) {
+      cond_idle.wait(lock);
+    }
+  }
+  bool isRunning(void)
+  {
+    std::unique_lock<std::mutex>lock(mutex);
+    return running;
+  }
+  bool hasFailed(void)
+  {
+    std::unique_lock<std::mutex>lock(mutex);
+    return failed;
+  }
+  unsigned long getEncoded(void)
+  {
+    std::unique_lock<std::mutex>lock(mutex);
+    return encoded;
+  }
+
+  /* copy the image into the queue; returns FALSE if the frame was dropped */
+  bool push(const imageStruct&img, double timestamp)
+  {
+    std::unique_lock<std::mutex>lock(mutex);
+    if(!running || failed) {
+      return false;
+    }
+    while(todo.size() >= capacity) {
+      switch(policy) {
+      case gem::image::SaveQueue::DROP_NEWEST:
+        dropped++;
+        return false;
+      case gem::image::SaveQueue::DROP_OLDEST:
+        pool.push_back(todo.front().img);
+        todo.pop_front();
+        dropped++;
+        break;
+      default:
+        cond_space.wait(lock);
+        if(!running || failed) {
+          return false;
+        }
+        break;
+      }
+    }
+    imageStruct*copy=getFrame();
+    /* copying might re-allocate, so do it without the lock */
+    lock.unlock();
+    img.copy2Image(copy);
+    lock.lock();
+    todo.push_back(frame(copy, timestamp));
+    if(todo.size() > maxdepth) {
+      maxdepth=todo.size();
+    }
+    cond_todo.notify_one();
+    return true;
+  }
+
   static gem::any atom2any(t_atom*ap)
   {
     gem::any result;
@@ -110,6 +304,8 @@ pix_record :: pix_record(int argc, t_atom *argv):
   m_outNumFrames(NULL), m_outInfo(NULL),
   m_currentFrame(-1),
   m_maxFrames(0),
+  m_async(true),
+  m_startTime(0.),
   m_recording(false),
   m_handle(NULL),
   m_pimpl(new PIMPL())
@@ -131,6 +327,7 @@ pix_record :: pix_record(int argc, t_atom *argv):
 /////////////////////////////////////////////////////////
 pix_record :: ~pix_record()
 {
+  stopRecording();
   if(m_handle) {
     delete m_handle;
   }
@@ -222,6 +419,10 @@ void pix_record :: startRecording()
   if(m_handle->start(m_filename, m_props)) {
     m_filename=std::string("");
     m_recording=true;
+    m_startTime=clock_getlogicaltime();
+    if(m_async) {
+      m_pimpl->start(m_handle);
+    }
   } else {
     post("unable to open '%s'", m_filename.c_str());
   }
@@ -237,6 +438,8 @@ void pix_record :: stopRecording()
   }
 
   if(m_recording) {
+    /* let the encoder finish all pending frames */
+    m_pimpl->stop();
     m_handle->stop();
     m_currentFrame = 0;
     outlet_float(m_outNumFrames,m_currentFrame);
@@ -268,9 +471,28 @@ void pix_record :: render(GemState *state)
     return;
   }
 
+  if(m_pimpl->isRunning()) {
+    if(m_pimpl->hasFailed()) {
+      pd_error(0, "encoding failed: stopping");
+      stopRecording();
+      return;
+    }
+    if(m_banged||m_automatic) {
+      m_pimpl->push(img->image, clock_gettimesince(m_startTime));
+      m_banged=false;
+    }
+    /* report the number of frames that actually made it into the file */
+    int numFrames=m_pimpl->getEncoded();
+    if(numFrames != m_currentFrame) {
+      m_currentFrame=numFrames;
+      outlet_float(m_outNumFrames,m_currentFrame);
+    }
+    return;
+  }
+
   if(m_banged||m_automatic) {
     //      if(m_maxFrames != 0 && m_currentFrame >= m_maxFrames) m_recordStop = 1;
-    bool success=m_handle->write(&img->image);
+    bool success=m_handle->write(&img->image, clock_gettimesince(m_startTime));
     m_banged=false;
 
     if(success) {
@@ -348,6 +570,35 @@ void pix_record :: clearPropertiesMess()
   m_props.clear();
 }
 
+void pix_record :: getPropertiesMess(t_symbol*s, int argc, t_atom*argv)
+{
+  if(!m_handle) {
+    return;
+  }
+  gem::Properties props;
+  for(int i=0; i<argc; i++) {
+    PIMPL::addProperties(this, props, 1, argv+i);
+  }
+  m_handle->getProperties(props);
+
+  t_atom ap[2];
+  std::vector<std::string>keys=props.keys();
+  for(unsigned int i=0; i<keys.size(); i++) {
+    const std::string key=keys[i];
+    SETSYMBOL(ap+0, gensym(key.c_str()));
+    double d=0;
+    std::string str;
+    if(props.get(key, d)) {
+      SETFLOAT(ap+1, d);
+    } else if(props.get(key, str)) {
+      SETSYMBOL(ap+1, gensym(str.c_str()));
+    } else {
+      continue;
+    }
+    outlet_anything(m_outInfo, gensym("prop"), 2, ap);
+  }
+}
+
 
 
 /////////////////////////////////////////////////////////
@@ -359,6 +610,7 @@ void pix_record :: dialogMess()
   if(!m_handle) {
     return;
   }
+  m_pimpl->flush();
 
   if(!m_handle->dialog()) {
     pd_error(0, "unable to open settings dialog");
@@ -432,6 +684,8 @@ void pix_record :: codecMess(t_atom *argv)
    */
 
   std::string sid;
+  /* don't change the codec under the encoder's feet */
+  m_pimpl->flush();
 
   if (A_SYMBOL==argv->a_type) {
     sid=std::string(atom_getsymbol(argv)->s_name);
@@ -455,6 +709,88 @@ void pix_record :: codecMess(t_atom *argv)
   enumPropertiesMess();
 }
 
+/////////////////////////////////////////////////////////
+// asynchronous encoding
+//
+/////////////////////////////////////////////////////////
+void pix_record :: asyncMess(bool on)
+{
+  /* takes effect with the next recording */
+  m_async=on;
+}
+void pix_record :: queueMess(int size)
+{
+  if(size<1) {
+    pd_error(0, "queue size must be >=1");
+    return;
+  }
+  std::unique_lock<std::mutex>lock(m_pimpl->mutex);
+  m_pimpl->capacity=size;
+  m_pimpl->cond_space.notify_all();
+}
+void pix_record :: policyMess(t_symbol*s)
+{
+  gem::image::SaveQueue::Policy policy;
+  if(!gem::image::SaveQueue::string2policy(s->s_name, policy)) {
+    pd_error(0, "unknown policy '%s' (use 'block', 'drop_oldest' or 'drop_newest')",
+             s->s_name);
+    return;
+  }
+  std::unique_lock<std::mutex>lock(m_pimpl->mutex);
+  m_pimpl->policy=policy;
+  m_pimpl->cond_space.notify_all();
+}
+void pix_record :: statsMess(void)
+{
+  t_atom ap[3];
+  unsigned int depth, maxdepth, capacity;
+  unsigned long encoded, dropped;
+  double encodeTime, lastEncodeTime;
+  double fps=0.;
+  {
+    std::unique_lock<std::mutex>lock(m_pimpl->mutex);
+    depth=m_pimpl->todo.size();
+    maxdepth=m_pimpl->maxdepth;
+    capacity=m_pimpl->capacity;
+    encoded=m_pimpl->encoded;
+    dropped=m_pimpl->dropped;
+    encodeTime=encoded?(m_pimpl->encodeTime/encoded):0.;
+    lastEncodeTime=m_pimpl->lastEncodeTime;
+
+    /* encoding rate since the last query */
+    std::chrono::steady_clock::time_point now=std::chrono::steady_clock::now();
+    double elapsed=std::chrono::duration<double>(now - m_pimpl->statsTime).count();
+    if(elapsed>0.) {
+      fps=(encoded - m_pimpl->statsEncoded)/elapsed;
+    }
+    m_pimpl->statsEncoded=encoded;
+    m_pimpl->statsTime=now;
+  }
+
+  SETSYMBOL(ap+0, gensym("fps"));
+  SETFLOAT (ap+1, fps);
+  outlet_anything(m_outInfo, gensym("stats"), 2, ap);
+
+  SETSYMBOL(ap+0, gensym("depth"));
+  SETFLOAT (ap+1, depth);
+  SETFLOAT (ap+2, maxdepth);
+  outlet_anything(m_outInfo, gensym("stats"), 3, ap);
+
+  SETSYMBOL(ap+0, gensym("capacity"));
+  SETFLOAT (ap+1, capacity);
+  outlet_anything(m_outInfo, gensym("stats"), 2, ap);
+
+  SETSYMBOL(ap+0, gensym("frames"));
+  SETFLOAT (ap+1, encoded);
+  SETFLOAT (ap+2, dropped);
+  outlet_anything(m_outInfo, gensym("stats"), 3, ap);
+
+  SETSYMBOL(ap+0, gensym("encodetime"));
+  SETFLOAT (ap+1, encodeTime);
+  SETFLOAT (ap+2, lastEncodeTime);
+  outlet_anything(m_outInfo, gensym("stats"), 3, ap);
+}
+
 void pix_record :: fileMess(t_symbol*s, int argc, t_atom *argv)
 {
   /* LATER let the record()-handles chose whether they accept an open request
@@ -489,6 +825,12 @@ void pix_record :: obj_setupCallback(t_class *classPtr)
 
   CPPEXTERN_MSG0(classPtr, "clearProps", clearPropertiesMess);
   CPPEXTERN_MSG0(classPtr, "clearprops", clearPropertiesMess);
+  CPPEXTERN_MSG (classPtr, "get", getPropertiesMess);
+
+  CPPEXTERN_MSG1(classPtr, "async", asyncMess, bool);
+  CPPEXTERN_MSG1(classPtr, "queue", queueMess, int);
+  CPPEXTERN_MSG1(classPtr, "policy", policyMess, t_symbol*);
+  CPPEXTERN_MSG0(classPtr, "stats", statsMess);
 }
 
 void pix_record :: bangMess(void)
@@ -39,6 +39,11 @@
   "file" - filename to write to
   "bang" - do write now
   "auto 0/1" - stop/start writing automatically
+  "async 0/1" - encode frames in a separate thread
+  "queue <n>" - max. number of frames waiting to be encoded
+  "policy block|drop_oldest|drop_newest" - what to do if the queue is full
+  "stats" - output encoder statistics
+  "get <key>..." - output read-only properties of the backend (e.g. "fps")
 
   -----------------------------------------------------------------*/
 class GEM_EXTERN pix_record : public GemBase
@@ -105,10 +110,22 @@ protected:
   //
   int m_maxFrames;
 
+  //////////
+  // encode frames in a separate thread
+  bool m_async;
+  virtual void  asyncMess(bool on);
+  virtual void  queueMess(int size);
+  virtual void  policyMess(t_symbol*s);
+  virtual void  statsMess(void);
+
+  // logical time when recording was started (for timestamping frames)
+  double m_startTime;
+
   gem::Properties m_props;
   virtual void  enumPropertiesMess(void);
   virtual void  setPropertiesMess(t_symbol*,int argc, t_atom*argv);
   virtual void  clearPropertiesMess(void);
+  virtual void  getPropertiesMess(t_symbol*,int argc, t_atom*argv);
 
 private:
   bool m_recording;
@@ -11,15 +11,16 @@
 #define _INCLUDE__GEM_PIXES_PIX_SHARE_H_
 
 #include <Gem/GemConfig.h>
-#if (defined HAVE_SYS_IPC_H) && (defined HAVE_SYS_SHM_H)
+#if (defined HAVE_SYS_MMAN_H) && !(defined _WIN32)
 # define USE_SHM 1
 #endif
 
 #include "Base/GemBase.h"
 #include <sys/types.h>
+#include <stdint.h>
+#include <atomic>
 #if USE_SHM
-# include <sys/ipc.h>
-# include <sys/shm.h>
+# include <sys/mman.h>
 #elif defined _WIN32
 # include <windows.h>
 # include <stdio.h>
@@ -27,13 +28,57 @@
 # include <tchar.h>
 #endif
 
-// this is the header of the shared-memory segment
+/*
+ * layout of the shared-memory segment:
+ *
+ *   [t_pixshare_header] [slot#0] [slot#1] ... [slot#<slots-1>]
+ *
+ * each slot is a t_pixshare_slot followed by the image data;
+ * the header is padded to 'headersize' bytes, and the slots are
+ * 'slotsize' bytes apart (both multiples of PIXSHARE_ALIGN)
+ *
+ * there is a single producer, that writes frame #n into slot #(n % slots)
+ * and then sets 'written' to n+1.
+ * while a slot is being written, its 'sequence' is odd (seqlock);
+ * consumers read a slot and then check that 'sequence' is even and has
+ * not changed in the meantime (otherwise the frame is torn and discarded).
+ * the last <slots-1> frames are never touched by the producer,
+ * so a consumer only loses frames if it falls behind by more than that.
+ *
+ * consumers may also use a slot's data in place; they 'pin' it
+ * (by incrementing 'pins' before checking 'sequence'),
+ * and the producer does not overwrite a pinned slot
+ * (it marks the slot as being written, and backs off if it is pinned)
+ *
+ * 'layout' is a seqlock for the header itself:
+ * it is odd while the ring is (re)initialized
+ */
+#define PIXSHARE_MAGIC   0x52536d47 /* "GmSR" */
+#define PIXSHARE_VERSION 3
+#define PIXSHARE_ALIGN   64
+
 typedef struct _pixshare_header {
-  size_t     size;    // total size of the shared-memory segment (without header)
-  int      xsize;     // width of the image in the shm-segment
-  int      ysize;     // height of the image in the shm-segment
-  unsigned int format;    // format of the image (calculate csize,... from that)
-  bool upsidedown;    // is the stored image swapped?
+  uint32_t magic;      // PIXSHARE_MAGIC
+  uint32_t version;    // PIXSHARE_VERSION
+  std::atomic<uint32_t> layout; // odd while the ring is (re)initialized
+  uint32_t slots;      // number of slots in the ring
+  uint64_t size;       // max. size of an image (in bytes)
+  uint64_t slotsize;   // distance between two slots (in bytes)
+  uint64_t headersize; // offset of the first slot (in bytes)
+  std::atomic<uint32_t> written;  // number of frames published by the producer
+  std::atomic<uint32_t> consumed; // number of frames taken by all consumers
+  std::atomic<uint32_t> waiters;  // consumers that wait for 'written' to change
+  std::atomic<uint32_t> users;    // objects that have the segment attached
 } t_pixshare_header;
 
+typedef struct _pixshare_slot {
+  std::atomic<uint32_t> sequence; // odd while the slot is written
+  std::atomic<uint32_t> pins;     // consumers that use the data in place
+  uint32_t frame;      // number of the frame in this slot
+  int32_t  xsize;      // width of the image
+  int32_t  ysize;      // height of the image
+  uint32_t format;     // format of the image (calculate csize,... from that)
+  uint32_t upsidedown; // is the stored image swapped?
+} t_pixshare_slot;
+
 #endif
@@ -16,7 +16,14 @@ CPPEXTERN_NEW_WITH_GIMME(pix_share_read);
 
 
 pix_share_read :: pix_share_read(int argc, t_atom*argv)
-  : pix_share_write(argc,argv)
+  : pix_share_write(argc,argv,true)
+  , m_current(0)
+  , m_next(0), m_synced(false), m_ring(NULL)
+  , m_newest(true), m_wait(0.f)
+  , m_zerocopy(false), m_pinned(NULL), m_pinnedSequence(0)
+  , m_shown(0), m_haveFrame(false)
+  , m_read(0), m_dropped(0), m_torn(0)
+  , m_copied(0), m_copiedTotal(0.)
 {}
 
 pix_share_read :: ~pix_share_read()
@@ -25,29 +32,148 @@ pix_share_read :: ~pix_share_read()
   //freeShm();
 }
 
+bool pix_share_read :: readFrame(t_pixshare_header*h, uint32_t frame)
+{
+  t_pixshare_slot*slot=getSlot(h, frame);
+  const uint32_t seq=slot->sequence.load(std::memory_order_acquire);
+  if((seq&1) || slot->frame!=frame) {
+    /* being written, or already overwritten */
+    return false;
+  }
+  /* the producer might change the slot while we are copying,
+   * so we only trust the values once we have checked 'sequence' again */
+  const int xsize=slot->xsize;
+  const int ysize=slot->ysize;
+  const unsigned int format=slot->format;
+  const bool upsidedown=slot->upsidedown;
+  imageStruct&image=m_frames[!m_current];
+  int csize=image.setFormat(format);
+  size_t imgsize=(size_t)csize*xsize*ysize;
+  if(xsize<=0 || ysize<=0 || !imgsize || imgsize>h->size) {
+    return false;
+  }
+  image.xsize=xsize;
+  image.ysize=ysize;
+  image.reallocate();
+  image.upsidedown=upsidedown;
+  memcpy(image.data,getSlotData(slot),imgsize);
+
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if(slot->sequence.load(std::memory_order_relaxed) != seq) {
+    return false;
+  }
+  m_current=!m_current;
+  m_frames[m_current].copy2ImageStruct(&pix.image);
+  pix.readonly=false;
+  m_copied=imgsize;
+  return true;
+}
+
+bool pix_share_read :: mapFrame(t_pixshare_header*h, uint32_t frame)
+{
+  t_pixshare_slot*slot=getSlot(h, frame);
+  /* pin the slot before checking it:
+   * (sequentially consistent, so that either the producer sees our pin,
+   * or we see that the producer is writing) */
+  slot->pins.fetch_add(1);
+  const uint32_t seq=slot->sequence.load();
+  const int xsize=slot->xsize;
+  const int ysize=slot->ysize;
+  imageStruct dummy;
+  size_t imgsize=(size_t)dummy.setFormat(slot->format)*xsize*ysize;
+  if((seq&1) || slot->frame!=frame
+      || xsize<=0 || ysize<=0 || !imgsize || imgsize>h->size) {
+    slot->pins.fetch_sub(1);
+    return false;
+  }
+  pix.image.xsize=xsize;
+  pix.image.ysize=ysize;
+  pix.image.setFormat(slot->format);
+  pix.image.upsidedown=slot->upsidedown;
+  pix.image.data=getSlotData(slot);
+  pix.image.not_owned=true;
+  /* the data is not ours (nor is it any other consumer's) */
+  pix.readonly=true;
+  m_pinned=slot;
+  m_pinnedSequence=seq;
+  m_copied=0;
+  return true;
+}
+
 void pix_share_read :: render(GemState *state)
 {
 #if USE_SHM
-  if(shm_id>0) {
+  if(shm_fd>=0) {
 #elif defined _WIN32
   if(m_MapFile) {
 #else
   if(0) {
 #endif /* _WIN32 */
-    if (shm_addr) {
-      t_pixshare_header *h=(t_pixshare_header *)shm_addr;
-      unsigned char* data=shm_addr+sizeof(t_pixshare_header);
-      int csize=pix.image.setFormat(h->format);
-      int imgsize=csize*h->xsize*h->ysize;
-      if(imgsize) {
-        pix.image.xsize=h->xsize;
-        pix.image.ysize=h->ysize;
-        pix.image.reallocate();
-        pix.image.upsidedown=h->upsidedown;
-
-        memcpy(pix.image.data,data,imgsize);
-
-        pix.newimage = true;
+    t_pixshare_header *h=getHeader();
+    if (h) {
+      const uint32_t layout=h->layout.load(std::memory_order_acquire);
+      uint32_t written=h->written.load(std::memory_order_acquire);
+      m_copied=0;
+      if(!(layout&1)) {
+        if(!m_synced || m_ring!=shm_addr) {
+          /* start with the newest frame */
+          m_next=written?(written-1):0;
+          m_synced=true;
+          m_ring=shm_addr;
+        }
+        if(written==m_next && m_wait>0.f) {
+          waitFor(h, written, m_wait);
+          written=h->written.load(std::memory_order_acquire);
+        }
+        /* the slot of frame 'written' is the next to be overwritten */
+        const uint32_t window=(h->slots>1)?(h->slots-1):1;
+        for(int attempt=0; attempt<3; attempt++) {
+          int32_t behind=(int32_t)(written - m_next);
+          if(behind<=0) {
+            if(behind<0) {
+              /* the producer has started over */
+              m_next=written;
+            }
+            break;
+          }
+          uint32_t frame=m_newest?(written-1):m_next;
+          if((int32_t)(frame - (written - window))<0) {
+            frame=written - window;
+          }
+          bool got=m_zerocopy?mapFrame(h, frame):readFrame(h, frame);
+          if(got && h->layout.load(std::memory_order_acquire)!=layout) {
+            got=false;
+            unpin();
+          }
+          if(got) {
+            m_dropped+=frame - m_next;
+            m_next=frame+1;
+            m_read++;
+            h->consumed.fetch_add(1);
+            m_copiedTotal+=m_copied;
+            m_shown=frame;
+            m_haveFrame=true;
+            pix.newimage = true;
+            break;
+          }
+          /* torn: try again (with whatever is the newest frame by now) */
+          m_torn++;
+          written=h->written.load(std::memory_order_acquire);
+        }
+        if(m_zerocopy && !m_pinned && m_haveFrame) {
+          /* no new frame: keep the one we are showing pinned for this render pass */
+          if(!mapFrame(h, m_shown)) {
+            /* gone: there is nothing left to show */
+            m_haveFrame=false;
+            pix.image.data=NULL;
+          }
+        }
+      }
+      if(m_zerocopy && !m_pinned) {
+        /* never leave a pointer to an unpinned slot in the chain */
+        pix.image.data=NULL;
+      }
+      if(pix.image.data) {
         state->set(GemState::_PIX, &pix);
       }
     } else {
@@ -59,5 +185,69 @@ void pix_share_read :: render(GemState *state)
   }
 }
 
+void pix_share_read :: unpin(void)
+{
+  if(m_pinned) {
+    if(m_pinned->sequence.load() != m_pinnedSequence) {
+      /* the producer gave up waiting for us */
+      m_torn++;
+    }
+    m_pinned->pins.fetch_sub(1);
+    m_pinned=NULL;
+  }
+}
+
+void pix_share_read :: postrender(GemState *state)
+{
+  unpin();
+  pix.newimage = false;
+}
+
+/////////////////////////////////////////////////////////
+// Messages
+//
+/////////////////////////////////////////////////////////
+void pix_share_read :: newestMess(bool state)
+{
+  m_newest=state;
+}
+void pix_share_read :: waitMess(float ms)
+{
+  m_wait=(ms>0.f)?ms:0.f;
+}
+void pix_share_read :: zerocopyMess(bool state)
+{
+  m_zerocopy=state;
+  /* re-read the current frame in the new mode */
+  if(m_haveFrame && m_next==m_shown+1) {
+    m_next=m_shown;
+  }
+  m_haveFrame=false;
+  pix.image.data=NULL;
+}
+void pix_share_read :: statsMess(void)
+{
+  t_atom ap[3];
+  pix_share_write::statsMess();
+
+  SETSYMBOL(ap+0, gensym("frames"));
+  SETFLOAT (ap+1, m_read);
+  SETFLOAT (ap+2, m_dropped);
+  outlet_anything(m_outlet, gensym("stats"), 3, ap);
+
+  SETSYMBOL(ap+0, gensym("torn"));
+  SETFLOAT (ap+1, m_torn);
+  outlet_anything(m_outlet, gensym("stats"), 2, ap);
+
+  SETSYMBOL(ap+0, gensym("copied"));
+  SETFLOAT (ap+1, m_copied);
+  SETFLOAT (ap+2, m_copiedTotal);
+  outlet_anything(m_outlet, gensym("stats"), 3, ap);
+}
+
 void pix_share_read :: obj_setupCallback(t_class *classPtr)
-{}
+{
+  CPPEXTERN_MSG1(classPtr, "newest", newestMess, bool);
+  CPPEXTERN_MSG1(classPtr, "wait", waitMess, float);
+  CPPEXTERN_MSG1(classPtr, "zerocopy", zerocopyMess, bool);
+}
@@ -24,8 +24,46 @@ protected:
   ~pix_share_read();
 
   virtual void render(GemState *state);
+  virtual void postrender(GemState *state);
+  virtual void statsMess(void);
+  virtual void newestMess(bool);
+  virtual void waitMess(float);
+  virtual void zerocopyMess(bool);
+
+  /* copy frame #'frame' out of the ring; returns FALSE if it was torn */
+  bool readFrame(t_pixshare_header*, uint32_t frame);
+  /* use frame #'frame' in place (pinned until postrender());
+   * returns FALSE if it is not available */
+  bool mapFrame(t_pixshare_header*, uint32_t frame);
+  void unpin(void);
 
   pixBlock      pix;
+  /* we read into one image while the other is in use */
+  imageStruct   m_frames[2];
+  int           m_current;
+
+  /* the next frame we expect */
+  uint32_t m_next;
+  bool     m_synced;
+  /* the segment we are synced to (re-sync after a 'set') */
+  unsigned char*m_ring;
+  /* skip to the newest frame (rather than reading all frames in order) */
+  bool     m_newest;
+  /* max. time to wait for a new frame (in ms) */
+  float    m_wait;
+  /* use the frames in place, rather than copying them */
+  bool     m_zerocopy;
+  /* the slot we use in place (and its 'sequence' at the time we pinned it) */
+  t_pixshare_slot*m_pinned;
+  uint32_t m_pinnedSequence;
+  /* the frame we are showing */
+  uint32_t m_shown;
+  bool     m_haveFrame;
+
+  unsigned long m_read, m_dropped, m_torn;
+  /* bytes copied out of the ring (for the last frame, and in total) */
+  size_t m_copied;
+  double m_copiedTotal;
 };
 
 #endif
@@ -11,9 +11,26 @@
 #include "Gem/Image.h"
 #include "Gem/State.h"
 #include "Gem/Exception.h"
+#include "Utils/Latency.h"
 
 #include <errno.h>
 #include <stdio.h>
+#include <string.h>
+
+#include <chrono>
+#include <thread>
+
+#if USE_SHM
+# include <fcntl.h>
+# include <unistd.h>
+# include <sys/stat.h>
+#endif
+#ifdef __linux__
+# include <linux/futex.h>
+# include <sys/syscall.h>
+# include <unistd.h>
+# include <climits>
+#endif
 
 #ifdef _MSC_VER
 # define snprintf _snprintf
@@ -54,22 +71,56 @@ int hash_str2us(std::string s)
   return ((unsigned short)(result) & 0x7FFFFFFF);
 }
 
+namespace
+{
+static size_t align(size_t size)
+{
+  return (size + PIXSHARE_ALIGN - 1) & ~((size_t)PIXSHARE_ALIGN - 1);
+}
+static size_t ringSize(size_t imagesize, unsigned int slots)
+{
+  return align(sizeof(t_pixshare_header))
+         + slots * align(sizeof(t_pixshare_slot) + imagesize);
+}
+};
+
 /////////////////////////////////////////////////////////
 // Constructor
 //
 /////////////////////////////////////////////////////////
 pix_share_write :: pix_share_write(int argc, t_atom*argv) :
+  shm_addr(NULL), shm_size(0),
 #if USE_SHM
-  shm_id(0), shm_addr(NULL),
+  shm_fd(-1),
+#elif defined _WIN32
+  m_MapFile(NULL),
 #endif
-  m_size(0),
+  m_size(0), m_slots(3),
+  m_skipped(0), m_pinnedSince(0.),
+  m_consumer(false),
   m_outlet(0)
 {
+  init(argc, argv);
+}
+pix_share_write :: pix_share_write(int argc, t_atom*argv, bool consumer) :
+  shm_addr(NULL), shm_size(0),
 #if USE_SHM
-  memset(&shm_desc, 0, sizeof(shm_desc));
+  shm_fd(-1),
 #elif defined _WIN32
-#else
-    pd_error(0, "Gem has been compiled without shared memory support!");
+  m_MapFile(NULL),
+#endif
+  m_size(0), m_slots(3),
+  m_skipped(0), m_pinnedSince(0.),
+  m_consumer(consumer),
+  m_outlet(0)
+{
+  init(argc, argv);
+}
+
+void pix_share_write :: init(int argc, t_atom*argv)
+{
+#if !(defined USE_SHM) && !(defined _WIN32)
+  pd_error(0, "Gem has been compiled without shared memory support!");
 #endif
   if(argc<1) {
     //~ throw(GemException("no ID given"));
@@ -120,6 +171,8 @@ pix_share_write :: ~pix_share_write()
 
 void pix_share_write :: freeShm()
 {
+  t_pixshare_header*h=getHeader();
+  bool last=(h && 1==h->users.fetch_sub(1));
 #ifdef _WIN32
   if ( shm_addr ) {
     UnmapViewOfFile( shm_addr );
@@ -130,28 +183,147 @@ void pix_share_write :: freeShm()
   m_MapFile = NULL;
 #elif USE_SHM
   if(shm_addr) {
-    if (shmdt(shm_addr) == -1) {
-      pd_error(0, "shmdt failed at %p", shm_addr);
+    if (munmap(shm_addr, shm_size) == -1) {
+      pd_error(0, "munmap failed at %p", shm_addr);
     }
   }
-  if(shm_id>0) {
-    if (shmctl(shm_id,IPC_STAT, &shm_desc) != -1) {
-      if(shm_desc.shm_nattch<=0) {
-        if (shmctl(shm_id,IPC_RMID, &shm_desc) == -1) {
-          error("shmctl remove failed for %d", shm_id);
-        }
-      }
+  if(shm_fd>=0) {
+    close(shm_fd);
+    /* the last one to leave removes the segment */
+    if(last) {
+      shm_unlink(m_name.c_str());
     }
   }
-  shm_id=0;
+  shm_fd=-1;
 #endif /* _WIN32, USE_SHM */
+  (void)last;
   shm_addr = NULL;
+  shm_size = 0;
 }
 
-int pix_share_write :: getShm(int argc,t_atom*argv)
+t_pixshare_header*pix_share_write :: getHeader(void)
+{
+  if(!shm_addr || shm_size < sizeof(t_pixshare_header)) {
+    return NULL;
+  }
+  t_pixshare_header*h=(t_pixshare_header*)shm_addr;
+  if(PIXSHARE_MAGIC != h->magic || PIXSHARE_VERSION != h->version
+      || !h->slots) {
+    return NULL;
+  }
+  size_t needed=h->headersize + h->slots * h->slotsize;
+#if USE_SHM
+  if(needed > shm_size && shm_fd>=0) {
+    /* the producer has grown the segment: map it again */
+    struct stat st;
+    if(fstat(shm_fd, &st)<0 || (size_t)st.st_size < needed) {
+      return NULL;
+    }
+    void*addr=mmap(NULL, st.st_size, PROT_READ|PROT_WRITE, MAP_SHARED,
+                   shm_fd, 0);
+    if(MAP_FAILED == addr) {
+      return NULL;
+    }
+    munmap(shm_addr, shm_size);
+    shm_addr=(unsigned char*)addr;
+    shm_size=st.st_size;
+    h=(t_pixshare_header*)shm_addr;
+  }
+#endif
+  if(needed > shm_size) {
+    return NULL;
+  }
+  return h;
+}
+
+t_pixshare_slot*pix_share_write :: getSlot(t_pixshare_header*h,
+    uint32_t frame)
+{
+  return (t_pixshare_slot*)(shm_addr + h->headersize
+                            + (frame % h->slots) * h->slotsize);
+}
+unsigned char*pix_share_write :: getSlotData(t_pixshare_slot*slot)
+{
+  return ((unsigned char*)slot) + align(sizeof(t_pixshare_slot));
+}
+
+void pix_share_write :: initRing(bool keepCounters)
+{
+  t_pixshare_header*h=(t_pixshare_header*)shm_addr;
+  uint32_t written=0, consumed=0, users=0;
+  uint32_t layout=0;
+  if(keepCounters) {
+    written=h->written.load();
+    consumed=h->consumed.load();
+    users=h->users.load();
+    layout=h->layout.load();
+  }
+  /* tell the consumers that the ring is being changed */
+  h->layout.store(layout|1);
+  std::atomic_thread_fence(std::memory_order_release);
+  h->magic=PIXSHARE_MAGIC;
+  h->version=PIXSHARE_VERSION;
+  h->slots=m_slots;
+  h->size=m_size;
+  h->headersize=align(sizeof(t_pixshare_header));
+  h->slotsize=align(sizeof(t_pixshare_slot) + m_size);
+  h->written.store(written);
+  h->consumed.store(consumed);
+  h->waiters.store(0);
+  h->users.store(users);
+  for(unsigned int i=0; i<m_slots; i++) {
+    t_pixshare_slot*slot=getSlot(h, i);
+    slot->sequence.store(0);
+    slot->pins.store(0);
+    /* no frame in here (yet) */
+    slot->frame=written - 1 - m_slots;
+    slot->xsize=slot->ysize=0;
+    slot->format=0;
+    slot->upsidedown=0;
+  }
+  h->layout.store((layout|1) + 1, std::memory_order_release);
+}
+
+void pix_share_write :: notify(t_pixshare_header*h)
+{
+#ifdef __linux__
+  if(h->waiters.load()) {
+    syscall(SYS_futex, (uint32_t*)&h->written, FUTEX_WAKE, INT_MAX,
+            NULL, NULL, 0);
+  }
+#endif
+}
+
+void pix_share_write :: waitFor(t_pixshare_header*h, uint32_t frame,
+                                double ms)
 {
-  int fake = 0;
+  std::chrono::steady_clock::time_point deadline =
+    std::chrono::steady_clock::now()
+    + std::chrono::microseconds((long)(ms*1000.));
+  h->waiters.fetch_add(1);
+  while(h->written.load(std::memory_order_acquire) == frame) {
+    std::chrono::steady_clock::time_point now=std::chrono::steady_clock::now();
+    if(now >= deadline) {
+      break;
+    }
+#ifdef __linux__
+    long usec=std::chrono::duration_cast<std::chrono::microseconds>
+              (deadline - now).count();
+    struct timespec timeout;
+    timeout.tv_sec=usec/1000000;
+    timeout.tv_nsec=(usec%1000000)*1000;
+    syscall(SYS_futex, (uint32_t*)&h->written, FUTEX_WAIT, frame, &timeout,
+            NULL, 0);
+#else
+    /* no futexes: poll */
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+#endif
+  }
+  h->waiters.fetch_sub(1);
+}
 
+int pix_share_write :: getShm(int argc,t_atom*argv)
+{
   size_t size=0;
   int    xsize=1;
   int    ysize=1;
@@ -160,36 +332,34 @@ int pix_share_write :: getShm(int argc,t_atom*argv)
   if(argc<1) {
     return 7;
   }
-#ifdef _WIN32
-  if ( shm_addr ) {
-    UnmapViewOfFile( shm_addr );
-  }
-  if ( m_MapFile ) {
-    CloseHandle( m_MapFile );
-  }
-  if(A_FLOAT==argv->a_type) {
-    snprintf(m_fileMappingName, MAXPDSTRING-1,
-             "gem_pix_share-FileMappingObject_%g", atom_getfloat(argv));
-  } else if (A_SYMBOL==argv->a_type) {
-    snprintf(m_fileMappingName, MAXPDSTRING-1,
-             "gem_pix_share-FileMappingObject_%s", atom_getsymbol(argv)->s_name);
-  }
-
-#elif USE_SHM
-  if(shm_id>0) {
-    freeShm();
-  }
+  std::vector<t_atom>args(argv, argv+argc);
+  std::string id;
   if(A_FLOAT==argv->a_type) {
     char buf[MAXPDSTRING];
     snprintf(buf, MAXPDSTRING-1, "%g", atom_getfloat(argv));
     buf[MAXPDSTRING-1]=0;
-    fake = hash_str2us(buf);
+    id=buf;
   } else if(A_SYMBOL==argv->a_type) {
-    fake = hash_str2us(atom_getsymbol(argv)->s_name);
+    id=atom_getsymbol(argv)->s_name;
   }
-  if(fake<=0) {
+  if(id.empty()) {
     return 8;
   }
+#ifdef _WIN32
+  freeShm();
+  snprintf(m_fileMappingName, MAXPDSTRING-1,
+           "gem_pix_share-FileMappingObject_%s", id.c_str());
+#elif USE_SHM
+  freeShm();
+  /* POSIX only guarantees portable names of the form "/name",
+   * and some systems have a rather small limit on the length */
+  m_name="/gem_pix_share-" + id;
+  if(m_name.size() > 30 || std::string::npos != id.find('/')) {
+    char buf[MAXPDSTRING];
+    snprintf(buf, MAXPDSTRING-1, "/gem_pix_share-#%d", hash_str2us(id));
+    buf[MAXPDSTRING-1]=0;
+    m_name=buf;
+  }
 #else
   return -1;
 #endif /* _WIN32, USE_SHM */
@@ -273,13 +443,13 @@ int pix_share_write :: getShm(int argc,t_atom*argv)
   dummy.setFormat(color);
 
   m_size = (size)?(size):(xsize * ysize * dummy.csize);
+  m_args=args;
 
-  verbose(1, "%dx%dx%d: %d",
-          xsize,ysize,dummy.csize, m_size);
+  verbose(1, "%dx%dx%d: %d (%d slots)",
+          xsize,ysize,dummy.csize, m_size, m_slots);
 
+  size_t segmentSize=ringSize(m_size, m_slots);
 #ifdef _WIN32
-  size_t segmentSize=m_size+sizeof(t_pixshare_header);
-
   m_MapFile = CreateFileMapping(
                 INVALID_HANDLE_VALUE,    // use paging file
                 NULL,                    // default security
@@ -291,7 +461,7 @@ int pix_share_write :: getShm(int argc,t_atom*argv)
 
   if (m_MapFile == NULL) {
     pd_error(0, "Could not create file mapping object %s - error %ld.",
-          m_fileMappingName, GetLastError());
+             m_fileMappingName, GetLastError());
     return -1;
   }
 
@@ -304,70 +474,108 @@ int pix_share_write :: getShm(int argc,t_atom*argv)
 
   if ( !shm_addr ) {
     pd_error(0, "Could not get a view of file %s - error %ld",m_fileMappingName,
-          GetLastError());
+             GetLastError());
     return -1;
   } else {
     verbose(0,"File mapping object %s successfully created.",
             m_fileMappingName);
   }
+  shm_size=segmentSize;
 
 #elif USE_SHM
 
-  /* get a new segment with the size specified by the user
-   * OR an old segment with the size specified in its header
-   * why: if somebody has already created the segment with our key
-   * we want to reuse it, even if its size is smaller than we requested
+  /* get the segment with the size specified by the user
+   * OR an existing segment with the layout specified in its header
+   * (consumers just take whatever the producer has set up;
+   * a producer grows the segment if needed, but never shrinks it,
+   * as this would pull the rug from under the consumers' feet)
    */
   errno=0;
-  shm_id = shmget(fake,m_size+sizeof(t_pixshare_header), IPC_CREAT | 0666);
-
-  if((shm_id<0) && (EINVAL==errno)) {
-    errno=0;
-    // the segment already exists, but is smaller than we thought!
-    int id = shmget(fake,sizeof(t_pixshare_header),0666);
-    if(id>0) { /* yea, we got it! */
-      t_pixshare_header*h=(t_pixshare_header*)shmat(id,NULL,0666);
-      if (!shm_addr || shm_addr==(void *)-1) {
-        shm_addr=NULL;
-        return 8;
-      }
-      /* read the size of the blob from the shared segment */
-      if(h&&h->size) {
-        pd_error(0, "someone was faster: only got %d bytes instead of %d",
-              h->size, m_size);
-        m_size=h->size;
-
-        /* so free this shm-segment before we re-try with a smaller size */
-        shmdt(h);
-
-        /* now get the shm-segment with the correct size */
-        shm_id = shmget(fake,m_size+sizeof(t_pixshare_header), IPC_CREAT | 0666);
-      }
+  shm_fd = shm_open(m_name.c_str(), O_RDWR | O_CREAT, 0666);
+  if(shm_fd<0) {
+    pd_error(0, "couldn't open shared memory '%s': error %d", m_name.c_str(),
+             errno);
+    return 6;
+  }
+  struct stat st;
+  if(fstat(shm_fd, &st)<0) {
+    return 6;
+  }
+  shm_size=st.st_size;
+  if(shm_size < sizeof(t_pixshare_header)) {
+    /* a new segment */
+    if(ftruncate(shm_fd, segmentSize)<0) {
+      pd_error(0, "couldn't resize shared memory '%s': error %d",
+               m_name.c_str(), errno);
+      return 6;
     }
+    shm_size=segmentSize;
   }
+  void*addr=mmap(NULL, shm_size, PROT_READ|PROT_WRITE, MAP_SHARED, shm_fd, 0);
+  if(MAP_FAILED==addr) {
+    shm_size=0;
+    return 8;
+  }
+  shm_addr=(unsigned char*)addr;
+#endif /* _WIN32, SHM */
 
-  if(shm_id>0) {
-    /* now that we have a shm-segment, get the pointer to the data */
-    shm_addr = (unsigned char*)shmat(shm_id,NULL,0666);
-    if (!shm_addr || shm_addr==(void *)-1) {
+#if (defined _WIN32) || (defined USE_SHM)
+  t_pixshare_header*h=getHeader();
+  bool reuse=false;
+  if(h) {
+    if(m_consumer) {
+      reuse=true;
+      m_size=h->size;
+      m_slots=h->slots;
+    } else {
+      reuse=(h->slots==m_slots && h->size>=m_size);
+    }
+    if(h->size > m_size) {
+      m_size=h->size;
+    }
+  }
+  if(!reuse) {
+# if USE_SHM
+    segmentSize=ringSize(m_size, m_slots);
+    if(shm_size < segmentSize) {
+      munmap(shm_addr, shm_size);
       shm_addr=NULL;
-      return 8;
+      if(ftruncate(shm_fd, segmentSize)<0) {
+        pd_error(0, "couldn't resize shared memory '%s': error %d",
+                 m_name.c_str(), errno);
+        shm_size=0;
+        return 6;
+      }
+      addr=mmap(NULL, segmentSize, PROT_READ|PROT_WRITE, MAP_SHARED, shm_fd, 0);
+      if(MAP_FAILED==addr) {
+        shm_size=0;
+        return 8;
+      }
+      shm_addr=(unsigned char*)addr;
+      shm_size=segmentSize;
     }
-
-    if(shmctl(shm_id,IPC_STAT,&shm_desc)<0) {
-      return 8;
+# endif
+    if(shm_size < ringSize(m_size, m_slots)) {
+      pd_error(0, "shared memory segment too small: %lu < %lu",
+               (unsigned long)shm_size, (unsigned long)ringSize(m_size, m_slots));
+      return 6;
     }
-    /* write the size into the shm-segment */
-    t_pixshare_header *h=(t_pixshare_header *)shm_addr;
-    h->size = (shm_desc.shm_segsz-sizeof(t_pixshare_header));
-
-    verbose(1, "shm:: id(%d) segsz(%d) cpid (%d) mem(%p)",
-            shm_id,shm_desc.shm_segsz,shm_desc.shm_cpid, shm_addr);
-  } else {
-    pd_error(0, "couldn't get shm_id: error %d", errno);
-    return -1; // AV : added because i'm usure of what value is returned when we get this error...
+    initRing(NULL!=h);
+    h=getHeader();
   }
-#endif /* _WIN32, SHM */
+  if(!h) {
+    return 6;
+  }
+  h->users.fetch_add(1);
+
+  verbose(1, "shm:: '%s' %d slots of %lu bytes, mem(%p)",
+#ifdef _WIN32
+          m_fileMappingName,
+#else
+          m_name.c_str(),
+#endif
+          h->slots, (unsigned long)h->size, shm_addr);
+#endif
   return 0;
 }
 
@@ -383,9 +591,9 @@ void pix_share_write :: render(GemState *state)
     return;
   }
 
-#if !defined _WIN32 && USE_SHM
-  if(shm_id>0) {
-#elif USE_SHM
+#if USE_SHM
+  if(shm_fd>=0) {
+#elif defined _WIN32
   if(m_MapFile) {
 #else
   if(0) {
@@ -393,7 +601,8 @@ void pix_share_write :: render(GemState *state)
     imageStruct *pix = &img->image;
     size_t size=pix->xsize*pix->ysize*pix->csize;
 
-    if (!shm_addr) {
+    t_pixshare_header *h=getHeader();
+    if (!h) {
       t_atom atom;
       pd_error(0, "no shmaddr");
       SETFLOAT(&atom, -1);
@@ -401,28 +610,102 @@ void pix_share_write :: render(GemState *state)
       return;
     }
 
-    if (size<=m_size) {
-      t_pixshare_header *h=(t_pixshare_header *)shm_addr;
-      h->size =m_size;
-      h->xsize=pix->xsize;
-      h->ysize=pix->ysize;
-      h->format=pix->format;
-      h->upsidedown=pix->upsidedown;
-      memcpy(shm_addr+sizeof(t_pixshare_header),pix->data,size);
+    if (size<=h->size) {
+      /* we are the only producer, so nobody else changes 'written' */
+      uint32_t frame=h->written.load(std::memory_order_relaxed);
+      t_pixshare_slot*slot=getSlot(h, frame);
+      uint32_t seq=slot->sequence.load(std::memory_order_relaxed);
+      /* (sequentially consistent, so that we either see the consumer's pin,
+       * or the consumer sees that we are writing) */
+      slot->sequence.store(seq|1);
+      if(slot->pins.load()) {
+        /* a consumer is using this frame in place: leave it alone,
+         * unless it has been pinned for so long that the consumer is probably dead */
+        double now=gem::utils::monotonicTime();
+        if(m_pinnedSince <= 0.) {
+          m_pinnedSince=now;
+        }
+        if(now - m_pinnedSince < 1000.) {
+          slot->sequence.store(seq);
+          m_skipped++;
+          return;
+        }
+      }
+      m_pinnedSince=0.;
+
+      slot->frame=frame;
+      slot->xsize=pix->xsize;
+      slot->ysize=pix->ysize;
+      slot->format=pix->format;
+      slot->upsidedown=pix->upsidedown;
+      memcpy(getSlotData(slot),pix->data,size);
+
+      slot->sequence.store((seq|1)+1, std::memory_order_release);
+      h->written.store(frame+1, std::memory_order_release);
+      notify(h);
     } else {
       pd_error(0, "input image too large: %dx%dx%d=%d>%lu",
-            pix->xsize, pix->ysize, pix->csize,
-            pix->xsize*pix->ysize*pix->csize,
-            m_size);
+               pix->xsize, pix->ysize, pix->csize,
+               pix->xsize*pix->ysize*pix->csize,
+               (unsigned long)h->size);
     }
   }
 }
 
+/////////////////////////////////////////////////////////
+// Messages
+//
+/////////////////////////////////////////////////////////
+void pix_share_write :: slotsMess(int slots)
+{
+  if(slots<2) {
+    pd_error(0, "need at least 2 slots");
+    return;
+  }
+  m_slots=slots;
+  /* re-create the ring with the new number of slots */
+  if(!m_args.empty()) {
+    std::vector<t_atom>args=m_args;
+    int err=getShm(args.size(), args.data());
+    if(err) {
+      error("couldn't get new shared memory block! %d", err);
+    }
+  }
+}
+
+void pix_share_write :: statsMess(void)
+{
+  t_atom ap[2];
+  t_pixshare_header*h=getHeader();
+  if(!h) {
+    return;
+  }
+  SETSYMBOL(ap+0, gensym("slots"));
+  SETFLOAT (ap+1, h->slots);
+  outlet_anything(m_outlet, gensym("stats"), 2, ap);
+
+  SETSYMBOL(ap+0, gensym("written"));
+  SETFLOAT (ap+1, h->written.load());
+  outlet_anything(m_outlet, gensym("stats"), 2, ap);
+
+  SETSYMBOL(ap+0, gensym("consumed"));
+  SETFLOAT (ap+1, h->consumed.load());
+  outlet_anything(m_outlet, gensym("stats"), 2, ap);
+
+  if(!m_consumer) {
+    SETSYMBOL(ap+0, gensym("skipped"));
+    SETFLOAT (ap+1, m_skipped);
+    outlet_anything(m_outlet, gensym("stats"), 2, ap);
+  }
+}
+
 void pix_share_write :: obj_setupCallback(t_class *classPtr)
 {
   class_addmethod(classPtr,
                   reinterpret_cast<t_method>(&pix_share_write::setMessCallback),
                   gensym("set"), A_GIMME, A_NULL);
+  CPPEXTERN_MSG1(classPtr, "slots", slotsMess, int);
+  CPPEXTERN_MSG0(classPtr, "stats", statsMess);
 }
 
 void pix_share_write :: setMessCallback(void *data, t_symbol* s, int argc,
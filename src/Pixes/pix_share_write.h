@@ -11,6 +11,8 @@
 #define _INCLUDE__GEM_PIXES_PIX_SHARE_WRITE_H_
 
 #include "pix_share.h"
+#include <string>
+#include <vector>
 
 class GEM_EXTERN pix_share_write : public GemBase
 {
@@ -20,21 +22,48 @@ public:
   pix_share_write(int, t_atom*);
 
 protected:
+  /* consumers attach to an existing ring as it is */
+  pix_share_write(int, t_atom*, bool consumer);
   ~pix_share_write();
 
+  void init(int, t_atom*);
   void freeShm();
   int getShm(int,t_atom*);
 
+  /* returns the header of the ring, or NULL if there is no (valid) ring */
+  t_pixshare_header*getHeader(void);
+  t_pixshare_slot*getSlot(t_pixshare_header*, uint32_t frame);
+  unsigned char*getSlotData(t_pixshare_slot*);
+  /* (re)initialize the ring in the segment */
+  void initRing(bool keepCounters);
+
+  /* wake up consumers waiting for a new frame */
+  static void notify(t_pixshare_header*);
+  /* wait (at most 'ms' milliseconds) until 'written' differs from 'frame' */
+  static void waitFor(t_pixshare_header*, uint32_t frame, double ms);
+
   virtual void render(GemState *state);
+  virtual void slotsMess(int);
+  virtual void statsMess(void);
+
   unsigned char *shm_addr;
+  size_t shm_size;  // size of the mapped segment
 #if USE_SHM
-  int   shm_id;
-  struct shmid_ds shm_desc;
+  int   shm_fd;
+  std::string m_name;
 #elif defined _WIN32
   HANDLE m_MapFile;
   char m_fileMappingName[MAXPDSTRING];
 #endif
   size_t m_size;
+  unsigned int m_slots;
+  /* frames we could not write, because a consumer had the slot pinned */
+  unsigned long m_skipped;
+  /* since when (ms) we are waiting for a pinned slot (0: not waiting) */
+  double m_pinnedSince;
+  bool m_consumer;
+  /* the arguments of the last 'set', for re-creating the ring */
+  std::vector<t_atom>m_args;
   t_outlet *m_outlet;
   static void   setMessCallback(void *data, t_symbol* s, int argc,
                                 t_atom *argv);
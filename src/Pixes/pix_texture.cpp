@@ -20,6 +20,7 @@
 #include "Gem/Settings.h"
 #include "Gem/Image.h"
 #include "Utils/Functions.h"
+#include "Utils/Latency.h"
 #include <string.h>
 
 #ifdef debug_post
@@ -333,6 +334,8 @@ void pix_texture :: render(GemState *state)
     upsidedown = img->image.upsidedown;
     if (img->newimage) {
       m_rebuildList = true;
+      /* keep track of how old the frame is by now */
+      gem::utils::FrameLatency::uploaded(img->timestamp);
     }
 
     img->image.copy2ImageStruct(&m_imagebuf);
@@ -21,6 +21,7 @@
 #include "Gem/Image.h"
 #include "Gem/Exception.h"
 #include "plugins/PluginFactory.h"
+#include "Utils/Latency.h"
 
 #include "RTE/Symbol.h"
 
@@ -44,7 +45,8 @@ CPPEXTERN_NEW_WITH_GIMME(pix_video);
 //
 /////////////////////////////////////////////////////////
 pix_video :: pix_video(int argc, t_atom*argv) :
-  m_videoHandle(NULL), m_driver(-1), m_running(UNKNOWN), m_infoOut(NULL)
+  m_videoHandle(NULL), m_driver(-1), m_running(UNKNOWN), m_infoOut(NULL),
+  m_lastTimestamp(0.), m_sequence(0)
 {
   gem::PluginFactory<gem::plugins::video>::loadPlugins("video");
   std::vector<std::string>ids=
@@ -108,6 +110,18 @@ void pix_video :: render(GemState *state)
   if (m_videoHandle) {
     pixBlock*frame=m_videoHandle->getFrame();
     //post("got frame: %p", frame);
+    if(frame && frame->newimage) {
+      if(frame->timestamp <= m_lastTimestamp) {
+        /* the backend does not know when the frame was captured */
+        frame->timestamp=gem::utils::monotonicTime();
+      }
+      /* keep the sequence numbers strictly increasing */
+      if(frame->sequence <= m_sequence) {
+        frame->sequence=m_sequence+1;
+      }
+      m_lastTimestamp=frame->timestamp;
+      m_sequence=frame->sequence;
+    }
     state->set(GemState::_PIX, frame);
   }
 }
@@ -150,6 +150,11 @@ protected:
   /* an outlet for status messages */
   t_outlet *m_infoOut;
 
+  /* timestamp/sequence of the last new frame
+   * (for backends that don't set them) */
+  double m_lastTimestamp;
+  unsigned long m_sequence;
+
 private:
 
   //////////
@@ -21,8 +21,10 @@
 #include "Gem/Manager.h"
 #include "Gem/Cache.h"
 #include "Gem/ImageIO.h"
+#include "Gem/Properties.h"
 
 #include "Gem/Files.h"
+#include "RTE/Outlet.h"
 #include <stdio.h>
 #include <string.h>
 
@@ -44,6 +46,8 @@ CPPEXTERN_NEW_WITH_GIMME(pix_write);
 /////////////////////////////////////////////////////////
 pix_write :: pix_write(int argc, t_atom *argv)
   : m_originalImage(NULL), m_color(3)
+  , m_async(false), m_queue(NULL)
+  , m_outlet(NULL)
 {
   m_xoff = m_yoff = 0;
   m_width = m_height = 0;
@@ -87,6 +91,7 @@ pix_write :: pix_write(int argc, t_atom *argv)
   m_originalImage->setFormat(m_color);
   m_originalImage->allocate();
 
+  m_outlet = new gem::RTE::Outlet(this);
 }
 
 /////////////////////////////////////////////////////////
@@ -95,7 +100,12 @@ pix_write :: pix_write(int argc, t_atom *argv)
 /////////////////////////////////////////////////////////
 pix_write :: ~pix_write(void)
 {
+  /* this blocks until all pending frames are written */
+  delete m_queue;
+  m_queue=NULL;
+  reportFailures();
   cleanImage();
+  delete m_outlet;
 }
 
 
@@ -135,16 +145,27 @@ void pix_write :: doWrite(void)
   m_originalImage->setFormat(GEM_RGBA);
 #endif /* APPLE */
 
-  m_originalImage->reallocate();
+  imageStruct*img=m_originalImage;
+  if(m_async) {
+    /* the queue takes ownership of the frame, so grab into a fresh image */
+    if(!m_queue) {
+      m_queue=new gem::image::SaveQueue();
+    }
+    img=new imageStruct();
+    m_originalImage->copy2ImageStruct(img);
+    img->allocate();
+  } else {
+    img->reallocate();
+  }
 
   /* the orientation is always correct, since we get it from openGL */
   /* if we do need flipping, this must be handled in mem2image() */
   // FIXXXME: upsidedown should default be 'true'
-  m_originalImage->upsidedown=false;
+  img->upsidedown=false;
 
 
   glReadPixels(m_xoff, m_yoff, width, height,
-               m_originalImage->format, m_originalImage->type, m_originalImage->data);
+               img->format, img->type, img->data);
 
 #if 0 // asynchronous texture fetching idea sketch
   /* Enable AGP storage hints */
@@ -164,7 +185,20 @@ void pix_write :: doWrite(void)
 #endif
 
 
-  mem2image(m_originalImage, m_filename, m_filetype);
+  /* legacy: type=0 -> TIFF; type>0 -> JPEG and (quality:=type) */
+  gem::Properties props;
+  if(m_filetype>0) {
+    props.set("quality", (float)m_filetype);
+  }
+  if(!m_compression.empty()) {
+    props.set("compression", m_compression);
+  }
+  if(m_async) {
+    m_queue->push(img, m_filename, std::string(), props);
+    reportFailures();
+  } else if(!gem::image::save::sync(*img, m_filename, std::string(), props)) {
+    pd_error(0, "GEM: Unable to save image to '%s'", m_filename);
+  }
 }
 
 /////////////////////////////////////////////////////////
@@ -259,6 +293,13 @@ void pix_write :: obj_setupCallback(t_class *classPtr)
 
   CPPEXTERN_MSG2(classPtr, "vert_size", sizeMess, int, int);
   CPPEXTERN_MSG2(classPtr, "vert_pos",  posMess, int, int);
+
+  CPPEXTERN_MSG1(classPtr, "async", asyncMess, bool);
+  CPPEXTERN_MSG1(classPtr, "queue", queueMess, unsigned int);
+  CPPEXTERN_MSG1(classPtr, "policy", policyMess, t_symbol*);
+  CPPEXTERN_MSG1(classPtr, "threads", threadsMess, unsigned int);
+  CPPEXTERN_MSG0(classPtr, "stats", statsMess);
+  CPPEXTERN_MSG (classPtr, "compression", compressionMess);
 }
 
 void pix_write :: autoMess(bool on)
@@ -277,3 +318,68 @@ void pix_write :: colorFormatMess(int format)
     m_color = 3;
   }
 }
+
+void pix_write :: asyncMess(bool on)
+{
+  if(!on && m_queue) {
+    /* make sure that all frames are written before we go synchronous */
+    m_queue->flush();
+    reportFailures();
+  }
+  m_async=on;
+}
+void pix_write :: queueMess(unsigned int size)
+{
+  if(!m_queue) {
+    m_queue=new gem::image::SaveQueue();
+  }
+  m_queue->setCapacity(size);
+}
+void pix_write :: policyMess(t_symbol*s)
+{
+  gem::image::SaveQueue::Policy policy;
+  if(!gem::image::SaveQueue::string2policy(s->s_name, policy)) {
+    pd_error(0, "unknown policy '%s' (use 'block', 'drop_oldest' or 'drop_newest')",
+             s->s_name);
+    return;
+  }
+  if(!m_queue) {
+    m_queue=new gem::image::SaveQueue();
+  }
+  m_queue->setPolicy(policy);
+}
+void pix_write :: threadsMess(unsigned int threads)
+{
+  if(!m_queue) {
+    m_queue=new gem::image::SaveQueue();
+  }
+  m_queue->setThreads(threads);
+  reportFailures();
+}
+void pix_write :: compressionMess(t_symbol*s, int argc, t_atom*argv)
+{
+  /* passed on to the imagesaver
+   * (e.g. "none", "lzw" or "deflate" for TIFF, 0..9 for PNG)
+   */
+  if(argc!=1) {
+    pd_error(0, "usage: compression <type|level>");
+    return;
+  }
+  char tmp[MAXPDSTRING];
+  atom_string(argv, tmp, MAXPDSTRING);
+  m_compression=tmp;
+}
+void pix_write :: statsMess(void)
+{
+  gem::image::SaveQueue::sendStats(m_queue, m_outlet);
+}
+void pix_write :: reportFailures(void)
+{
+  if(!m_queue) {
+    return;
+  }
+  std::vector<std::string>failed=m_queue->getFailures();
+  for(unsigned int i=0; i<failed.size(); i++) {
+    pd_error(0, "GEM: Unable to save image to '%s'", failed[i].c_str());
+  }
+}
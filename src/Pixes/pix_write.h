@@ -18,6 +18,18 @@ LOG
 #include "Base/GemBase.h"
 #include "Gem/Image.h"
 
+namespace gem
+{
+namespace image
+{
+class SaveQueue;
+};
+namespace RTE
+{
+class Outlet;
+};
+};
+
 /*-----------------------------------------------------------------
 -------------------------------------------------------------------
 CLASS
@@ -36,6 +48,11 @@ DESCRIPTION
     "file" - filename to write to
     "bang" - do write now
     "auto 0/1" - stop/start writing automatically
+    "async 0/1" - write files immediately (default) or in the background
+    "queue <n>" - max. number of frames waiting to be written
+    "policy block|drop_oldest|drop_newest" - what to do if the queue is full
+    "threads <n>" - number of encoder threads
+    "stats" - output statistics about the write queue
 
     "vert_size" - Set the size of the pix
     "vert_pos" - Set the position of the pix
@@ -88,6 +105,19 @@ protected:
   void bangMess(void);
   void colorFormatMess(int format);
 
+  //////////
+  // background writing
+  void asyncMess(bool);
+  void queueMess(unsigned int);
+  void policyMess(t_symbol*);
+  void threadsMess(unsigned int);
+  void statsMess(void);
+  void reportFailures(void);
+
+  //////////
+  // compression of the written files
+  void compressionMess(t_symbol*, int, t_atom*);
+
   //////////
   // Clean up the image
   void            cleanImage(void);
@@ -140,6 +170,15 @@ protected:
   // The color (1 = R, 3 = RGB, 4 = RGBA)
   int m_color;
 
+  //////////
+  // write frames in the background
+  bool m_async;
+  gem::image::SaveQueue*m_queue;
+
+  std::string m_compression;
+
+  gem::RTE::Outlet*m_outlet;
+
 private:
 
   //////////
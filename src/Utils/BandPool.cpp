@@ -0,0 +1,188 @@
+////////////////////////////////////////////////////////
+//
+// GEM - Graphics Environment for Multimedia
+//
+// agent@local
+//
+// Implementation file
+//
+//    Copyright (c) 2026 agent. agent@local
+//    For information on usage and redistribution, and for a DISCLAIMER OF ALL
+//    WARRANTIES, see the file, "GEM.LICENSE.TERMS" in this distribution.
+//
+/////////////////////////////////////////////////////////
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "BandPool.h"
+#include "Thread.h"
+#include "Latency.h"
+#include "RTE/Outlet.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class gem::thread::BandPool::PIMPL
+{
+public:
+  std::mutex mutex;
+  std::condition_variable wake, done;
+  std::vector<std::thread>threads;
+  bool quit;
+
+  /* the current job: workers run it once 'generation' changes */
+  unsigned long generation;
+  band_fn fn;
+  void*data;
+  unsigned int bands;
+  unsigned int pending; /* bands (other than #0) not yet done */
+
+  unsigned int numthreads;
+
+  /* the last frame */
+  double start;
+  double time, pixels;
+  unsigned int lastbands;
+
+  PIMPL(void)
+    : quit(false)
+    , generation(0), fn(0), data(0), bands(0), pending(0)
+    , numthreads(0)
+    , start(0.), time(0.), pixels(0.), lastbands(0)
+  {}
+  ~PIMPL(void)
+  {
+    {
+      std::unique_lock<std::mutex>lock(mutex);
+      quit=true;
+    }
+    wake.notify_all();
+    for(size_t i=0; i<threads.size(); i++) {
+      threads[i].join();
+    }
+  }
+
+  /* worker #index processes band #index of each job */
+  void worker(unsigned int index, unsigned long seen)
+  {
+    std::unique_lock<std::mutex>lock(mutex);
+    while(true) {
+      while(!quit && generation==seen) {
+        wake.wait(lock);
+      }
+      if(quit) {
+        return;
+      }
+      seen=generation;
+      if(index<bands) {
+        band_fn f=fn;
+        void*d=data;
+        lock.unlock();
+        f(index, d);
+        lock.lock();
+        if(0 == --pending) {
+          done.notify_one();
+        }
+      }
+    }
+  }
+};
+
+gem::thread::BandPool::BandPool(void)
+  : m_pimpl(new PIMPL())
+{
+}
+gem::thread::BandPool::~BandPool(void)
+{
+  delete m_pimpl;
+}
+
+void gem::thread::BandPool::setThreads(unsigned int threads)
+{
+  m_pimpl->numthreads=threads;
+}
+
+unsigned int gem::thread::BandPool::getBands(int lines, int minlines,
+    int bytes, int minbytes) const
+{
+  unsigned int bands = m_pimpl->numthreads?m_pimpl->numthreads:getCPUCount();
+  if(minlines>0 && bands>static_cast<unsigned int>(lines/minlines)) {
+    bands=lines/minlines;
+  }
+  if(minbytes>0 && bands>static_cast<unsigned int>(bytes/minbytes)) {
+    bands=bytes/minbytes;
+  }
+  if(bands<1) {
+    bands=1;
+  }
+  return bands;
+}
+
+void gem::thread::BandPool::run(unsigned int bands, band_fn fn, void*data)
+{
+  m_pimpl->lastbands=bands;
+  if(bands<2) {
+    if(bands) {
+      fn(0, data);
+    }
+    return;
+  }
+  {
+    std::unique_lock<std::mutex>lock(m_pimpl->mutex);
+    /* new workers must not pick up the previous job */
+    while(m_pimpl->threads.size()+1 < bands) {
+      const unsigned int index=m_pimpl->threads.size()+1;
+      m_pimpl->threads.push_back(std::thread(&PIMPL::worker, m_pimpl, index,
+                                             m_pimpl->generation));
+    }
+    m_pimpl->fn=fn;
+    m_pimpl->data=data;
+    m_pimpl->bands=bands;
+    m_pimpl->pending=bands-1;
+    m_pimpl->generation++;
+  }
+  m_pimpl->wake.notify_all();
+
+  fn(0, data);
+
+  std::unique_lock<std::mutex>lock(m_pimpl->mutex);
+  while(m_pimpl->pending) {
+    m_pimpl->done.wait(lock);
+  }
+}
+
+void gem::thread::BandPool::begin(void)
+{
+  m_pimpl->start=gem::utils::monotonicTime();
+}
+void gem::thread::BandPool::end(double pixels)
+{
+  m_pimpl->time=gem::utils::monotonicTime()-m_pimpl->start;
+  m_pimpl->pixels=pixels;
+}
+
+void gem::thread::BandPool::sendStats(gem::RTE::Outlet*outlet) const
+{
+  if(!outlet) {
+    return;
+  }
+  const double time=m_pimpl->time;
+  std::vector<gem::any>data;
+  data.push_back(std::string("threads"));
+  data.push_back(static_cast<int>(m_pimpl->lastbands));
+  outlet->send("stats", data);
+
+  data.clear();
+  data.push_back(std::string("time"));
+  data.push_back(time);
+  outlet->send("stats", data);
+
+  /* throughput of the last frame in MPixel/s */
+  data.clear();
+  data.push_back(std::string("mpixels"));
+  data.push_back((time>0.)?(m_pimpl->pixels/(time*1000.)):0.);
+  outlet->send("stats", data);
+}
@@ -0,0 +1,89 @@
+/*-----------------------------------------------------------------
+LOG
+    GEM - Graphics Environment for Multimedia
+
+    BandPool.h
+       - part of GEM
+       - process an image in bands on a pool of persistent threads
+
+    Copyright (c) 2026 agent. agent@local
+    For information on usage and redistribution, and for a DISCLAIMER OF ALL
+    WARRANTIES, see the file, "GEM.LICENSE.TERMS" in this distribution.
+
+-----------------------------------------------------------------*/
+
+#ifndef _INCLUDE__GEM_UTILS_BANDPOOL_H_
+#define _INCLUDE__GEM_UTILS_BANDPOOL_H_
+
+#include "Gem/ExportDef.h"
+
+namespace gem
+{
+namespace RTE
+{
+class Outlet;
+};
+namespace thread
+{
+/**
+ * split the work on an image into bands, one per thread
+ * the threads are started when they are first needed and then kept
+ * (waiting for the next bands) until the pool is destroyed,
+ * so running the bands of each frame does not cost a thread creation
+ *
+ * the pool also keeps track of the processing time of the last frame
+ */
+class GEM_EXTERN BandPool
+{
+private:
+  class PIMPL;
+  PIMPL*m_pimpl;
+
+  BandPool(const BandPool&);
+  BandPool&operator=(const BandPool&);
+
+  template<class F>
+  static void callBand(unsigned int band, void*f)
+  {
+    (*static_cast<const F*>(f))(band);
+  }
+public:
+  BandPool(void);
+  virtual ~BandPool(void);
+
+  /* number of threads to use (0: one per CPU) */
+  void setThreads(unsigned int threads);
+
+  /* number of bands for 'lines' lines of 'bytes' bytes:
+   * one per thread, but none thinner than 'minlines' lines
+   * (and, if 'minbytes' is given, none narrower than 'minbytes' bytes)
+   */
+  unsigned int getBands(int lines, int minlines,
+                        int bytes=0, int minbytes=0) const;
+
+  /* call fn(band, data) for each band in [0..bands), in parallel;
+   * band #0 is processed in the calling thread.
+   * returns once all bands are done */
+  typedef void (*band_fn)(unsigned int band, void*data);
+  void run(unsigned int bands, band_fn fn, void*data);
+  /* call f(band) for each band in [0..bands), in parallel */
+  template<class F>
+  void run(unsigned int bands, const F&f)
+  {
+    run(bands, callBand<F>, const_cast<void*>(static_cast<const void*>(&f)));
+  }
+
+  /* timing: call begin() before processing a frame
+   * and end() with the number of pixels processed afterwards */
+  void begin(void);
+  void end(double pixels);
+
+  /* output the number of bands, the processing time (in ms)
+   * and the throughput (in MPixel/s) of the last frame
+   * as "stats threads <n>", "stats time <ms>", "stats mpixels <n>" */
+  void sendStats(gem::RTE::Outlet*outlet) const;
+};
+};
+};
+
+#endif  // for header file
@@ -0,0 +1,134 @@
+////////////////////////////////////////////////////////
+//
+// GEM - Graphics Environment for Multimedia
+//
+// agent@local
+//
+// Implementation file
+//
+//    Copyright (c) 2026 agent. agent@local
+//    For information on usage and redistribution, and for a DISCLAIMER OF ALL
+//    WARRANTIES, see the file, "GEM.LICENSE.TERMS" in this distribution.
+//
+/////////////////////////////////////////////////////////
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "Latency.h"
+
+#include <chrono>
+#include <mutex>
+
+namespace
+{
+static std::mutex s_mutex;
+static gem::utils::LatencyHistogram s_upload, s_swap;
+/* timestamps of the frames uploaded since the last swap */
+static std::vector<double>s_pending;
+};
+
+double gem::utils::monotonicTime(void)
+{
+  return std::chrono::duration<double, std::milli>
+         (std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+gem::utils::LatencyHistogram::LatencyHistogram(void)
+  : m_bins(BINS)
+  , m_count(0)
+  , m_sum(0.), m_max(0.)
+{
+}
+
+void gem::utils::LatencyHistogram::add(double ms)
+{
+  unsigned int bin=0;
+  while(bin<BINS-1 && ms>=binEdge(bin)) {
+    bin++;
+  }
+  m_bins[bin]++;
+  m_count++;
+  m_sum+=ms;
+  if(ms>m_max) {
+    m_max=ms;
+  }
+}
+
+void gem::utils::LatencyHistogram::reset(void)
+{
+  m_bins.assign(BINS, 0);
+  m_count=0;
+  m_sum=m_max=0.;
+}
+
+unsigned long gem::utils::LatencyHistogram::count(void) const
+{
+  return m_count;
+}
+double gem::utils::LatencyHistogram::mean(void) const
+{
+  return m_count?(m_sum/m_count):0.;
+}
+double gem::utils::LatencyHistogram::max(void) const
+{
+  return m_max;
+}
+const std::vector<unsigned long>&gem::utils::LatencyHistogram::bins(
+  void) const
+{
+  return m_bins;
+}
+double gem::utils::LatencyHistogram::binEdge(unsigned int i)
+{
+  return (double)(1UL<<i);
+}
+
+
+double gem::utils::FrameLatency::uploaded(double timestamp)
+{
+  if(timestamp<=0.) {
+    /* unknown */
+    return 0.;
+  }
+  double age=monotonicTime() - timestamp;
+  std::unique_lock<std::mutex>lock(s_mutex);
+  s_upload.add(age);
+  if(s_pending.size()>=1024) {
+    /* nobody is swapping buffers */
+    s_pending.erase(s_pending.begin());
+  }
+  s_pending.push_back(timestamp);
+  return age;
+}
+
+void gem::utils::FrameLatency::swapped(void)
+{
+  std::unique_lock<std::mutex>lock(s_mutex);
+  if(s_pending.empty()) {
+    return;
+  }
+  double now=monotonicTime();
+  for(unsigned int i=0; i<s_pending.size(); i++) {
+    s_swap.add(now - s_pending[i]);
+  }
+  s_pending.clear();
+}
+
+gem::utils::LatencyHistogram gem::utils::FrameLatency::getUpload(void)
+{
+  std::unique_lock<std::mutex>lock(s_mutex);
+  return s_upload;
+}
+gem::utils::LatencyHistogram gem::utils::FrameLatency::getSwap(void)
+{
+  std::unique_lock<std::mutex>lock(s_mutex);
+  return s_swap;
+}
+void gem::utils::FrameLatency::reset(void)
+{
+  std::unique_lock<std::mutex>lock(s_mutex);
+  s_upload.reset();
+  s_swap.reset();
+  s_pending.clear();
+}
@@ -0,0 +1,85 @@
+/*-----------------------------------------------------------------
+LOG
+    GEM - Graphics Environment for Multimedia
+
+    Latency.h
+       - part of GEM
+       - measure how old frames are when they get displayed
+
+    Copyright (c) 2026 agent. agent@local
+    For information on usage and redistribution, and for a DISCLAIMER OF ALL
+    WARRANTIES, see the file, "GEM.LICENSE.TERMS" in this distribution.
+
+-----------------------------------------------------------------*/
+
+#ifndef _INCLUDE__GEM_UTILS_LATENCY_H_
+#define _INCLUDE__GEM_UTILS_LATENCY_H_
+
+#include "Gem/ExportDef.h"
+
+#include <vector>
+
+namespace gem
+{
+namespace utils
+{
+/**
+ * the current time of a monotonic clock (in milliseconds)
+ * this is the clock used for pixBlock::timestamp
+ */
+GEM_EXTERN double monotonicTime(void);
+
+/**
+ * a histogram of latencies (in milliseconds)
+ * bin #0 holds all values below 1ms, bin #i holds values in [2^(i-1), 2^i),
+ * the last bin holds everything above
+ */
+class GEM_EXTERN LatencyHistogram
+{
+public:
+  static const unsigned int BINS=12;
+
+  LatencyHistogram(void);
+
+  void add(double ms);
+  void reset(void);
+
+  unsigned long count(void) const;
+  double mean(void) const;
+  double max(void) const;
+  const std::vector<unsigned long>&bins(void) const;
+
+  /* upper bound of bin 'i' (in ms) */
+  static double binEdge(unsigned int i);
+
+private:
+  std::vector<unsigned long>m_bins;
+  unsigned long m_count;
+  double m_sum, m_max;
+};
+
+/**
+ * global bookkeeping of frame ages
+ * pix_texture reports each frame it uploads; when a window swaps its
+ * buffers, all frames uploaded since the last swap are on screen
+ */
+class GEM_EXTERN FrameLatency
+{
+public:
+  /* a frame captured (or decoded) at 'timestamp' has been uploaded to a texture
+   * returns the frame's age (in ms)
+   */
+  static double uploaded(double timestamp);
+  /* a window has swapped its buffers */
+  static void swapped(void);
+
+  /* age of frames at texture upload */
+  static LatencyHistogram getUpload(void);
+  /* age of frames at buffer swap */
+  static LatencyHistogram getSwap(void);
+  static void reset(void);
+};
+};
+};
+
+#endif  // for header file
@@ -0,0 +1,270 @@
+////////////////////////////////////////////////////////
+//
+// GEM - Graphics Environment for Multimedia
+//
+// agent@local
+//
+// Implementation file
+//
+//    Copyright (c) 2026 agent. agent@local
+//    For information on usage and redistribution, and for a DISCLAIMER OF ALL
+//    WARRANTIES, see the file, "GEM.LICENSE.TERMS" in this distribution.
+//
+/////////////////////////////////////////////////////////
+
+#include "plugins/BackendCache.h"
+
+#include "Gem/RTE.h"
+#include "Gem/Files.h"
+#include "Gem/Settings.h"
+
+#include <map>
+#include <mutex>
+#include <fstream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+
+namespace
+{
+#ifdef _WIN32
+# define GEM_BACKENDCACHE_FILE "%HOMEPATH%\\plugdata\\Extra\\Gem\\backends.cache"
+#else
+# define GEM_BACKENDCACHE_FILE "~/Documents/plugdata/Extra/Gem/backends.cache"
+#endif
+
+/* number of bytes at the beginning of the file used as "magic"
+ * this covers the signatures of the common formats (PNG, JPEG, TIFF, GIF, RIFF,...)
+ * but stops before any per-file data (like TIFF's IFD offset),
+ * so all files of a given format share a single entry */
+static const unsigned int MAGIC_SIZE=4;
+
+/* the first few bytes of the file (as a hex string);
+ * "-" if 'filename' is not a readable file (e.g. a stream)
+ */
+static std::string getMagic(const std::string&filename)
+{
+  std::string result;
+  FILE*fd=fopen(filename.c_str(), "rb");
+  if(!fd) {
+    return "-";
+  }
+  unsigned char buf[MAGIC_SIZE];
+  size_t len=fread(buf, 1, sizeof(buf), fd);
+  fclose(fd);
+  static const char hex[]="0123456789abcdef";
+  for(size_t i=0; i<len; i++) {
+    result+=hex[buf[i]>>4];
+    result+=hex[buf[i]&0xF];
+  }
+  return result.empty()?"-":result;
+}
+static std::string getExtension(const std::string&filename)
+{
+  std::string ext=gem::files::getExtension(filename, true);
+  /* we store the extension in a whitespace separated file */
+  for(size_t i=0; i<ext.size(); i++) {
+    if(isspace(ext[i])) {
+      ext[i]='_';
+    }
+  }
+  return ext.empty()?"-":ext;
+}
+
+class Cache
+{
+public:
+  static Cache*get(void)
+  {
+    static Cache*s_cache=new Cache();
+    return s_cache;
+  }
+
+  std::mutex mutex;
+
+  /* "<kind> <extension> <magic>" -> id
+   * "<kind> <extension>"         -> id
+   */
+  std::map<std::string, std::string>backends;
+  /* "<kind>" -> "<id>" -> latency */
+  std::map<std::string, std::map<std::string, gem::plugins::BackendCache::Latency> >latencies;
+
+  void load(void)
+  {
+    if(m_filename.empty()) {
+      return;
+    }
+    std::ifstream f(m_filename.c_str());
+    std::string kind, ext, magic, id;
+    bool pruned=false;
+    while(f >> kind >> ext >> magic >> id) {
+      if("-" != magic && 2*MAGIC_SIZE != magic.size()) {
+        /* written with a different MAGIC_SIZE: drop it */
+        pruned=true;
+        continue;
+      }
+      add(kind, ext, magic, id);
+    }
+    m_dirty=pruned;
+  }
+  /* write the cache to disk (if it has changed) */
+  void save(void)
+  {
+    if(m_filename.empty() || !m_dirty) {
+      return;
+    }
+    m_dirty=false;
+    std::ofstream f(m_filename.c_str());
+    if(!f.is_open()) {
+      return;
+    }
+    std::map<std::string, std::string>::iterator it;
+    for(it=m_entries.begin(); it!=m_entries.end(); ++it) {
+      f << it->first << " " << it->second << "\n";
+    }
+  }
+  void add(const std::string&kind, const std::string&ext,
+           const std::string&magic, const std::string&id)
+  {
+    backends[kind+" "+ext+" "+magic]=id;
+    /* the extension-only fallback sticks with the first backend we learned,
+     * so files of different flavours (with the same extension)
+     * don't keep overwriting each other */
+    backends.insert(std::pair<std::string, std::string>(kind+" "+ext, id));
+    m_entries[kind+" "+ext+" "+magic]=id;
+    m_dirty=true;
+  }
+  void remove(const std::string&kind, const std::string&ext,
+              const std::string&magic)
+  {
+    std::map<std::string, std::string>::iterator it=
+      backends.find(kind+" "+ext+" "+magic);
+    if(backends.end()!=it) {
+      /* only drop the fallback if it points to the same backend */
+      std::map<std::string, std::string>::iterator fallback=
+        backends.find(kind+" "+ext);
+      if(backends.end()!=fallback && fallback->second==it->second) {
+        backends.erase(fallback);
+      }
+      backends.erase(it);
+    } else {
+      backends.erase(kind+" "+ext);
+    }
+    if(m_entries.erase(kind+" "+ext+" "+magic)) {
+      m_dirty=true;
+    }
+  }
+
+private:
+  /* the entries as they are stored in the file */
+  std::map<std::string, std::string>m_entries;
+  std::string m_filename;
+  /* whether m_entries differ from what is on disk */
+  bool m_dirty;
+
+  Cache(void)
+    : m_filename(GEM_BACKENDCACHE_FILE)
+    , m_dirty(false)
+  {
+    gem::Settings::get("backends.cache", m_filename);
+    if(!m_filename.empty()) {
+      m_filename=gem::files::expandEnv(m_filename);
+    }
+    load();
+    /* rather than rewriting the file on each change, write it once at exit */
+    atexit(saveAtExit);
+  }
+  static void saveAtExit(void)
+  {
+    Cache*cache=get();
+    std::unique_lock<std::mutex>lock(cache->mutex);
+    cache->save();
+  }
+};
+};
+
+
+std::string gem::plugins::BackendCache::lookup(const std::string&kind,
+    const std::string&filename)
+{
+  const std::string ext=getExtension(filename);
+  const std::string magic=getMagic(filename);
+  Cache*cache=Cache::get();
+  std::unique_lock<std::mutex>lock(cache->mutex);
+  std::map<std::string, std::string>::iterator it;
+  /* exact match first, then only the extension */
+  it=cache->backends.find(kind+" "+ext+" "+magic);
+  if(cache->backends.end()==it) {
+    it=cache->backends.find(kind+" "+ext);
+  }
+  if(cache->backends.end()==it) {
+    return std::string();
+  }
+  return it->second;
+}
+
+void gem::plugins::BackendCache::remember(const std::string&kind,
+    const std::string&filename, const std::string&id)
+{
+  const std::string ext=getExtension(filename);
+  const std::string magic=getMagic(filename);
+  Cache*cache=Cache::get();
+  std::unique_lock<std::mutex>lock(cache->mutex);
+  std::map<std::string, std::string>::iterator it=
+    cache->backends.find(kind+" "+ext+" "+magic);
+  if(cache->backends.end()!=it && id==it->second) {
+    /* nothing new */
+    return;
+  }
+  cache->add(kind, ext, magic, id);
+}
+
+void gem::plugins::BackendCache::forget(const std::string&kind,
+                                        const std::string&filename)
+{
+  const std::string ext=getExtension(filename);
+  const std::string magic=getMagic(filename);
+  Cache*cache=Cache::get();
+  std::unique_lock<std::mutex>lock(cache->mutex);
+  cache->remove(kind, ext, magic);
+}
+
+void gem::plugins::BackendCache::addLatency(const std::string&kind,
+    const std::string&id, double ms, bool success)
+{
+  Cache*cache=Cache::get();
+  std::unique_lock<std::mutex>lock(cache->mutex);
+  std::map<std::string, Latency>&lat=cache->latencies[kind];
+  std::map<std::string, Latency>::iterator it=lat.find(id);
+  if(lat.end()==it) {
+    Latency l;
+    l.id=id;
+    l.opens=l.failures=0;
+    l.time=l.maxtime=0.;
+    it=lat.insert(std::pair<std::string, Latency>(id, l)).first;
+  }
+  Latency&l=it->second;
+  if(success) {
+    l.opens++;
+  } else {
+    l.failures++;
+  }
+  l.time+=ms;
+  if(ms>l.maxtime) {
+    l.maxtime=ms;
+  }
+}
+
+std::vector<gem::plugins::BackendCache::Latency>
+gem::plugins::BackendCache::getLatencies(const std::string&kind)
+{
+  std::vector<Latency>result;
+  Cache*cache=Cache::get();
+  std::unique_lock<std::mutex>lock(cache->mutex);
+  std::map<std::string, Latency>&lat=cache->latencies[kind];
+  std::map<std::string, Latency>::iterator it;
+  for(it=lat.begin(); it!=lat.end(); ++it) {
+    result.push_back(it->second);
+  }
+  return result;
+}
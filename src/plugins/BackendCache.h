@@ -0,0 +1,81 @@
+/* -----------------------------------------------------------------
+
+GEM - Graphics Environment for Multimedia
+
+remember which backend is able to open which kind of file
+
+Copyright (c) 2026 agent. agent@local
+For information on usage and redistribution, and for a DISCLAIMER OF ALL
+WARRANTIES, see the file, "GEM.LICENSE.TERMS" in this distribution.
+
+-----------------------------------------------------------------*/
+
+#ifndef _INCLUDE__GEM_PLUGINS_BACKENDCACHE_H_
+#define _INCLUDE__GEM_PLUGINS_BACKENDCACHE_H_
+
+#include "Gem/ExportDef.h"
+
+#include <string>
+#include <vector>
+
+
+/*-----------------------------------------------------------------
+  -------------------------------------------------------------------
+  CLASS
+  BackendCache
+
+  the meta-plugins (film, imageloader, modelloader) try all their
+  backends in turn until one succeeds in opening a file.
+  the BackendCache remembers the backend that succeeded for a given
+  kind of file (identified by its extension and the first few bytes
+  of the file), so it can be tried first the next time.
+
+  the cache is shared by all objects and persists across sessions
+  (it is stored in the file given by the "backends.cache" setting
+  when Pd exits; set it to an empty string to disable persistence)
+
+  it also records how long each backend took to (try to) open a file
+
+  KEYWORDS
+  plugins
+
+  -----------------------------------------------------------------*/
+namespace gem
+{
+namespace plugins
+{
+class GEM_EXTERN BackendCache
+{
+public:
+  /* 'kind' is the type of the plugin (e.g. "film", "image", "model") */
+
+  /* get the ID of the backend that opened a file like 'filename'
+   * returns an empty string if we don't know
+   */
+  static std::string lookup(const std::string&kind,
+                            const std::string&filename);
+
+  /* remember that backend 'id' successfully opened 'filename' */
+  static void remember(const std::string&kind, const std::string&filename,
+                       const std::string&id);
+
+  /* forget about 'filename' (e.g. because the cached backend failed) */
+  static void forget(const std::string&kind, const std::string&filename);
+
+  /* record how long (in ms) backend 'id' took to (try to) open a file */
+  static void addLatency(const std::string&kind, const std::string&id,
+                         double ms, bool success);
+
+  struct Latency {
+    std::string id;
+    unsigned long opens;    /* number of successful opens */
+    unsigned long failures; /* number of failed attempts */
+    double time;            /* accumulated time (in ms) */
+    double maxtime;         /* slowest attempt (in ms) */
+  };
+  static std::vector<Latency> getLatencies(const std::string&kind);
+};
+};
+};
+
+#endif  // for header file
@@ -5,9 +5,231 @@
 #include "Gem/RTE.h"
 
 #include <sstream>
+#include <fstream>
+#include <mutex>
+#include <chrono>
+#include <typeinfo>
+#include <stdlib.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
 
 using namespace gem;
 
+namespace
+{
+#ifdef _WIN32
+# define GEM_PLUGINMANIFEST_FILE "%HOMEPATH%\\plugdata\\Extra\\Gem\\plugins.manifest"
+#else
+# define GEM_PLUGINMANIFEST_FILE "~/Documents/plugdata/Extra/Gem/plugins.manifest"
+#endif
+
+/* protects all factories (loading a plugin registers classes with other factories)
+ * (function-local, as static registrars might need it before we are initialized) */
+static std::recursive_mutex&getMutex(void)
+{
+  static std::recursive_mutex s_mutex;
+  return s_mutex;
+}
+/* the plugin file that is currently being loaded */
+static std::string&getLoadingFile(void)
+{
+  static std::string s_loadingFile;
+  return s_loadingFile;
+}
+
+/* identify a specific version of a file (so we notice when a plugin is updated) */
+static std::string getStamp(const std::string&filename)
+{
+  struct stat st;
+  if(stat(filename.c_str(), &st)) {
+    return std::string();
+  }
+  std::stringstream ss;
+  ss << (long long)st.st_size << ":" << (long long)st.st_mtime;
+  return ss.str();
+}
+
+/*
+ * the manifest records which IDs each plugin-file registers with which factory,
+ * so we can register the IDs without actually loading the plugin
+ * (which might pull in heavy dependencies)
+ */
+class Manifest
+{
+public:
+  static Manifest&get(void)
+  {
+    static Manifest s_manifest;
+    return s_manifest;
+  }
+
+  /* get the IDs that 'file' (in version 'stamp') registers with 'factory'
+   * returns false if the manifest doesn't know about this file (version)
+   */
+  bool lookup(const std::string&file, const std::string&stamp,
+              const std::string&factory, std::vector<std::string>&ids)
+  {
+    std::map<std::string, entry>::iterator it=m_entries.find(file);
+    if(stamp.empty() || m_entries.end()==it || stamp!=it->second.stamp) {
+      return false;
+    }
+    const std::vector<std::pair<std::string, std::string> >&reg=
+      it->second.ids;
+    for(unsigned int i=0; i<reg.size(); i++) {
+      if(factory==reg[i].first) {
+        ids.push_back(reg[i].second);
+      }
+    }
+    return true;
+  }
+  /* start recording the IDs registered by 'file'
+   * (the entry only becomes valid with commit()) */
+  void begin(const std::string&file)
+  {
+    entry&e=m_entries[file];
+    e.stamp.clear();
+    e.ids.clear();
+  }
+  /* validate the recorded IDs of 'file' for version 'stamp'
+   * if 'file' failed to load (or didn't register anything), the entry stays
+   * without a stamp, so it is neither saved nor trusted: the file will be retried */
+  void commit(const std::string&file, const std::string&stamp, bool success)
+  {
+    std::map<std::string, entry>::iterator it=m_entries.find(file);
+    if(m_entries.end()==it) {
+      return;
+    }
+    if(success && !it->second.ids.empty()) {
+      it->second.stamp=stamp;
+    } else {
+      it->second.stamp.clear();
+    }
+  }
+  void add(const std::string&file, const std::string&factory,
+           const std::string&id)
+  {
+    std::map<std::string, entry>::iterator it=m_entries.find(file);
+    if(m_entries.end()!=it) {
+      it->second.ids.push_back(std::pair<std::string, std::string>(factory, id));
+    }
+  }
+  /* "<file> <stamp> <#ids> (<factory> <id>)*" per line */
+  void save(void)
+  {
+    if(m_filename.empty()) {
+      return;
+    }
+    std::ofstream f(m_filename.c_str());
+    if(!f.is_open()) {
+      return;
+    }
+    for(std::map<std::string, entry>::iterator it=m_entries.begin();
+        it!=m_entries.end(); ++it) {
+      if(it->second.stamp.empty()) {
+        continue;
+      }
+      const std::vector<std::pair<std::string, std::string> >&reg=
+        it->second.ids;
+      f << it->first << "\t" << it->second.stamp << "\t" << reg.size();
+      for(unsigned int i=0; i<reg.size(); i++) {
+        f << "\t" << reg[i].first << "\t" << reg[i].second;
+      }
+      f << "\n";
+    }
+  }
+
+private:
+  struct entry {
+    std::string stamp;
+    std::vector<std::pair<std::string, std::string> >ids;
+  };
+  std::map<std::string, entry>m_entries;
+  std::string m_filename;
+
+  Manifest(void)
+    : m_filename(GEM_PLUGINMANIFEST_FILE)
+  {
+    gem::Settings::get("gem.plugins.manifest", m_filename);
+    if(!m_filename.empty()) {
+      m_filename=gem::files::expandEnv(m_filename);
+    }
+    load();
+  }
+  void load(void)
+  {
+    if(m_filename.empty()) {
+      return;
+    }
+    std::ifstream f(m_filename.c_str());
+    std::string line;
+    while(std::getline(f, line)) {
+      std::vector<std::string>tokens;
+      std::stringstream ss(line);
+      std::string token;
+      while(std::getline(ss, token, '\t')) {
+        tokens.push_back(token);
+      }
+      if(tokens.size()<3) {
+        continue;
+      }
+      unsigned int count=atoi(tokens[2].c_str());
+      if(tokens.size() != 3 + 2*count) {
+        continue;
+      }
+      entry&e=m_entries[tokens[0]];
+      e.stamp=tokens[1];
+      e.ids.clear();
+      for(unsigned int i=0; i<count; i++) {
+        e.ids.push_back(std::pair<std::string, std::string>(tokens[3+2*i],
+                        tokens[4+2*i]));
+      }
+    }
+  }
+};
+
+/* load a plugin-file (recording the IDs it registers in the manifest) */
+static GemDylib*loadDylib(const std::string&f, const std::string&path)
+{
+  std::unique_lock<std::recursive_mutex>lock(getMutex());
+  GemDylib*dll=NULL;
+  std::chrono::steady_clock::time_point t0=std::chrono::steady_clock::now();
+  std::string loadingFile=getLoadingFile();
+  getLoadingFile()=f;
+  Manifest::get().begin(f);
+
+  std::cerr << "dylib loading file '" << f << "'!" << std::endl;
+  try {
+    dll=new GemDylib(f, "");
+  } catch (GemException&x) {
+    // oops, on w32 this might simply be because getFilenameListing() stripped the path
+    // so let's try again, with Path added...
+    if(f.find(path) == f.npos) {
+      try {
+        std::string f1=path;
+        f1+=f;
+        dll=new GemDylib(f1, "");
+      } catch (GemException&x1) {
+        // giving up
+        std::cerr << "library loading returned: " << x1.what() << std::endl;
+        dll=NULL;
+      }
+    } else {
+      std::cerr << "library loading returned: " << x.what() << std::endl;
+      dll=NULL;
+    }
+  }
+  getLoadingFile()=loadingFile;
+  Manifest::get().commit(f, getStamp(f), NULL!=dll);
+  Manifest::get().save();
+
+  double ms=std::chrono::duration<double, std::milli>
+            (std::chrono::steady_clock::now() - t0).count();
+  verbose(1, "[GEM] loading plugin '%s' took %gms", f.c_str(), ms);
+  return dll;
+}
+};
+
 class gem::BasePluginFactory::Pimpl
 {
   friend class BasePluginFactory;
@@ -24,6 +246,10 @@ class gem::BasePluginFactory::Pimpl
   std::vector<std::string>p_loaded;
 
   std::map<std::string, void*>p_ctors;
+
+  /* IDs that are provided by plugin-files that are not loaded yet:
+   * ID -> (file, path) */
+  std::map<std::string, std::pair<std::string, std::string> >p_lazy;
 };
 
 
@@ -40,6 +266,7 @@ gem::BasePluginFactory::~BasePluginFactory(void)
 int gem::BasePluginFactory::doLoadPlugins(const std::string&basename,
     const std::string&path_)
 {
+  std::unique_lock<std::recursive_mutex>lock(getMutex());
   int already=m_pimpl->p_loaded.size();
   if(already>0) {
     int once=1;
@@ -71,6 +298,11 @@ int gem::BasePluginFactory::doLoadPlugins(const std::string&basename,
 
   unsigned int count=0;
 
+  /* only load plugins when one of their IDs is actually needed */
+  int lazy=1;
+  gem::Settings::get("gem.plugins.lazy", lazy);
+  const std::string factory=typeid(*this).name();
+
   std::vector<std::string>files=gem::files::getFilenameListing(pattern);
 
   for(unsigned int i=0; i<files.size(); i++) {
@@ -90,28 +322,21 @@ int gem::BasePluginFactory::doLoadPlugins(const std::string&basename,
       continue;
     }
 
-    std::cerr << "dylib loading file '" << f << "'!" << std::endl;
-    dll=NULL;
-    try {
-      dll=new GemDylib(f, "");
-    } catch (GemException&x) {
-      // oops, on w32 this might simply be because getFilenameListing() stripped the path
-      // so let's try again, with Path added...
-      if(f.find(path) == f.npos) {
-        try {
-          std::string f1=path;
-          f1+=f;
-          dll=new GemDylib(f1, "");
-        } catch (GemException&x1) {
-          // giving up
-          std::cerr << "library loading returned: " << x1.what() << std::endl;
-          dll=NULL;
+    std::vector<std::string>ids;
+    if(lazy && Manifest::get().lookup(f, getStamp(f), factory, ids)) {
+      /* we know which IDs the plugin provides, so defer loading it */
+      for(unsigned int j=0; j<ids.size(); j++) {
+        std::map<std::string, void*>::iterator it=m_pimpl->p_ctors.find(ids[j]);
+        if(m_pimpl->p_ctors.end()==it || NULL==it->second) {
+          m_pimpl->p_lazy[ids[j]]=std::pair<std::string, std::string>(f, path);
         }
-      } else {
-        std::cerr << "library loading returned: " << x.what() << std::endl;
-        dll=NULL;
       }
+      m_pimpl->p_loaded.push_back(f);
+      count++;
+      continue;
     }
+
+    dll=loadDylib(f, path);
     if(dll) { // loading succeeded
       try {
         m_pimpl->p_loaded.push_back(f);
@@ -128,6 +353,7 @@ int gem::BasePluginFactory::doLoadPlugins(const std::string&basename,
 
 std::vector<std::string>gem::BasePluginFactory::get()
 {
+  std::unique_lock<std::recursive_mutex>lock(getMutex());
   std::vector<std::string>result;
   if(m_pimpl) {
     for(std::map<std::string, void*>::iterator iter = m_pimpl->p_ctors.begin(); iter != m_pimpl->p_ctors.end(); ++iter) {
@@ -135,23 +361,48 @@ std::vector<std::string>gem::BasePluginFactory::get()
         result.push_back(iter->first);
       }
     }
+    /* IDs of plugins that are not loaded yet */
+    for(std::map<std::string, std::pair<std::string, std::string> >::iterator iter = m_pimpl->p_lazy.begin(); iter != m_pimpl->p_lazy.end(); ++iter) {
+      std::map<std::string, void*>::iterator it=m_pimpl->p_ctors.find(iter->first);
+      if(m_pimpl->p_ctors.end()==it || NULL==it->second) {
+        result.push_back(iter->first);
+      }
+    }
   }
   return result;
 }
 
 void*gem::BasePluginFactory::get(std::string id)
 {
+  std::unique_lock<std::recursive_mutex>lock(getMutex());
   void*ctor=NULL;
   if(m_pimpl) {
     ctor=m_pimpl->p_ctors[id];
+    if(!ctor) {
+      std::map<std::string, std::pair<std::string, std::string> >::iterator it=
+        m_pimpl->p_lazy.find(id);
+      if(m_pimpl->p_lazy.end()!=it) {
+        /* the first time this ID is needed: load the plugin now */
+        const std::pair<std::string, std::string>file=it->second;
+        m_pimpl->p_lazy.erase(it);
+        /* the library must stay loaded, so we never delete the GemDylib */
+        loadDylib(file.first, file.second);
+        ctor=m_pimpl->p_ctors[id];
+      }
+    }
   }
   return ctor;
 }
 
 void gem::BasePluginFactory::set(std::string id, void*ptr)
 {
+  std::unique_lock<std::recursive_mutex>lock(getMutex());
   if(m_pimpl) {
     m_pimpl->p_ctors[id]=ptr;
+    const std::string&loadingFile=getLoadingFile();
+    if(ptr && !id.empty() && !loadingFile.empty()) {
+      Manifest::get().add(loadingFile, typeid(*this).name(), id);
+    }
   }
 }
 
@@ -179,8 +430,12 @@ static bool default_true (const char*name, int global, int local)
 }
 
 }
-#define PLUGIN_INIT(x) s=-1; gem::Settings::get("gem.plugins."#x".startup", s); \
-  if(default_true("gem.plugins."#x".startup", s0,s))delete x::getInstance()
+/* with lazy loading, we only register the plugins (without loading them) */
+#define PLUGIN_INIT(x, basename) s=-1; gem::Settings::get("gem.plugins."#x".startup", s); \
+  if(default_true("gem.plugins."#x".startup", s0,s)) { \
+    if(lazy) gem::PluginFactory<x>::loadPlugins(basename); \
+    else delete x::getInstance(); \
+  }
 
 namespace gem
 {
@@ -189,15 +444,21 @@ namespace plugins
 void init(void)
 {
   int s, s0=1;
+  int lazy=1;
   gem::Settings::get("gem.plugins.startup", s0);
+  gem::Settings::get("gem.plugins.lazy", lazy);
   using namespace gem::plugins;
 
-  PLUGIN_INIT(film);
-  PLUGIN_INIT(imageloader);
-  PLUGIN_INIT(imagesaver);
-  PLUGIN_INIT(modelloader);
-  PLUGIN_INIT(record);
-  PLUGIN_INIT(video);
+  std::chrono::steady_clock::time_point t0=std::chrono::steady_clock::now();
+  PLUGIN_INIT(film, "film");
+  PLUGIN_INIT(imageloader, "image");
+  PLUGIN_INIT(imagesaver, "image");
+  PLUGIN_INIT(modelloader, "model");
+  PLUGIN_INIT(record, "record");
+  PLUGIN_INIT(video, "video");
+  double ms=std::chrono::duration<double, std::milli>
+            (std::chrono::steady_clock::now() - t0).count();
+  verbose(1, "[GEM] initializing plugins took %gms", ms);
 }
 };
 };
@@ -20,8 +20,10 @@
 #include "Gem/Exception.h"
 #include "Gem/Properties.h"
 #include "imageloader.h"
+#include "BackendCache.h"
 
 #include <algorithm>
+#include <chrono>
 
 gem::plugins::film :: ~film(void) {}
 /* initialize the film factory */
@@ -117,13 +119,11 @@ public:
 class filmMeta : public gem::plugins::film
 {
 private:
-  std::vector<gem::plugins::film*>m_handles; // all available handles
+  std::vector<gem::plugins::film*>m_handles; // all available handles (NULL if not instantiated yet)
+  std::vector<bool>m_failed; // TRUE if the handle could not be instantiated
   gem::plugins::film*m_handle; // currently opened handle (or NULL)
   std::vector<std::string>m_ids; // list of handle names
 
-  // set to TRUE if we can use the current handle in another thread
-  bool m_canThread;
-
   bool addPlugin( std::vector<std::string>available,
                   std::string ID=std::string(""))
   {
@@ -150,18 +150,10 @@ private:
       verbose(2, "trying to add '%s' as backend", key.c_str());
       if(std::find(m_ids.begin(), m_ids.end(), key)==m_ids.end()) {
         // not yet added, do so now!
-        gem::plugins::film*handle=NULL;
-        try {
-          handle=gem::PluginFactory<gem::plugins::film>::getInstance(key);
-        } catch(GemException&x) {
-          handle=NULL;
-          verbose(1, "cannot use film plugin '%s': %s", key.c_str(), x.what());
-        }
-        if(NULL==handle) {
-          continue;
-        }
+        // (the backend is only instantiated once we need it)
         m_ids.push_back(key);
-        m_handles.push_back(handle);
+        m_handles.push_back(NULL);
+        m_failed.push_back(false);
         count++;
         verbose(2, "added backend#%d '%s'", (int)(m_handles.size()-1),
                 key.c_str());
@@ -169,11 +161,25 @@ private:
     }
     return (count>0);
   }
+  /* get the backend #i, instantiating it on first use
+   * (so we only load the plugin-libraries we really need) */
+  gem::plugins::film*getHandle(unsigned int i)
+  {
+    if(!m_handles[i] && !m_failed[i]) {
+      try {
+        m_handles[i]=gem::PluginFactory<gem::plugins::film>::getInstance(m_ids[i]);
+      } catch(GemException&x) {
+        m_handles[i]=NULL;
+        verbose(1, "cannot use film plugin '%s': %s", m_ids[i].c_str(), x.what());
+      }
+      m_failed[i]=(NULL==m_handles[i]);
+    }
+    return m_handles[i];
+  }
 
 public:
   filmMeta(void) :
-    m_handle(NULL),
-    m_canThread(true)
+    m_handle(NULL)
   {
     gem::PluginFactory<gem::plugins::film>::loadPlugins("film");
     std::vector<std::string>ids=
@@ -191,17 +197,11 @@ public:
     addPlugin(ids, "MPEG1");
     addPlugin(ids);
 
-    unsigned int i;
-    for(i=0; i<m_handles.size(); i++) {
-      if(!m_handles[i]->isThreadable()) {
-        m_canThread=false;
-        break;
-      }
-    }
     try {
       gem::plugins::film*filmImage=new filmIMAGE();
       if(NULL!=filmImage) {
         m_handles.push_back(filmImage);
+        m_failed.push_back(false);
         m_ids.push_back("image");
       }
     } catch (GemException&) {
@@ -249,8 +249,8 @@ public:
         std::string id=backends[j];
         for(i=0; i<m_handles.size(); i++) {
           /* coverity[assign_where_compare_meant] we set 'tried' to true if we have found at least one matching backend */
-          if(id==m_ids[i] && (tried=true)
-              && m_handles[i]->open(name, requestprops)) {
+          if(id==m_ids[i] && getHandle(i) && (tried=true)
+              && tryOpen(i, name, requestprops)) {
             m_handle=m_handles[i];
             break;
           }
@@ -261,10 +261,30 @@ public:
       if(!backends.empty() && !m_handles.empty()) {
         verbose(2, "no available backend selected, fall back to valid ones");
       }
+      /* try the backend that opened similar files before */
+      int cached=-1;
+      const std::string cachedID=BackendCache::lookup("film", name);
+      if(!cachedID.empty()) {
+        std::vector<std::string>::iterator it=std::find(m_ids.begin(), m_ids.end(), cachedID);
+        if(it!=m_ids.end()) {
+          cached=it-m_ids.begin();
+        }
+      }
+      if(cached>=0) {
+        if(getHandle(cached) && tryOpen(cached, name, requestprops)) {
+          m_handle=m_handles[cached];
+          return true;
+        }
+        BackendCache::forget("film", name);
+      }
       unsigned int i=0;
       for(i=0; i<m_handles.size(); i++) {
-        if(m_handles[i] && m_handles[i]->open(name, requestprops)) {
+        if(static_cast<int>(i)==cached) {
+          continue;
+        }
+        if(getHandle(i) && tryOpen(i, name, requestprops)) {
           m_handle=m_handles[i];
+          BackendCache::remember("film", name, m_ids[i]);
           break;
         } else {
 
@@ -273,6 +293,17 @@ public:
     }
     return (NULL!=m_handle);
   }
+  /* open the file with the given backend (and record how long it took) */
+  bool tryOpen(unsigned int i, const std::string&name,
+               const gem::Properties&requestprops)
+  {
+    std::chrono::steady_clock::time_point t0=std::chrono::steady_clock::now();
+    bool result=m_handles[i]->open(name, requestprops);
+    double ms=std::chrono::duration<double, std::milli>
+              (std::chrono::steady_clock::now() - t0).count();
+    BackendCache::addLatency("film", m_ids[i], ms, result);
+    return result;
+  }
 
   virtual errCode changeImage(int imgNum, int trackNum=-1)
   {
@@ -305,7 +336,14 @@ public:
       return m_handle->isThreadable();
     }
 
-    return m_canThread;
+    /* backends that are not instantiated yet will be asked once they are opened */
+    unsigned int i;
+    for(i=0; i<m_handles.size(); i++) {
+      if(m_handles[i] && !m_handles[i]->isThreadable()) {
+        return false;
+      }
+    }
+    return true;
   }
 
   virtual bool enumProperties(gem::Properties&readable,
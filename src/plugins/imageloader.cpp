@@ -17,8 +17,11 @@
 
 #include "Gem/RTE.h"
 #include "Gem/Exception.h"
+#include "BackendCache.h"
 
 #include <algorithm>
+#include <chrono>
+#include <mutex>
 
 gem::plugins::imageloader :: ~imageloader(void) {}
 
@@ -33,11 +36,13 @@ class imageloaderMeta : public gem::plugins::imageloader
 {
 private:
   static imageloaderMeta*s_instance;
-  std::vector<gem::plugins::imageloader*>m_loaders;
+  std::vector<gem::plugins::imageloader*>m_loaders; // NULL if not instantiated yet
+  std::vector<bool>m_failed; // TRUE if the loader could not be instantiated
   std::vector<std::string>m_ids;
-  bool m_canThread;
+  /* protects the (lazy) instantiation of the loaders */
+  std::mutex m_mutex;
 public:
-  imageloaderMeta(void) : m_canThread(true)
+  imageloaderMeta(void)
   {
     gem::PluginFactory<gem::plugins::imageloader>::loadPlugins("image");
     std::vector<std::string>available_ids=
@@ -56,15 +61,6 @@ public:
       endpost();
     }
     firsttime=false;
-
-    m_canThread=true;
-    unsigned int i;
-    for(i=0; i<m_loaders.size(); i++) {
-      if(!m_loaders[i]->isThreadable()) {
-        m_canThread=false;
-        break;
-      }
-    }
   }
   bool addLoader( std::vector<std::string>available,
                   std::string ID=std::string(""))
@@ -92,26 +88,34 @@ public:
       verbose(2, "trying to add '%s' as backend", key.c_str());
       if(std::find(m_ids.begin(), m_ids.end(), key)==m_ids.end()) {
         // not yet added, do so now!
-        gem::plugins::imageloader*loader=NULL;
-        try {
-          loader=gem::PluginFactory<gem::plugins::imageloader>::getInstance(key);
-        } catch(GemException&x) {
-          loader=NULL;
-          verbose(1, "cannot use image loader plugin '%s': %s", key.c_str(),
-                  x.what());
-        }
-        if(NULL==loader) {
-          continue;
-        }
+        // (the loader is only instantiated once we need it)
         m_ids.push_back(key);
-        m_loaders.push_back(loader);
+        m_loaders.push_back(NULL);
+        m_failed.push_back(false);
         count++;
-        verbose(2, "added backend#%d '%s' @ %p", (int)(m_loaders.size()-1),
-                key.c_str(), loader);
+        verbose(2, "added backend#%d '%s'", (int)(m_loaders.size()-1),
+                key.c_str());
       }
     }
     return (count>0);
   }
+  /* get the loader #i, instantiating it on first use
+   * (so we only load the plugin-libraries we really need) */
+  gem::plugins::imageloader*getLoader(unsigned int i)
+  {
+    std::unique_lock<std::mutex>lock(m_mutex);
+    if(!m_loaders[i] && !m_failed[i]) {
+      try {
+        m_loaders[i]=gem::PluginFactory<gem::plugins::imageloader>::getInstance(m_ids[i]);
+      } catch(GemException&x) {
+        m_loaders[i]=NULL;
+        verbose(1, "cannot use image loader plugin '%s': %s", m_ids[i].c_str(),
+                x.what());
+      }
+      m_failed[i]=(NULL==m_loaders[i]);
+    }
+    return m_loaders[i];
+  }
 
 public:
   virtual ~imageloaderMeta(void)
@@ -126,18 +130,70 @@ public:
   virtual bool load(std::string filename, imageStruct&result,
                     gem::Properties&props)
   {
+    /* try the loader that loaded similar files before */
+    int cached=-1;
+    const std::string cachedID=BackendCache::lookup("image", filename);
+    if(!cachedID.empty()) {
+      std::vector<std::string>::iterator it=std::find(m_ids.begin(), m_ids.end(), cachedID);
+      if(it!=m_ids.end()) {
+        cached=it-m_ids.begin();
+      }
+    }
+    if(cached>=0) {
+      if(tryLoad(cached, filename, result, props)) {
+        return true;
+      }
+      BackendCache::forget("image", filename);
+    }
+
     unsigned int i;
     for(i=0; i<m_loaders.size(); i++) {
-      if(m_loaders[i]->load(filename, result, props)) {
+      if(static_cast<int>(i)==cached) {
+        continue;
+      }
+      if(tryLoad(i, filename, result, props)) {
+        BackendCache::remember("image", filename, m_ids[i]);
         return true;
       }
     }
     return false;
   }
+  /* load the file with the given loader (and record how long it took) */
+  bool tryLoad(unsigned int i, const std::string&filename, imageStruct&result,
+               gem::Properties&props)
+  {
+    gem::plugins::imageloader*loader=getLoader(i);
+    if(!loader) {
+      return false;
+    }
+    std::chrono::steady_clock::time_point t0=std::chrono::steady_clock::now();
+    bool success=false;
+    if(loader->isThreadable()) {
+      success=loader->load(filename, result, props);
+    } else {
+      /* loaders that are not threadsafe must not be used concurrently */
+      static std::mutex s_mutex;
+      std::unique_lock<std::mutex>lock(s_mutex);
+      success=loader->load(filename, result, props);
+    }
+    double ms=std::chrono::duration<double, std::milli>
+              (std::chrono::steady_clock::now() - t0).count();
+    BackendCache::addLatency("image", m_ids[i], ms, success);
+    return success;
+  }
 
   virtual bool isThreadable(void)
   {
-    return m_canThread;
+    /* loaders that are instantiated later (from a thread) and turn out not
+     * to be threadsafe are serialized in tryLoad() */
+    std::unique_lock<std::mutex>lock(m_mutex);
+    unsigned int i;
+    for(i=0; i<m_loaders.size(); i++) {
+      if(m_loaders[i] && !m_loaders[i]->isThreadable()) {
+        return false;
+      }
+    }
+    return true;
   }
 };
 };
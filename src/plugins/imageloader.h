@@ -53,6 +53,13 @@ public:
    *
    * props can be filled by the loader with additional information on the image
    * e.g. EXIF tags,...
+   *
+   * props might also hold hints for the loader, which it is free to ignore, e.g.
+   *   "width", "height": the image will be used at this size, so a smaller
+   *                      (but not smaller than this) image is fine
+   *   "colorspace": "yuv" if the image should preferably be in GEM_YUV,
+   *                 "native" if it should be kept in its own format
+   *                 (e.g. GEM_RGB rather than GEM_RGBA)
    */
   /* returns TRUE if loading was successful, FALSE otherwise */
   virtual bool load(std::string filename,
@@ -23,6 +23,14 @@
 #include <algorithm>
 
 gem::plugins::record :: ~record(void) {}
+bool gem::plugins::record :: write(imageStruct*img, double timestamp)
+{
+  return write(img);
+}
+void gem::plugins::record :: getProperties(gem::Properties&props)
+{
+  props.clear();
+}
 
 static gem::PluginFactoryRegistrar::dummy<gem::plugins::record>
 fac_recorddummy;
@@ -272,6 +280,17 @@ public:
     return false;
   }
 
+  //////////
+  // get properties of the current recording
+  virtual void getProperties(gem::Properties&props)
+  {
+    if(!m_handle) {
+      props.clear();
+      return;
+    }
+    m_handle->getProperties(props);
+  }
+
   //////////
   // start recording
   //
@@ -314,6 +333,18 @@ public:
 
     return result;
   }
+  virtual bool write(imageStruct*img, double timestamp)
+  {
+    if(!m_handle) {
+      return false;
+    }
+    if(!img) {
+      return true;
+    }
+    /* this might be called from an encoder thread,
+     * so leave it to the caller to stop() on failure */
+    return m_handle->write(img, timestamp);
+  }
 
   //////////
   // stop recording
@@ -70,6 +70,14 @@ public:
    */
   virtual bool enumProperties(gem::Properties&props) = 0;
 
+  /**
+   * get the current values of the (read-only) properties in 'props'
+   * (e.g. statistics of the running recording);
+   * properties the backend doesn't know are removed from 'props'
+   * the default implementation knows no properties
+   */
+  virtual void getProperties(gem::Properties&props);
+
   //////////
   // popup a dialog to set the codec interactively (interesting on os-x and w32)
   // just return FALSE if you don't support dialogs
@@ -86,6 +94,14 @@ public:
   // record a frame
   virtual bool write(imageStruct*) = 0;
 
+  //////////
+  // record a frame that was grabbed 'timestamp' milliseconds after start()
+  // frames might be handed to the backend asynchronously (and thus late),
+  // so backends that care about timing should use the given timestamp
+  // rather than the current time.
+  // the default implementation simply ignores the timestamp
+  virtual bool write(imageStruct*img, double timestamp);
+
   //////////
   // stop recording
   virtual void stop (void) = 0;
@@ -33,8 +33,9 @@ class videoMeta : public gem::plugins::video
 {
 private:
   static videoMeta*s_instance;
-  std::vector<gem::plugins::video*>m_allHandles, // all available handles
+  std::vector<gem::plugins::video*>m_allHandles, // all available handles (NULL if not instantiated yet)
       m_selectedHandles; // handles with the currently selected codec
+  std::vector<bool>m_failed; // TRUE if the handle could not be instantiated
   gem::plugins::video*m_handle; // currently opened handle (or NULL)
   std::vector<std::string>m_ids; // list of handle names
   std::string m_codec; // currently selected codec
@@ -86,19 +87,10 @@ private:
       verbose(2, "Gem::video: trying to add '%s' as backend", key.c_str());
       if(std::find(m_ids.begin(), m_ids.end(), key)==m_ids.end()) {
         // not yet added, do so now!
-        gem::plugins::video*handle=NULL;
-        try {
-          handle=gem::PluginFactory<gem::plugins::video>::getInstance(key);
-        } catch(GemException&x) {
-          handle=NULL;
-          verbose(1, "Gem::video: cannot use video plugin '%s': %s", key.c_str(),
-                  x.what());
-        }
-        if(NULL==handle) {
-          continue;
-        }
+        // (the backend is only instantiated once we need it)
         m_ids.push_back(key);
-        m_allHandles.push_back(handle);
+        m_allHandles.push_back(NULL);
+        m_failed.push_back(false);
         count++;
         verbose(2, "Gem::video: added backend#%d '%s'",
                 (int)(m_allHandles.size()-1), key.c_str());
@@ -106,6 +98,39 @@ private:
     }
     return (count>0);
   }
+  /* get the backend #i, instantiating it on first use
+   * (so we only load the plugin-libraries we really need);
+   * settings that were made before are applied to the new backend */
+  gem::plugins::video*getHandle(unsigned int i)
+  {
+    if(!m_allHandles[i] && !m_failed[i]) {
+      gem::plugins::video*handle=NULL;
+      try {
+        handle=gem::PluginFactory<gem::plugins::video>::getInstance(m_ids[i]);
+      } catch(GemException&x) {
+        handle=NULL;
+        verbose(1, "Gem::video: cannot use video plugin '%s': %s",
+                m_ids[i].c_str(), x.what());
+      }
+      m_failed[i]=(NULL==handle);
+      if(handle) {
+        if(m_deviceName.empty()) {
+          handle->setDevice(m_deviceNum);
+        } else {
+          handle->setDevice(m_deviceName);
+        }
+        if(m_color>=0) {
+          handle->setColor(m_color);
+        }
+      }
+      m_allHandles[i]=handle;
+    }
+    return m_allHandles[i];
+  }
+  /* settings to apply to backends that are instantiated later */
+  int m_deviceNum;
+  std::string m_deviceName;
+  int m_color;
 
   // set to TRUE if we can use the current handle in another thread
   bool m_canThread;
@@ -113,6 +138,8 @@ private:
 public:
   videoMeta(void) :
     m_handle(NULL),
+    m_deviceNum(-1),
+    m_color(-1),
     m_canThread(false)
   {
     // compat
@@ -126,13 +153,6 @@ public:
     addPlugin(ids, "dv4l");
     addPlugin(ids);
 
-    for(unsigned int i=0; i<m_allHandles.size(); i++) {
-      if(!m_allHandles[i]->isThreadable()) {
-        m_canThread=false;
-        break;
-      }
-    }
-
     static bool firsttime=true;
     if(firsttime && ids.size()>0) {
       startpost("GEM: video capture plugins:");
@@ -163,6 +183,9 @@ public:
      */
     std::vector<std::string>result;
     for(unsigned int i=0; i<m_allHandles.size(); i++) {
+      if(!getHandle(i)) {
+        continue;
+      }
       std::vector<std::string>res=m_allHandles[i]->enumerate();
       for(unsigned int j=0; j<res.size(); j++) {
         result.push_back(res[j]);
@@ -173,9 +196,12 @@ public:
   virtual bool setDevice(int ID)
   {
     // compat
+    m_deviceNum=ID;
+    m_deviceName.clear();
+    // backends that are not instantiated yet get the device later
     bool result=false;
     for(unsigned int i=0; i<m_allHandles.size(); i++) {
-      if(m_allHandles[i]->setDevice(ID)) {
+      if(!m_allHandles[i] || m_allHandles[i]->setDevice(ID)) {
         result=true;
       }
     }
@@ -184,9 +210,11 @@ public:
   virtual bool          setDevice(const std::string&ID)
   {
     // compat
+    m_deviceName=ID;
+    // backends that are not instantiated yet get the device later
     bool result=false;
     for(unsigned int i=0; i<m_allHandles.size(); i++) {
-      if(m_allHandles[i]->setDevice(ID)) {
+      if(!m_allHandles[i] || m_allHandles[i]->setDevice(ID)) {
         result=true;
       }
     }
@@ -202,7 +230,7 @@ public:
       close();
     }
     for(unsigned int i=0; i<m_allHandles.size(); i++) {
-      if(m_allHandles[i]->open(props)) {
+      if(getHandle(i) && m_allHandles[i]->open(props)) {
         m_handle=m_allHandles[i];
         return true;
       }
@@ -257,7 +285,7 @@ public:
 
     bool result=false;
     for(unsigned int i=0; i<m_allHandles.size(); i++) {
-      if(m_allHandles[i]->reset()) {
+      if(getHandle(i) && m_allHandles[i]->reset()) {
         result=true;
       }
     }
@@ -309,6 +337,9 @@ public:
 
     std::vector<std::string>result;
     for(unsigned int i=0; i<m_allHandles.size(); i++) {
+      if(!getHandle(i)) {
+        continue;
+      }
       std::vector<std::string>res=m_allHandles[i]->dialogs();
       for(unsigned int j=0; j<res.size(); j++) {
         result.push_back(res[j]);
@@ -339,9 +370,11 @@ public:
     // OK
     // LATER get rid of that!
     // think about the return value...
+    m_color=color;
+    // backends that are not instantiated yet get the color later
     bool result=true;
     for(unsigned int i=0; i<m_allHandles.size(); i++) {
-      if(!m_allHandles[i]->setColor(color)) {
+      if(m_allHandles[i] && !m_allHandles[i]->setColor(color)) {
         result=false;
       }
     }
@@ -351,7 +384,7 @@ public:
   {
     // OK
     for(unsigned int i=0; i<m_allHandles.size(); i++) {
-      if(m_allHandles[i]->provides(ID)) {
+      if(getHandle(i) && m_allHandles[i]->provides(ID)) {
         return true;
       }
     }
@@ -363,6 +396,9 @@ public:
     // LATER: remove dupes
     std::vector<std::string>result;
     for(unsigned int i=0; i<m_allHandles.size(); i++) {
+      if(!getHandle(i)) {
+        continue;
+      }
       std::vector<std::string>res=m_allHandles[i]->provides();
       for(unsigned int j=0; j<res.size(); j++) {
         result.push_back(res[i]);
@@ -16,6 +16,7 @@
 #include "plugins/videoBase.h"
 #include "Gem/RTE.h"
 #include "Utils/nop.h"
+#include "Utils/Latency.h"
 #ifdef HAVE_SYS_SELECT_H
 # include <sys/select.h>
 #endif
@@ -73,6 +74,10 @@ public:
 
   bool shouldrun; /* we should be capturing */
 
+  /* timestamp/sequence of the last new frame */
+  double lastTimestamp;
+  unsigned long sequence;
+
   const std::string name;
 
   PIMPL(const std::string&name_, unsigned int locks_,
@@ -89,6 +94,7 @@ public:
     cont(true),
     running(false),
     shouldrun(false),
+    lastTimestamp(0.), sequence(0),
     name(name_)
   {
     if(locks_>0) {
@@ -500,6 +506,20 @@ pixBlock* videoBase :: getFrame(void)
     }
   }
   lock();
+  if(pix && pix->newimage) {
+    /* backends that know when the frame was captured set the timestamp
+     * themselves; for all others, use the time the frame is delivered */
+    if(pix->timestamp <= m_pimpl->lastTimestamp) {
+      pix->timestamp=gem::utils::monotonicTime();
+    }
+    m_pimpl->lastTimestamp=pix->timestamp;
+    /* likewise, keep the sequence number the backend set
+     * (it still holds the one we gave the last frame if it didn't) */
+    if(0==pix->sequence || pix->sequence==m_pimpl->sequence) {
+      pix->sequence=m_pimpl->sequence+1;
+    }
+    m_pimpl->sequence=pix->sequence;
+  }
   return pix;
 }
 